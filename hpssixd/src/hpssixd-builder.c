@@ -42,10 +42,11 @@ static int do_builder(uint64_t task_id, int *result)
     FILE *pout = NULL;
     uint64_t n_processed = 0;
     uint64_t n_regular = 0;
+    uint64_t n_unchanged = 0;
     char cmd[LINE_MAX] = { 0, };
     char datadir[PATH_MAX] = { 0, };
 
-    ret = hpssix_get_datadir_today(datadir, PATH_MAX);
+    ret = hpssix_get_datadir(task_id, datadir, PATH_MAX);
     if (ret)
         goto out;
 
@@ -67,14 +68,15 @@ static int do_builder(uint64_t task_id, int *result)
 
         catch_line_output(cmd, "## files indexed", &n_processed);
         catch_line_output(cmd, "## regular files", &n_regular);
+        catch_line_output(cmd, "## unchanged files", &n_unchanged);
     }
     if (ferror(pout))
         perror("fgets");
     else
         *result = (int) n_processed;
 
-    hpssixd_log_info("%lu files indexed (%lu regular files)",
-                     n_processed, n_regular);
+    hpssixd_log_info("%lu files indexed (%lu regular files, %lu unchanged)",
+                     n_processed, n_regular, n_unchanged);
 
     pclose(pout);
 out:
@@ -38,11 +38,14 @@ static int do_extractor(uint64_t task_id, int *result)
     char *pos = NULL;
     FILE *pout = NULL;
     uint64_t n_extracted = 0;
+    uint64_t n_unchanged = 0;
+    uint64_t n_remaining = 0;
+    int summary = 0;
     char cmd[LINE_MAX] = { 0, };
     char builder_output[PATH_MAX] = { 0, };
     hpssix_config_t *config = &extractor_data->config;
 
-    ret = hpssix_get_datadir_today(builder_output, PATH_MAX);
+    ret = hpssix_get_datadir(task_id, builder_output, PATH_MAX);
     if (ret)
         goto out;
 
@@ -64,15 +67,29 @@ static int do_extractor(uint64_t task_id, int *result)
         fputs(cmd, stdout);
 
         catch_line_output(cmd, "## files extracted", &n_extracted);
+        catch_line_output(cmd, "## unchanged files", &n_unchanged);
+        if (strncmp(cmd, "## files remaining", 18) == 0)
+            summary = 1;
+        catch_line_output(cmd, "## files remaining", &n_remaining);
     }
     if (ferror(pout))
         perror("fgets");
-    else
-        *result = (int) n_extracted;
-
-    hpssixd_log_info("extracted contents from %lu files", n_extracted);
 
     pclose(pout);
+
+    /*
+     * without the summary, the extractor has died in the middle. the progress
+     * is kept on the disk, so the task can be resumed.
+     */
+    *result = hpssixd_extractor_result(n_extracted,
+                                       summary && n_remaining == 0);
+
+    hpssixd_log_info("extracted contents from %lu files (%lu unchanged)",
+                     n_extracted, n_unchanged);
+    if (!summary || n_remaining)
+        hpssixd_log_warning("extraction incomplete (%lu files remaining)",
+                            n_remaining);
+
 out:
     return ret;
 }
@@ -104,10 +121,15 @@ int *extractor_run_1_svc(u_quad_t *argp, struct svc_req *rqstp)
     else {
         current_task = task_id;
 
-        /* run builder here .. */
+        /*
+         * the same task can be requested again to resume an incomplete run,
+         * the extractor continues from the progress left in the datadir.
+         */
         ret = do_extractor(task_id, &result);
         if (ret)
             hpssixd_log_err("running extractor failed.");
+
+        current_task = 0;
     }
 
     return &result;
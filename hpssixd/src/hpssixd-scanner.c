@@ -42,6 +42,9 @@ struct timeval rpc_timeout;
 static int builder_running;
 static int extractor_running;
 
+/* seconds to wait before resuming an incomplete extraction */
+static const uint64_t extractor_retry_delay = 60;
+
 int *scanner_connect_1_svc(int *argp, struct svc_req *rqstp)
 {
     static int  result = 0;
@@ -338,6 +341,8 @@ out:
 static int do_scanner(void)
 {
     int ret = 0;
+    int attempt = 0;
+    int retries = scanner_data->config.extractor_retries;
     int *result = NULL;
     uint64_t task_id = 0;
     uint64_t elapsed = 0;
@@ -371,7 +376,7 @@ static int do_scanner(void)
     }
 
     /* .. run the scanner here .. */
-    ret = hpssix_get_datadir_today(outdir, PATH_MAX);
+    ret = hpssix_get_datadir(task_id, outdir, PATH_MAX);
     if (ret) {
         hpssixd_log_err("failed to prepare the workdir");
         goto out;
@@ -413,23 +418,46 @@ static int do_scanner(void)
 
     status.n_indexed = *result;
 
-    /* run extractor */
-    hpssixd_log_info("sending request to extractor..");
+    /*
+     * run extractor. if the extractor (or tika) dies in the middle, the
+     * extractor is requested again with the same task, and it resumes from
+     * where it has stopped.
+     */
+    status.status = HPSSIX_WORK_STATUS_INCOMPLETE;
+
+    for (attempt = 0; attempt <= retries; attempt++) {
+        if (attempt > 0) {
+            hpssixd_log_warning("extraction incomplete, resuming in %lu "
+                                "seconds (%d/%d)..",
+                                extractor_retry_delay, attempt, retries);
+            sleep(extractor_retry_delay);
+        }
+
+        hpssixd_log_info("sending request to extractor..");
 
-    ret = rpc_run_worker(HPSSIXD_ID_EXTRACTOR, status.id, &result);
-    if (ret) {
-        hpssixd_log_err("extractor failed, aborting the job.");
-        goto out;
+        ret = rpc_run_worker(HPSSIXD_ID_EXTRACTOR, status.id, &result);
+        if (ret || result == NULL) {
+            hpssixd_log_err("extractor request failed.");
+            continue;
+        }
+
+        status.n_extracted += hpssixd_extractor_result_count(*result);
+
+        if (*result >= 0) {
+            status.status = HPSSIX_WORK_STATUS_DONE;
+            break;
+        }
     }
 
+    ret = 0;
+
     status.extractor_end = time(NULL);
     elapsed = status.extractor_end - status.extractor_start;
 
-    hpssixd_log_info("extractor finished: %d records in %lu seconds.",
-                     *result, elapsed);
-
-    status.n_extracted = *result;
-    status.status = 0;
+    hpssixd_log_info("extractor finished: %lu records in %lu seconds%s.",
+                     status.n_extracted, elapsed,
+                     status.status == HPSSIX_WORK_STATUS_DONE ?
+                     "" : " (incomplete)");
 
     ret = hpssix_mdb_record(mdb, &status);
     if (ret)
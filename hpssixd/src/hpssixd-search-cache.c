@@ -0,0 +1,288 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hpssixd-search-cache.h"
+
+struct _hpssixd_search_cache_entry {
+    uint64_t hash;
+    char *key;
+    uint64_t keylen;
+    char *data;
+    uint64_t len;
+
+    struct _hpssixd_search_cache_entry *prev;   /* in the lru list */
+    struct _hpssixd_search_cache_entry *next;
+    struct _hpssixd_search_cache_entry *chain;  /* in the bucket */
+};
+
+typedef struct _hpssixd_search_cache_entry cache_entry_t;
+
+/* fnv-1a */
+static uint64_t cache_hash(const char *key, uint64_t keylen)
+{
+    uint64_t i = 0;
+    uint64_t hash = 0xcbf29ce484222325UL;
+
+    for (i = 0; i < keylen; i++) {
+        hash ^= (unsigned char) key[i];
+        hash *= 0x100000001b3UL;
+    }
+
+    return hash;
+}
+
+static inline uint64_t entry_size(cache_entry_t *entry)
+{
+    return sizeof(*entry) + entry->keylen + entry->len;
+}
+
+static inline cache_entry_t **entry_bucket(hpssixd_search_cache_t *cache,
+                                           uint64_t hash)
+{
+    return &cache->buckets[hash % HPSSIXD_SEARCH_CACHE_BUCKETS];
+}
+
+static void lru_unlink(hpssixd_search_cache_t *cache, cache_entry_t *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache->lru = entry->next;
+
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache->lru_tail = entry->prev;
+
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push(hpssixd_search_cache_t *cache, cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->lru;
+
+    if (cache->lru)
+        cache->lru->prev = entry;
+    else
+        cache->lru_tail = entry;
+
+    cache->lru = entry;
+}
+
+static cache_entry_t *cache_find(hpssixd_search_cache_t *cache,
+                                 const char *key, uint64_t keylen,
+                                 uint64_t hash)
+{
+    cache_entry_t *entry = *entry_bucket(cache, hash);
+
+    for ( ; entry; entry = entry->chain)
+        if (entry->hash == hash && entry->keylen == keylen &&
+            !memcmp(entry->key, key, keylen))
+            return entry;
+
+    return NULL;
+}
+
+static void cache_remove(hpssixd_search_cache_t *cache, cache_entry_t *entry)
+{
+    cache_entry_t **pos = entry_bucket(cache, entry->hash);
+
+    while (*pos != entry)
+        pos = &(*pos)->chain;
+
+    *pos = entry->chain;
+
+    lru_unlink(cache, entry);
+
+    cache->stats.size -= entry_size(entry);
+    cache->stats.n_entries--;
+
+    free(entry->key);
+    free(entry->data);
+    free(entry);
+}
+
+static void cache_clear(hpssixd_search_cache_t *cache)
+{
+    while (cache->lru)
+        cache_remove(cache, cache->lru);
+}
+
+int hpssixd_search_cache_init(hpssixd_search_cache_t *cache,
+                              uint64_t capacity)
+{
+    int ret = 0;
+
+    if (!cache)
+        return EINVAL;
+
+    memset((void *) cache, 0, sizeof(*cache));
+
+    ret = pthread_mutex_init(&cache->lock, NULL);
+    if (ret)
+        return ret;
+
+    cache->capacity = capacity;
+    cache->maxentry = capacity/4;
+    cache->stats.capacity = capacity;
+
+    return 0;
+}
+
+void hpssixd_search_cache_free(hpssixd_search_cache_t *cache)
+{
+    if (!cache)
+        return;
+
+    cache_clear(cache);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+void hpssixd_search_cache_set_generation(hpssixd_search_cache_t *cache,
+                                         uint64_t generation)
+{
+    pthread_mutex_lock(&cache->lock);
+
+    if (cache->stats.generation != generation) {
+        cache->stats.invalidations += cache->stats.n_entries;
+        cache_clear(cache);
+        cache->stats.generation = generation;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+int hpssixd_search_cache_get(hpssixd_search_cache_t *cache,
+                             const char *key, uint64_t keylen,
+                             char **data, uint64_t *len)
+{
+    int ret = 0;
+    char *copy = NULL;
+    cache_entry_t *entry = NULL;
+    uint64_t hash = cache_hash(key, keylen);
+
+    pthread_mutex_lock(&cache->lock);
+
+    entry = cache_find(cache, key, keylen, hash);
+    if (!entry) {
+        cache->stats.misses++;
+        ret = ENOENT;
+        goto out;
+    }
+
+    /* copied, as the entry may be evicted while the answer is sent */
+    copy = malloc(entry->len ? entry->len : 1);
+    if (!copy) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    memcpy(copy, entry->data, entry->len);
+
+    *data = copy;
+    *len = entry->len;
+
+    cache->stats.hits++;
+
+    lru_unlink(cache, entry);
+    lru_push(cache, entry);
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+
+    return ret;
+}
+
+int hpssixd_search_cache_put(hpssixd_search_cache_t *cache,
+                             uint64_t generation,
+                             const char *key, uint64_t keylen,
+                             const char *data, uint64_t len)
+{
+    int ret = 0;
+    cache_entry_t *entry = NULL;
+    cache_entry_t *old = NULL;
+    cache_entry_t **bucket = NULL;
+    uint64_t hash = cache_hash(key, keylen);
+
+    if (keylen + len + sizeof(*entry) > cache->maxentry)
+        return EFBIG;
+
+    entry = calloc(1, sizeof(*entry));
+    if (!entry)
+        return ENOMEM;
+
+    entry->key = malloc(keylen);
+    entry->data = malloc(len ? len : 1);
+    if (!entry->key || !entry->data) {
+        ret = ENOMEM;
+        goto out_free;
+    }
+
+    memcpy(entry->key, key, keylen);
+    memcpy(entry->data, data, len);
+    entry->keylen = keylen;
+    entry->len = len;
+    entry->hash = hash;
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* the index has changed while the answer was read */
+    if (cache->stats.generation != generation) {
+        pthread_mutex_unlock(&cache->lock);
+        ret = ESTALE;
+        goto out_free;
+    }
+
+    /* the same search may be answered by two workers at once */
+    old = cache_find(cache, key, keylen, hash);
+    if (old)
+        cache_remove(cache, old);
+
+    while (cache->lru_tail &&
+           cache->stats.size + entry_size(entry) > cache->capacity) {
+        cache_remove(cache, cache->lru_tail);
+        cache->stats.evictions++;
+    }
+
+    bucket = entry_bucket(cache, hash);
+    entry->chain = *bucket;
+    *bucket = entry;
+
+    lru_push(cache, entry);
+
+    cache->stats.size += entry_size(entry);
+    cache->stats.n_entries++;
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return 0;
+
+out_free:
+    free(entry->key);
+    free(entry->data);
+    free(entry);
+
+    return ret;
+}
+
+void hpssixd_search_cache_get_stats(hpssixd_search_cache_t *cache,
+                                    hpssixd_search_cache_stats_t *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * the result cache of the search service. the answers are kept by the search
+ * (the statement and the parameters), for the generation of the index, which
+ * each build and each batch of documents bump. the whole cache is dropped
+ * when the generation changes, and the least recently used answers are
+ * evicted to stay in the size.
+ */
+#ifndef __HPSSIXD_SEARCH_CACHE_H
+#define __HPSSIXD_SEARCH_CACHE_H
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define HPSSIXD_SEARCH_CACHE_BUCKETS    1024
+
+struct _hpssixd_search_cache_entry;
+
+struct _hpssixd_search_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;         /* by the size */
+    uint64_t invalidations;     /* by the new generations */
+    uint64_t n_entries;
+    uint64_t size;              /* bytes of the keys and the answers */
+    uint64_t capacity;
+    uint64_t generation;
+};
+
+typedef struct _hpssixd_search_cache_stats hpssixd_search_cache_stats_t;
+
+struct _hpssixd_search_cache {
+    pthread_mutex_t lock;
+
+    uint64_t capacity;
+    uint64_t maxentry;          /* the largest answer to keep */
+
+    hpssixd_search_cache_stats_t stats;
+
+    struct _hpssixd_search_cache_entry *lru;    /* the most recent first */
+    struct _hpssixd_search_cache_entry *lru_tail;
+    struct _hpssixd_search_cache_entry *buckets[HPSSIXD_SEARCH_CACHE_BUCKETS];
+};
+
+typedef struct _hpssixd_search_cache hpssixd_search_cache_t;
+
+/**
+ * @brief initialize @cache.
+ *
+ * @param cache
+ * @param capacity in bytes. a single answer is kept up to a quarter of it.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssixd_search_cache_init(hpssixd_search_cache_t *cache,
+                              uint64_t capacity);
+
+/**
+ * @brief release all entries of @cache.
+ *
+ * @param cache
+ */
+void hpssixd_search_cache_free(hpssixd_search_cache_t *cache);
+
+/**
+ * @brief set the generation of the index. the entries of the old generation
+ * are dropped.
+ *
+ * @param cache
+ * @param generation
+ */
+void hpssixd_search_cache_set_generation(hpssixd_search_cache_t *cache,
+                                         uint64_t generation);
+
+/**
+ * @brief look up the answer of @key.
+ *
+ * @param cache
+ * @param key
+ * @param keylen
+ * @param data [out] a copy of the answer, which should be freed by the caller.
+ * @param len [out]
+ *
+ * @return 0 on a hit, ENOENT on a miss, ENOMEM.
+ */
+int hpssixd_search_cache_get(hpssixd_search_cache_t *cache,
+                             const char *key, uint64_t keylen,
+                             char **data, uint64_t *len);
+
+/**
+ * @brief keep the answer of @key, if it is of the current generation.
+ *
+ * @param cache
+ * @param generation of the index, from which the answer was read.
+ * @param key
+ * @param keylen
+ * @param data
+ * @param len
+ *
+ * @return 0 on success, EFBIG if the answer is too large to keep, ESTALE if
+ * the generation has changed, ENOMEM.
+ */
+int hpssixd_search_cache_put(hpssixd_search_cache_t *cache,
+                             uint64_t generation,
+                             const char *key, uint64_t keylen,
+                             const char *data, uint64_t len);
+
+/**
+ * @brief read the statistics of @cache.
+ *
+ * @param cache
+ * @param stats [out]
+ */
+void hpssixd_search_cache_get_stats(hpssixd_search_cache_t *cache,
+                                    hpssixd_search_cache_stats_t *stats);
+
+#endif /* __HPSSIXD_SEARCH_CACHE_H */
@@ -0,0 +1,631 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * the search service. the searches are answered over the unix socket by the
+ * workers, each of which keeps a database session, so that a search does not
+ * pay for the connection, and the statements stay prepared across searches.
+ * the answers are cached until the index changes (hpssixd-search-cache.h).
+ */
+#include <config.h>
+
+#include "hpssixd.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <hpssix-query-msg.h>
+
+#include "hpssixd-search-cache.h"
+
+#define SEARCH_DEFAULT_WORKERS  4
+#define SEARCH_QUEUE_LEN        128
+
+static hpssixd_daemon_data_t *search_data;
+
+/* the result cache, for the generation of the index (hpssix_generation) */
+static int cache_enabled;
+static hpssixd_search_cache_t cache;
+
+/* the accepted connections, waiting for a worker */
+static int queue[SEARCH_QUEUE_LEN];
+static uint32_t queue_head;
+static uint32_t queue_count;
+
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void queue_push(int fd)
+{
+    pthread_mutex_lock(&queue_lock);
+
+    while (queue_count == SEARCH_QUEUE_LEN)
+        pthread_cond_wait(&queue_cond, &queue_lock);
+
+    queue[(queue_head + queue_count) % SEARCH_QUEUE_LEN] = fd;
+    queue_count++;
+
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static int queue_pop(void)
+{
+    int fd = -1;
+
+    pthread_mutex_lock(&queue_lock);
+
+    while (queue_count == 0)
+        pthread_cond_wait(&queue_cond, &queue_lock);
+
+    fd = queue[queue_head];
+    queue_head = (queue_head + 1) % SEARCH_QUEUE_LEN;
+    queue_count--;
+
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    return fd;
+}
+
+/*
+ * the session is reset if the database went away since the last search. the
+ * prepared statements are gone with the old session.
+ */
+static int search_session(hpssix_db_t *db)
+{
+    if (db->dbconn) {
+        if (PQstatus(db->dbconn) == CONNECTION_OK)
+            return 0;
+
+        hpssixd_log_warning("database session lost, reconnecting..");
+
+        PQreset(db->dbconn);
+        db->n_prepared = 0;
+
+        if (PQstatus(db->dbconn) == CONNECTION_OK)
+            return 0;
+
+        hpssix_db_disconnect(db);
+        db->dbconn = NULL;
+    }
+
+    if (hpssix_db_connect(db, &search_data->config)) {
+        hpssixd_log_err("failed to connect to the database.");
+        return EIO;
+    }
+
+    return 0;
+}
+
+/*
+ * the answer to a client, which is also captured for the cache, until it gets
+ * too large to keep.
+ */
+struct search_reply {
+    FILE *out;
+    FILE *capture;
+    char *buf;
+    size_t len;
+    uint64_t captured;
+    uint64_t limit;
+};
+
+static void reply_drop_capture(struct search_reply *reply)
+{
+    if (reply->capture) {
+        fclose(reply->capture);
+        reply->capture = NULL;
+    }
+
+    free(reply->buf);
+    reply->buf = NULL;
+    reply->len = 0;
+}
+
+static int reply_send(struct search_reply *reply, const char *buf,
+                      uint32_t len)
+{
+    if (reply->capture) {
+        reply->captured += 1 + sizeof(uint32_t) + len;
+
+        if (reply->captured > reply->limit ||
+            hpssix_query_msg_send(reply->capture, HPSSIX_QUERY_MSG_ROW,
+                                  buf, len))
+            reply_drop_capture(reply);
+    }
+
+    return hpssix_query_msg_send(reply->out, HPSSIX_QUERY_MSG_ROW, buf, len);
+}
+
+static int send_row(struct search_reply *reply, PGresult *res, int row)
+{
+    int i = 0;
+    int ret = 0;
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp = NULL;
+
+    fp = open_memstream(&buf, &len);
+    if (!fp)
+        return ENOMEM;
+
+    for (i = 0; i < PQnfields(res); i++)
+        fprintf(fp, "%s%c", PQgetvalue(res, row, i), '\0');
+
+    if (fclose(fp)) {
+        free(buf);
+        return ENOMEM;
+    }
+
+    ret = reply_send(reply, buf, len);
+    free(buf);
+
+    return ret;
+}
+
+static int search_estimate(hpssix_db_t *db, hpssix_query_msg_t *msg,
+                           struct search_reply *reply)
+{
+    int ret = 0;
+    int len = 0;
+    char buf[64] = { 0, };
+    hpssix_query_estimate_t est = { 0, };
+
+    ret = hpssix_query_estimate(db, &msg->query, &est);
+    if (ret)
+        return ret;
+
+    len = sprintf(buf, "%d%c%lu%c%lu%c", est.source, '\0', est.rows, '\0',
+                                         est.bound, '\0');
+
+    return reply_send(reply, buf, len);
+}
+
+static int search_count(hpssix_db_t *db, hpssix_query_stmt_t *stmt,
+                        struct search_reply *reply)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+
+    res = hpssix_query_exec(db, stmt);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1)
+        ret = EIO;
+    else
+        ret = send_row(reply, res, 0);
+
+    PQclear(res);
+
+    return ret;
+}
+
+/* the rows are sent as each batch arrives */
+static int search_rows(hpssix_db_t *db, hpssix_query_msg_t *msg,
+                       hpssix_query_stmt_t *stmt, struct search_reply *reply)
+{
+    int i = 0;
+    int ret = 0;
+    PGresult *res = NULL;
+    hpssix_query_cursor_t cursor = { 0, };
+
+    ret = hpssix_query_open(db, stmt, msg->batch, &cursor);
+    if (ret)
+        return ret;
+
+    while ((ret = hpssix_query_fetch(&cursor, &res)) == 0 && res) {
+        for (i = 0; i < PQntuples(res) && !ret; i++)
+            ret = send_row(reply, res, i);
+
+        PQclear(res);
+
+        if (ret || fflush(reply->out)) {
+            ret = EIO;
+            break;
+        }
+    }
+
+    if (hpssix_query_close(&cursor) && !ret)
+        ret = EIO;
+
+    return ret;
+}
+
+static const char *search_generation_stmt =
+"SELECT n FROM hpssix_generation";
+
+/*
+ * the generation is bumped in the same transaction as each change of the
+ * index (a build, or a batch of documents), so that the answers read after
+ * it stay valid until the next one commits. it is read before the search,
+ * and an answer from a newer index is only dropped at the next search.
+ */
+static int search_generation(hpssix_db_t *db, uint64_t *generation)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+
+    res = hpssix_db_exec_prepared(db, search_generation_stmt, 0, NULL);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1) {
+        ret = EIO;
+        goto out;
+    }
+
+    *generation = strtoull(PQgetvalue(res, 0, 0), NULL, 10);
+
+    hpssixd_search_cache_set_generation(&cache, *generation);
+
+out:
+    PQclear(res);
+
+    return ret;
+}
+
+/*
+ * the key of the cache is the statement and the parameters, which is the
+ * normalized search: the same conditions build the same statement, whatever
+ * order they are given in, and the values are only in the parameters. the
+ * batch is not in the key, as it does not change the answer.
+ */
+static int search_key(hpssix_query_msg_t *msg, hpssix_query_stmt_t *stmt,
+                      char **key, size_t *keylen)
+{
+    int i = 0;
+    FILE *fp = NULL;
+
+    fp = open_memstream(key, keylen);
+    if (!fp)
+        return ENOMEM;
+
+    fprintf(fp, "%c%s%c", msg->estimate ? 'e' : 'q', stmt->sql, '\0');
+
+    for (i = 0; i < stmt->n_params; i++)
+        fprintf(fp, "%s%c", stmt->params[i], '\0');
+
+    if (fclose(fp)) {
+        free(*key);
+        *key = NULL;
+        return ENOMEM;
+    }
+
+    return 0;
+}
+
+static int search_query(hpssix_db_t *db, char *buf, uint32_t len, FILE *out)
+{
+    int ret = 0;
+    int n = 0;
+    int cached = 0;
+    char *key = NULL;
+    size_t keylen = 0;
+    char *data = NULL;
+    uint64_t datalen = 0;
+    uint64_t generation = 0;
+    char end[32] = { 0, };
+    hpssix_query_msg_t msg = { 0, };
+    hpssix_query_stmt_t stmt = { 0, };
+    hpssix_query_plan_t plan = { 0, };
+    struct search_reply reply = { 0, };
+
+    reply.out = out;
+
+    ret = hpssix_query_msg_decode(&msg, buf, len);
+    if (ret)
+        goto out;
+
+    ret = hpssix_query_build(&msg.query, &stmt);
+    if (ret)
+        goto out;
+
+    ret = search_session(db);
+    if (ret)
+        goto out;
+
+    /* without the generation, the answer is not cached */
+    if (cache_enabled && search_generation(db, &generation) == 0 &&
+        search_key(&msg, &stmt, &key, &keylen) == 0) {
+        if (hpssixd_search_cache_get(&cache, key, keylen,
+                                     &data, &datalen) == 0) {
+            if (datalen && fwrite(data, datalen, 1, out) != 1)
+                ret = EIO;
+
+            cached = 1;
+            goto out;
+        }
+
+        reply.limit = cache.maxentry;
+        reply.capture = open_memstream(&reply.buf, &reply.len);
+    }
+
+    /*
+     * the key is of the statement without the plan, so that a search is
+     * cached once, whichever predicate drove it. a search which cannot be
+     * planned is driven by hpssix_object.
+     */
+    if (!msg.estimate && hpssix_query_plan(db, &msg.query, &plan) == 0) {
+        msg.query.plan = &plan;
+
+        hpssix_query_stmt_free(&stmt);
+        ret = hpssix_query_build(&msg.query, &stmt);
+        if (ret)
+            goto out;
+    }
+
+    if (msg.estimate)
+        ret = search_estimate(db, &msg, &reply);
+    else if (msg.query.countonly)
+        ret = search_count(db, &stmt, &reply);
+    else
+        ret = search_rows(db, &msg, &stmt, &reply);
+
+    if (!ret && reply.capture) {
+        n = fclose(reply.capture);
+        reply.capture = NULL;
+
+        if (n == 0)
+            hpssixd_search_cache_put(&cache, generation, key, keylen,
+                                     reply.buf, reply.len);
+    }
+
+out:
+    /* a failed search should not leave the session in a transaction */
+    if (db->dbconn && PQtransactionStatus(db->dbconn) != PQTRANS_IDLE)
+        hpssix_db_psql_exec(db, "ROLLBACK");
+
+    reply_drop_capture(&reply);
+    hpssix_query_stmt_free(&stmt);
+    hpssix_query_msg_free(&msg);
+    free(data);
+    free(key);
+
+    n = sprintf(end, "%d%c%s", ret, '\0', cached ? "cached" : "");
+
+    if (hpssix_query_msg_send(out, HPSSIX_QUERY_MSG_END, end, n) ||
+        fflush(out))
+        return EIO;
+
+    return 0;
+}
+
+static int send_stat(FILE *out, const char *name, uint64_t val)
+{
+    int len = 0;
+    char buf[64] = { 0, };
+
+    len = sprintf(buf, "%s%c%lu%c", name, '\0', val, '\0');
+
+    return hpssix_query_msg_send(out, HPSSIX_QUERY_MSG_ROW, buf, len);
+}
+
+static int search_stats(FILE *out)
+{
+    int ret = 0;
+    char end[16] = { 0, };
+    hpssixd_search_cache_stats_t stats = { 0, };
+
+    if (cache_enabled) {
+        hpssixd_search_cache_get_stats(&cache, &stats);
+
+        ret |= send_stat(out, "cache hits", stats.hits);
+        ret |= send_stat(out, "cache misses", stats.misses);
+        ret |= send_stat(out, "cache entries", stats.n_entries);
+        ret |= send_stat(out, "cache bytes", stats.size);
+        ret |= send_stat(out, "cache capacity", stats.capacity);
+        ret |= send_stat(out, "cache evictions", stats.evictions);
+        ret |= send_stat(out, "cache invalidations", stats.invalidations);
+        ret |= send_stat(out, "index generation", stats.generation);
+    }
+
+    sprintf(end, "%d", cache_enabled ? 0 : ENOENT);
+
+    if (ret ||
+        hpssix_query_msg_send(out, HPSSIX_QUERY_MSG_END, end, strlen(end)) ||
+        fflush(out))
+        return EIO;
+
+    return 0;
+}
+
+/*
+ * a client may send the queries one after another, over the connection, until
+ * it closes the connection.
+ */
+static void search_serve(hpssix_db_t *db, int fd)
+{
+    int ret = 0;
+    int type = 0;
+    int wfd = -1;
+    char *buf = NULL;
+    uint32_t size = 0;
+    uint32_t len = 0;
+    FILE *in = NULL;
+    FILE *out = NULL;
+
+    wfd = dup(fd);
+    if (wfd < 0) {
+        close(fd);
+        return;
+    }
+
+    in = fdopen(fd, "r");
+    out = fdopen(wfd, "w");
+    if (!in || !out) {
+        hpssixd_log_err("failed to open the connection (%d).", errno);
+        goto out;
+    }
+
+    while (1) {
+        ret = hpssix_query_msg_recv(in, &type, &buf, &size, &len);
+        if (ret)
+            break;
+
+        if (type == HPSSIX_QUERY_MSG_STATS) {
+            if (search_stats(out))
+                break;
+            continue;
+        }
+        else if (type != HPSSIX_QUERY_MSG_QUERY)
+            break;
+
+        /* the query takes the buffer */
+        ret = search_query(db, buf, len, out);
+        buf = NULL;
+        size = 0;
+
+        if (ret)
+            break;
+    }
+
+out:
+    free(buf);
+
+    if (in)
+        fclose(in);
+    else
+        close(fd);
+
+    if (out)
+        fclose(out);
+    else
+        close(wfd);
+}
+
+static void *search_worker(void *arg)
+{
+    int fd = -1;
+    hpssix_db_t db = { 0, };
+
+    /* warm the session up, before the first search */
+    search_session(&db);
+
+    while (1) {
+        fd = queue_pop();
+        search_serve(&db, fd);
+    }
+
+    return NULL;
+}
+
+static int search_listen(const char *path)
+{
+    int fd = -1;
+    struct sockaddr_un addr = { 0, };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        hpssixd_log_err("the socket path is too long: %s", path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* the socket left from the previous run */
+    unlink(path);
+
+    /*
+     * only the users in the group of hpssixd can connect, the others search
+     * the database directly with their own credentials.
+     */
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+        chmod(path, 0660) || listen(fd, SEARCH_QUEUE_LEN)) {
+        hpssixd_log_err("failed to listen on %s (%d).", path, errno);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int hpssixd_daemon_search(hpssixd_daemon_data_t *data)
+{
+    int ret = 0;
+    int fd = -1;
+    int sock = -1;
+    uint32_t i = 0;
+    uint32_t n_workers = data->config.search_workers;
+    const char *path = data->config.search_socket;
+    pthread_t thread;
+
+    search_data = data;
+
+    if (!path) {
+        hpssixd_log_err("search.socket is not configured.");
+        return EINVAL;
+    }
+
+    if (n_workers == 0)
+        n_workers = SEARCH_DEFAULT_WORKERS;
+
+    if (data->config.search_cachesize) {
+        ret = hpssixd_search_cache_init(&cache, data->config.search_cachesize);
+        if (ret == 0)
+            cache_enabled = 1;
+        else
+            hpssixd_log_warning("the results are not cached (%d).", ret);
+
+        ret = 0;
+    }
+
+    /* the clients may go away in the middle of the results */
+    signal(SIGPIPE, SIG_IGN);
+
+    sock = search_listen(path);
+    if (sock < 0)
+        return EIO;
+
+    for (i = 0; i < n_workers; i++) {
+        ret = pthread_create(&thread, NULL, search_worker, NULL);
+        if (ret) {
+            hpssixd_log_err("failed to spawn a search worker");
+            goto out;
+        }
+
+        pthread_detach(thread);
+    }
+
+    hpssixd_log_info("search service on %s (%u workers, %lu bytes cached)..",
+                     path, n_workers,
+                     cache_enabled ? data->config.search_cachesize : 0);
+
+    while (1) {
+        fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+
+            hpssixd_log_err("failed to accept (%d).", errno);
+            ret = errno;
+            break;
+        }
+
+        /* not to keep a worker for a client which stopped talking */
+        if (hpssix_query_msg_set_timeout(fd, HPSSIX_QUERY_MSG_TIMEOUT)) {
+            close(fd);
+            continue;
+        }
+
+        queue_push(fd);
+    }
+
+out:
+    close(sock);
+    unlink(path);
+
+    return ret;
+}
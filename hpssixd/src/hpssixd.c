@@ -30,6 +30,7 @@ enum {
     HPSSIXD_CTX_SCANNER = 0,
     HPSSIXD_CTX_BUILDER,
     HPSSIXD_CTX_EXTRACTOR,
+    HPSSIXD_CTX_SEARCH,
 
     N_HPSSIXD_CTX,
 };
@@ -44,6 +45,7 @@ static hpssixd_daemon_func_t daemon_funcs[] = {
     &hpssixd_daemon_scanner,
     &hpssixd_daemon_builder,
     &hpssixd_daemon_extractor,
+    &hpssixd_daemon_search,
 };
 
 static inline hpssixd_daemon_func_t get_daemon_func(int context)
@@ -61,12 +63,13 @@ static struct option const long_opts[] = {
     { "extractor", 0, 0, 'e' },
     { "foreground", 0, 0, 'f' },
     { "help", 0, 0, 'h' },
+    { "search", 0, 0, 'q' },
     { "scanner", 0, 0, 's' },
     { "systemd", 0, 0, 't' },
     { 0, 0, 0, 0 },
 };
 
-static const char *short_opts = "bdefhst";
+static const char *short_opts = "bdefhqst";
 
 static const char *usage_str =
 "\n"
@@ -77,6 +80,7 @@ static const char *usage_str =
 "-e, --extractor    Launch the extractor daemon.\n"
 "-f, --foreground   Do not daemonize but run as a foreground process.\n"
 "-h, --help         Print this help message\n"
+"-q, --search       Launch the search service (search.socket).\n"
 "-s, --scanner      Launch the scanner daemon.\n"
 "-t, --systemd      Launch the systemd daemon (default SysV daemon).\n"
 "\n";
@@ -119,6 +123,11 @@ int main(int argc, char **argv)
             foreground = 1;
             break;
 
+        case 'q':
+            context = HPSSIXD_CTX_SEARCH;
+            data.name = "search";
+            break;
+
         case 's':
             context = HPSSIXD_CTX_SCANNER;
             data.name = "scanner";
@@ -34,6 +34,8 @@ int hpssixd_daemon_builder(hpssixd_daemon_data_t *data);
 
 int hpssixd_daemon_extractor(hpssixd_daemon_data_t *data);
 
+int hpssixd_daemon_search(hpssixd_daemon_data_t *data);
+
 /**
  * @brief daemonize the process. when using the traditional daemonizing method
  * (i.e., @systemd=0), the following signals will be handled by the default
@@ -192,6 +194,20 @@ enum {
     HPSSIXD_RC_FAIL = 1,
 };
 
+/*
+ * the extractor returns the number of extracted files, or a negative value
+ * if the task is not complete (some files are left to be resumed).
+ */
+static inline int hpssixd_extractor_result(uint64_t n_extracted, int complete)
+{
+    return complete ? (int) n_extracted : -((int) n_extracted) - 1;
+}
+
+static inline uint64_t hpssixd_extractor_result_count(int result)
+{
+    return result >= 0 ? result : -(result + 1);
+}
+
 #include "hpssixd-comm.h"
 
 #ifndef SIG_PF
@@ -21,6 +21,8 @@
 
 static const char *hpssix_sysconf_file = CONFDIR "/hpssix.conf";
 static const char *hpssix_extfilter_file = CONFDIR "/extfilter.conf";
+static const char *hpssix_extfilter_native_file =
+                                    CONFDIR "/extfilter-native.conf";
 
 static void read_hpssix_schedule(hpssix_config_t *config, const char *str)
 {
@@ -35,6 +37,7 @@ int hpssix_config_read_sysconf(hpssix_config_t *config)
     int ret = 0;
     config_t section = { 0, };
     config_setting_t *setting = NULL;
+    config_setting_t *list = NULL;
     const char *sval = NULL;
     int ival = 0;
 
@@ -129,6 +132,27 @@ int hpssix_config_read_sysconf(hpssix_config_t *config)
             ret = config_setting_lookup_int(setting, "port", &ival);
             if (ret == CONFIG_TRUE)
                 config->tika_port = ival;
+
+            list = config_setting_get_member(setting, "endpoints");
+            if (list && config_setting_length(list) > 0) {
+                int i = 0;
+                int n = config_setting_length(list);
+
+                config->tika_endpoints = calloc(n, sizeof(char *));
+                if (!config->tika_endpoints) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+
+                for (i = 0; i < n; i++) {
+                    sval = config_setting_get_string_elem(list, i);
+                    if (!sval)
+                        continue;
+
+                    config->tika_endpoints[config->tika_n_endpoints++] =
+                                                                strdup(sval);
+                }
+            }
         }
 
         /* read the scanner configuration */
@@ -161,6 +185,106 @@ int hpssix_config_read_sysconf(hpssix_config_t *config)
             ret = config_setting_lookup_int(setting, "nthreads", &ival);
             if (ret == CONFIG_TRUE)
                 config->extractor_nthreads = ival;
+
+            ret = config_setting_lookup_string(setting, "upload", &sval);
+            if (ret == CONFIG_TRUE)
+                config->extractor_upload = strdup(sval);
+
+            ret = config_setting_lookup_int(setting, "batchcount", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_batchcount = ival;
+
+            ret = config_setting_lookup_int(setting, "batchbytes", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_batchbytes = ival;
+
+            ret = config_setting_lookup_int(setting, "fingerprint", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_fingerprint = ival;
+
+            ret = config_setting_lookup_bool(setting, "native", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_native = ival;
+
+            ret = config_setting_lookup_int(setting, "nativecap", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_nativecap = ival;
+
+            ret = config_setting_lookup_int(setting, "retries", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_retries = ival;
+
+            ret = config_setting_lookup_int(setting, "maxinflight", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_maxinflight = ival;
+
+            ret = config_setting_lookup_bool(setting, "adaptive", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_adaptive = ival;
+
+            ret = config_setting_lookup_int(setting, "texthead", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_texthead = ival;
+
+            ret = config_setting_lookup_int(setting, "texttail", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_texttail = ival;
+
+            ret = config_setting_lookup_bool(setting, "keepfull", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_keepfull = ival;
+
+            ret = config_setting_lookup_bool(setting, "clienttsv", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_clienttsv = ival;
+
+            ret = config_setting_lookup_int(setting, "dispatch", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_dispatch = ival;
+
+            ret = config_setting_lookup_int(setting, "timeout", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_timeout = ival;
+
+            ret = config_setting_lookup_int(setting, "minrate", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_minrate = ival;
+
+            ret = config_setting_lookup_int(setting, "quarantine", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_quarantine = ival;
+
+            ret = config_setting_lookup_int(setting, "prefetch", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_prefetch = ival;
+
+            ret = config_setting_lookup_int(setting, "stagebytes", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_stagebytes = ival;
+
+            ret = config_setting_lookup_int(setting, "profile", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_profile = ival;
+
+            ret = config_setting_lookup_int(setting, "rate", &ival);
+            if (ret == CONFIG_TRUE)
+                config->extractor_rate = ival;
+        }
+
+        /* read the search service configuration */
+        setting = config_lookup(&section, "search");
+        if (setting) {
+            ret = config_setting_lookup_string(setting, "socket", &sval);
+            if (ret == CONFIG_TRUE)
+                config->search_socket = strdup(sval);
+
+            ret = config_setting_lookup_int(setting, "workers", &ival);
+            if (ret == CONFIG_TRUE)
+                config->search_workers = ival;
+
+            ret = config_setting_lookup_int(setting, "cachesize", &ival);
+            if (ret == CONFIG_TRUE)
+                config->search_cachesize = ival;
         }
     }
     else {
@@ -198,12 +322,23 @@ void hpssix_config_free(hpssix_config_t *config)
             free(config->db2password);
         if (config->tika_host)
             free(config->tika_host);
+        if (config->tika_endpoints) {
+            uint32_t i = 0;
+
+            for (i = 0; i < config->tika_n_endpoints; i++)
+                free(config->tika_endpoints[i]);
+            free(config->tika_endpoints);
+        }
         if (config->scanner_host)
             free(config->scanner_host);
         if (config->builder_host)
             free(config->builder_host);
         if (config->extractor_host)
             free(config->extractor_host);
+        if (config->extractor_upload)
+            free(config->extractor_upload);
+        if (config->search_socket)
+            free(config->search_socket);
     }
 }
 
@@ -251,27 +386,57 @@ static inline char *trim_extension(char *str)
     return str;
 }
 
-hpssix_extfilter_t *hpssix_extfilter_get(void)
+/*
+ * counts the extensions in @fp, or adds them to @filter if given. returns -1
+ * on errors.
+ */
+static int64_t extfilter_read(FILE *fp, hpssix_extfilter_t *filter)
 {
-    char *filter_file = NULL;
-    FILE *fp = NULL;
-    uint64_t lines = 0;
-    uint64_t memsize = 0;
+    int64_t lines = 0;
     char linebuf[LINE_MAX] = { 0, };
-    hpssix_extfilter_t *filter = NULL;
 
-    fp = fopen(hpssix_extfilter_file, "r");
-    if (!fp)
-        goto out;
+    rewind(fp);
 
     while (fgets(linebuf, LINE_MAX-1, fp) != NULL) {
         if (isspace(linebuf[0]) || linebuf[0] == '#')
             continue;
 
+        if (filter) {
+            char *current = strdup(trim_extension(linebuf));
+            if (!current)
+                return -1;
+            filter->exts[filter->n_exts++] = current;
+        }
+
         lines++;
     }
-    if (ferror(fp))
-        goto out_close;
+
+    return ferror(fp) ? -1 : lines;
+}
+
+hpssix_extfilter_t *hpssix_extfilter_get(int native)
+{
+    int i = 0;
+    int n_files = native ? 2 : 1;
+    int64_t count = 0;
+    uint64_t lines = 0;
+    uint64_t memsize = 0;
+    FILE *fp[2] = { NULL, NULL };
+    const char *files[2] = { hpssix_extfilter_file,
+                             hpssix_extfilter_native_file };
+    hpssix_extfilter_t *filter = NULL;
+
+    for (i = 0; i < n_files; i++) {
+        fp[i] = fopen(files[i], "r");
+        if (!fp[i])
+            goto out_close;
+
+        count = extfilter_read(fp[i], NULL);
+        if (count < 0)
+            goto out_close;
+
+        lines += count;
+    }
 
     memsize = sizeof(*filter) + lines*sizeof(char *) + 1;
     filter = malloc(memsize);
@@ -280,28 +445,19 @@ hpssix_extfilter_t *hpssix_extfilter_get(void)
 
     memset((void *) filter, 0, memsize);
 
-    rewind(fp);
-    lines = 0;
-
-    while (fgets(linebuf, LINE_MAX-1, fp) != NULL) {
-        char *current = NULL;
-
-        if (isspace(linebuf[0]) || linebuf[0] == '#')
-            continue;
-
-        current = strdup(trim_extension(linebuf));
-        if (!current)
-            goto out_close;
-        filter->exts[lines] = current;
-
-        lines++;
+    for (i = 0; i < n_files; i++) {
+        if (extfilter_read(fp[i], filter) < 0) {
+            hpssix_extfilter_free(filter);
+            filter = NULL;
+            break;
+        }
     }
-    if (!ferror(fp))
-        filter->n_exts = lines;
 
 out_close:
-    fclose(fp);
-out:
+    for (i = 0; i < n_files; i++)
+        if (fp[i])
+            fclose(fp[i]);
+
     return filter;
 }
 
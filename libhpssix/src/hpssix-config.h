@@ -34,14 +34,41 @@ struct _hpssix_config {
 
     char *tika_host;
     uint16_t tika_port;
+    char **tika_endpoints;      /* "host:port", overrides tika_host/port */
+    uint32_t tika_n_endpoints;
 
     uint32_t extractor_nthreads;
     uint64_t extractor_maxfilesize;
+    char *extractor_upload;
+    uint64_t extractor_batchcount;
+    uint64_t extractor_batchbytes;
+    uint64_t extractor_fingerprint;     /* KB, 0 to disable the hash */
+    int extractor_native;               /* native text extractors */
+    uint64_t extractor_nativecap;       /* bytes, 0 for the default */
+    uint32_t extractor_retries;         /* resume incomplete runs */
+    uint32_t extractor_maxinflight;     /* tika requests, 0 for nthreads */
+    int extractor_adaptive;             /* adapt the requests in flight */
+    uint64_t extractor_texthead;        /* bytes of the text stored, */
+    uint64_t extractor_texttail;        /*   0 for no cap */
+    int extractor_keepfull;             /* keep the full text aside */
+    int extractor_clienttsv;            /* build tsvectors in the extractor */
+    uint64_t extractor_dispatch;        /* objects per batch to a thread */
+    uint32_t extractor_timeout;         /* seconds per file, 0 for none, */
+    uint64_t extractor_minrate;         /*   plus size/minrate (bytes/sec) */
+    uint32_t extractor_quarantine;      /* timeouts to skip a file */
+    uint32_t extractor_prefetch;        /* threads reading ahead, 0 for none */
+    uint64_t extractor_stagebytes;      /* memory for the prefetched files */
+    uint32_t extractor_profile;         /* stamped on extracted documents */
+    uint32_t extractor_rate;            /* files/sec for re-extraction */
 
     char *scanner_host;
     char *builder_host;
     char *extractor_host;
 
+    char *search_socket;                /* the search service of hpssixd */
+    uint32_t search_workers;            /* database sessions of the service */
+    uint64_t search_cachesize;          /* bytes of the results cached */
+
     uint64_t rpc_timeout;
     uint64_t first_oid;
 
@@ -87,11 +114,14 @@ struct _hpssix_extfilter {
 typedef struct _hpssix_extfilter hpssix_extfilter_t;
 
 /**
- * @brief
+ * @brief read the whitelist of the file extensions from extfilter.conf.
+ *
+ * @param native non-zero to add the plain text formats in
+ * extfilter-native.conf, which are natively extracted (extractor.native)
  *
  * @return
  */
-hpssix_extfilter_t *hpssix_extfilter_get(void);
+hpssix_extfilter_t *hpssix_extfilter_get(int native);
 
 /**
  * @brief
@@ -5,10 +5,12 @@
 BEGIN TRANSACTION;
 
 DROP TABLE IF EXISTS hpssix_object cascade;
+DROP TABLE IF EXISTS hpssix_object_count cascade;
 DROP TRIGGER IF EXISTS hpssix_file_name_update ON hpssix_file;
 DROP FUNCTION IF EXISTS hpssix_file_get_name;
 DROP TABLE IF EXISTS hpssix_file cascade;
 DROP TABLE IF EXISTS hpssix_attr_key cascade;
+DROP TABLE IF EXISTS hpssix_attr_key_count cascade;
 DROP FUNCTION IF EXISTS hpssix_attr_key_pop;
 DROP TRIGGER IF EXISTS hpssix_attr_val_update ON hpssix_attr_val;
 DROP FUNCTION IF EXISTS hpssix_attr_parse_numeric;
@@ -16,6 +18,11 @@ DROP TABLE IF EXISTS hpssix_attr_val cascade;
 DROP TRIGGER IF EXISTS hpssix_attr_document_tsv_update ON hpssix_attr_document;
 DROP FUNCTION IF EXISTS documents_search_trigger;
 DROP TABLE IF EXISTS hpssix_attr_document cascade;
+DROP TABLE IF EXISTS hpssix_attr_document_full cascade;
+DROP TABLE IF EXISTS hpssix_attr_docmeta cascade;
+DROP TABLE IF EXISTS hpssix_attr_fingerprint cascade;
+DROP TABLE IF EXISTS hpssix_attr_quarantine cascade;
+DROP TABLE IF EXISTS hpssix_generation cascade;
 
 CREATE TABLE hpssix_object (
     oid BIGINT NOT NULL,        -- object_id in HPSS
@@ -45,6 +52,18 @@ CREATE INDEX ix_hpssix_atime ON hpssix_object(st_atime);
 CREATE INDEX ix_hpssix_mtime ON hpssix_object(st_mtime);
 CREATE INDEX ix_hpssix_ctime ON hpssix_object(st_ctime);
 
+--
+-- the objects by the owner and the file type (st_mode & S_IFMT), counted at
+-- the end of each build, for hpssix-search --count-only --estimate.
+--
+CREATE TABLE hpssix_object_count (
+    valid BOOL NOT NULL,
+    st_uid INTEGER NOT NULL,
+    st_gid INTEGER NOT NULL,
+    st_type INTEGER NOT NULL,
+    n BIGINT NOT NULL
+);
+
 CREATE TABLE hpssix_file (
     fid BIGINT GENERATED ALWAYS AS IDENTITY,
     oid BIGINT NOT NULL REFERENCES hpssix_object(oid) ON DELETE CASCADE,
@@ -56,6 +75,28 @@ CREATE TABLE hpssix_file (
 
 CREATE INDEX ix_hpssix_file_name ON hpssix_file (name);
 
+-- the search results are paged by the oid (hpssix-search --after)
+CREATE INDEX ix_hpssix_file_oid ON hpssix_file (oid);
+
+--
+-- substring searches of the names and paths (hpssix-search --name/--path, as
+-- LIKE '%x%') are served by the trigram indexes. a pattern shorter than three
+-- characters has no trigram to look up in them.
+--
+CREATE EXTENSION IF NOT EXISTS pg_trgm;
+
+CREATE INDEX ix_hpssix_file_name_trgm
+    ON hpssix_file USING GIN (name gin_trgm_ops);
+CREATE INDEX ix_hpssix_file_path_trgm
+    ON hpssix_file USING GIN (path gin_trgm_ops);
+
+--
+-- subtree searches (hpssix-search --under) are range scans of the path
+-- prefix, ['/dir/', '/dir0') in the c ordering of text_pattern_ops.
+--
+CREATE INDEX ix_hpssix_file_path_prefix
+    ON hpssix_file (path text_pattern_ops);
+
 CREATE FUNCTION hpssix_file_get_name() RETURNS TRIGGER AS $$
 BEGIN
     new.name := substring(new.path from '[^/]+$');
@@ -88,6 +129,17 @@ BEGIN
 END
 $$ LANGUAGE plpgsql;
 
+--
+-- the values of each key, counted at the end of each build, for choosing the
+-- driving predicate of the searches.
+--
+CREATE TABLE hpssix_attr_key_count (
+    kid BIGINT NOT NULL,
+    n BIGINT NOT NULL,
+
+    PRIMARY KEY (kid)
+);
+
 CREATE TABLE hpssix_attr_val (
     vid BIGINT GENERATED ALWAYS AS IDENTITY,
     oid BIGINT NOT NULL REFERENCES hpssix_object(oid) ON DELETE CASCADE,
@@ -128,17 +180,39 @@ CREATE TABLE hpssix_attr_document (
     meta JSONB,
     text TEXT,
     tsv TSVECTOR,
+    profile INTEGER NOT NULL DEFAULT 0,     -- extractor.profile of the run
 
     PRIMARY KEY (tid),
     UNIQUE (oid)
 );
 
 CREATE INDEX ix_tsv ON hpssix_attr_document USING GIN (tsv);
+CREATE INDEX ix_document_profile ON hpssix_attr_document (profile);
 
+--
+-- the text is capped by the extractor (extractor.texthead/texttail), and the
+-- tsvector input is bounded here again, so that a single huge document cannot
+-- go over the tsvector size limit or stall the index build.
+--
+-- the tsvector can be prepared by the extractor (extractor.clienttsv), then it
+-- is stored as is. writers should set the tsv to NULL (or a prepared one) when
+-- updating the document, to have it rebuilt.
+--
+-- the 'simple' configuration (no stemming, no stopwords removed) is used as
+-- the prepared tsvectors are not stemmed, so that a search matches the same
+-- words whichever side built the tsvector of a document.
+--
 CREATE FUNCTION documents_search_trigger() RETURNS TRIGGER AS $$
 BEGIN
-    new.tsv := SETWEIGHT(TO_TSVECTOR(COALESCE(new.meta->>'title','')), 'A') ||
-               SETWEIGHT(TO_TSVECTOR(COALESCE(new.text,'')), 'D');
+    IF new.tsv IS NOT NULL THEN
+        RETURN new;
+    END IF;
+
+    new.tsv := SETWEIGHT(TO_TSVECTOR('simple',
+                                     COALESCE(new.meta->>'title','')), 'A') ||
+               SETWEIGHT(TO_TSVECTOR('simple',
+                                     LEFT(COALESCE(new.text,''), 1048576)),
+                         'D');
     RETURN new;
 END
 $$ LANGUAGE plpgsql;
@@ -147,5 +221,85 @@ CREATE TRIGGER hpssix_attr_document_tsv_update
     BEFORE INSERT OR UPDATE ON hpssix_attr_document
     FOR EACH ROW EXECUTE PROCEDURE documents_search_trigger();
 
+--
+-- the full text of the documents truncated in hpssix_attr_document, if
+-- extractor.keepfull is set. it is kept out of the hot table since it is
+-- rarely read.
+--
+CREATE TABLE hpssix_attr_document_full (
+    oid BIGINT NOT NULL REFERENCES hpssix_object(oid) ON DELETE CASCADE,
+    text TEXT,
+
+    PRIMARY KEY (oid)
+);
+
+--
+-- typed attributes flattened from the document metadata by the extractor
+-- (see hpssix-docmeta.h), so that the searches can use the indexes instead of
+-- looking into the jsonb. NULL if the metadata does not have the field.
+--
+CREATE TABLE hpssix_attr_docmeta (
+    oid BIGINT NOT NULL REFERENCES hpssix_object(oid) ON DELETE CASCADE,
+    content_type TEXT,          -- lowercase, without the parameters
+    author TEXT,
+    language TEXT,              -- lowercase
+    created BIGINT,             -- seconds since the epoch
+    modified BIGINT,
+    pages INTEGER,
+
+    PRIMARY KEY (oid)
+);
+
+CREATE INDEX ix_docmeta_content_type
+    ON hpssix_attr_docmeta (content_type text_pattern_ops);
+CREATE INDEX ix_docmeta_author
+    ON hpssix_attr_docmeta (LOWER(author) text_pattern_ops);
+CREATE INDEX ix_docmeta_language ON hpssix_attr_docmeta (language);
+CREATE INDEX ix_docmeta_created ON hpssix_attr_docmeta (created);
+CREATE INDEX ix_docmeta_modified ON hpssix_attr_docmeta (modified);
+CREATE INDEX ix_docmeta_pages ON hpssix_attr_docmeta (pages);
+
+--
+-- content fingerprints of the extracted files. the builder does not hand
+-- files with the same size and mtime over to the extractor again, and the
+-- extractor compares the hash (of the first and last few KB) when only the
+-- mtime has changed (e.g., touched by hpssix-tag).
+--
+CREATE TABLE hpssix_attr_fingerprint (
+    oid BIGINT NOT NULL REFERENCES hpssix_object(oid) ON DELETE CASCADE,
+    st_size BIGINT NOT NULL,
+    st_mtime BIGINT NOT NULL,
+    hash BIGINT,                -- NULL if not computed
+
+    PRIMARY KEY (oid)
+);
+
+--
+-- files which the extractor gave up on for the deadline. the builder skips
+-- the files which timed out repeatedly, until they are modified (st_mtime).
+--
+CREATE TABLE hpssix_attr_quarantine (
+    oid BIGINT NOT NULL REFERENCES hpssix_object(oid) ON DELETE CASCADE,
+    st_mtime BIGINT NOT NULL,
+    n_timeouts INTEGER NOT NULL DEFAULT 1,
+    last_timeout TIMESTAMP NOT NULL DEFAULT now(),
+
+    PRIMARY KEY (oid)
+);
+
+--
+-- the generation of the index, a single row bumped in the same transaction
+-- as each build and each batch of documents. the search service drops its
+-- cached answers when it changes.
+--
+CREATE TABLE hpssix_generation (
+    one BOOL NOT NULL DEFAULT 't' CHECK (one),
+    n BIGINT NOT NULL,
+
+    PRIMARY KEY (one)
+);
+
+INSERT INTO hpssix_generation (n) VALUES (0);
+
 END TRANSACTION;
 
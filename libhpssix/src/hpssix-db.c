@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <sys/time.h>
 #include <libpq-fe.h>
 
 #include "hpssix-db.h"
@@ -68,6 +69,55 @@ PGresult *hpssix_db_psql_query(hpssix_db_t *self, const char *format, ...)
     return result;
 }
 
+/* fnv-1a */
+static uint64_t db_statement_hash(const char *sql)
+{
+    uint64_t hash = 0xcbf29ce484222325UL;
+
+    for (; *sql; sql++) {
+        hash ^= (unsigned char) *sql;
+        hash *= 0x100000001b3UL;
+    }
+
+    return hash;
+}
+
+PGresult *hpssix_db_exec_prepared(hpssix_db_t *self, const char *sql,
+                                  int n_params, const char * const *params)
+{
+    uint32_t i = 0;
+    uint64_t hash = db_statement_hash(sql);
+    char name[32] = { 0, };
+    PGresult *res = NULL;
+
+    sprintf(name, "hpssix_%016lx", hash);
+
+    for (i = 0; i < self->n_prepared; i++)
+        if (self->prepared[i] == hash)
+            goto execute;
+
+    /* too many shapes in a session, start over */
+    if (self->n_prepared == HPSSIX_DB_MAX_PREPARED) {
+        if (hpssix_db_psql_exec(self, "DEALLOCATE ALL"))
+            return NULL;
+
+        self->n_prepared = 0;
+    }
+
+    res = PQprepare(self->dbconn, name, sql, n_params, NULL);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        db_psql_print_error(self->logfp ? self->logfp : stderr, res);
+        return res;
+    }
+
+    PQclear(res);
+
+    self->prepared[self->n_prepared++] = hash;
+
+execute:
+    return PQexecPrepared(self->dbconn, name, n_params, params, NULL, NULL, 0);
+}
+
 int hpssix_db_connect(hpssix_db_t *self, hpssix_config_t *config)
 {
     char uri[512] = { 0, };
@@ -90,12 +140,14 @@ int hpssix_db_connect(hpssix_db_t *self, hpssix_config_t *config)
 
     conn_status = PQstatus(conn);
     if (conn_status != CONNECTION_OK) {
+        PQfinish(conn);
         errno = EIO;
         return -1;
     }
 
     self->dbconn = conn;
     self->logfp = stderr;
+    self->n_prepared = 0;
 
     return 0;
 }
@@ -177,13 +229,16 @@ int hpssix_db_delete_xattrs(hpssix_db_t *self, hpssix_xattr_t **xattrs,
     return ret;
 }
 
-int hpssix_db_index_tsv(hpssix_db_t *self, uint64_t object_id,
-                        const char *meta, const char *text)
+/* @tsv is a prepared tsvector, or NULL to be built by the trigger */
+static int db_index_document(hpssix_db_t *self, uint64_t object_id,
+                             const char *meta, const char *text,
+                             const char *tsv, uint32_t profile)
 {
     int ret = 0;
     PGresult *res = NULL;
     char *escaped_meta = NULL;
     char *escaped_text = NULL;
+    char *escaped_tsv = NULL;
 
     if (!meta)
         return EINVAL;
@@ -200,18 +255,32 @@ int hpssix_db_index_tsv(hpssix_db_t *self, uint64_t object_id,
     else
         escaped_text = "''";
 
+    if (tsv) {
+        escaped_tsv = PQescapeLiteral(self->dbconn, tsv, strlen(tsv));
+        if (!escaped_tsv)
+            return ENOMEM;
+    }
+    else
+        escaped_tsv = "NULL";
+
     res = hpssix_db_psql_query(self,
                                "INSERT INTO hpssix_attr_document\n"
-                               "  (oid, meta, text) VALUES (%lu, %s, %s)\n"
+                               "  (oid, meta, text, tsv, profile)\n"
+                               "  VALUES (%lu, %s, %s, %s::tsvector, %u)\n"
                                "ON CONFLICT (oid)\n"
                                "DO UPDATE SET\n"
-                               "  meta = EXCLUDED.meta, text = EXCLUDED.text;",
-                               object_id, escaped_meta, escaped_text);
+                               "  meta = EXCLUDED.meta, text = EXCLUDED.text,\n"
+                               "  tsv = EXCLUDED.tsv, "
+                               "profile = EXCLUDED.profile;",
+                               object_id, escaped_meta, escaped_text,
+                               escaped_tsv, profile);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         db_psql_print_error(stderr, res);
         ret = EIO;
     }
 
+    if (tsv)
+        PQfreemem(escaped_tsv);
     if (text)
         PQfreemem(escaped_text);
 
@@ -221,6 +290,119 @@ int hpssix_db_index_tsv(hpssix_db_t *self, uint64_t object_id,
     return ret;
 }
 
+int hpssix_db_index_tsv(hpssix_db_t *self, uint64_t object_id,
+                        const char *meta, const char *text)
+{
+    return db_index_document(self, object_id, meta, text, NULL, 0);
+}
+
+int hpssix_db_update_fingerprint(hpssix_db_t *self, uint64_t object_id,
+                                 uint64_t size, uint64_t mtime,
+                                 uint64_t hash)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+    char hashstr[32] = "NULL";
+
+    if (!self)
+        return EINVAL;
+
+    if (hash)
+        sprintf(hashstr, "%ld", (int64_t) hash);
+
+    res = hpssix_db_psql_query(self,
+                               "INSERT INTO hpssix_attr_fingerprint\n"
+                               "  (oid, st_size, st_mtime, hash)\n"
+                               "  VALUES (%lu, %lu, %lu, %s)\n"
+                               "ON CONFLICT (oid)\n"
+                               "DO UPDATE SET\n"
+                               "  st_size = EXCLUDED.st_size,\n"
+                               "  st_mtime = EXCLUDED.st_mtime,\n"
+                               "  hash = EXCLUDED.hash;",
+                               object_id, size, mtime, hashstr);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        db_psql_print_error(stderr, res);
+        ret = EIO;
+    }
+
+    PQclear(res);
+
+    return ret;
+}
+
+int hpssix_db_quarantine(hpssix_db_t *self, uint64_t object_id,
+                         uint64_t mtime)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+
+    if (!self)
+        return EINVAL;
+
+    res = hpssix_db_psql_query(self,
+                               "INSERT INTO hpssix_attr_quarantine\n"
+                               "  (oid, st_mtime) VALUES (%lu, %lu)\n"
+                               "ON CONFLICT (oid)\n"
+                               "DO UPDATE SET\n"
+                               "  n_timeouts = CASE\n"
+                               "    WHEN hpssix_attr_quarantine.st_mtime =\n"
+                               "         EXCLUDED.st_mtime\n"
+                               "    THEN hpssix_attr_quarantine.n_timeouts + 1\n"
+                               "    ELSE 1 END,\n"
+                               "  st_mtime = EXCLUDED.st_mtime,\n"
+                               "  last_timeout = now();",
+                               object_id, mtime);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        db_psql_print_error(stderr, res);
+        ret = EIO;
+    }
+
+    PQclear(res);
+
+    return ret;
+}
+
+int hpssix_db_index_fulltext(hpssix_db_t *self, uint64_t object_id,
+                             const char *text)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+    char *escaped_text = NULL;
+
+    if (!self)
+        return EINVAL;
+
+    if (!text) {
+        res = hpssix_db_psql_query(self,
+                                   "DELETE FROM hpssix_attr_document_full\n"
+                                   "WHERE oid = %lu;", object_id);
+        goto out;
+    }
+
+    escaped_text = PQescapeLiteral(self->dbconn, text, strlen(text));
+    if (!escaped_text)
+        return ENOMEM;
+
+    res = hpssix_db_psql_query(self,
+                               "INSERT INTO hpssix_attr_document_full\n"
+                               "  (oid, text) VALUES (%lu, %s)\n"
+                               "ON CONFLICT (oid)\n"
+                               "DO UPDATE SET text = EXCLUDED.text;",
+                               object_id, escaped_text);
+
+    PQfreemem(escaped_text);
+
+out:
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        db_psql_print_error(stderr, res);
+        ret = EIO;
+    }
+
+    PQclear(res);
+
+    return ret;
+}
+
 int hpssix_db_copy(hpssix_db_t *self, hpssix_db_copy_t *copy)
 {
     int ret = 0;
@@ -312,3 +494,624 @@ out_close:
     return ret;
 }
 
+/* @str is escaped by the caller, or NULL */
+static inline const char *sql_or_null(const char *str)
+{
+    return str ? str : "NULL";
+}
+
+static inline char *escape_or_null(hpssix_db_t *self, const char *str)
+{
+    return str ? PQescapeLiteral(self->dbconn, str, strlen(str)) : NULL;
+}
+
+static inline void docmeta_number(char *buf, int64_t val)
+{
+    if (val == HPSSIX_DOCMETA_NONE)
+        strcpy(buf, "NULL");
+    else
+        sprintf(buf, "%ld", val);
+}
+
+int hpssix_db_index_docmeta(hpssix_db_t *self, uint64_t object_id,
+                            hpssix_docmeta_t *docmeta)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+    hpssix_docmeta_t none = { 0, };
+    char *content_type = NULL;
+    char *author = NULL;
+    char *language = NULL;
+    char created[32] = { 0, };
+    char modified[32] = { 0, };
+    char pages[32] = { 0, };
+
+    if (!self)
+        return EINVAL;
+
+    if (!docmeta) {
+        hpssix_docmeta_init(&none);
+        docmeta = &none;
+    }
+
+    content_type = escape_or_null(self, docmeta->content_type);
+    author = escape_or_null(self, docmeta->author);
+    language = escape_or_null(self, docmeta->language);
+    if ((docmeta->content_type && !content_type) ||
+        (docmeta->author && !author) || (docmeta->language && !language)) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    docmeta_number(created, docmeta->created);
+    docmeta_number(modified, docmeta->modified);
+    docmeta_number(pages, docmeta->pages);
+
+    res = hpssix_db_psql_query(self,
+                               "INSERT INTO hpssix_attr_docmeta\n"
+                               "  (oid, content_type, author, language,\n"
+                               "   created, modified, pages)\n"
+                               "  VALUES (%lu, %s, %s, %s, %s, %s, %s)\n"
+                               "ON CONFLICT (oid)\n"
+                               "DO UPDATE SET\n"
+                               "  content_type = EXCLUDED.content_type,\n"
+                               "  author = EXCLUDED.author,\n"
+                               "  language = EXCLUDED.language,\n"
+                               "  created = EXCLUDED.created,\n"
+                               "  modified = EXCLUDED.modified,\n"
+                               "  pages = EXCLUDED.pages;",
+                               object_id, sql_or_null(content_type),
+                               sql_or_null(author), sql_or_null(language),
+                               created, modified, pages);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        db_psql_print_error(stderr, res);
+        ret = EIO;
+    }
+
+    PQclear(res);
+
+out:
+    if (content_type)
+        PQfreemem(content_type);
+    if (author)
+        PQfreemem(author);
+    if (language)
+        PQfreemem(language);
+
+    return ret;
+}
+
+/*
+ * document sink
+ */
+static const uint64_t docsink_default_count = 64;
+static const uint64_t docsink_default_bytes = 32*(1<<20);
+
+static const char *docsink_init_stmt =
+"CREATE TEMPORARY TABLE __document (\n"
+"    seq BIGINT,\n"
+"    oid BIGINT,\n"
+"    meta JSONB,\n"
+"    text TEXT,\n"
+"    st_size BIGINT,\n"
+"    st_mtime BIGINT,\n"
+"    hash BIGINT,\n"
+"    full_text TEXT,\n"
+"    tsv TEXT,\n"
+"    profile INTEGER,\n"
+"    content_type TEXT,\n"
+"    author TEXT,\n"
+"    language TEXT,\n"
+"    created BIGINT,\n"
+"    modified BIGINT,\n"
+"    pages INTEGER\n"
+") ON COMMIT DELETE ROWS;\n";
+
+static const char *docsink_copy_stmt =
+"COPY __document\n"
+"  (seq, oid, meta, text, st_size, st_mtime, hash, full_text, tsv, profile,\n"
+"   content_type, author, language, created, modified, pages)\n"
+"FROM STDIN;\n";
+
+/* the latest document wins if the same oid appears more than once. */
+static const char *docsink_fini_stmt =
+"INSERT INTO hpssix_attr_document (oid, meta, text, tsv, profile)\n"
+"     SELECT DISTINCT ON (oid) oid, meta, text, tsv::tsvector, profile\n"
+"       FROM __document WHERE meta IS NOT NULL ORDER BY oid, seq DESC\n"
+"ON CONFLICT (oid)\n"
+"DO UPDATE SET\n"
+"  meta = EXCLUDED.meta, text = EXCLUDED.text, tsv = EXCLUDED.tsv,\n"
+"  profile = EXCLUDED.profile;\n"
+"DELETE FROM hpssix_attr_document_full f\n"
+"      USING __document d WHERE d.oid = f.oid AND d.meta IS NOT NULL;\n"
+"INSERT INTO hpssix_attr_document_full (oid, text)\n"
+"     SELECT oid, full_text FROM (\n"
+"         SELECT DISTINCT ON (oid) oid, full_text\n"
+"           FROM __document WHERE meta IS NOT NULL ORDER BY oid, seq DESC\n"
+"     ) AS latest WHERE full_text IS NOT NULL;\n"
+"INSERT INTO hpssix_attr_docmeta\n"
+"  (oid, content_type, author, language, created, modified, pages)\n"
+"     SELECT DISTINCT ON (oid)\n"
+"            oid, content_type, author, language, created, modified, pages\n"
+"       FROM __document WHERE meta IS NOT NULL ORDER BY oid, seq DESC\n"
+"ON CONFLICT (oid)\n"
+"DO UPDATE SET\n"
+"  content_type = EXCLUDED.content_type, author = EXCLUDED.author,\n"
+"  language = EXCLUDED.language, created = EXCLUDED.created,\n"
+"  modified = EXCLUDED.modified, pages = EXCLUDED.pages;\n"
+"DELETE FROM hpssix_attr_quarantine q\n"
+"      USING __document d WHERE d.oid = q.oid;\n"
+"INSERT INTO hpssix_attr_fingerprint (oid, st_size, st_mtime, hash)\n"
+"     SELECT DISTINCT ON (oid) oid, st_size, st_mtime, hash\n"
+"       FROM __document ORDER BY oid, seq DESC\n"
+"ON CONFLICT (oid)\n"
+"DO UPDATE SET\n"
+"  st_size = EXCLUDED.st_size, st_mtime = EXCLUDED.st_mtime,\n"
+"  hash = EXCLUDED.hash;\n"
+"UPDATE hpssix_generation SET n = n + 1;\n";
+
+#define DOCSINK_CHUNK_SIZE  (64*(1<<10))
+
+struct docsink_chunk {
+    hpssix_db_t *db;
+    size_t len;
+    char buf[DOCSINK_CHUNK_SIZE];
+};
+
+static int docsink_chunk_flush(struct docsink_chunk *chunk)
+{
+    int ret = 0;
+
+    if (chunk->len == 0)
+        return 0;
+
+    ret = PQputCopyData(chunk->db->dbconn, chunk->buf, chunk->len);
+    if (ret != 1) {
+        fprintf(stderr, "PostgreSQL error: %s\n",
+                        PQerrorMessage(chunk->db->dbconn));
+        return EIO;
+    }
+
+    chunk->len = 0;
+
+    return 0;
+}
+
+static int docsink_chunk_putc(struct docsink_chunk *chunk, char ch)
+{
+    int ret = 0;
+
+    if (chunk->len + 1 > DOCSINK_CHUNK_SIZE) {
+        ret = docsink_chunk_flush(chunk);
+        if (ret)
+            return ret;
+    }
+
+    chunk->buf[chunk->len++] = ch;
+
+    return 0;
+}
+
+/*
+ * write @str in the COPY text format. the escaped string is streamed through
+ * @chunk, so that large documents are never duplicated in the memory.
+ */
+static int docsink_chunk_put(struct docsink_chunk *chunk, const char *str)
+{
+    int ret = 0;
+    char esc = 0;
+    const char *pos = NULL;
+
+    if (!str) {     /* NULL */
+        ret = docsink_chunk_putc(chunk, '\\');
+        return ret ? ret : docsink_chunk_putc(chunk, 'N');
+    }
+
+    for (pos = str; *pos != '\0'; pos++) {
+        if (chunk->len + 2 > DOCSINK_CHUNK_SIZE) {
+            ret = docsink_chunk_flush(chunk);
+            if (ret)
+                return ret;
+        }
+
+        switch (*pos) {
+        case '\\':
+            esc = '\\';
+            break;
+        case '\n':
+            esc = 'n';
+            break;
+        case '\r':
+            esc = 'r';
+            break;
+        case '\t':
+            esc = 't';
+            break;
+        default:
+            esc = 0;
+            break;
+        }
+
+        if (esc) {
+            chunk->buf[chunk->len++] = '\\';
+            chunk->buf[chunk->len++] = esc;
+        }
+        else
+            chunk->buf[chunk->len++] = *pos;
+    }
+
+    return 0;
+}
+
+static int docsink_put_number(struct docsink_chunk *chunk, int64_t val)
+{
+    char numbuf[32] = { 0, };
+
+    if (val == HPSSIX_DOCMETA_NONE)
+        return docsink_chunk_put(chunk, NULL);
+
+    sprintf(numbuf, "%ld", val);
+
+    return docsink_chunk_put(chunk, numbuf);
+}
+
+/* content_type, author, language, created, modified and pages */
+static int docsink_put_docmeta(struct docsink_chunk *chunk,
+                               hpssix_docmeta_t *docmeta)
+{
+    int ret = 0;
+    hpssix_docmeta_t none = { 0, };
+
+    if (!docmeta) {
+        hpssix_docmeta_init(&none);
+        docmeta = &none;
+    }
+
+    ret = docsink_chunk_put(chunk, docmeta->content_type);
+    ret |= docsink_chunk_putc(chunk, '\t');
+    ret |= docsink_chunk_put(chunk, docmeta->author);
+    ret |= docsink_chunk_putc(chunk, '\t');
+    ret |= docsink_chunk_put(chunk, docmeta->language);
+    ret |= docsink_chunk_putc(chunk, '\t');
+    ret |= docsink_put_number(chunk, docmeta->created);
+    ret |= docsink_chunk_putc(chunk, '\t');
+    ret |= docsink_put_number(chunk, docmeta->modified);
+    ret |= docsink_chunk_putc(chunk, '\t');
+    ret |= docsink_put_number(chunk, docmeta->pages);
+
+    return ret;
+}
+
+static int docsink_copy(hpssix_db_docsink_t *self)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    char numbuf[64] = { 0, };
+    struct docsink_chunk *chunk = NULL;
+
+    chunk = malloc(sizeof(*chunk));
+    if (!chunk)
+        return ENOMEM;
+
+    chunk->db = self->db;
+    chunk->len = 0;
+
+    ret = hpssix_db_copy_init(self->db, docsink_copy_stmt);
+    if (ret)
+        goto out;
+
+    for (i = 0; i < self->count; i++) {
+        hpssix_db_document_t *doc = &self->docs[i];
+
+        sprintf(numbuf, "%lu\t%lu\t", i, doc->oid);
+
+        ret = docsink_chunk_put(chunk, numbuf);
+        ret |= docsink_chunk_put(chunk, doc->meta);
+        ret |= docsink_chunk_putc(chunk, '\t');
+        ret |= docsink_chunk_put(chunk, doc->text);
+
+        sprintf(numbuf, "\t%lu\t%lu\t", doc->size, doc->mtime);
+        ret |= docsink_chunk_put(chunk, numbuf);
+        if (doc->hash) {
+            sprintf(numbuf, "%ld", (int64_t) doc->hash);
+            ret |= docsink_chunk_put(chunk, numbuf);
+        }
+        else
+            ret |= docsink_chunk_put(chunk, NULL);
+        ret |= docsink_chunk_putc(chunk, '\t');
+        ret |= docsink_chunk_put(chunk, doc->full);
+        ret |= docsink_chunk_putc(chunk, '\t');
+        ret |= docsink_chunk_put(chunk, doc->tsv);
+        sprintf(numbuf, "\t%u\t", self->profile);
+        ret |= docsink_chunk_put(chunk, numbuf);
+        ret |= docsink_put_docmeta(chunk, doc->docmeta);
+        ret |= docsink_chunk_putc(chunk, '\n');
+        if (ret) {
+            ret = EIO;
+            break;
+        }
+    }
+
+    if (!ret)
+        ret = docsink_chunk_flush(chunk);
+
+    if (ret)
+        hpssix_db_copy_end(self->db, 1);
+    else
+        ret = hpssix_db_copy_end(self->db, 0);
+
+out:
+    free(chunk);
+
+    return ret;
+}
+
+static void docsink_clear(hpssix_db_docsink_t *self)
+{
+    uint64_t i = 0;
+
+    for (i = 0; i < self->count; i++) {
+        free(self->docs[i].meta);
+        free(self->docs[i].text);
+        free(self->docs[i].full);
+        free(self->docs[i].tsv);
+
+        if (self->docs[i].docmeta) {
+            hpssix_docmeta_free(self->docs[i].docmeta);
+            free(self->docs[i].docmeta);
+        }
+    }
+
+    self->count = 0;
+    self->bytes = 0;
+}
+
+int hpssix_db_docsink_init(hpssix_db_docsink_t *self, hpssix_db_t *db,
+                           uint64_t max_count, uint64_t max_bytes)
+{
+    int ret = 0;
+
+    if (!self || !db)
+        return EINVAL;
+
+    memset((void *) self, 0, sizeof(*self));
+
+    self->db = db;
+    self->max_count = max_count ? max_count : docsink_default_count;
+    self->max_bytes = max_bytes ? max_bytes : docsink_default_bytes;
+
+    self->docs = calloc(self->max_count, sizeof(*self->docs));
+    if (!self->docs)
+        return ENOMEM;
+
+    ret = hpssix_db_psql_exec(db, docsink_init_stmt);
+    if (ret) {
+        free(self->docs);
+        self->docs = NULL;
+    }
+
+    return ret;
+}
+
+int hpssix_db_docsink_flush(hpssix_db_docsink_t *self)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    struct timeval before = { 0, };
+    struct timeval after = { 0, };
+
+    if (!self)
+        return EINVAL;
+
+    if (self->count == 0)
+        return 0;
+
+    gettimeofday(&before, NULL);
+    self->bytes_flushed += self->bytes;
+
+    ret = hpssix_db_begin_transaction(self->db);
+    if (ret)
+        goto out_clear;
+
+    ret = docsink_copy(self);
+    if (!ret)
+        ret = hpssix_db_psql_exec(self->db, docsink_fini_stmt);
+
+    if (!ret)
+        ret = hpssix_db_end_transaction(self->db);
+
+    if (!ret) {
+        for (i = 0; i < self->count; i++) {
+            if (self->docs[i].meta)
+                self->n_flushed++;
+            else
+                self->n_fingerprints++;
+
+            if (self->flushed)
+                self->flushed(&self->docs[i], self->flushed_arg);
+        }
+        goto out_clear;
+    }
+
+    /* fall back to the slow path, document by document */
+    hpssix_db_rollback(self->db);
+
+    self->n_fallbacks++;
+
+    ret = 0;
+
+    for (i = 0; i < self->count; i++) {
+        hpssix_db_document_t *doc = &self->docs[i];
+
+        if (doc->meta &&
+            (db_index_document(self->db, doc->oid, doc->meta, doc->text,
+                               doc->tsv, self->profile) ||
+             hpssix_db_index_fulltext(self->db, doc->oid, doc->full) ||
+             hpssix_db_index_docmeta(self->db, doc->oid, doc->docmeta))) {
+            self->n_failed++;
+            ret = EIO;
+            continue;
+        }
+
+        if (hpssix_db_update_fingerprint(self->db, doc->oid, doc->size,
+                                         doc->mtime, doc->hash))
+            ret = EIO;
+
+        if (doc->meta)
+            self->n_flushed++;
+        else
+            self->n_fingerprints++;
+
+        if (self->flushed)
+            self->flushed(doc, self->flushed_arg);
+    }
+
+    if (hpssix_db_bump_generation(self->db))
+        ret = EIO;
+
+out_clear:
+    docsink_clear(self);
+
+    gettimeofday(&after, NULL);
+    self->flush_sec += (after.tv_sec - before.tv_sec) +
+                       (after.tv_usec - before.tv_usec)/1e6;
+
+    return ret;
+}
+
+/* how far a cut can move to find a word boundary */
+static const uint64_t docsink_word_slack = 64;
+
+static const char *docsink_cut_marker = "\n[...]\n";
+
+static inline int is_utf8_cont(char ch)
+{
+    return (ch & 0xc0) == 0x80;
+}
+
+static inline int is_word_sep(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+}
+
+/*
+ * cut @doc->text down to its head and tail. the original text is moved to
+ * @doc->full if the sink keeps the full text, freed otherwise.
+ */
+static int docsink_truncate(hpssix_db_docsink_t *self,
+                            hpssix_db_document_t *doc)
+{
+    char *text = doc->text;
+    char *truncated = NULL;
+    uint64_t len = 0;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    uint64_t i = 0;
+
+    if (!text || !(self->text_head || self->text_tail))
+        return 0;
+
+    len = strlen(text);
+    if (len <= self->text_head + self->text_tail)
+        return 0;
+
+    /* the head ends before a word separator, and at a character boundary */
+    head = self->text_head;
+    for (i = 0; i < docsink_word_slack && i < head; i++)
+        if (is_word_sep(text[head - i]))
+            break;
+    if (i < docsink_word_slack && i < head)
+        head -= i;
+    while (head > 0 && is_utf8_cont(text[head]))
+        head--;
+
+    /* the tail starts after a word separator */
+    tail = len - self->text_tail;
+    for (i = 0; i < docsink_word_slack && tail + i < len; i++)
+        if (is_word_sep(text[tail + i - 1]))
+            break;
+    if (i < docsink_word_slack && tail + i < len)
+        tail += i;
+    while (tail < len && is_utf8_cont(text[tail]))
+        tail++;
+
+    truncated = malloc(head + strlen(docsink_cut_marker) + (len - tail) + 1);
+    if (!truncated)
+        return ENOMEM;
+
+    memcpy(truncated, text, head);
+    strcpy(&truncated[head], docsink_cut_marker);
+    strcat(&truncated[head], &text[tail]);
+
+    self->n_truncated++;
+    self->bytes_truncated += tail - head;
+
+    doc->text = truncated;
+
+    if (self->keep_full)
+        doc->full = text;
+    else
+        free(text);
+
+    return 0;
+}
+
+static void docsink_build_tsv(hpssix_db_docsink_t *self,
+                              hpssix_db_document_t *doc)
+{
+    char *title = hpssix_tsv_meta_title(doc->meta);
+
+    if (hpssix_tsv_build(title, doc->text, &doc->tsv) == 0)
+        self->n_client_tsv++;
+
+    free(title);
+}
+
+int hpssix_db_docsink_append(hpssix_db_docsink_t *self,
+                             hpssix_db_document_t *doc)
+{
+    if (!self || !doc)
+        return EINVAL;
+
+    /* the text is stored as is, if it cannot be truncated */
+    doc->full = NULL;
+    docsink_truncate(self, doc);
+
+    /* the trigger builds the tsvector, if it cannot be prepared here */
+    doc->tsv = NULL;
+    if (self->client_tsv && doc->meta)
+        docsink_build_tsv(self, doc);
+
+    self->docs[self->count++] = *doc;
+
+    if (doc->meta)
+        self->bytes += strlen(doc->meta);
+    if (doc->text)
+        self->bytes += strlen(doc->text);
+    if (doc->full)
+        self->bytes += strlen(doc->full);
+    if (doc->tsv)
+        self->bytes += strlen(doc->tsv);
+
+    if (self->count >= self->max_count || self->bytes >= self->max_bytes)
+        return hpssix_db_docsink_flush(self);
+
+    return 0;
+}
+
+int hpssix_db_docsink_fini(hpssix_db_docsink_t *self)
+{
+    int ret = 0;
+
+    if (!self)
+        return EINVAL;
+
+    if (self->docs) {
+        ret = hpssix_db_docsink_flush(self);
+        free(self->docs);
+        self->docs = NULL;
+    }
+
+    return ret;
+}
+
@@ -21,10 +21,17 @@
 #include <libpq-fe.h>
 
 #include "hpssix.h"
+#include "hpssix-docmeta.h"
+
+/* the statements prepared in a session, see hpssix_db_exec_prepared() */
+#define HPSSIX_DB_MAX_PREPARED      64
 
 struct _hpssix_db {
     PGconn *dbconn;
     FILE *logfp;
+
+    uint32_t n_prepared;
+    uint64_t prepared[HPSSIX_DB_MAX_PREPARED];  /* hashes of the statements */
 };
 
 typedef struct _hpssix_db hpssix_db_t;
@@ -142,6 +149,21 @@ static inline int hpssix_db_psql_exec(hpssix_db_t *self, const char *command)
  */
 PGresult *hpssix_db_psql_query(hpssix_db_t *self, const char *format, ...);
 
+/**
+ * @brief run @sql with the parameters, as a prepared statement. the statement
+ * is named by the hash of @sql, and prepared only at the first use in the
+ * session, so that the repeated queries skip the parsing and planning.
+ *
+ * @param self
+ * @param sql
+ * @param n_params
+ * @param params the values in the text format, NULL for SQL null.
+ *
+ * @return the result, which should be cleared by the caller.
+ */
+PGresult *hpssix_db_exec_prepared(hpssix_db_t *self, const char *sql,
+                                  int n_params, const char * const *params);
+
 static inline int hpssix_db_copy_init(hpssix_db_t *self, const char *command)
 {
     int ret = 0;
@@ -294,6 +316,21 @@ static inline int hpssix_db_rollback(hpssix_db_t *self)
     return hpssix_db_psql_exec(self, "ABORT;");
 }
 
+/**
+ * @brief bump the generation of the index (hpssix_generation), in the
+ * transaction which changes the index, so that the cached searches are not
+ * served across the commit.
+ *
+ * @param self
+ *
+ * @return 0 on success, EIO.
+ */
+static inline int hpssix_db_bump_generation(hpssix_db_t *self)
+{
+    return hpssix_db_psql_exec(self,
+                               "UPDATE hpssix_generation SET n = n + 1;");
+}
+
 /**
  * @brief
  *
@@ -331,5 +368,177 @@ int hpssix_db_delete_xattrs(hpssix_db_t *self, hpssix_xattr_t **xattrs,
 int hpssix_db_index_tsv(hpssix_db_t *self, uint64_t object_id,
                         const char *meta, const char *text);
 
+/**
+ * @brief insert or update the content fingerprint of an object.
+ *
+ * @param self
+ * @param object_id
+ * @param size
+ * @param mtime
+ * @param hash 0 if not computed (stored as NULL).
+ *
+ * @return 0 on success, errno otherwise
+ */
+int hpssix_db_update_fingerprint(hpssix_db_t *self, uint64_t object_id,
+                                 uint64_t size, uint64_t mtime,
+                                 uint64_t hash);
+
+/**
+ * @brief count a timeout of the extraction of an object. the count starts
+ * over if the object has been modified since the last timeout.
+ *
+ * @param self
+ * @param object_id
+ * @param mtime
+ *
+ * @return 0 on success, errno otherwise
+ */
+int hpssix_db_quarantine(hpssix_db_t *self, uint64_t object_id,
+                         uint64_t mtime);
+
+/**
+ * @brief store the full text of a truncated document in
+ * hpssix_attr_document_full.
+ *
+ * @param self
+ * @param object_id
+ * @param text NULL to remove the full text, e.g., when the document is not
+ * truncated anymore.
+ *
+ * @return 0 on success, errno otherwise
+ */
+int hpssix_db_index_fulltext(hpssix_db_t *self, uint64_t object_id,
+                             const char *text);
+
+/**
+ * @brief store the typed attributes of a document in hpssix_attr_docmeta.
+ *
+ * @param self
+ * @param object_id
+ * @param docmeta NULL to store none of the attributes.
+ *
+ * @return 0 on success, errno otherwise
+ */
+int hpssix_db_index_docmeta(hpssix_db_t *self, uint64_t object_id,
+                            hpssix_docmeta_t *docmeta);
+
+/*
+ * document sink: buffers the extracted documents and writes them in batches.
+ * each flush copies the buffered documents into a temporary staging table
+ * and upserts hpssix_attr_document with a single statement. a sink uses its
+ * own temporary table, thus only one sink can be used per connection.
+ *
+ * the content fingerprint (hpssix_attr_fingerprint) of each document is
+ * written along with the document. a document without @meta only updates the
+ * fingerprint, e.g., when the extractor finds the content unchanged.
+ *
+ * if @text_head or @text_tail is set, a text longer than their sum is cut
+ * down to its head and tail (at utf-8 character and word boundaries) before
+ * it is buffered. the full text then goes to hpssix_attr_document_full if
+ * @keep_full is set, or is dropped otherwise.
+ *
+ * with @client_tsv, the tsvector is built by hpssix_tsv_build() in the
+ * appending thread, and the database stores it without running to_tsvector().
+ *
+ * the typed attributes in @docmeta, if set, go to hpssix_attr_docmeta.
+ */
+struct _hpssix_db_document {
+    uint64_t oid;
+    char *meta;
+    char *text;
+    char *full;             /* set by the sink if @text is truncated */
+    char *tsv;              /* set by the sink with @client_tsv */
+    hpssix_docmeta_t *docmeta;  /* malloc(3)ed, NULL if not flattened */
+
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t hash;          /* 0 if not computed */
+
+    uint64_t tag;           /* not stored, passed back to @flushed */
+};
+
+typedef struct _hpssix_db_document hpssix_db_document_t;
+
+struct _hpssix_db_docsink {
+    hpssix_db_t *db;
+
+    uint64_t max_count;     /* flush when this many documents are buffered */
+    uint64_t max_bytes;     /* flush when the buffered data exceeds this */
+
+    uint64_t text_head;     /* bytes kept from the head, 0 for no cap */
+    uint64_t text_tail;     /* bytes kept from the tail */
+    int keep_full;          /* keep the truncated full text aside */
+    int client_tsv;         /* prepare the tsvector here, not in the trigger */
+    uint32_t profile;       /* extraction profile stamped on the documents */
+
+    uint64_t count;
+    uint64_t bytes;
+    hpssix_db_document_t *docs;
+
+    uint64_t n_flushed;     /* number of documents written so far */
+    uint64_t n_fingerprints;    /* fingerprint-only updates written */
+    uint64_t n_truncated;   /* documents truncated */
+    uint64_t bytes_truncated;   /* bytes cut off from the stored text */
+    uint64_t n_client_tsv;  /* tsvectors prepared by the sink */
+    uint64_t bytes_flushed; /* buffered bytes handed to the database */
+    double flush_sec;       /* time spent in the flushes */
+
+    /* called for each document written to the database, if set */
+    void (*flushed)(hpssix_db_document_t *doc, void *arg);
+    void *flushed_arg;
+    uint64_t n_failed;      /* number of documents failed to be written */
+    uint64_t n_fallbacks;   /* batches written document by document */
+};
+
+typedef struct _hpssix_db_docsink hpssix_db_docsink_t;
+
+/**
+ * @brief initialize the document sink and create the staging table.
+ *
+ * @param self
+ * @param db
+ * @param max_count 0 to use the default (64).
+ * @param max_bytes 0 to use the default (32MB).
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_db_docsink_init(hpssix_db_docsink_t *self, hpssix_db_t *db,
+                           uint64_t max_count, uint64_t max_bytes);
+
+/**
+ * @brief append a document to the sink. the sink takes the ownership of
+ * @doc->meta, @doc->text and @doc->docmeta, which should be allocated by
+ * malloc(3). the buffered documents are flushed when either of the thresholds
+ * is reached.
+ *
+ * @param self
+ * @param doc @doc->meta can be NULL to only update the fingerprint, and
+ * @doc->text can be NULL.
+ *
+ * @return 0 on success, errno otherwise (from the flush).
+ */
+int hpssix_db_docsink_append(hpssix_db_docsink_t *self,
+                             hpssix_db_document_t *doc);
+
+/**
+ * @brief write all buffered documents to the database. if the batch fails,
+ * e.g., with a malformed metadata, the documents are written one by one so
+ * that a single bad document does not drop the whole batch.
+ *
+ * @param self
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_db_docsink_flush(hpssix_db_docsink_t *self);
+
+/**
+ * @brief flush the remaining documents and release the sink.
+ *
+ * @param self
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_db_docsink_fini(hpssix_db_docsink_t *self);
+
 #endif  /* HPSSIX_DB_H */
 
@@ -0,0 +1,586 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "hpssix-docmeta.h"
+
+struct docmeta_key {
+    const char *name;
+    int field;
+};
+
+/* in the order of the preference for each field */
+static const struct docmeta_key docmeta_keys[] = {
+    { "Content-Type", HPSSIX_DOCMETA_CONTENT_TYPE },
+    { "dc:creator", HPSSIX_DOCMETA_AUTHOR },
+    { "meta:author", HPSSIX_DOCMETA_AUTHOR },
+    { "Author", HPSSIX_DOCMETA_AUTHOR },
+    { "creator", HPSSIX_DOCMETA_AUTHOR },
+    { "dc:language", HPSSIX_DOCMETA_LANGUAGE },
+    { "language", HPSSIX_DOCMETA_LANGUAGE },
+    { "dcterms:created", HPSSIX_DOCMETA_CREATED },
+    { "meta:creation-date", HPSSIX_DOCMETA_CREATED },
+    { "Creation-Date", HPSSIX_DOCMETA_CREATED },
+    { "created", HPSSIX_DOCMETA_CREATED },
+    { "dcterms:modified", HPSSIX_DOCMETA_MODIFIED },
+    { "Last-Modified", HPSSIX_DOCMETA_MODIFIED },
+    { "modified", HPSSIX_DOCMETA_MODIFIED },
+    { "xmpTPg:NPages", HPSSIX_DOCMETA_PAGES },
+    { "meta:page-count", HPSSIX_DOCMETA_PAGES },
+    { "Page-Count", HPSSIX_DOCMETA_PAGES },
+};
+
+static const int n_docmeta_keys = sizeof(docmeta_keys)/sizeof(*docmeta_keys);
+
+enum {
+    DOCMETA_ST_VALUE = 0,   /* between the tokens */
+    DOCMETA_ST_STRING,
+    DOCMETA_ST_ESCAPE,
+    DOCMETA_ST_UNICODE,
+    DOCMETA_ST_SCALAR,      /* numbers, true, false and null */
+    DOCMETA_ST_DONE,        /* the object is closed */
+};
+
+enum {
+    DOCMETA_CAPTURE_NONE = 0,
+    DOCMETA_CAPTURE_KEY,
+    DOCMETA_CAPTURE_VALUE,
+};
+
+void hpssix_docmeta_init(hpssix_docmeta_t *docmeta)
+{
+    memset((void *) docmeta, 0, sizeof(*docmeta));
+
+    docmeta->created = HPSSIX_DOCMETA_NONE;
+    docmeta->modified = HPSSIX_DOCMETA_NONE;
+    docmeta->pages = HPSSIX_DOCMETA_NONE;
+}
+
+void hpssix_docmeta_free(hpssix_docmeta_t *docmeta)
+{
+    if (!docmeta)
+        return;
+
+    free(docmeta->content_type);
+    free(docmeta->author);
+    free(docmeta->language);
+
+    hpssix_docmeta_init(docmeta);
+}
+
+void hpssix_docmeta_parser_init(hpssix_docmeta_parser_t *parser,
+                                hpssix_docmeta_t *docmeta)
+{
+    int i = 0;
+
+    memset((void *) parser, 0, sizeof(*parser));
+
+    parser->docmeta = docmeta;
+    parser->field = -1;
+
+    for (i = 0; i < N_HPSSIX_DOCMETA; i++)
+        parser->rank_taken[i] = INT_MAX;
+
+    hpssix_docmeta_init(docmeta);
+}
+
+static inline int is_space(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+}
+
+static inline int is_utf8_cont(char ch)
+{
+    return (ch & 0xc0) == 0x80;
+}
+
+static inline int hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+static inline void put_char(hpssix_docmeta_parser_t *parser, char ch)
+{
+    if (parser->capture && parser->len < HPSSIX_DOCMETA_MAX_VALUE)
+        parser->buf[parser->len++] = ch;
+}
+
+/* surrogates are not paired, they are replaced */
+static void put_unicode(hpssix_docmeta_parser_t *parser, uint32_t cp)
+{
+    if (cp >= 0xd800 && cp <= 0xdfff)
+        cp = '?';
+
+    if (cp < 0x80)
+        put_char(parser, cp);
+    else if (cp < 0x800) {
+        put_char(parser, 0xc0 | (cp >> 6));
+        put_char(parser, 0x80 | (cp & 0x3f));
+    }
+    else {
+        put_char(parser, 0xe0 | (cp >> 12));
+        put_char(parser, 0x80 | ((cp >> 6) & 0x3f));
+        put_char(parser, 0x80 | (cp & 0x3f));
+    }
+}
+
+/* terminate the buffer, not leaving a partial character behind */
+static char *finish_buf(hpssix_docmeta_parser_t *parser)
+{
+    if (parser->len == HPSSIX_DOCMETA_MAX_VALUE) {
+        uint32_t len = parser->len;
+        unsigned char lead = 0;
+        uint32_t seqlen = 0;
+
+        while (len > 0 && is_utf8_cont(parser->buf[len - 1]))
+            len--;
+
+        if (len > 0 && parser->buf[len - 1] & 0x80) {
+            lead = parser->buf[len - 1];
+            seqlen = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+
+            /* the last character is cut */
+            if (parser->len - (len - 1) < seqlen)
+                parser->len = len - 1;
+        }
+    }
+
+    parser->buf[parser->len] = '\0';
+
+    return parser->buf;
+}
+
+static inline int is_wanted(hpssix_docmeta_parser_t *parser)
+{
+    if (parser->field < 0)
+        return 0;
+
+    if (parser->depth == 1)
+        return !parser->expect_key;
+
+    return parser->depth == 2 && parser->in_array && !parser->taken;
+}
+
+static void lookup_key(hpssix_docmeta_parser_t *parser, const char *key)
+{
+    int i = 0;
+
+    parser->field = -1;
+
+    for (i = 0; i < n_docmeta_keys; i++) {
+        if (strcmp(key, docmeta_keys[i].name) == 0) {
+            parser->field = docmeta_keys[i].field;
+            parser->rank = i;
+            return;
+        }
+    }
+}
+
+static char *dup_trimmed(const char *str, int lower)
+{
+    char *pos = NULL;
+    char *dup = NULL;
+    size_t len = 0;
+
+    while (is_space(*str))
+        str++;
+
+    len = strlen(str);
+    while (len > 0 && is_space(str[len - 1]))
+        len--;
+
+    if (len == 0)
+        return NULL;
+
+    dup = strndup(str, len);
+    if (dup && lower)
+        for (pos = dup; *pos; pos++)
+            if (*pos >= 'A' && *pos <= 'Z')
+                *pos += 'a' - 'A';
+
+    return dup;
+}
+
+static int64_t parse_count(const char *str)
+{
+    char *end = NULL;
+    long long val = 0;
+
+    while (is_space(*str))
+        str++;
+
+    if (*str < '0' || *str > '9')
+        return HPSSIX_DOCMETA_NONE;
+
+    val = strtoll(str, &end, 10);
+    if (*end != '\0' && !is_space(*end))
+        return HPSSIX_DOCMETA_NONE;
+
+    return val;
+}
+
+static int set_string(char **field, char *str)
+{
+    if (!str)
+        return 0;
+
+    free(*field);
+    *field = str;
+
+    return 1;
+}
+
+static int set_number(int64_t *field, int64_t val)
+{
+    if (val == HPSSIX_DOCMETA_NONE)
+        return 0;
+
+    *field = val;
+
+    return 1;
+}
+
+/* a value found earlier under a preferred key is kept */
+static void take_value(hpssix_docmeta_parser_t *parser, char *value)
+{
+    int taken = 0;
+    char *pos = NULL;
+    hpssix_docmeta_t *docmeta = parser->docmeta;
+
+    if (parser->rank >= parser->rank_taken[parser->field])
+        return;
+
+    switch (parser->field) {
+    case HPSSIX_DOCMETA_CONTENT_TYPE:
+        pos = strchr(value, ';');
+        if (pos)
+            *pos = '\0';
+        taken = set_string(&docmeta->content_type, dup_trimmed(value, 1));
+        break;
+
+    case HPSSIX_DOCMETA_AUTHOR:
+        taken = set_string(&docmeta->author, dup_trimmed(value, 0));
+        break;
+
+    case HPSSIX_DOCMETA_LANGUAGE:
+        taken = set_string(&docmeta->language, dup_trimmed(value, 1));
+        break;
+
+    case HPSSIX_DOCMETA_CREATED:
+        taken = set_number(&docmeta->created,
+                           hpssix_docmeta_parse_date(value));
+        break;
+
+    case HPSSIX_DOCMETA_MODIFIED:
+        taken = set_number(&docmeta->modified,
+                           hpssix_docmeta_parse_date(value));
+        break;
+
+    case HPSSIX_DOCMETA_PAGES:
+        taken = set_number(&docmeta->pages, parse_count(value));
+        break;
+
+    default:
+        break;
+    }
+
+    if (taken)
+        parser->rank_taken[parser->field] = parser->rank;
+}
+
+static void end_token(hpssix_docmeta_parser_t *parser, int scalar)
+{
+    char *str = NULL;
+
+    if (parser->capture == DOCMETA_CAPTURE_NONE)
+        return;
+
+    str = finish_buf(parser);
+
+    if (parser->capture == DOCMETA_CAPTURE_KEY)
+        lookup_key(parser, str);
+    else if (!scalar || strcmp(str, "null"))
+        take_value(parser, str);
+
+    if (parser->capture == DOCMETA_CAPTURE_VALUE && parser->in_array)
+        parser->taken = 1;
+
+    parser->capture = DOCMETA_CAPTURE_NONE;
+}
+
+static int start_token(hpssix_docmeta_parser_t *parser)
+{
+    if (parser->depth == 0)
+        return EINVAL;      /* not an object */
+
+    if (parser->depth == 1 && parser->expect_key)
+        parser->capture = DOCMETA_CAPTURE_KEY;
+    else if (is_wanted(parser))
+        parser->capture = DOCMETA_CAPTURE_VALUE;
+    else
+        parser->capture = DOCMETA_CAPTURE_NONE;
+
+    parser->len = 0;
+
+    return 0;
+}
+
+static int feed_value(hpssix_docmeta_parser_t *parser, char ch)
+{
+    if (is_space(ch))
+        return 0;
+
+    switch (ch) {
+    case '{':
+        if (parser->depth++ == 0)
+            parser->expect_key = 1;
+        break;
+
+    case '[':
+        if (parser->depth == 0)
+            return EINVAL;
+        if (parser->depth++ == 1 && parser->field >= 0) {
+            parser->in_array = 1;
+            parser->taken = 0;
+        }
+        break;
+
+    case '}':
+    case ']':
+        if (parser->depth == 0)
+            return EINVAL;
+        if (--parser->depth == 1)
+            parser->in_array = 0;
+        else if (parser->depth == 0)
+            parser->state = DOCMETA_ST_DONE;
+        break;
+
+    case ':':
+        if (parser->depth == 1)
+            parser->expect_key = 0;
+        break;
+
+    case ',':
+        if (parser->depth == 1) {
+            parser->expect_key = 1;
+            parser->field = -1;
+            parser->in_array = 0;
+        }
+        break;
+
+    case '"':
+        if (start_token(parser))
+            return EINVAL;
+        parser->state = DOCMETA_ST_STRING;
+        break;
+
+    default:
+        if (start_token(parser))
+            return EINVAL;
+        put_char(parser, ch);
+        parser->state = DOCMETA_ST_SCALAR;
+        break;
+    }
+
+    return 0;
+}
+
+static int feed_char(hpssix_docmeta_parser_t *parser, char ch)
+{
+    int hex = 0;
+
+    switch (parser->state) {
+    case DOCMETA_ST_VALUE:
+        return feed_value(parser, ch);
+
+    case DOCMETA_ST_STRING:
+        if (ch == '\\')
+            parser->state = DOCMETA_ST_ESCAPE;
+        else if (ch == '"') {
+            end_token(parser, 0);
+            parser->state = DOCMETA_ST_VALUE;
+        }
+        else
+            put_char(parser, ch);
+        break;
+
+    case DOCMETA_ST_ESCAPE:
+        parser->state = DOCMETA_ST_STRING;
+
+        switch (ch) {
+        case 'n':
+            put_char(parser, '\n');
+            break;
+        case 't':
+            put_char(parser, '\t');
+            break;
+        case 'r':
+            put_char(parser, '\r');
+            break;
+        case 'b':
+            put_char(parser, '\b');
+            break;
+        case 'f':
+            put_char(parser, '\f');
+            break;
+        case 'u':
+            parser->unicode = 0;
+            parser->n_hex = 0;
+            parser->state = DOCMETA_ST_UNICODE;
+            break;
+        default:    /* ", \ and / */
+            put_char(parser, ch);
+            break;
+        }
+        break;
+
+    case DOCMETA_ST_UNICODE:
+        hex = hex_value(ch);
+        if (hex < 0)
+            return EINVAL;
+
+        parser->unicode = (parser->unicode << 4) | hex;
+        if (++parser->n_hex == 4) {
+            put_unicode(parser, parser->unicode);
+            parser->state = DOCMETA_ST_STRING;
+        }
+        break;
+
+    case DOCMETA_ST_SCALAR:
+        if (is_space(ch) || ch == ',' || ch == '}' || ch == ']' ||
+            ch == ':') {
+            end_token(parser, 1);
+            parser->state = DOCMETA_ST_VALUE;
+            return feed_value(parser, ch);
+        }
+
+        put_char(parser, ch);
+        break;
+
+    case DOCMETA_ST_DONE:
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+int hpssix_docmeta_parser_feed(hpssix_docmeta_parser_t *parser,
+                               const char *buf, uint64_t len)
+{
+    uint64_t i = 0;
+
+    if (!parser || !buf)
+        return EINVAL;
+
+    for (i = 0; i < len && !parser->error; i++)
+        parser->error = feed_char(parser, buf[i]);
+
+    return parser->error;
+}
+
+int hpssix_docmeta_parse(const char *meta, hpssix_docmeta_t *docmeta)
+{
+    hpssix_docmeta_parser_t parser;
+
+    if (!meta || !docmeta)
+        return EINVAL;
+
+    hpssix_docmeta_parser_init(&parser, docmeta);
+
+    return hpssix_docmeta_parser_feed(&parser, meta, strlen(meta));
+}
+
+/* days since 1970-01-01 in the proleptic gregorian calendar */
+static int64_t days_from_civil(int64_t y, int64_t m, int64_t d)
+{
+    int64_t era = 0;
+    int64_t yoe = 0;
+    int64_t doy = 0;
+    int64_t doe = 0;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399)/400;
+    yoe = y - era*400;
+    doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + d - 1;
+    doe = yoe*365 + yoe/4 - yoe/100 + doy;
+
+    return era*146097 + doe - 719468;
+}
+
+int64_t hpssix_docmeta_parse_date(const char *str)
+{
+    int n = 0;
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    int hour = 0;
+    int min = 0;
+    int sec = 0;
+    int tzhour = 0;
+    int tzmin = 0;
+    int64_t offset = 0;
+    const char *pos = NULL;
+
+    if (!str)
+        return HPSSIX_DOCMETA_NONE;
+
+    if (sscanf(str, "%4d-%2d-%2d%n", &year, &month, &day, &n) != 3 ||
+        month < 1 || month > 12 || day < 1 || day > 31)
+        return HPSSIX_DOCMETA_NONE;
+
+    pos = &str[n];
+
+    if (*pos == 'T' || *pos == ' ') {
+        if (sscanf(pos + 1, "%2d:%2d%n", &hour, &min, &n) != 2)
+            return HPSSIX_DOCMETA_NONE;
+        pos += 1 + n;
+
+        if (*pos == ':') {
+            if (sscanf(pos + 1, "%2d%n", &sec, &n) != 1)
+                return HPSSIX_DOCMETA_NONE;
+            pos += 1 + n;
+        }
+
+        if (*pos == '.')    /* the fraction of a second */
+            for (pos++; *pos >= '0' && *pos <= '9'; pos++)
+                ;
+
+        if (*pos == '+' || *pos == '-') {
+            n = sscanf(pos + 1, strchr(pos, ':') ? "%2d:%2d" : "%2d%2d",
+                       &tzhour, &tzmin);
+            if (n < 1)
+                return HPSSIX_DOCMETA_NONE;
+
+            offset = tzhour*3600 + tzmin*60;
+            if (*pos == '-')
+                offset = -offset;
+        }
+
+        if (hour > 23 || min > 59 || sec > 60)
+            return HPSSIX_DOCMETA_NONE;
+    }
+
+    return days_from_civil(year, month, day)*86400 +
+           hour*3600 + min*60 + sec - offset;
+}
+
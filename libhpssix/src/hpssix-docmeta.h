@@ -0,0 +1,127 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * typed document attributes (hpssix_attr_docmeta), flattened from the tika
+ * metadata json. the parser is fed with the response as it arrives, and only
+ * keeps the top-level fields it knows, so the json is never parsed as a
+ * whole. tika names a field differently by the format (e.g., dc:creator,
+ * meta:author and Author), and the first name in docmeta_keys[] wins.
+ */
+#ifndef __HPSSIX_DOCMETA_H
+#define __HPSSIX_DOCMETA_H
+#include <config.h>
+
+#include <stdint.h>
+
+/* for the numeric fields not found in the metadata */
+#define HPSSIX_DOCMETA_NONE     INT64_MIN
+
+/* longer values are cut, at a character boundary */
+#define HPSSIX_DOCMETA_MAX_VALUE    512
+
+enum {
+    HPSSIX_DOCMETA_CONTENT_TYPE = 0,
+    HPSSIX_DOCMETA_AUTHOR,
+    HPSSIX_DOCMETA_LANGUAGE,
+    HPSSIX_DOCMETA_CREATED,
+    HPSSIX_DOCMETA_MODIFIED,
+    HPSSIX_DOCMETA_PAGES,
+    N_HPSSIX_DOCMETA,
+};
+
+struct _hpssix_docmeta {
+    char *content_type;     /* without the parameters, e.g., charset */
+    char *author;
+    char *language;
+    int64_t created;        /* seconds since the epoch */
+    int64_t modified;
+    int64_t pages;
+};
+
+typedef struct _hpssix_docmeta hpssix_docmeta_t;
+
+struct _hpssix_docmeta_parser {
+    hpssix_docmeta_t *docmeta;
+
+    int state;
+    int depth;              /* containers open */
+    int in_array;           /* the value of the key is an array */
+    int taken;              /* the first element of the array is taken */
+    int expect_key;
+    int field;              /* of the current key, -1 if not wanted */
+    int rank;
+    int rank_taken[N_HPSSIX_DOCMETA];
+
+    int capture;            /* 1 for the key, 2 for the value */
+    uint32_t unicode;       /* \uXXXX being read */
+    int n_hex;
+
+    char buf[HPSSIX_DOCMETA_MAX_VALUE + 8];
+    uint32_t len;
+    int error;
+};
+
+typedef struct _hpssix_docmeta_parser hpssix_docmeta_parser_t;
+
+/**
+ * @brief initialize @docmeta with no fields.
+ *
+ * @param docmeta
+ */
+void hpssix_docmeta_init(hpssix_docmeta_t *docmeta);
+
+/**
+ * @brief release the strings in @docmeta, and initialize it again.
+ *
+ * @param docmeta
+ */
+void hpssix_docmeta_free(hpssix_docmeta_t *docmeta);
+
+/**
+ * @brief start parsing a metadata json into @docmeta, which is initialized.
+ *
+ * @param parser
+ * @param docmeta
+ */
+void hpssix_docmeta_parser_init(hpssix_docmeta_parser_t *parser,
+                                hpssix_docmeta_t *docmeta);
+
+/**
+ * @brief feed the next @len bytes of the json. the fields are set in the
+ * docmeta as soon as their values are complete.
+ *
+ * @param parser
+ * @param buf
+ * @param len
+ *
+ * @return 0 on success, EINVAL if the input is not a json object (the fields
+ * found so far are kept), ENOMEM.
+ */
+int hpssix_docmeta_parser_feed(hpssix_docmeta_parser_t *parser,
+                               const char *buf, uint64_t len);
+
+/**
+ * @brief parse the whole metadata json @meta at once.
+ *
+ * @param meta
+ * @param docmeta [out]
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_docmeta_parse(const char *meta, hpssix_docmeta_t *docmeta);
+
+/**
+ * @brief parse an iso 8601 date as in the tika metadata, e.g.,
+ * 2019-03-01T10:20:30Z, 2019-03-01T10:20:30+09:00 or 2019-03-01.
+ *
+ * @param str
+ *
+ * @return seconds since the epoch, HPSSIX_DOCMETA_NONE if not parsed.
+ */
+int64_t hpssix_docmeta_parse_date(const char *str);
+
+#endif /* __HPSSIX_DOCMETA_H */
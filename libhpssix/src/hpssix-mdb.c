@@ -70,6 +70,11 @@ static const char *mdb_sqls[N_HPSSIX_MDB_SQLS] =
     "n_scanned, n_deleted, n_indexed, n_extracted, status)\n"
     "values (?,?,?,?,?,?,?,?,?,?,?)",
 
+    /*
+     * the next scan starts after the last task done. an incomplete task has
+     * files left unextracted, which the next scan should cover again.
+     */
+
     /* [1] HPSSIX_MDB_SQL_LAST_OID */
     "select max(oid_end) from hpssix_mdb where status=0",
 
@@ -42,6 +42,17 @@ struct _hpssix_work_status {
 
 typedef struct _hpssix_work_status hpssix_work_status_t;
 
+/*
+ * hpssix_work_status_t.status. the scanned range of an incomplete task is not
+ * considered as done, the next scan covers it again. the remaining files of
+ * the task can also be extracted by resuming the extractor with the same
+ * task id.
+ */
+enum {
+    HPSSIX_WORK_STATUS_DONE         = 0,
+    HPSSIX_WORK_STATUS_INCOMPLETE   = 1,    /* extraction did not finish */
+};
+
 /**
  * @brief
  *
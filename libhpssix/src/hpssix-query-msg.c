@@ -0,0 +1,329 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "hpssix-query-msg.h"
+
+static void put_string(FILE *fp, const char *key, const char *val)
+{
+    if (val)
+        fprintf(fp, "%s=%s%c", key, val, '\0');
+}
+
+static void put_cond(FILE *fp, const char *key, hpssix_query_cond_t *cond)
+{
+    if (cond->op != HPSSIX_OP_NONE)
+        fprintf(fp, "%s=%d,%ld,%ld%c", key, cond->op, cond->val1, cond->val2,
+                                       '\0');
+}
+
+int hpssix_query_msg_encode(hpssix_query_msg_t *msg, char **buf,
+                            uint32_t *len)
+{
+    int i = 0;
+    FILE *fp = NULL;
+    char *mem = NULL;
+    size_t size = 0;
+    char key[32] = { 0, };
+    char token[HPSSIX_QUERY_MAX_TOKEN] = { 0, };
+    hpssix_query_t *query = &msg->query;
+    hpssix_query_tag_t *tag = NULL;
+
+    fp = open_memstream(&mem, &size);
+    if (!fp)
+        return ENOMEM;
+
+    if (query->removed)
+        put_string(fp, "removed", "1");
+    if (query->countonly)
+        put_string(fp, "countonly", "1");
+    if (msg->estimate)
+        put_string(fp, "estimate", "1");
+
+    for (i = 0; i < N_HPSSIX_QUERY_FATTR; i++) {
+        sprintf(key, "fattr.%d", i);
+        put_cond(fp, key, &query->fattr[i]);
+    }
+
+    put_string(fp, "name", query->name);
+    put_string(fp, "path", query->path);
+    put_string(fp, "under", query->under);
+
+    /* the name last, as it may have ',' */
+    for (i = 0; i < query->n_tags; i++) {
+        tag = &query->tags[i];
+
+        fprintf(fp, "tag=%d,%.17g,%.17g,%s%c", tag->op, tag->val1, tag->val2,
+                                               tag->name, '\0');
+        if (tag->op < 0)
+            put_string(fp, "tag.value", tag->value);
+    }
+
+    put_string(fp, "keyword", query->keyword);
+    put_string(fp, "content_type", query->content_type);
+    put_string(fp, "author", query->author);
+    put_string(fp, "language", query->language);
+    put_cond(fp, "created", &query->created);
+    put_cond(fp, "modified", &query->modified);
+    put_cond(fp, "pages", &query->pages);
+
+    if (query->limit)
+        fprintf(fp, "limit=%lu%c", query->limit, '\0');
+
+    if (msg->batch)
+        fprintf(fp, "batch=%lu%c", msg->batch, '\0');
+
+    if (query->after.valid) {
+        hpssix_query_key_token(&query->after, token);
+        put_string(fp, "after", token);
+    }
+
+    if (fclose(fp)) {
+        free(mem);
+        return ENOMEM;
+    }
+
+    *buf = mem;
+    *len = size;
+
+    return 0;
+}
+
+static int get_cond(const char *val, hpssix_query_cond_t *cond)
+{
+    if (sscanf(val, "%d,%ld,%ld", &cond->op, &cond->val1, &cond->val2) != 3)
+        return EINVAL;
+
+    if (cond->op < HPSSIX_OP_EQ || cond->op > HPSSIX_OP_BITAND)
+        return EINVAL;
+
+    return 0;
+}
+
+static int get_tag(char *val, hpssix_query_tag_t *tag)
+{
+    int n = 0;
+
+    if (sscanf(val, "%d,%lf,%lf,%n", &tag->op, &tag->val1, &tag->val2,
+                                     &n) != 3 || n == 0)
+        return EINVAL;
+
+    /* the string matches only take the substring */
+    if (tag->op < HPSSIX_OP_NONE || tag->op > HPSSIX_OP_NE)
+        if (tag->op != HPSSIX_OP_BETWEEN)
+            return EINVAL;
+
+    tag->name = &val[n];
+    tag->value = "";
+
+    return 0;
+}
+
+int hpssix_query_msg_decode(hpssix_query_msg_t *msg, char *buf, uint32_t len)
+{
+    int ret = 0;
+    int attr = 0;
+    uint32_t n_tags = 0;
+    char *pos = NULL;
+    char *end = &buf[len];
+    char *val = NULL;
+    hpssix_query_t *query = &msg->query;
+
+    memset((void *) msg, 0, sizeof(*msg));
+    hpssix_query_init(query);
+
+    msg->buf = buf;
+
+    if (len == 0 || buf[len - 1] != '\0')
+        return EINVAL;
+
+    for (pos = buf; pos < end; pos += strlen(pos) + 1)
+        if (strncmp(pos, "tag=", 4) == 0)
+            n_tags++;
+
+    if (n_tags > HPSSIX_QUERY_MSG_MAX_TAGS)
+        return EINVAL;
+
+    if (n_tags) {
+        msg->tags = calloc(n_tags, sizeof(*msg->tags));
+        if (!msg->tags)
+            return ENOMEM;
+
+        query->tags = msg->tags;
+    }
+
+    for (pos = buf; pos < end && !ret; pos += strlen(pos) + 1) {
+        val = strchr(pos, '=');
+        if (!val)
+            return EINVAL;
+
+        *val++ = '\0';
+
+        if (!strcmp(pos, "removed"))
+            query->removed = 1;
+        else if (!strcmp(pos, "countonly"))
+            query->countonly = 1;
+        else if (!strcmp(pos, "estimate"))
+            msg->estimate = 1;
+        else if (sscanf(pos, "fattr.%d", &attr) == 1) {
+            if (attr < 0 || attr >= N_HPSSIX_QUERY_FATTR)
+                return EINVAL;
+            ret = get_cond(val, &query->fattr[attr]);
+        }
+        else if (!strcmp(pos, "name"))
+            query->name = val;
+        else if (!strcmp(pos, "path"))
+            query->path = val;
+        else if (!strcmp(pos, "under"))
+            query->under = val;
+        else if (!strcmp(pos, "tag"))
+            ret = get_tag(val, &query->tags[query->n_tags++]);
+        else if (!strcmp(pos, "tag.value") && query->n_tags)
+            query->tags[query->n_tags - 1].value = val;
+        else if (!strcmp(pos, "keyword"))
+            query->keyword = val;
+        else if (!strcmp(pos, "content_type"))
+            query->content_type = val;
+        else if (!strcmp(pos, "author"))
+            query->author = val;
+        else if (!strcmp(pos, "language"))
+            query->language = val;
+        else if (!strcmp(pos, "created"))
+            ret = get_cond(val, &query->created);
+        else if (!strcmp(pos, "modified"))
+            ret = get_cond(val, &query->modified);
+        else if (!strcmp(pos, "pages"))
+            ret = get_cond(val, &query->pages);
+        else if (!strcmp(pos, "limit"))
+            query->limit = strtoull(val, NULL, 10);
+        else if (!strcmp(pos, "batch"))
+            msg->batch = strtoull(val, NULL, 10);
+        else if (!strcmp(pos, "after"))
+            ret = hpssix_query_key_parse(val, &query->after);
+        else
+            return EINVAL;
+
+        /* the '=' is cut, the next string is after the value */
+        pos = val;
+    }
+
+    return ret;
+}
+
+void hpssix_query_msg_free(hpssix_query_msg_t *msg)
+{
+    if (!msg)
+        return;
+
+    free(msg->tags);
+    free(msg->buf);
+
+    memset((void *) msg, 0, sizeof(*msg));
+}
+
+int hpssix_query_msg_send(FILE *fp, int type, const char *buf, uint32_t len)
+{
+    uint32_t nlen = htonl(len);
+
+    if (fputc(type, fp) == EOF)
+        return EIO;
+
+    if (fwrite(&nlen, sizeof(nlen), 1, fp) != 1)
+        return EIO;
+
+    if (len && fwrite(buf, len, 1, fp) != 1)
+        return EIO;
+
+    return 0;
+}
+
+int hpssix_query_msg_recv(FILE *fp, int *type, char **buf, uint32_t *size,
+                          uint32_t *len)
+{
+    int ch = 0;
+    uint32_t nlen = 0;
+    char *tmp = NULL;
+
+    ch = fgetc(fp);
+    if (ch == EOF)
+        return EIO;
+
+    if (fread(&nlen, sizeof(nlen), 1, fp) != 1)
+        return EIO;
+
+    nlen = ntohl(nlen);
+    if (nlen > HPSSIX_QUERY_MSG_MAX_LEN)
+        return EINVAL;
+
+    if (!*buf || *size < nlen + 1) {
+        tmp = realloc(*buf, nlen + 1);
+        if (!tmp)
+            return ENOMEM;
+
+        *buf = tmp;
+        *size = nlen + 1;
+    }
+
+    if (nlen && fread(*buf, nlen, 1, fp) != 1)
+        return EIO;
+
+    (*buf)[nlen] = '\0';
+
+    *type = ch;
+    *len = nlen;
+
+    return 0;
+}
+
+int hpssix_query_msg_set_timeout(int fd, uint32_t sec)
+{
+    struct timeval tv = { sec, 0 };
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)))
+        return errno;
+
+    return 0;
+}
+
+int hpssix_query_msg_connect(const char *path)
+{
+    int fd = -1;
+    struct sockaddr_un addr = { 0, };
+
+    if (!path || strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+        hpssix_query_msg_set_timeout(fd, HPSSIX_QUERY_MSG_TIMEOUT)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
@@ -0,0 +1,134 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * messages between the search clients and the search service of hpssixd
+ * (hpssixd --search), over the unix socket of search.socket.
+ *
+ * a message is a frame of the type (a byte), the length of the payload (4
+ * bytes, in the network order) and the payload. the client sends a query
+ * ('Q'), whose payload is a list of "key=value" strings, each terminated by
+ * '\0'. the service answers with the rows ('R', the values of the columns,
+ * each terminated by '\0') and the end ('E', the errno in decimal, then
+ * "cached" if the rows are from the result cache). the statistics of the
+ * service ('S', no payload) are answered with the rows of the name and the
+ * value.
+ */
+#ifndef __HPSSIX_QUERY_MSG_H
+#define __HPSSIX_QUERY_MSG_H
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "hpssix-query.h"
+
+enum {
+    HPSSIX_QUERY_MSG_QUERY = 'Q',
+    HPSSIX_QUERY_MSG_ROW = 'R',
+    HPSSIX_QUERY_MSG_END = 'E',
+    HPSSIX_QUERY_MSG_STATS = 'S',
+};
+
+#define HPSSIX_QUERY_MSG_MAX_LEN    (1<<24)
+
+/* the tags of a query, as many as hpssix-search takes */
+#define HPSSIX_QUERY_MSG_MAX_TAGS   128
+
+/* seconds to wait for the other side, before giving up the connection */
+#define HPSSIX_QUERY_MSG_TIMEOUT    30
+
+struct _hpssix_query_msg {
+    hpssix_query_t query;
+    int estimate;           /* hpssix_query_estimate(), for a single row of
+                               the source and the rows */
+    uint64_t batch;         /* the rows read at a time, 0 for the default */
+
+    char *buf;              /* the strings in the decoded query */
+    hpssix_query_tag_t *tags;
+};
+
+typedef struct _hpssix_query_msg hpssix_query_msg_t;
+
+/**
+ * @brief encode @msg as the payload of a query frame.
+ *
+ * @param msg
+ * @param buf [out] should be freed by the caller.
+ * @param len [out]
+ *
+ * @return 0 on success, ENOMEM.
+ */
+int hpssix_query_msg_encode(hpssix_query_msg_t *msg, char **buf,
+                            uint32_t *len);
+
+/**
+ * @brief decode the payload of a query frame into @msg, which takes @buf.
+ *
+ * @param msg [out] should be released with hpssix_query_msg_free().
+ * @param buf
+ * @param len
+ *
+ * @return 0 on success, EINVAL if @buf is not a query or has more than
+ * HPSSIX_QUERY_MSG_MAX_TAGS tags, ENOMEM.
+ */
+int hpssix_query_msg_decode(hpssix_query_msg_t *msg, char *buf, uint32_t len);
+
+/**
+ * @brief release the decoded @msg.
+ *
+ * @param msg
+ */
+void hpssix_query_msg_free(hpssix_query_msg_t *msg);
+
+/**
+ * @brief write a frame to @fp (not flushed).
+ *
+ * @param fp
+ * @param type
+ * @param buf
+ * @param len
+ *
+ * @return 0 on success, EIO.
+ */
+int hpssix_query_msg_send(FILE *fp, int type, const char *buf, uint32_t len);
+
+/**
+ * @brief read a frame from @fp.
+ *
+ * @param fp
+ * @param type [out]
+ * @param buf [in/out] a buffer from malloc(), grown as needed, or NULL.
+ * @param size [in/out] the size of @buf.
+ * @param len [out] the length of the payload, which is followed by '\0'.
+ *
+ * @return 0 on success, EIO, EINVAL for a frame too long, ENOMEM.
+ */
+int hpssix_query_msg_recv(FILE *fp, int *type, char **buf, uint32_t *size,
+                          uint32_t *len);
+
+/**
+ * @brief give up the reads and the writes on @fd after @sec seconds, which
+ * then fail with EIO.
+ *
+ * @param fd
+ * @param sec
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_query_msg_set_timeout(int fd, uint32_t sec);
+
+/**
+ * @brief connect to the search service, with HPSSIX_QUERY_MSG_TIMEOUT.
+ *
+ * @param path of the socket.
+ *
+ * @return the socket, or -1 if the service is not running, or the caller
+ * cannot connect to it.
+ */
+int hpssix_query_msg_connect(const char *path);
+
+#endif /* __HPSSIX_QUERY_MSG_H */
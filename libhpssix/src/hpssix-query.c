@@ -0,0 +1,1352 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "hpssix-query.h"
+#include "hpssix-tsv.h"
+
+/*
+ * the values are in the parameters, but the text still grows with the
+ * conditions (e.g., the tags), so a longer one fails with E2BIG.
+ */
+#define QUERY_MAX_SQL       (1<<16)
+
+/* the shortest pattern which can be looked up in the trigram indexes */
+#define TRGM_MIN_PATTERN    3
+
+static const char *opstr[] = { "=", ">", ">=", "<", "<=", "<>" };
+
+static const char *fstr[] = {
+    "oid",
+    "st_mode",
+    "st_uid",
+    "st_gid",
+    "st_size",
+    "st_atime",
+    "st_mtime",
+    "st_ctime",
+};
+
+struct query_builder {
+    hpssix_query_stmt_t *stmt;
+    char *pos;
+    char *end;              /* of the buffer */
+    int n_conds;            /* in the WHERE clause */
+    int error;
+};
+
+/* nothing more is written once the statement has failed */
+static void put(struct query_builder *b, const char *fmt, ...)
+{
+    int len = 0;
+    va_list argv;
+
+    if (b->error)
+        return;
+
+    va_start(argv, fmt);
+    len = vsnprintf(b->pos, b->end - b->pos, fmt, argv);
+    va_end(argv);
+
+    if (len < 0 || len >= b->end - b->pos) {
+        b->error = E2BIG;
+        return;
+    }
+
+    b->pos += len;
+}
+
+/* append a parameter, and return its number ($n) in the statement */
+static int param(struct query_builder *b, const char *fmt, ...)
+{
+    int ret = 0;
+    char *val = NULL;
+    va_list argv;
+    hpssix_query_stmt_t *stmt = b->stmt;
+
+    if (b->error)
+        return 0;
+
+    if (stmt->n_params == HPSSIX_QUERY_MAX_PARAMS) {
+        b->error = EINVAL;
+        return 0;
+    }
+
+    va_start(argv, fmt);
+    ret = vasprintf(&val, fmt, argv);
+    va_end(argv);
+
+    if (ret < 0) {
+        b->error = ENOMEM;
+        return 0;
+    }
+
+    stmt->params[stmt->n_params++] = val;
+
+    return stmt->n_params;
+}
+
+/*
+ * a LIKE pattern matching @str literally, with '%' in front (@leading) and
+ * after (@trailing) it.
+ */
+static char *like_pattern(const char *str, size_t len, int leading,
+                          int trailing)
+{
+    char *pattern = NULL;
+    char *pos = NULL;
+
+    pattern = malloc(2*len + 3);
+    if (!pattern)
+        return NULL;
+
+    pos = pattern;
+
+    if (leading)
+        *pos++ = '%';
+
+    for (; len > 0; str++, len--) {
+        if (*str == '%' || *str == '_' || *str == '\\')
+            *pos++ = '\\';
+        *pos++ = *str;
+    }
+
+    if (trailing)
+        *pos++ = '%';
+
+    *pos = '\0';
+
+    return pattern;
+}
+
+static int param_like(struct query_builder *b, const char *str, int leading,
+                      int trailing)
+{
+    int n = 0;
+    char *pattern = like_pattern(str, strlen(str), leading, trailing);
+
+    if (!pattern) {
+        b->error = ENOMEM;
+        return 0;
+    }
+
+    n = param(b, "%s", pattern);
+    free(pattern);
+
+    return n;
+}
+
+static void put_cond(struct query_builder *b, const char *column,
+                     hpssix_query_cond_t *cond)
+{
+    if (cond->op == HPSSIX_OP_BETWEEN) {
+        int n1 = param(b, "%ld", cond->val1);
+        int n2 = param(b, "%ld", cond->val2);
+
+        put(b, "%s BETWEEN $%d AND $%d", column, n1, n2);
+    }
+    else if (cond->op == HPSSIX_OP_BITAND)
+        put(b, "%s & $%d > 0", column, param(b, "%ld", cond->val1));
+    else
+        put(b, "%s %s $%d", column, opstr[cond->op],
+                            param(b, "%ld", cond->val1));
+}
+
+/* the next condition of the WHERE clause */
+static void put_and(struct query_builder *b)
+{
+    put(b, b->n_conds++ ? "\n  AND " : "\nWHERE ");
+}
+
+static void put_object(struct query_builder *b, hpssix_query_t *query)
+{
+    int i = 0;
+    char column[32] = { 0, };
+
+    put_and(b);
+    put(b, "o.valid=%s", query->removed ? "false" : "true");
+
+    for (i = 0; i < N_HPSSIX_QUERY_FATTR; i++) {
+        if (query->fattr[i].op == HPSSIX_OP_NONE)
+            continue;
+
+        sprintf(column, "o.%s", fstr[i]);
+
+        put(b, " AND ");
+        put_cond(b, column, &query->fattr[i]);
+    }
+}
+
+/*
+ * a row of hpssix_attr_val (@alias) has a single key, so that each tag is
+ * matched on its own row, the driving one or in a semi-join.
+ */
+static void put_tag(struct query_builder *b, const char *alias,
+                    hpssix_query_tag_t *tag)
+{
+    put(b, "%s.kid=(SELECT kid FROM hpssix_attr_key WHERE name=$%d)",
+           alias, param(b, "%s", tag->name));
+
+    if (tag->op == HPSSIX_OP_BETWEEN) {
+        int n1 = param(b, "%.17g", tag->val1);
+        int n2 = param(b, "%.17g", tag->val2);
+
+        put(b, " AND %s.rval BETWEEN $%d AND $%d", alias, n1, n2);
+    }
+    else if (tag->op >= 0)
+        put(b, " AND %s.rval %s $%d", alias, opstr[tag->op],
+                                      param(b, "%.17g", tag->val1));
+    else
+        put(b, " AND %s.sval LIKE $%d", alias,
+                                        param_like(b, tag->value, 1, 1));
+}
+
+static void put_tag_exists(struct query_builder *b, hpssix_query_t *query,
+                           uint32_t i)
+{
+    char alias[16] = { 0, };
+
+    sprintf(alias, "v%u", i);
+
+    put_and(b);
+    put(b, "EXISTS (SELECT 1 FROM hpssix_attr_val %s WHERE %s.oid = o.oid AND ",
+           alias, alias);
+    put_tag(b, alias, &query->tags[i]);
+    put(b, ")");
+}
+
+/* above any character in utf-8, as the upper bound of a prefix */
+#define QUERY_MAX_CHAR      "\xf4\x8f\xbf\xbf"
+
+/*
+ * @column is stored in lowercase, unless it is wrapped by @lower. a prefix
+ * (with a trailing '*') is matched as the range ['prefix', 'prefix\U10FFFF'),
+ * a range scan of the text_pattern_ops index (ix_docmeta_content_type or
+ * _author), as put_under() does for the paths.
+ */
+static void put_text(struct query_builder *b, const char *column,
+                     const char *str, int lower)
+{
+    size_t len = strlen(str);
+    char *prefix = NULL;
+    int n1 = 0;
+    int n2 = 0;
+
+    if (len == 0 || str[len - 1] != '*') {
+        put(b, lower ? "LOWER(%s) = LOWER($%d)" : "%s = LOWER($%d)",
+               column, param(b, "%s", str));
+        return;
+    }
+
+    prefix = strndup(str, len - 1);
+    if (!prefix) {
+        b->error = ENOMEM;
+        return;
+    }
+
+    n1 = param(b, "%s", prefix);
+    n2 = param(b, "%s" QUERY_MAX_CHAR, prefix);
+    free(prefix);
+
+    if (lower)
+        put(b, "LOWER(%s) ~>=~ LOWER($%d) AND LOWER(%s) ~<~ LOWER($%d)",
+               column, n1, column, n2);
+    else
+        put(b, "%s ~>=~ LOWER($%d) AND %s ~<~ LOWER($%d)",
+               column, n1, column, n2);
+}
+
+static void put_docmeta(struct query_builder *b, hpssix_query_t *query)
+{
+    put_and(b);
+    put(b, "EXISTS (SELECT 1 FROM hpssix_attr_docmeta d WHERE d.oid = o.oid");
+
+    if (query->content_type) {
+        put(b, " AND ");
+        put_text(b, "d.content_type", query->content_type, 0);
+    }
+
+    if (query->author) {
+        put(b, " AND ");
+        put_text(b, "d.author", query->author, 1);
+    }
+
+    if (query->language) {
+        put(b, " AND ");
+        put_text(b, "d.language", query->language, 0);
+    }
+
+    if (query->created.op != HPSSIX_OP_NONE) {
+        put(b, " AND ");
+        put_cond(b, "d.created", &query->created);
+    }
+
+    if (query->modified.op != HPSSIX_OP_NONE) {
+        put(b, " AND ");
+        put_cond(b, "d.modified", &query->modified);
+    }
+
+    if (query->pages.op != HPSSIX_OP_NONE) {
+        put(b, " AND ");
+        put_cond(b, "d.pages", &query->pages);
+    }
+
+    put(b, ")");
+}
+
+/*
+ * the tsvectors are built with the 'simple' configuration, in the trigger or
+ * by the client (extractor.clienttsv), so the keyword is not stemmed either.
+ * the tsquery from hpssix_tsv_query() covers the words split differently by
+ * the client tokenizer.
+ */
+static void put_tsquery(struct query_builder *b, hpssix_query_t *query)
+{
+    int n1 = 0;
+    int n2 = 0;
+    char *tsquery = NULL;
+
+    if (hpssix_tsv_query(query->keyword, &tsquery)) {
+        b->error = ENOMEM;
+        return;
+    }
+
+    n1 = param(b, "%s", query->keyword);
+    n2 = param(b, "%s", tsquery);
+    free(tsquery);
+
+    put(b, "PLAINTO_TSQUERY('simple', $%d) || $%d::TSQUERY AS q", n1, n2);
+}
+
+/* the matching documents with the rank, as t */
+static void put_tsv(struct query_builder *b, hpssix_query_t *query)
+{
+    put(b, "(SELECT oid, TS_RANK_CD(tsv, q) AS rank "
+           "FROM hpssix_attr_document, ");
+    put_tsquery(b, query);
+    put(b, " WHERE tsv @@ q) t");
+}
+
+/* for the counts, which need no rank */
+static void put_tsv_exists(struct query_builder *b, hpssix_query_t *query)
+{
+    put_and(b);
+    put(b, "EXISTS (SELECT 1 FROM hpssix_attr_document doc, ");
+    put_tsquery(b, query);
+    put(b, " WHERE doc.oid = o.oid AND doc.tsv @@ q)");
+}
+
+static inline uint64_t count_chars(const char *str)
+{
+    uint64_t count = 0;
+
+    for (; *str; str++)
+        if ((*str & 0xc0) != 0x80)
+            count++;
+
+    return count;
+}
+
+/*
+ * a substring of TRGM_MIN_PATTERN or more characters is looked up in the
+ * trigram index of @column (ix_hpssix_file_name_trgm or _path_trgm). a
+ * shorter one has no trigram, and the index would be read as a whole, so it
+ * is matched on an expression which no index covers, leaving the planner to
+ * filter the rows found by the other conditions.
+ */
+static void put_substring(struct query_builder *b, const char *column,
+                          const char *str)
+{
+    int n = param_like(b, str, 1, 1);
+
+    if (count_chars(str) >= TRGM_MIN_PATTERN)
+        put(b, "%s LIKE $%d", column, n);
+    else
+        put(b, "(%s || '') LIKE $%d", column, n);
+}
+
+/*
+ * the descendants of @dir are the paths in ['@dir/', '@dir0'), which is a
+ * range scan of ix_hpssix_file_path_prefix. a prefix LIKE would do the same
+ * only with a constant pattern, not in a prepared statement.
+ */
+static void put_under(struct query_builder *b, const char *dir)
+{
+    size_t len = strlen(dir);
+    char *lower = NULL;
+    int n1 = 0;
+    int n2 = 0;
+
+    lower = malloc(len + 2);
+    if (!lower) {
+        b->error = ENOMEM;
+        return;
+    }
+
+    strcpy(lower, dir);
+    if (len == 0 || lower[len - 1] != '/')
+        strcpy(&lower[len++], "/");
+
+    n1 = param(b, "%s", lower);
+
+    lower[len - 1] = '/' + 1;
+    n2 = param(b, "%s", lower);
+
+    free(lower);
+
+    put(b, "f.path ~>=~ $%d AND f.path ~<~ $%d", n1, n2);
+}
+
+/*
+ * the rows after the key, in the order of the results. the rank is compared
+ * as the real of TS_RANK_CD(), as printed by the database.
+ */
+static void put_after(struct query_builder *b, hpssix_query_t *query)
+{
+    hpssix_query_key_t *key = &query->after;
+    int n1 = 0;
+    int n2 = 0;
+
+    if (query->keyword) {
+        n1 = param(b, "%s", key->rank);
+        n2 = param(b, "%lu", key->oid);
+
+        put(b, "(t.rank < $%d::REAL OR (t.rank = $%d::REAL AND f.oid > $%d))",
+               n1, n1, n2);
+    }
+    else
+        put(b, "f.oid > $%d", param(b, "%lu", key->oid));
+}
+
+static void put_file(struct query_builder *b, hpssix_query_t *query)
+{
+    if (query->name) {
+        put_and(b);
+        put_substring(b, "f.name", query->name);
+    }
+
+    if (query->path) {
+        put_and(b);
+        put_substring(b, "f.path", query->path);
+    }
+
+    if (query->under) {
+        put_and(b);
+        put_under(b, query->under);
+    }
+
+    if (query->after.valid) {
+        put_and(b);
+        put_after(b, query);
+    }
+}
+
+static int has_docmeta(hpssix_query_t *query)
+{
+    return query->content_type || query->author || query->language ||
+           query->created.op != HPSSIX_OP_NONE ||
+           query->modified.op != HPSSIX_OP_NONE ||
+           query->pages.op != HPSSIX_OP_NONE;
+}
+
+void hpssix_query_init(hpssix_query_t *query)
+{
+    int i = 0;
+
+    if (!query)
+        return;
+
+    memset((void *) query, 0, sizeof(*query));
+
+    for (i = 0; i < N_HPSSIX_QUERY_FATTR; i++)
+        query->fattr[i].op = HPSSIX_OP_NONE;
+
+    query->created.op = HPSSIX_OP_NONE;
+    query->modified.op = HPSSIX_OP_NONE;
+    query->pages.op = HPSSIX_OP_NONE;
+}
+
+/* the predicates in the order given, driven by hpssix_object */
+static void plan_init(hpssix_query_t *query, hpssix_query_plan_t *plan)
+{
+    uint32_t i = 0;
+    hpssix_query_pred_t *pred = NULL;
+
+    memset((void *) plan, 0, sizeof(*plan));
+
+    plan->n_tags = query->n_tags;
+    if (plan->n_tags > HPSSIX_QUERY_MAX_PREDS - 2)
+        plan->n_tags = HPSSIX_QUERY_MAX_PREDS - 2;
+
+    pred = &plan->preds[plan->n_preds++];
+    pred->type = HPSSIX_QUERY_PRED_OBJECT;
+    pred->rows = -1;
+
+    for (i = 0; i < plan->n_tags; i++) {
+        pred = &plan->preds[plan->n_preds++];
+        pred->type = HPSSIX_QUERY_PRED_TAG;
+        pred->tag = i;
+        pred->rows = -1;
+    }
+
+    if (query->keyword) {
+        pred = &plan->preds[plan->n_preds++];
+        pred->type = HPSSIX_QUERY_PRED_KEYWORD;
+        pred->rows = -1;
+    }
+}
+
+/* each predicate of @query once, and no others */
+static int plan_valid(hpssix_query_t *query, const hpssix_query_plan_t *plan)
+{
+    hpssix_query_plan_t expected;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    plan_init(query, &expected);
+
+    if (plan->n_preds != expected.n_preds || plan->n_tags != expected.n_tags)
+        return 0;
+
+    for (i = 0; i < expected.n_preds; i++) {
+        for (j = 0; j < plan->n_preds; j++)
+            if (plan->preds[j].type == expected.preds[i].type &&
+                (expected.preds[i].type != HPSSIX_QUERY_PRED_TAG ||
+                 plan->preds[j].tag == expected.preds[i].tag))
+                break;
+
+        if (j == plan->n_preds)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the driving predicate is in the FROM clause, and its conditions first */
+static void put_driver(struct query_builder *b, hpssix_query_t *query,
+                       const hpssix_query_pred_t *driver)
+{
+    put(b, "\nFROM ");
+
+    if (driver->type == HPSSIX_QUERY_PRED_TAG)
+        put(b, "hpssix_attr_val v JOIN hpssix_object o ON o.oid = v.oid");
+    else if (driver->type == HPSSIX_QUERY_PRED_KEYWORD) {
+        put_tsv(b, query);
+        put(b, " JOIN hpssix_object o ON o.oid = t.oid");
+    }
+    else
+        put(b, "hpssix_object o");
+
+    put(b, "\nJOIN hpssix_file f ON f.oid = o.oid");
+
+    /* the counts look the files up for each key, see hpssix_query_build() */
+    if (query->countonly && query->keys) {
+        put_and(b);
+        put(b, query->keys == HPSSIX_QUERY_KEYS_NAME ? "f.name = k.key"
+                                                     : "f.path = k.key");
+    }
+    else if (query->keys == HPSSIX_QUERY_KEYS_NAME)
+        put(b, "\nJOIN hpssix_query_keys k ON k.key = f.name");
+    else if (query->keys == HPSSIX_QUERY_KEYS_PATH)
+        put(b, "\nJOIN hpssix_query_keys k ON k.key = f.path");
+
+    /* the rank is read for each row */
+    if (query->keyword && !query->countonly &&
+        driver->type != HPSSIX_QUERY_PRED_KEYWORD) {
+        put(b, "\nJOIN ");
+        put_tsv(b, query);
+        put(b, " ON t.oid = o.oid");
+    }
+
+    if (driver->type == HPSSIX_QUERY_PRED_TAG) {
+        put_and(b);
+        put_tag(b, "v", &query->tags[driver->tag]);
+    }
+}
+
+/* the stat attributes are put along with the driver, always */
+static void put_pred(struct query_builder *b, hpssix_query_t *query,
+                     const hpssix_query_pred_t *pred)
+{
+    if (pred->type == HPSSIX_QUERY_PRED_TAG)
+        put_tag_exists(b, query, pred->tag);
+    else if (pred->type == HPSSIX_QUERY_PRED_KEYWORD && query->countonly)
+        put_tsv_exists(b, query);
+}
+
+int hpssix_query_build(hpssix_query_t *query, hpssix_query_stmt_t *stmt)
+{
+    uint32_t i = 0;
+    hpssix_query_plan_t noplan;
+    const hpssix_query_plan_t *plan = NULL;
+    const hpssix_query_pred_t *driver = NULL;
+    struct query_builder b = { 0, };
+
+    if (!query || !stmt)
+        return EINVAL;
+
+    memset((void *) stmt, 0, sizeof(*stmt));
+
+    /* the key of a keyword search has the rank, and only that */
+    if (query->after.valid && !query->keyword != !query->after.rank[0])
+        return EINVAL;
+
+    plan = query->plan;
+    if (!plan) {
+        plan_init(query, &noplan);
+        plan = &noplan;
+    }
+    else if (!plan_valid(query, plan))
+        return EINVAL;
+
+    driver = &plan->preds[0];
+
+    stmt->sql = malloc(QUERY_MAX_SQL);
+    if (!stmt->sql)
+        return ENOMEM;
+
+    b.stmt = stmt;
+    b.pos = stmt->sql;
+    b.end = stmt->sql + QUERY_MAX_SQL;
+
+    /*
+     * the counts of the keys are driven by hpssix_query_keys, so that a key
+     * with no files is counted as 0, instead of being left out.
+     */
+    if (query->countonly && query->keys)
+        put(&b, "SELECT COUNT(f.path), k.key\nFROM hpssix_query_keys k"
+                "\nLEFT JOIN LATERAL (SELECT f.path");
+    else if (query->countonly)
+        put(&b, "SELECT COUNT(f.path)");
+    else if (query->keyword)
+        put(&b, "SELECT f.oid, f.path, t.rank");
+    else
+        put(&b, "SELECT f.oid, f.path");
+
+    if (query->keys && !query->countonly)
+        put(&b, ", k.key");
+
+    put_driver(&b, query, driver);
+
+    /* always, for the valid (or the removed) files only */
+    put_object(&b, query);
+
+    /* the others, as the semi-joins, the most selective first */
+    for (i = 1; i < plan->n_preds; i++)
+        put_pred(&b, query, &plan->preds[i]);
+
+    for (i = plan->n_tags; i < query->n_tags; i++)
+        put_tag_exists(&b, query, i);
+
+    if (has_docmeta(query))
+        put_docmeta(&b, query);
+
+    put_file(&b, query);
+
+    /* the oid breaks the ties, for the pages not to overlap */
+    if (query->countonly && query->keys)
+        put(&b, "\n) f ON true\nGROUP BY k.seq, k.key ORDER BY k.seq");
+    else if (query->countonly)
+        ;
+    else if (query->keyword)
+        put(&b, "\nORDER BY t.rank DESC, f.oid");
+    else if (query->limit || query->after.valid)
+        put(&b, "\nORDER BY f.oid");
+    else if (query->keys)
+        put(&b, "\nORDER BY k.seq, f.oid");
+
+    if (query->limit)
+        put(&b, "\nLIMIT $%d", param(&b, "%lu", query->limit));
+
+    if (b.error)
+        hpssix_query_stmt_free(stmt);
+
+    return b.error;
+}
+
+static const char *keys_init_stmt =
+"CREATE TEMP TABLE IF NOT EXISTS hpssix_query_keys (\n"
+"    seq BIGINT NOT NULL,\n"
+"    key TEXT NOT NULL\n"
+");\n"
+"TRUNCATE hpssix_query_keys;\n";
+
+/* the paths are stored without the mount point */
+static const char *keys_strip(const char *key, const char *prefix)
+{
+    size_t len = 0;
+
+    if (!prefix)
+        return key;
+
+    len = strlen(prefix);
+    while (len > 1 && prefix[len - 1] == '/')
+        len--;
+
+    if (len > 1 && strncmp(key, prefix, len) == 0 && key[len] == '/')
+        return &key[len];
+
+    return key;
+}
+
+/* a row of COPY in the text format, with the special characters escaped */
+static void keys_row(char *buf, uint64_t seq, const char *key)
+{
+    char *pos = buf + sprintf(buf, "%lu\t", seq);
+
+    for ( ; *key; key++) {
+        if (*key == '\\' || *key == '\t' || *key == '\r') {
+            *pos++ = '\\';
+            *pos++ = *key == '\t' ? 't' : *key == '\r' ? 'r' : '\\';
+        }
+        else
+            *pos++ = *key;
+    }
+
+    strcpy(pos, "\n");
+}
+
+/*
+ * the lines are read whole, unlike hpssix_db_copy(), as a path can be longer
+ * than LINE_MAX.
+ */
+int hpssix_query_keys_load(hpssix_db_t *db, FILE *fp, const char *prefix,
+                           uint64_t *n_keys)
+{
+    int ret = 0;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len = 0;
+    char *buf = NULL;
+    size_t bufsize = 0;
+    char *tmp = NULL;
+    uint64_t seq = 0;
+
+    if (!db || !fp)
+        return EINVAL;
+
+    ret = hpssix_db_psql_exec(db, keys_init_stmt);
+    if (ret)
+        return ret;
+
+    ret = hpssix_db_copy_init(db, "COPY hpssix_query_keys (seq, key) "
+                                  "FROM STDIN");
+    if (ret)
+        return ret;
+
+    while ((len = getline(&line, &size, fp)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        if (len == 0)
+            continue;
+
+        if (bufsize < 2*len + 32) {
+            tmp = realloc(buf, 2*len + 32);
+            if (!tmp) {
+                ret = ENOMEM;
+                break;
+            }
+
+            buf = tmp;
+            bufsize = 2*len + 32;
+        }
+
+        keys_row(buf, seq, keys_strip(line, prefix));
+
+        ret = hpssix_db_copy_put(db, buf);
+        if (ret)
+            break;
+
+        seq++;
+    }
+
+    if (!ret && ferror(fp))
+        ret = EIO;
+
+    if (ret)
+        hpssix_db_copy_end(db, 1);
+    else
+        ret = hpssix_db_copy_end(db, 0);
+
+    /* for the planner to know how many keys there are */
+    if (!ret)
+        ret = hpssix_db_psql_exec(db, "ANALYZE hpssix_query_keys");
+
+    if (!ret && n_keys)
+        *n_keys = seq;
+
+    free(line);
+    free(buf);
+
+    return ret;
+}
+
+void hpssix_query_stmt_free(hpssix_query_stmt_t *stmt)
+{
+    int i = 0;
+
+    if (!stmt)
+        return;
+
+    for (i = 0; i < stmt->n_params; i++)
+        free(stmt->params[i]);
+
+    free(stmt->sql);
+
+    memset((void *) stmt, 0, sizeof(*stmt));
+}
+
+/* the conditions which hpssix_object_count has */
+/* the owner, and the file type (st_mode & S_IFMT), are in the counters */
+static inline int cond_countable(int i, hpssix_query_cond_t *cond)
+{
+    if (i == HPSSIX_QUERY_UID || i == HPSSIX_QUERY_GID)
+        return 1;
+
+    return i == HPSSIX_QUERY_MODE && cond->op == HPSSIX_OP_BITAND &&
+           (cond->val1 & ~S_IFMT) == 0;
+}
+
+static int fattr_countable(hpssix_query_t *query)
+{
+    int i = 0;
+    hpssix_query_cond_t *cond = NULL;
+
+    for (i = 0; i < N_HPSSIX_QUERY_FATTR; i++) {
+        cond = &query->fattr[i];
+
+        if (cond->op != HPSSIX_OP_NONE && !cond_countable(i, cond))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int query_countable(hpssix_query_t *query)
+{
+    if (query->name || query->path || query->under || query->keys ||
+        query->n_tags ||
+        query->keyword || has_docmeta(query) || query->after.valid)
+        return 0;
+
+    return fattr_countable(query);
+}
+
+/*
+ * the rows of hpssix_object_count tell whether the counters have been built
+ * at all, otherwise @found is cleared. the conditions the counters do not
+ * have are left out, so that the sum is an upper bound of the search, and
+ * exact if it has no other conditions (query_countable()).
+ */
+static int estimate_counter(hpssix_db_t *db, hpssix_query_t *query,
+                            uint64_t *rows, int *found)
+{
+    int ret = 0;
+    int i = 0;
+    PGresult *res = NULL;
+    hpssix_query_stmt_t stmt = { 0, };
+    struct query_builder b = { 0, };
+    const char *cols[N_HPSSIX_QUERY_FATTR] = {
+        [HPSSIX_QUERY_MODE] = "st_type",
+        [HPSSIX_QUERY_UID] = "st_uid",
+        [HPSSIX_QUERY_GID] = "st_gid",
+    };
+
+    stmt.sql = malloc(QUERY_MAX_SQL);
+    if (!stmt.sql)
+        return ENOMEM;
+
+    b.stmt = &stmt;
+    b.pos = stmt.sql;
+    b.end = stmt.sql + QUERY_MAX_SQL;
+
+    put(&b, "SELECT COALESCE(SUM(n) FILTER (WHERE valid=%s",
+            query->removed ? "false" : "true");
+
+    for (i = 0; i < N_HPSSIX_QUERY_FATTR; i++) {
+        if (query->fattr[i].op == HPSSIX_OP_NONE ||
+            !cond_countable(i, &query->fattr[i]))
+            continue;
+
+        put(&b, " AND ");
+        put_cond(&b, cols[i], &query->fattr[i]);
+    }
+
+    put(&b, "), 0), COUNT(*) FROM hpssix_object_count");
+
+    if (b.error) {
+        ret = b.error;
+        goto out;
+    }
+
+    res = hpssix_query_exec(db, &stmt);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        ret = EIO;
+        goto out;
+    }
+
+    *rows = strtoull(PQgetvalue(res, 0, 0), NULL, 10);
+    *found = strtoull(PQgetvalue(res, 0, 1), NULL, 10) > 0;
+
+out:
+    PQclear(res);
+    hpssix_query_stmt_free(&stmt);
+
+    return ret;
+}
+
+/* the rows of the top node in the plan, i.e., the first in the json */
+static int explain_rows(hpssix_db_t *db, hpssix_query_stmt_t *stmt,
+                        uint64_t *rows)
+{
+    int ret = 0;
+    char *sql = NULL;
+    char *pos = NULL;
+    PGresult *res = NULL;
+
+    if (asprintf(&sql, "EXPLAIN (FORMAT JSON) %s", stmt->sql) < 0)
+        return ENOMEM;
+
+    res = PQexecParams(db->dbconn, sql, stmt->n_params, NULL,
+                       (const char * const *) stmt->params, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        ret = EIO;
+        goto out;
+    }
+
+    pos = strstr(PQgetvalue(res, 0, 0), "\"Plan Rows\":");
+    if (!pos) {
+        ret = EIO;
+        goto out;
+    }
+
+    *rows = strtoull(&pos[strlen("\"Plan Rows\":")], NULL, 10);
+
+out:
+    PQclear(res);
+    free(sql);
+
+    return ret;
+}
+
+static int estimate_planner(hpssix_db_t *db, hpssix_query_t *query,
+                            uint64_t *rows)
+{
+    int ret = 0;
+    hpssix_query_t rowquery = *query;
+    hpssix_query_stmt_t stmt = { 0, };
+
+    rowquery.countonly = 0;
+    rowquery.limit = 0;
+
+    ret = hpssix_query_build(&rowquery, &stmt);
+    if (ret)
+        return ret;
+
+    ret = explain_rows(db, &stmt, rows);
+
+    hpssix_query_stmt_free(&stmt);
+
+    return ret;
+}
+
+int hpssix_query_estimate(hpssix_db_t *db, hpssix_query_t *query,
+                          hpssix_query_estimate_t *estimate)
+{
+    int ret = 0;
+    int found = 0;
+    uint64_t bound = 0;
+
+    memset((void *) estimate, 0, sizeof(*estimate));
+
+    ret = estimate_counter(db, query, &bound, &found);
+    if (ret)
+        return ret;
+
+    if (found && query_countable(query)) {
+        estimate->source = HPSSIX_QUERY_ESTIMATE_COUNTER;
+        estimate->rows = bound;
+        estimate->bound = bound;
+        return 0;
+    }
+
+    estimate->source = HPSSIX_QUERY_ESTIMATE_PLANNER;
+    estimate->bound = found ? bound : UINT64_MAX;
+
+    ret = estimate_planner(db, query, &estimate->rows);
+    if (!ret && estimate->rows > estimate->bound)
+        estimate->rows = estimate->bound;
+
+    return ret;
+}
+
+/*
+ * the stat attributes are counted exactly by the counters, if they have only
+ * the owner and the type. the others take the planner estimate, which has
+ * the statistics of each column.
+ */
+static int plan_object(hpssix_db_t *db, hpssix_query_t *query, int64_t *rows)
+{
+    int ret = 0;
+    int found = 0;
+    uint64_t n = 0;
+    hpssix_query_stmt_t stmt = { 0, };
+    struct query_builder b = { 0, };
+
+    if (fattr_countable(query)) {
+        ret = estimate_counter(db, query, &n, &found);
+        if (ret)
+            return ret;
+
+        if (found) {
+            *rows = n;
+            return 0;
+        }
+    }
+
+    stmt.sql = malloc(QUERY_MAX_SQL);
+    if (!stmt.sql)
+        return ENOMEM;
+
+    b.stmt = &stmt;
+    b.pos = stmt.sql;
+    b.end = stmt.sql + QUERY_MAX_SQL;
+
+    put(&b, "SELECT 1 FROM hpssix_object o");
+    put_object(&b, query);
+
+    ret = b.error;
+    if (!ret)
+        ret = explain_rows(db, &stmt, &n);
+    if (!ret)
+        *rows = n;
+
+    hpssix_query_stmt_free(&stmt);
+
+    return ret;
+}
+
+/* the files with the key, whatever the value is */
+static const char *plan_tag_stmt =
+"SELECT COALESCE((SELECT c.n FROM hpssix_attr_key k\n"
+"                   JOIN hpssix_attr_key_count c ON c.kid = k.kid\n"
+"                 WHERE k.name = $1), 0),\n"
+"       EXISTS (SELECT 1 FROM hpssix_attr_key_count)";
+
+static int plan_tag(hpssix_db_t *db, hpssix_query_tag_t *tag, int64_t *rows)
+{
+    int ret = 0;
+    PGresult *res = NULL;
+    const char *params[1] = { tag->name };
+
+    res = hpssix_db_exec_prepared(db, plan_tag_stmt, 1, params);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        ret = EIO;
+        goto out;
+    }
+
+    /* the keys have been counted, otherwise the tag stays unestimated */
+    if (PQgetvalue(res, 0, 1)[0] == 't')
+        *rows = strtoll(PQgetvalue(res, 0, 0), NULL, 10);
+
+out:
+    PQclear(res);
+
+    return ret;
+}
+
+/*
+ * the planner estimates the matches of a tsquery from the most common lexemes
+ * of hpssix_attr_document.tsv, which ANALYZE samples, i.e., the document
+ * frequencies of the lexemes, without reading the documents.
+ */
+static int plan_keyword(hpssix_db_t *db, hpssix_query_t *query, int64_t *rows)
+{
+    int ret = 0;
+    uint64_t n = 0;
+    hpssix_query_stmt_t stmt = { 0, };
+    struct query_builder b = { 0, };
+
+    stmt.sql = malloc(QUERY_MAX_SQL);
+    if (!stmt.sql)
+        return ENOMEM;
+
+    b.stmt = &stmt;
+    b.pos = stmt.sql;
+    b.end = stmt.sql + QUERY_MAX_SQL;
+
+    put(&b, "SELECT 1 FROM hpssix_attr_document, ");
+    put_tsquery(&b, query);
+    put(&b, " WHERE tsv @@ q");
+
+    ret = b.error;
+    if (!ret)
+        ret = explain_rows(db, &stmt, &n);
+    if (!ret)
+        *rows = n;
+
+    hpssix_query_stmt_free(&stmt);
+
+    return ret;
+}
+
+/* the unknown ones last, and the ties in the order given */
+static inline int pred_before(hpssix_query_pred_t *a, hpssix_query_pred_t *b)
+{
+    if (a->rows < 0)
+        return 0;
+
+    return b->rows < 0 || a->rows < b->rows;
+}
+
+static void plan_sort(hpssix_query_plan_t *plan)
+{
+    uint32_t i = 0;
+    uint32_t j = 0;
+    hpssix_query_pred_t pred;
+
+    for (i = 1; i < plan->n_preds; i++) {
+        pred = plan->preds[i];
+
+        for (j = i; j > 0 && pred_before(&pred, &plan->preds[j - 1]); j--)
+            plan->preds[j] = plan->preds[j - 1];
+
+        plan->preds[j] = pred;
+    }
+}
+
+int hpssix_query_plan(hpssix_db_t *db, hpssix_query_t *query,
+                      hpssix_query_plan_t *plan)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    hpssix_query_pred_t *pred = NULL;
+
+    if (!db || !query || !plan)
+        return EINVAL;
+
+    plan_init(query, plan);
+
+    for (i = 0; i < plan->n_preds && !ret; i++) {
+        pred = &plan->preds[i];
+
+        if (pred->type == HPSSIX_QUERY_PRED_OBJECT)
+            ret = plan_object(db, query, &pred->rows);
+        else if (pred->type == HPSSIX_QUERY_PRED_TAG)
+            ret = plan_tag(db, &query->tags[pred->tag], &pred->rows);
+        else
+            ret = plan_keyword(db, query, &pred->rows);
+    }
+
+    if (ret)
+        return ret;
+
+    plan_sort(plan);
+
+    return 0;
+}
+
+int hpssix_query_explain(hpssix_db_t *db, hpssix_query_stmt_t *stmt,
+                         PGresult **res)
+{
+    int ret = 0;
+    char *sql = NULL;
+    PGresult *rows = NULL;
+
+    if (asprintf(&sql, "EXPLAIN (ANALYZE, BUFFERS) %s", stmt->sql) < 0)
+        return ENOMEM;
+
+    rows = PQexecParams(db->dbconn, sql, stmt->n_params, NULL,
+                        (const char * const *) stmt->params, NULL, NULL, 0);
+    if (PQresultStatus(rows) != PGRES_TUPLES_OK) {
+        fprintf(db->logfp ? db->logfp : stderr, "%s",
+                PQresultErrorMessage(rows));
+        PQclear(rows);
+        ret = EIO;
+    }
+    else
+        *res = rows;
+
+    free(sql);
+
+    return ret;
+}
+
+int hpssix_query_key_parse(const char *token, hpssix_query_key_t *key)
+{
+    char *end = NULL;
+    const char *comma = NULL;
+    const char *oid = token;
+
+    memset((void *) key, 0, sizeof(*key));
+
+    comma = strchr(token, ',');
+    if (comma) {
+        if (comma == token || comma - token >= sizeof(key->rank))
+            return EINVAL;
+
+        strtof(token, &end);
+        if (end != comma)
+            return EINVAL;
+
+        memcpy(key->rank, token, comma - token);
+        oid = &comma[1];
+    }
+
+    if (!isdigit(oid[0]))
+        return EINVAL;
+
+    errno = 0;
+    key->oid = strtoull(oid, &end, 10);
+    if (errno || *end)
+        return EINVAL;
+
+    key->valid = 1;
+
+    return 0;
+}
+
+int hpssix_query_key_get(hpssix_query_t *query, PGresult *res, int row,
+                         hpssix_query_key_t *key)
+{
+    const char *rank = NULL;
+
+    memset((void *) key, 0, sizeof(*key));
+
+    if (row < 0 || row >= PQntuples(res) || query->countonly)
+        return EINVAL;
+
+    key->oid = strtoull(PQgetvalue(res, row, 0), NULL, 10);
+
+    if (query->keyword) {
+        rank = PQgetvalue(res, row, 2);
+        if (strlen(rank) >= sizeof(key->rank))
+            return EINVAL;
+
+        strcpy(key->rank, rank);
+    }
+
+    key->valid = 1;
+
+    return 0;
+}
+
+void hpssix_query_key_token(hpssix_query_key_t *key, char *buf)
+{
+    if (key->rank[0])
+        sprintf(buf, "%s,%lu", key->rank, key->oid);
+    else
+        sprintf(buf, "%lu", key->oid);
+}
+
+static uint32_t cursor_seq;
+
+int hpssix_query_open(hpssix_db_t *db, hpssix_query_stmt_t *stmt,
+                      uint64_t batch, hpssix_query_cursor_t *cursor)
+{
+    int ret = 0;
+    char *sql = NULL;
+    PGresult *res = NULL;
+
+    memset((void *) cursor, 0, sizeof(*cursor));
+
+    cursor->db = db;
+    cursor->batch = batch ? batch : HPSSIX_QUERY_DEFAULT_BATCH;
+    sprintf(cursor->name, "hpssix_cursor_%u",
+            __sync_fetch_and_add(&cursor_seq, 1));
+
+    if (PQtransactionStatus(db->dbconn) == PQTRANS_IDLE) {
+        ret = hpssix_db_begin_transaction(db);
+        if (ret)
+            return EIO;
+
+        cursor->own_transaction = 1;
+    }
+
+    if (asprintf(&sql, "DECLARE %s NO SCROLL CURSOR FOR %s",
+                       cursor->name, stmt->sql) < 0) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    /* a cursor cannot be prepared, the parameters are sent along */
+    res = PQexecParams(db->dbconn, sql, stmt->n_params, NULL,
+                       (const char * const *) stmt->params, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(db->logfp ? db->logfp : stderr, "%s",
+                PQresultErrorMessage(res));
+        ret = EIO;
+    }
+
+    PQclear(res);
+    free(sql);
+
+out:
+    if (ret && cursor->own_transaction)
+        hpssix_db_rollback(db);
+
+    return ret;
+}
+
+int hpssix_query_fetch(hpssix_query_cursor_t *cursor, PGresult **res)
+{
+    PGresult *rows = NULL;
+
+    if (cursor->done) {
+        *res = NULL;
+        return 0;
+    }
+
+    rows = hpssix_db_psql_query(cursor->db, "FETCH FORWARD %lu FROM %s",
+                                cursor->batch, cursor->name);
+    if (PQresultStatus(rows) != PGRES_TUPLES_OK) {
+        PQclear(rows);
+        return EIO;
+    }
+
+    if (PQntuples(rows) < cursor->batch)
+        cursor->done = 1;
+
+    *res = rows;
+
+    return 0;
+}
+
+int hpssix_query_close(hpssix_query_cursor_t *cursor)
+{
+    int ret = 0;
+    char sql[64] = { 0, };
+    hpssix_db_t *db = cursor->db;
+
+    if (PQtransactionStatus(db->dbconn) == PQTRANS_INERROR) {
+        if (cursor->own_transaction)
+            hpssix_db_rollback(db);
+        return EIO;
+    }
+
+    sprintf(sql, "CLOSE %s", cursor->name);
+
+    ret = hpssix_db_psql_exec(db, sql);
+
+    if (cursor->own_transaction)
+        ret |= hpssix_db_end_transaction(db);
+
+    return ret ? EIO : 0;
+}
@@ -0,0 +1,383 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * the search query builder. a search (hpssix_query_t) is turned into a
+ * parameterized statement, whose text depends only on which conditions are
+ * given (and their operators) and on the plan, never on the values. the values are passed as
+ * the parameters, so that any input is taken as it is, and the statement of
+ * the same shape is prepared once per session by hpssix_db_exec_prepared().
+ */
+#ifndef __HPSSIX_QUERY_H
+#define __HPSSIX_QUERY_H
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libpq-fe.h>
+
+#include "hpssix-db.h"
+
+enum {
+    HPSSIX_OP_NONE = -1,
+    HPSSIX_OP_EQ = 0,
+    HPSSIX_OP_GT = 1,
+    HPSSIX_OP_GE = 2,
+    HPSSIX_OP_LT = 3,
+    HPSSIX_OP_LE = 4,
+    HPSSIX_OP_NE = 5,
+    HPSSIX_OP_BETWEEN = 6,
+    HPSSIX_OP_BITAND = 7,
+};
+
+/* the stat attributes in hpssix_object */
+enum {
+    HPSSIX_QUERY_INODE = 0,
+    HPSSIX_QUERY_MODE,
+    HPSSIX_QUERY_UID,
+    HPSSIX_QUERY_GID,
+    HPSSIX_QUERY_SIZE,
+    HPSSIX_QUERY_ATIME,
+    HPSSIX_QUERY_MTIME,
+    HPSSIX_QUERY_CTIME,
+    N_HPSSIX_QUERY_FATTR,
+};
+
+struct _hpssix_query_cond {
+    int op;                 /* HPSSIX_OP_NONE if not given */
+    int64_t val1;
+    int64_t val2;           /* for HPSSIX_OP_BETWEEN */
+};
+
+typedef struct _hpssix_query_cond hpssix_query_cond_t;
+
+/*
+ * a tag (user.hpssix.* xattr), either compared as a number (op >= 0), or
+ * matched by a substring of the value.
+ */
+struct _hpssix_query_tag {
+    const char *name;       /* the full name, e.g., user.hpssix.projid */
+    const char *value;      /* the substring, when op < 0 */
+
+    int op;
+    double val1;
+    double val2;
+};
+
+typedef struct _hpssix_query_tag hpssix_query_tag_t;
+
+/*
+ * a position in the results, for the keyset pagination. the results are
+ * ordered by the oid, or by the rank and then the oid for the keyword
+ * searches. the token is "<oid>", or "<rank>,<oid>".
+ */
+struct _hpssix_query_key {
+    int valid;
+    uint64_t oid;
+    char rank[32];          /* as printed by the database, to compare exactly */
+};
+
+typedef struct _hpssix_query_key hpssix_query_key_t;
+
+#define HPSSIX_QUERY_MAX_TOKEN      64
+
+struct _hpssix_query_plan;
+
+/* the keys of a batch, in hpssix_query_keys */
+enum {
+    HPSSIX_QUERY_KEYS_NONE = 0,
+    HPSSIX_QUERY_KEYS_NAME,     /* the file names */
+    HPSSIX_QUERY_KEYS_PATH,     /* the paths, as stored (no mount point) */
+};
+
+struct _hpssix_query {
+    int removed;            /* the removed files instead of the valid ones */
+    int countonly;
+
+    hpssix_query_cond_t fattr[N_HPSSIX_QUERY_FATTR];
+
+    const char *name;       /* substring of the file name */
+    const char *path;       /* substring of the path */
+    const char *under;      /* a directory, as stored (no mount point) */
+
+    /*
+     * the files of each key loaded by hpssix_query_keys_load(), matched
+     * exactly, with the other conditions applied to all of them.
+     */
+    int keys;
+
+    uint32_t n_tags;
+    hpssix_query_tag_t *tags;
+
+    const char *keyword;
+
+    /*
+     * the document attributes (hpssix_attr_docmeta). a trailing '*' in the
+     * strings matches the prefix, and the author is matched ignoring the case.
+     */
+    const char *content_type;
+    const char *author;
+    const char *language;
+    hpssix_query_cond_t created;
+    hpssix_query_cond_t modified;
+    hpssix_query_cond_t pages;
+
+    uint64_t limit;         /* 0 for no limit */
+    hpssix_query_key_t after;   /* the results after this, if valid */
+
+    /* from hpssix_query_plan(), or NULL to drive by hpssix_object */
+    const struct _hpssix_query_plan *plan;
+};
+
+typedef struct _hpssix_query hpssix_query_t;
+
+#define HPSSIX_QUERY_MAX_PARAMS     256
+
+struct _hpssix_query_stmt {
+    char *sql;
+    int n_params;
+    char *params[HPSSIX_QUERY_MAX_PARAMS];
+};
+
+typedef struct _hpssix_query_stmt hpssix_query_stmt_t;
+
+/**
+ * @brief initialize @query with no conditions.
+ *
+ * @param query
+ */
+void hpssix_query_init(hpssix_query_t *query);
+
+/**
+ * @brief build the statement for @query. the rows are (oid, path), with the
+ * rank for the keyword searches, or a single count with @query->countonly.
+ * the keyword searches are ordered by the rank, and the others by the oid
+ * when they are paged (@query->limit or @query->after).
+ *
+ * with @query->keys, the key of each row is the last column, the results are
+ * in the order of the keys unless ordered as above, and the counts are of
+ * each key which has any.
+ *
+ * the statement starts from the driving predicate of @query->plan, and the
+ * other predicates follow as the semi-joins (EXISTS), in the order of the
+ * plan.
+ *
+ * @param query
+ * @param stmt [out] should be released with hpssix_query_stmt_free().
+ *
+ * @return 0 on success, EINVAL if @query has too many conditions, or the key
+ * or the plan is not of the search, ENOMEM.
+ */
+int hpssix_query_build(hpssix_query_t *query, hpssix_query_stmt_t *stmt);
+
+/**
+ * @brief load the keys of a batch, a line each, into hpssix_query_keys, a
+ * temporary table of the session, replacing the keys loaded before.
+ *
+ * @param db
+ * @param fp
+ * @param prefix the mount point, stripped from the paths, or NULL.
+ * @param n_keys [out]
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_query_keys_load(hpssix_db_t *db, FILE *fp, const char *prefix,
+                           uint64_t *n_keys);
+
+/**
+ * @brief release the statement and the parameters.
+ *
+ * @param stmt
+ */
+void hpssix_query_stmt_free(hpssix_query_stmt_t *stmt);
+
+/**
+ * @brief run @stmt as a prepared statement.
+ *
+ * @param db
+ * @param stmt
+ *
+ * @return the result, which should be cleared by the caller.
+ */
+static inline
+PGresult *hpssix_query_exec(hpssix_db_t *db, hpssix_query_stmt_t *stmt)
+{
+    return hpssix_db_exec_prepared(db, stmt->sql, stmt->n_params,
+                                   (const char * const *) stmt->params);
+}
+
+enum {
+    HPSSIX_QUERY_ESTIMATE_COUNTER = 0,  /* hpssix_object_count, exact */
+    HPSSIX_QUERY_ESTIMATE_PLANNER,      /* the row estimate of the plan */
+};
+
+struct _hpssix_query_estimate {
+    int source;
+    uint64_t rows;
+    uint64_t bound;         /* at most, UINT64_MAX if not counted */
+};
+
+typedef struct _hpssix_query_estimate hpssix_query_estimate_t;
+
+/**
+ * @brief estimate the number of the results of @query, without reading them.
+ * the searches by the owner and the type (-D, -F) only are summed from the
+ * counters of the last build, which are exact for the index. the others take
+ * the row estimate of the planner, which has no error bound of its own, but
+ * is capped by the counters of the valid (or removed) files with the same
+ * owner and type, as the upper bound.
+ *
+ * @param db
+ * @param query
+ * @param estimate [out]
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_query_estimate(hpssix_db_t *db, hpssix_query_t *query,
+                          hpssix_query_estimate_t *estimate);
+
+/* the predicates which can drive a search */
+enum {
+    HPSSIX_QUERY_PRED_OBJECT = 0,   /* hpssix_object, the stat attributes */
+    HPSSIX_QUERY_PRED_TAG,          /* hpssix_attr_val, a single tag */
+    HPSSIX_QUERY_PRED_KEYWORD,      /* hpssix_attr_document */
+};
+
+struct _hpssix_query_pred {
+    int type;
+    uint32_t tag;           /* the index in @query->tags */
+    int64_t rows;           /* the estimated rows, -1 if not known */
+};
+
+typedef struct _hpssix_query_pred hpssix_query_pred_t;
+
+#define HPSSIX_QUERY_MAX_PREDS      32
+
+/*
+ * the predicates of a search, the most selective (the driving one) first.
+ * the tags after the first @n_tags are not estimated, and follow the others.
+ */
+struct _hpssix_query_plan {
+    uint32_t n_preds;
+    uint32_t n_tags;
+    hpssix_query_pred_t preds[HPSSIX_QUERY_MAX_PREDS];
+};
+
+typedef struct _hpssix_query_plan hpssix_query_plan_t;
+
+/**
+ * @brief estimate the rows of each predicate of @query, and order them. the
+ * stat attributes are summed from hpssix_object_count where it can, the tags
+ * are bounded by the values of the key (hpssix_attr_key_count), and the
+ * keyword takes the planner estimate, from the lexeme frequencies of the
+ * last ANALYZE. the plan is used by setting @query->plan.
+ *
+ * @param db not in a transaction, which a failed lookup would abort.
+ * @param query
+ * @param plan [out]
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_query_plan(hpssix_db_t *db, hpssix_query_t *query,
+                      hpssix_query_plan_t *plan);
+
+/**
+ * @brief run @stmt with EXPLAIN ANALYZE, which executes it.
+ *
+ * @param db
+ * @param stmt
+ * @param res [out] a line of the plan in each row, which should be cleared by
+ * the caller.
+ *
+ * @return 0 on success, EIO otherwise.
+ */
+int hpssix_query_explain(hpssix_db_t *db, hpssix_query_stmt_t *stmt,
+                         PGresult **res);
+
+/**
+ * @brief parse the pagination @token, from hpssix_query_key_token().
+ *
+ * @param token
+ * @param key [out]
+ *
+ * @return 0 on success, EINVAL if @token is not valid.
+ */
+int hpssix_query_key_parse(const char *token, hpssix_query_key_t *key);
+
+/**
+ * @brief the key of a row, from which the next page starts.
+ *
+ * @param query
+ * @param res the rows of @query.
+ * @param row
+ * @param key [out]
+ *
+ * @return 0 on success, EINVAL if @row is not in @res.
+ */
+int hpssix_query_key_get(hpssix_query_t *query, PGresult *res, int row,
+                         hpssix_query_key_t *key);
+
+/**
+ * @brief format @key as a token.
+ *
+ * @param key
+ * @param buf [out] of HPSSIX_QUERY_MAX_TOKEN bytes.
+ */
+void hpssix_query_key_token(hpssix_query_key_t *key, char *buf);
+
+/*
+ * the results read in batches, through a cursor, so that the client keeps no
+ * more than @batch rows, and the first rows come without waiting for the
+ * whole result.
+ */
+struct _hpssix_query_cursor {
+    hpssix_db_t *db;
+    char name[32];
+    uint64_t batch;
+    int own_transaction;    /* opened by hpssix_query_open() */
+    int done;
+};
+
+typedef struct _hpssix_query_cursor hpssix_query_cursor_t;
+
+#define HPSSIX_QUERY_DEFAULT_BATCH  10000
+
+/**
+ * @brief declare a cursor on @stmt. a transaction is started if the session
+ * is not in one, which lasts until hpssix_query_close().
+ *
+ * @param db
+ * @param stmt
+ * @param batch the rows per hpssix_query_fetch(), 0 for the default.
+ * @param cursor [out]
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_query_open(hpssix_db_t *db, hpssix_query_stmt_t *stmt,
+                      uint64_t batch, hpssix_query_cursor_t *cursor);
+
+/**
+ * @brief fetch the next batch of rows.
+ *
+ * @param cursor
+ * @param res [out] the rows, which should be cleared by the caller. NULL
+ * after the last batch.
+ *
+ * @return 0 on success, EIO otherwise.
+ */
+int hpssix_query_fetch(hpssix_query_cursor_t *cursor, PGresult **res);
+
+/**
+ * @brief close the cursor, and end the transaction if it was started by
+ * hpssix_query_open().
+ *
+ * @param cursor
+ *
+ * @return 0 on success, EIO otherwise.
+ */
+int hpssix_query_close(hpssix_query_cursor_t *cursor);
+
+#endif /* __HPSSIX_QUERY_H */
@@ -0,0 +1,483 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hpssix-tsv.h"
+
+/* limits of the postgresql tsvector */
+#define TSV_MAX_LEXEME      2046
+#define TSV_MAX_POS         16383
+#define TSV_MAX_NPOS        256
+
+struct tsv_token {
+    const char *str;
+    uint32_t len;
+    uint32_t pos;
+    char weight;        /* 'A' or 0 (D) */
+};
+
+struct tsv_tokens {
+    struct tsv_token *tokens;
+    uint64_t count;
+    uint64_t size;
+};
+
+struct tsv_buf {
+    char *buf;
+    uint64_t len;
+    uint64_t size;
+};
+
+static inline int is_word_char(char ch)
+{
+    unsigned char c = (unsigned char) ch;
+
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static int tokens_add(struct tsv_tokens *list, const char *str, uint32_t len,
+                      uint32_t pos, char weight)
+{
+    struct tsv_token *token = NULL;
+
+    if (len == 0 || len > TSV_MAX_LEXEME)
+        return 0;       /* too long to be indexed, postgresql ignores it too */
+
+    if (list->count == list->size) {
+        uint64_t size = list->size ? list->size*2 : 1024;
+        struct tsv_token *tokens = NULL;
+
+        tokens = realloc(list->tokens, size*sizeof(*tokens));
+        if (!tokens)
+            return ENOMEM;
+
+        list->tokens = tokens;
+        list->size = size;
+    }
+
+    token = &list->tokens[list->count++];
+    token->str = str;
+    token->len = len;
+    token->pos = pos < TSV_MAX_POS ? pos : TSV_MAX_POS;
+    token->weight = weight;
+
+    return 0;
+}
+
+/*
+ * split the lowercased @buf into tokens. words joined by hyphens (e.g.,
+ * "x-ray") are added as a compound followed by each part, as the default
+ * postgresql parser does.
+ */
+static int tokenize(const char *buf, uint64_t len, char weight,
+                    struct tsv_tokens *list, uint32_t *pos)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    uint64_t start = 0;
+    uint64_t end = 0;
+
+    while (i < len) {
+        if (!is_word_char(buf[i])) {
+            i++;
+            continue;
+        }
+
+        start = i;
+        while (i < len && is_word_char(buf[i]))
+            i++;
+        end = i;
+
+        while (end + 1 < len && buf[end] == '-' && is_word_char(buf[end+1])) {
+            end++;
+            while (end < len && is_word_char(buf[end]))
+                end++;
+        }
+
+        if (end > i) {  /* compound */
+            ret = tokens_add(list, &buf[start], end - start, (*pos)++, weight);
+            if (ret)
+                return ret;
+
+            for (i = start; i < end; ) {
+                uint64_t part = i;
+
+                while (i < end && buf[i] != '-')
+                    i++;
+
+                ret = tokens_add(list, &buf[part], i - part, (*pos)++, weight);
+                if (ret)
+                    return ret;
+
+                if (i < end)
+                    i++;    /* skip the hyphen */
+            }
+        }
+        else {
+            ret = tokens_add(list, &buf[start], end - start, (*pos)++, weight);
+            if (ret)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
+/* lowercased copy of @str, cut at a character boundary within @max bytes */
+static char *lower_copy(const char *str, uint64_t max, uint64_t *len)
+{
+    uint64_t i = 0;
+    uint64_t n = 0;
+    char *buf = NULL;
+
+    n = strnlen(str, max);
+    if (n == max)
+        while (n > 0 && (str[n] & 0xc0) == 0x80)
+            n--;
+
+    buf = malloc(n + 1);
+    if (!buf)
+        return NULL;
+
+    for (i = 0; i < n; i++)
+        buf[i] = (str[i] >= 'A' && str[i] <= 'Z') ? str[i] + ('a' - 'A')
+                                                  : str[i];
+    buf[n] = '\0';
+    *len = n;
+
+    return buf;
+}
+
+static int buf_put(struct tsv_buf *out, const char *str, uint64_t len)
+{
+    if (out->len + len + 1 > out->size) {
+        uint64_t size = out->size ? out->size*2 : 4096;
+        char *buf = NULL;
+
+        while (size < out->len + len + 1)
+            size *= 2;
+
+        buf = realloc(out->buf, size);
+        if (!buf)
+            return ENOMEM;
+
+        out->buf = buf;
+        out->size = size;
+    }
+
+    memcpy(&out->buf[out->len], str, len);
+    out->len += len;
+    out->buf[out->len] = '\0';
+
+    return 0;
+}
+
+/* write a quoted lexeme, quotes and backslashes are escaped */
+static int buf_put_lexeme(struct tsv_buf *out, const char *str, uint32_t len)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    uint32_t from = 0;
+
+    ret = buf_put(out, "'", 1);
+
+    for (i = 0; i < len && !ret; i++) {
+        if (str[i] != '\'' && str[i] != '\\')
+            continue;
+
+        ret = buf_put(out, &str[from], i - from);
+        if (!ret)
+            ret = buf_put(out, str[i] == '\'' ? "''" : "\\\\", 2);
+        from = i + 1;
+    }
+
+    if (!ret)
+        ret = buf_put(out, &str[from], len - from);
+    if (!ret)
+        ret = buf_put(out, "'", 1);
+
+    return ret;
+}
+
+static int token_compare(const void *p1, const void *p2)
+{
+    const struct tsv_token *t1 = (const struct tsv_token *) p1;
+    const struct tsv_token *t2 = (const struct tsv_token *) p2;
+    int cmp = memcmp(t1->str, t2->str, t1->len < t2->len ? t1->len : t2->len);
+
+    if (cmp)
+        return cmp;
+    if (t1->len != t2->len)
+        return t1->len < t2->len ? -1 : 1;
+
+    return (int) t1->pos - (int) t2->pos;
+}
+
+static int write_tsvector(struct tsv_tokens *list, struct tsv_buf *out)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    uint32_t npos = 0;
+    uint32_t last = 0;
+    char posbuf[16] = { 0, };
+    struct tsv_token *prev = NULL;
+
+    qsort(list->tokens, list->count, sizeof(*list->tokens), token_compare);
+
+    for (i = 0; i < list->count && !ret; i++) {
+        struct tsv_token *token = &list->tokens[i];
+        int n = 0;
+
+        if (!prev || prev->len != token->len ||
+            memcmp(prev->str, token->str, token->len)) {
+            if (prev)
+                ret = buf_put(out, " ", 1);
+            if (!ret)
+                ret = buf_put_lexeme(out, token->str, token->len);
+            if (!ret)
+                ret = buf_put(out, ":", 1);
+
+            npos = 0;
+            last = 0;
+            prev = token;
+        }
+        else if (npos >= TSV_MAX_NPOS || token->pos == last)
+            continue;
+        else
+            ret = buf_put(out, ",", 1);
+
+        n = sprintf(posbuf, "%u%s", token->pos, token->weight ? "A" : "");
+        if (!ret)
+            ret = buf_put(out, posbuf, n);
+
+        npos++;
+        last = token->pos;
+    }
+
+    return ret;
+}
+
+int hpssix_tsv_build(const char *title, const char *text, char **tsv)
+{
+    int ret = 0;
+    uint32_t pos = 1;
+    uint64_t len = 0;
+    char *title_buf = NULL;
+    char *text_buf = NULL;
+    struct tsv_tokens list = { 0, };
+    struct tsv_buf out = { 0, };
+
+    if (!tsv)
+        return EINVAL;
+
+    if (title) {
+        title_buf = lower_copy(title, HPSSIX_TSV_MAX_INPUT, &len);
+        if (!title_buf) {
+            ret = ENOMEM;
+            goto out;
+        }
+
+        ret = tokenize(title_buf, len, 'A', &list, &pos);
+        if (ret)
+            goto out;
+    }
+
+    if (text) {
+        text_buf = lower_copy(text, HPSSIX_TSV_MAX_INPUT, &len);
+        if (!text_buf) {
+            ret = ENOMEM;
+            goto out;
+        }
+
+        ret = tokenize(text_buf, len, 0, &list, &pos);
+        if (ret)
+            goto out;
+    }
+
+    ret = buf_put(&out, "", 0);     /* an empty tsvector, at least */
+    if (!ret)
+        ret = write_tsvector(&list, &out);
+
+out:
+    if (ret) {
+        free(out.buf);
+        out.buf = NULL;
+    }
+
+    *tsv = out.buf;
+
+    free(list.tokens);
+    free(text_buf);
+    free(title_buf);
+
+    return ret;
+}
+
+static inline const char *skip_space(const char *pos)
+{
+    while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')
+        pos++;
+
+    return pos;
+}
+
+/* append the utf-8 encoding of @code to @out */
+static int buf_put_utf8(struct tsv_buf *out, unsigned int code)
+{
+    char buf[4] = { 0, };
+    int n = 0;
+
+    if (code == 0 || (code >= 0xd800 && code <= 0xdfff))
+        buf[n++] = ' ';     /* not to produce an invalid utf-8 */
+    else if (code < 0x80)
+        buf[n++] = code;
+    else if (code < 0x800) {
+        buf[n++] = 0xc0 | (code >> 6);
+        buf[n++] = 0x80 | (code & 0x3f);
+    }
+    else {
+        buf[n++] = 0xe0 | (code >> 12);
+        buf[n++] = 0x80 | ((code >> 6) & 0x3f);
+        buf[n++] = 0x80 | (code & 0x3f);
+    }
+
+    return buf_put(out, buf, n);
+}
+
+/* unescape the json string at @pos (after the opening quote) */
+static char *json_string(const char *pos)
+{
+    int ret = 0;
+    unsigned int code = 0;
+    struct tsv_buf out = { 0, };
+
+    ret = buf_put(&out, "", 0);
+
+    for ( ; *pos && *pos != '"' && !ret; pos++) {
+        if (*pos != '\\') {
+            ret = buf_put(&out, pos, 1);
+            continue;
+        }
+
+        switch (*++pos) {
+        case 'n': case 't': case 'r': case 'b': case 'f':
+            ret = buf_put(&out, " ", 1);
+            break;
+        case 'u':
+            if (sscanf(pos + 1, "%4x", &code) != 1)
+                goto out;
+            ret = buf_put_utf8(&out, code);
+            pos += 4;
+            break;
+        case '\0':
+            goto out;
+        default:    /* \", \\, \/ */
+            ret = buf_put(&out, pos, 1);
+            break;
+        }
+    }
+
+out:
+    if (ret) {
+        free(out.buf);
+        return NULL;
+    }
+
+    return out.buf;
+}
+
+char *hpssix_tsv_meta_title(const char *meta)
+{
+    const char *pos = NULL;
+    const char *end = NULL;
+    int depth = 0;
+
+    if (!meta)
+        return NULL;
+
+    for (pos = strstr(meta, "\"title\""); pos;
+         pos = strstr(pos + 1, "\"title\"")) {
+        const char *value = skip_space(pos + 7);
+
+        if (*value != ':')
+            continue;
+
+        value = skip_space(value + 1);
+
+        if (*value == '"')
+            return json_string(value + 1);
+
+        /* arrays and scalars are taken in the json text */
+        for (end = value; *end; end++) {
+            if (*end == '[' || *end == '{')
+                depth++;
+            else if (*end == ']' || *end == '}') {
+                if (depth == 0)
+                    break;
+                if (--depth == 0) {
+                    end++;
+                    break;
+                }
+            }
+            else if (*end == ',' && depth == 0)
+                break;
+        }
+
+        return strndup(value, end - value);
+    }
+
+    return NULL;
+}
+
+int hpssix_tsv_query(const char *keyword, char **query)
+{
+    int ret = 0;
+    uint32_t pos = 1;
+    uint64_t i = 0;
+    uint64_t len = 0;
+    char *buf = NULL;
+    struct tsv_tokens list = { 0, };
+    struct tsv_buf out = { 0, };
+
+    if (!keyword || !query)
+        return EINVAL;
+
+    buf = lower_copy(keyword, HPSSIX_TSV_MAX_INPUT, &len);
+    if (!buf)
+        return ENOMEM;
+
+    ret = tokenize(buf, len, 0, &list, &pos);
+    if (!ret)
+        ret = buf_put(&out, "", 0);
+
+    for (i = 0; i < list.count && !ret; i++) {
+        if (i > 0)
+            ret = buf_put(&out, " & ", 3);
+        if (!ret)
+            ret = buf_put_lexeme(&out, list.tokens[i].str, list.tokens[i].len);
+    }
+
+    if (ret) {
+        free(out.buf);
+        out.buf = NULL;
+    }
+
+    *query = out.buf;
+
+    free(list.tokens);
+    free(buf);
+
+    return ret;
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * client side tsvector preparation. the text is split into words (runs of
+ * ascii letters and digits, and non-ascii utf-8 characters), lowercased, and
+ * written as a tsvector literal with the positions and weights, so that the
+ * database stores it without running to_tsvector() in the trigger.
+ *
+ * the lexemes are not stemmed and the stopwords are kept, as the 'simple' text
+ * search configuration, which documents_search_trigger() and the searches
+ * use. searches also match them with a tsquery built by hpssix_tsv_query()
+ * from the same tokenizer.
+ */
+#ifndef __HPSSIX_TSV_H
+#define __HPSSIX_TSV_H
+#include <config.h>
+
+#include <stdint.h>
+
+/* the same bound as documents_search_trigger() */
+#define HPSSIX_TSV_MAX_INPUT    1048576
+
+/**
+ * @brief build a tsvector literal from the title (weight A) and the text
+ * (weight D). only the first HPSSIX_TSV_MAX_INPUT bytes of @text are used.
+ *
+ * @param title can be NULL.
+ * @param text can be NULL.
+ * @param tsv [out] the tsvector literal, should be freed by the caller.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_tsv_build(const char *title, const char *text, char **tsv);
+
+/**
+ * @brief find the title in the document metadata (tika json), as meta->>'title'
+ * does in the database. an array value is returned in its json text.
+ *
+ * @param meta
+ *
+ * @return the title which should be freed by the caller, NULL if not found.
+ */
+char *hpssix_tsv_meta_title(const char *meta);
+
+/**
+ * @brief build a tsquery literal which matches the documents with all words
+ * in @keyword, as plainto_tsquery() does, for the tsvectors built by
+ * hpssix_tsv_build().
+ *
+ * @param keyword
+ * @param query [out] the tsquery literal (empty if @keyword has no word),
+ * should be freed by the caller.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_tsv_query(const char *keyword, char **query);
+
+#endif /* __HPSSIX_TSV_H */
@@ -54,9 +54,8 @@ static int create_directory(const char *path)
     return ret;
 }
 
-static inline void dirname_today(char *buf)
+static inline void dirname_of(time_t now_time, char *buf)
 {
-    time_t now_time = { 0, };
     struct tm now = { 0, };
     int year = 0;
     int mm = 0;
@@ -65,7 +64,6 @@ static inline void dirname_today(char *buf)
     if (!buf)
         return;
 
-    now_time = time(NULL);
     localtime_r(&now_time, &now);
 
     year = now.tm_year + 1900;
@@ -76,6 +74,11 @@ static inline void dirname_today(char *buf)
                  hpssix_work_root, year, year, mm, dd);
 }
 
+static inline void dirname_today(char *buf)
+{
+    dirname_of(time(NULL), buf);
+}
+
 /* directory structure:
  *
  * For storing the master db (mdb):
@@ -149,6 +152,34 @@ int hpssix_get_datadir_today(char *pathbuf, uint64_t buflen)
     return ret;
 }
 
+int hpssix_get_datadir(uint64_t task_id, char *pathbuf, uint64_t buflen)
+{
+    int ret = 0;
+    struct stat sb = { 0, };
+
+    if (!pathbuf)
+        return EINVAL;
+
+    if (buflen < strlen(hpssix_work_root) + 20)
+        return ENOSPC;
+
+    /* the task id is the time when the scanner started the task */
+    dirname_of((time_t) task_id, pathbuf);
+
+    ret = stat(pathbuf, &sb);
+    if (ret < 0 && errno == ENOENT) {
+        ret = hpssix_create_work_directories();
+        if (ret)
+            return ret;
+
+        ret = stat(pathbuf, &sb);
+        if (ret < 0)
+            return errno;
+    }
+
+    return 0;
+}
+
 char *hpssix_find_hpss_mountpoint(void)
 {
     struct mntent *ent = NULL;
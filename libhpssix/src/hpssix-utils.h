@@ -38,6 +38,19 @@ const char *hpssix_get_work_root(void);
  */
 int hpssix_get_datadir_today(char *pathbuf, uint64_t buflen);
 
+/**
+ * @brief get the data directory of the task, which is the directory of the
+ * day when the task has started. unlike hpssix_get_datadir_today(), this
+ * stays the same if the task runs past midnight, or is resumed later.
+ *
+ * @param task_id
+ * @param pathbuf
+ * @param buflen
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_get_datadir(uint64_t task_id, char *pathbuf, uint64_t buflen);
+
 /**
  * @brief
  *
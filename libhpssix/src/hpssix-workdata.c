@@ -11,6 +11,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "hpssix-workdata.h"
 
@@ -22,7 +27,11 @@ static const char *workdata_schema =
 "create table hpssix_workdata (\n"
 "    id integer primary key,\n"
 "    pid integer not null,\n"
-"    path text not null\n"
+"    path text not null,\n"
+"    size integer not null default 0,\n"
+"    mtime integer not null default 0,\n"
+"    hash integer not null default 0,\n"
+"    locality text\n"
 ");\n"
 "\n"
 "end transaction;\n";
@@ -37,13 +46,15 @@ enum {
 static const char *workdata_sqls[N_HPSSIX_WORKDATA_SQLS] =
 {
     /* HPSSIX_WORKDATA_SQL_APPEND */
-    "insert into hpssix_workdata (pid,path) values (?,?)",
+    "insert into hpssix_workdata (pid,path,size,mtime,hash,locality)\n"
+    "values (?,?,?,?,?,?)",
 
     /* HPSSIX_WORKDATA_SQL_TOTALCOUNT */
     "select count(id) from hpssix_workdata",
 
     /* HPSSIX_WORKDATA_SQL_FETCH */
-    "select pid,path from hpssix_workdata order by id asc limit ?,?",
+    "select pid,path,size,mtime,hash,locality from hpssix_workdata\n"
+    "order by id asc limit ?,?",
 };
 
 enum { HPSSIX_WORKDATA_OPEN = 0, HPSSIX_WORKDATA_CREATE = 1 };
@@ -77,6 +88,12 @@ static int __hpssix_workdata_open(hpssix_workdata_t *self, const char *name,
 
 int hpssix_workdata_create(hpssix_workdata_t *self, const char *name)
 {
+    char progress[PATH_MAX] = { 0, };
+
+    /* the progress of the previous workdata is not valid anymore */
+    if (name)
+        unlink(hpssix_workdata_progress_filename(name, progress));
+
     return __hpssix_workdata_open(self, name, HPSSIX_WORKDATA_CREATE);
 }
 
@@ -95,16 +112,35 @@ int hpssix_workdata_close(hpssix_workdata_t *self)
 
 int hpssix_workdata_append(hpssix_workdata_t *self,
                            uint64_t pid, const char *path)
+{
+    hpssix_workdata_object_t object = { 0, };
+
+    object.object_id = pid;
+    object.path = (char *) path;
+
+    return hpssix_workdata_append_object(self, &object);
+}
+
+int hpssix_workdata_append_object(hpssix_workdata_t *self,
+                                  hpssix_workdata_object_t *object)
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
 
-    if (!self || !path)
+    if (!self || !object || !object->path)
         return EINVAL;
 
     stmt = hpssix_tmpdb_stmt_get(&self->tmpdb, HPSSIX_WORKDATA_SQL_APPEND);
-    ret = sqlite3_bind_int64(stmt, 1, pid);
-    ret |= sqlite3_bind_text(stmt, 2, path, -1, SQLITE_STATIC);
+    ret = sqlite3_bind_int64(stmt, 1, object->object_id);
+    ret |= sqlite3_bind_text(stmt, 2, object->path, -1, SQLITE_STATIC);
+    ret |= sqlite3_bind_int64(stmt, 3, object->size);
+    ret |= sqlite3_bind_int64(stmt, 4, object->mtime);
+    ret |= sqlite3_bind_int64(stmt, 5, object->hash);
+    if (object->locality)
+        ret |= sqlite3_bind_text(stmt, 6, object->locality, -1,
+                                 SQLITE_STATIC);
+    else
+        ret |= sqlite3_bind_null(stmt, 6);
     if (ret) {
         ret = EIO;
         goto out;
@@ -203,6 +239,18 @@ int hpssix_workdata_dispatch(hpssix_workdata_t *self,
             hpssix_workdata_cleanup_object_list(object_list, count);
             goto out;
         }
+        current->size = sqlite3_column_int64(stmt, 2);
+        current->mtime = sqlite3_column_int64(stmt, 3);
+        current->hash = sqlite3_column_int64(stmt, 4);
+        if (sqlite3_column_type(stmt, 5) != SQLITE_NULL) {
+            current->locality =
+                strdup((const char *) sqlite3_column_text(stmt, 5));
+            if (!current->locality) {
+                ret = ENOMEM;
+                hpssix_workdata_cleanup_object_list(object_list, count + 1);
+                goto out;
+            }
+        }
 
         count++;
     } while (sqlite3_step(stmt) == SQLITE_ROW);
@@ -218,3 +266,153 @@ out:
     return ret;
 }
 
+/*
+ * extraction progress
+ */
+
+#define PROGRESS_MAGIC          "HPSSIXDN"
+#define PROGRESS_HEADER_SIZE    4096
+
+struct _hpssix_workdata_progress_header {
+    char magic[8];
+    uint64_t count;
+    uint64_t n_done;
+};
+
+static const uint64_t progress_default_sync_interval = 256;
+
+int hpssix_workdata_progress_open(hpssix_workdata_progress_t *self,
+                                  const char *name, uint64_t count)
+{
+    int ret = 0;
+    int fd = -1;
+    void *map = NULL;
+    uint64_t mapsize = 0;
+    struct stat sb = { 0, };
+    char path[PATH_MAX] = { 0, };
+    struct _hpssix_workdata_progress_header *header = NULL;
+
+    if (!self || !name)
+        return EINVAL;
+
+    hpssix_workdata_progress_filename(name, path);
+    mapsize = PROGRESS_HEADER_SIZE + (count + 7)/8;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return errno;
+
+    ret = fstat(fd, &sb);
+    if (ret < 0)
+        goto out_err;
+
+    if (sb.st_size != mapsize) {
+        ret = ftruncate(fd, 0);
+        ret |= ftruncate(fd, mapsize);
+        if (ret < 0)
+            goto out_err;
+    }
+
+    map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        goto out_err;
+
+    header = (struct _hpssix_workdata_progress_header *) map;
+
+    if (memcmp(header->magic, PROGRESS_MAGIC, 8) || header->count != count) {
+        memset(map, 0, mapsize);
+        memcpy(header->magic, PROGRESS_MAGIC, 8);
+        header->count = count;
+
+        if (msync(map, mapsize, MS_SYNC) < 0) {
+            munmap(map, mapsize);
+            goto out_err;
+        }
+    }
+    else {
+        uint64_t i = 0;
+        uint64_t n_done = 0;
+        uint8_t *bitmap = (uint8_t *) map + PROGRESS_HEADER_SIZE;
+
+        /* the counter might not have been synced with the bits */
+        for (i = 0; i < (count + 7)/8; i++)
+            n_done += __builtin_popcount(bitmap[i]);
+
+        header->n_done = n_done;
+    }
+
+    self->fd = fd;
+    self->count = count;
+    self->mapsize = mapsize;
+    self->header = header;
+    self->bitmap = (uint8_t *) map + PROGRESS_HEADER_SIZE;
+    self->n_unsynced = 0;
+    if (!self->sync_interval)
+        self->sync_interval = progress_default_sync_interval;
+
+    return 0;
+
+out_err:
+    ret = errno;
+    close(fd);
+
+    return ret;
+}
+
+int hpssix_workdata_progress_close(hpssix_workdata_progress_t *self)
+{
+    int ret = 0;
+
+    if (!self || !self->header)
+        return EINVAL;
+
+    ret = hpssix_workdata_progress_sync(self);
+
+    munmap((void *) self->header, self->mapsize);
+    close(self->fd);
+
+    self->header = NULL;
+    self->bitmap = NULL;
+    self->fd = -1;
+
+    return ret;
+}
+
+int hpssix_workdata_progress_mark(hpssix_workdata_progress_t *self,
+                                  uint64_t index)
+{
+    uint8_t bit = 0;
+    uint8_t old = 0;
+
+    if (!self || index >= self->count)
+        return EINVAL;
+
+    bit = 1 << (index & 7);
+
+    old = __sync_fetch_and_or(&self->bitmap[index >> 3], bit);
+    if (old & bit)
+        return 0;
+
+    __sync_fetch_and_add(&self->header->n_done, 1);
+
+    if (__sync_add_and_fetch(&self->n_unsynced, 1) % self->sync_interval == 0)
+        return hpssix_workdata_progress_sync(self);
+
+    return 0;
+}
+
+int hpssix_workdata_progress_sync(hpssix_workdata_progress_t *self)
+{
+    if (!self || !self->header)
+        return EINVAL;
+
+    if (msync((void *) self->header, self->mapsize, MS_SYNC) < 0)
+        return errno;
+
+    return 0;
+}
+
+uint64_t hpssix_workdata_progress_count_done(hpssix_workdata_progress_t *self)
+{
+    return self && self->header ? self->header->n_done : 0;
+}
@@ -28,6 +28,11 @@ typedef struct _hpssix_workdata hpssix_workdata_t;
 struct _hpssix_workdata_object {
     uint64_t object_id;
     char *path;
+
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t hash;      /* fingerprint hash from the previous run, 0 if none */
+    char *locality;     /* storage locality key, NULL if not known */
 };
 
 typedef struct _hpssix_workdata_object hpssix_workdata_object_t;
@@ -48,9 +53,12 @@ hpssix_workdata_cleanup_object_list(hpssix_workdata_object_t *list,
     uint64_t i = 0;
 
     if (list) {
-        for (i = 0; i < count; i++)
+        for (i = 0; i < count; i++) {
             if (list[i].path)
                 free(list[i].path);
+            if (list[i].locality)
+                free(list[i].locality);
+        }
         free(list);
     }
 }
@@ -97,6 +105,20 @@ int hpssix_workdata_close(hpssix_workdata_t *self);
 int hpssix_workdata_append(hpssix_workdata_t *self,
                            uint64_t pid, const char *path);
 
+/**
+ * @brief append an object along with its size, mtime, the previous
+ * fingerprint hash (@object->hash, 0 if not available) and the storage
+ * locality (@object->locality, can be NULL). the objects are dispatched in
+ * the appended order.
+ *
+ * @param self
+ * @param object
+ *
+ * @return 0 on success, errno otherwise
+ */
+int hpssix_workdata_append_object(hpssix_workdata_t *self,
+                                  hpssix_workdata_object_t *object);
+
 /**
  * @brief
  *
@@ -118,6 +140,111 @@ int hpssix_workdata_get_total_count(hpssix_workdata_t *self, uint64_t *count);
 int hpssix_workdata_dispatch(hpssix_workdata_t *self,
                              hpssix_workdata_worklist_t *list);
 
+/*
+ * extraction progress: a done-bitmap file next to the workdata
+ * (<workdata>.done), indexed by the position of the object in the workdata
+ * (the offset used in hpssix_workdata_dispatch()). the file is mapped, and
+ * the bits are set atomically, so a single progress can be shared by the
+ * threads. the dirty pages are synced every @sync_interval marks.
+ */
+struct _hpssix_workdata_progress_header;
+
+struct _hpssix_workdata_progress {
+    int fd;
+    uint64_t count;             /* total objects in the workdata */
+    uint64_t mapsize;
+    struct _hpssix_workdata_progress_header *header;
+    uint8_t *bitmap;
+
+    uint64_t sync_interval;     /* 0 for the default (256) */
+    uint64_t n_unsynced;
+};
+
+typedef struct _hpssix_workdata_progress hpssix_workdata_progress_t;
+
+/**
+ * @brief open (or create) the progress file of the workdata @name. if the
+ * existing file does not match @count, it is reset.
+ *
+ * @param self
+ * @param name the workdata file name.
+ * @param count the total number of objects in the workdata.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_workdata_progress_open(hpssix_workdata_progress_t *self,
+                                  const char *name, uint64_t count);
+
+/**
+ * @brief sync and close the progress file.
+ *
+ * @param self
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_workdata_progress_close(hpssix_workdata_progress_t *self);
+
+/**
+ * @brief
+ *
+ * @param self
+ * @param index
+ *
+ * @return non-zero if the object at @index has been done.
+ */
+static inline int hpssix_workdata_progress_isdone(
+                            hpssix_workdata_progress_t *self, uint64_t index)
+{
+    if (index >= self->count)
+        return 0;
+
+    return (self->bitmap[index >> 3] >> (index & 7)) & 1;
+}
+
+/**
+ * @brief mark the object at @index done.
+ *
+ * @param self
+ * @param index
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_workdata_progress_mark(hpssix_workdata_progress_t *self,
+                                  uint64_t index);
+
+/**
+ * @brief flush the marks to the disk.
+ *
+ * @param self
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_workdata_progress_sync(hpssix_workdata_progress_t *self);
+
+/**
+ * @brief
+ *
+ * @param self
+ *
+ * @return the number of objects done.
+ */
+uint64_t hpssix_workdata_progress_count_done(hpssix_workdata_progress_t *self);
+
+/**
+ * @brief get the progress file name of the workdata @name.
+ *
+ * @param name
+ * @param buf
+ *
+ * @return @buf
+ */
+static inline char *hpssix_workdata_progress_filename(const char *name,
+                                                      char *buf)
+{
+    sprintf(buf, "%s.done", name);
+    return buf;
+}
+
 /**
  * @brief
  *
@@ -20,6 +20,8 @@
 #include "hpssix-db.h"
 #include "hpssix-mdb.h"
 #include "hpssix-workdata.h"
+#include "hpssix-tsv.h"
+#include "hpssix-docmeta.h"
 
 struct _hpssix_context {
     hpssix_config_t *config;
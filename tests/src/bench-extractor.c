@@ -0,0 +1,590 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * extractor benchmark without a tika server or an hpss mount.
+ *
+ * synthetic files are generated in a scratch directory with a log-normal size
+ * distribution (the median and the spread can be given), and listed in a
+ * workdata as the builder would. the files then go through the same per-file
+ * path as in hpssix-extractor (hpssix-extractor-file.c), with the workdata
+ * dispatch, the prefetch stage, the limiter, and the tika pool, against local
+ * tika stubs answering with the latency and the parsing speed of the chosen
+ * profile. there is no database, so the documents are dropped instead of
+ * going to the document sink.
+ *
+ * reports docs/sec, bytes/sec, the latency percentiles per document, and the
+ * cpu time per document. with the same seed, the same files are generated.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <hpssix.h>
+#include "hpssix-extractor.h"
+#include "tika-stub.h"
+#include "testlib.h"
+
+struct bench_profile {
+    const char *name;
+    int delay_ms;
+    int jitter_ms;
+    uint64_t bytes_per_sec;
+    int fail_permille;
+};
+
+static struct bench_profile profiles[] = {
+    { "fast",    1,   1,   512*(1<<20), 0 },
+    { "typical", 20,  20,  32*(1<<20),  5 },
+    { "slow",    100, 100, 4*(1<<20),   20 },
+};
+
+static const int n_profiles = sizeof(profiles)/sizeof(profiles[0]);
+
+#define MAX_STUBS   16
+
+static struct tika_stub stubs[MAX_STUBS];
+static hpssix_extractor_pool_t pool;
+static hpssix_extractor_limiter_t limiter;
+static hpssix_extractor_stage_t stage;
+
+/* parameters */
+static uint64_t n_files = 2000;
+static uint64_t median_size = 32*1024;
+static double size_sigma = 1.5F;
+static uint64_t max_size = 16*(1<<20);
+static uint64_t nthreads = 8;
+static uint64_t nprefetch;
+static uint64_t n_stubs = 1;
+static uint64_t batch_size = 128;
+static int adaptive = 1;
+static uint64_t seed = 1;
+static int keep;
+static struct bench_profile *profile = &profiles[1];
+
+static char scratch[PATH_MAX];
+static char dbpath[PATH_MAX];
+
+static hpssix_extractor_file_t extraction = {
+    .prefix = scratch,
+    .upload_mode = HPSSIX_EXTRACTOR_UPLOAD_PREAD,
+    .pool = &pool,
+    .limiter = &limiter,
+    .stage = &stage,
+};
+
+static uint64_t dispatch_next;
+
+/* results */
+static double *latencies;       /* per document, indexed in the workdata */
+static hpssix_extractor_watch_t *watches;
+static hpssix_extractor_file_stat_t *file_stats;   /* per thread */
+static volatile uint64_t n_done;
+static volatile uint64_t n_failed;
+static volatile uint64_t bytes_done;
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+/* xorshift64*, not to depend on the libc rand(3) */
+static inline uint64_t next_random(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+
+    return seed*2685821657736338717UL;
+}
+
+static inline double next_uniform(void)
+{
+    return ((next_random() >> 11) + 0.5F)/9007199254740992.0F;
+}
+
+static uint64_t next_size(void)
+{
+    double u1 = next_uniform();
+    double u2 = next_uniform();
+    double z = sqrt(-2.0F*log(u1))*cos(2.0F*M_PI*u2);
+    double size = median_size*exp(size_sigma*z);
+
+    if (size < 1.0F)
+        size = 1.0F;
+    if (size > max_size)
+        size = max_size;
+
+    return (uint64_t) size;
+}
+
+static void write_file(const char *path, uint64_t size)
+{
+    int fd = -1;
+    char buf[65536];
+    uint64_t i = 0;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = 'a' + next_random() % 26;
+
+    fd = open(path, O_CREAT|O_WRONLY|O_TRUNC, 0644);
+    if (fd < 0)
+        die("cannot create %s (%s)\n", path, strerror(errno));
+
+    while (size > 0) {
+        size_t count = size < sizeof(buf) ? size : sizeof(buf);
+
+        if (write(fd, buf, count) != (ssize_t) count)
+            die("cannot write %s (%s)\n", path, strerror(errno));
+
+        size -= count;
+    }
+
+    close(fd);
+}
+
+/* files in directories of 100, like the builder would list them */
+static void generate_workdata(void)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    uint64_t total = 0;
+    char path[PATH_MAX] = { 0, };
+    char name[PATH_MAX] = { 0, };
+    char locality[64] = { 0, };
+    hpssix_workdata_t wd = { 0, };
+
+    sprintf(scratch, "/tmp/bench-extractor.XXXXXX");
+    if (!mkdtemp(scratch))
+        die("mkdtemp failed (%s)\n", strerror(errno));
+
+    sprintf(dbpath, "%s/workdata.db", scratch);
+
+    ret = hpssix_workdata_create(&wd, dbpath);
+    if (ret)
+        die("hpssix_workdata_create failed (%d)\n", ret);
+
+    hpssix_workdata_begin_transaction(&wd);
+
+    for (i = 0; i < n_files; i++) {
+        hpssix_workdata_object_t object = { 0, };
+
+        if (i % 100 == 0) {
+            sprintf(path, "%s/d%04lu", scratch, i/100);
+            mkdir(path, 0755);
+        }
+
+        sprintf(name, "/d%04lu/f%08lu.dat", i/100, i);
+        sprintf(path, "%s%s", scratch, name);
+        sprintf(locality, "dir:/d%04lu", i/100);
+
+        object.object_id = i + 1;
+        object.path = name;
+        object.size = next_size();
+        object.mtime = 1;
+        object.locality = locality;
+
+        write_file(path, object.size);
+        total += object.size;
+
+        ret = hpssix_workdata_append_object(&wd, &object);
+        if (ret)
+            die("hpssix_workdata_append_object failed (%d)\n", ret);
+    }
+
+    hpssix_workdata_end_transaction(&wd);
+    hpssix_workdata_close(&wd);
+
+    printf("## generated %lu files, %lu bytes (median %lu, sigma %.2lf) "
+           "in %s\n", n_files, total, median_size, size_sigma, scratch);
+}
+
+static void remove_scratch(void)
+{
+    char cmd[PATH_MAX + 16] = { 0, };
+
+    sprintf(cmd, "rm -rf %s", scratch);
+    if (system(cmd))
+        fprintf(stderr, "cannot remove %s\n", scratch);
+}
+
+static inline int get_next_batch(uint64_t *offset, uint64_t *count)
+{
+    uint64_t _offset = __sync_fetch_and_add(&dispatch_next, batch_size);
+
+    if (_offset >= n_files)
+        return 0;
+
+    *offset = _offset;
+    *count = n_files - _offset < batch_size ? n_files - _offset : batch_size;
+
+    return 1;
+}
+
+static void account(hpssix_workdata_object_t *object, uint64_t index, int ret,
+                    double started)
+{
+    latencies[index] = now_sec() - started;
+
+    __sync_fetch_and_add(&n_done, 1);
+    if (ret)
+        __sync_fetch_and_add(&n_failed, 1);
+    if (!ret || ret == EINVAL)
+        __sync_fetch_and_add(&bytes_done, object->size);
+}
+
+static void *prefetch_func(void *arg)
+{
+    uint64_t id = (uint64_t) arg;
+    uint64_t i = 0;
+    hpssix_workdata_t wd = { 0, };
+    hpssix_workdata_worklist_t list = { 0, };
+
+    if (hpssix_workdata_open(&wd, dbpath))
+        die("hpssix_workdata_open failed\n");
+
+    while (get_next_batch(&list.offset, &list.count)) {
+        if (hpssix_workdata_dispatch(&wd, &list))
+            die("hpssix_workdata_dispatch failed\n");
+
+        for (i = 0; i < list.count; i++) {
+            hpssix_extractor_staged_t *staged = calloc(1, sizeof(*staged));
+
+            if (!staged)
+                die("calloc failed\n");
+
+            staged->object = list.object_list[i];
+            staged->index = list.offset + i;
+            list.object_list[i].path = NULL;
+            list.object_list[i].locality = NULL;
+
+            /* the latency counts from the time the file is taken */
+            latencies[staged->index] = now_sec();
+
+            hpssix_extractor_file_prefetch(&extraction, id, &watches[id],
+                                           &file_stats[id], staged);
+        }
+
+        hpssix_workdata_cleanup_object_list(list.object_list, list.count);
+        list.object_list = NULL;
+    }
+
+    hpssix_workdata_close(&wd);
+    hpssix_extractor_stage_producer_done(&stage);
+
+    return (void *) 0;
+}
+
+static void *worker_func(void *arg)
+{
+    uint64_t id = (uint64_t) arg;
+    int ret = 0;
+    uint64_t i = 0;
+    hpssix_workdata_t wd = { 0, };
+    hpssix_workdata_worklist_t list = { 0, };
+    hpssix_extractor_staged_t *staged = NULL;
+
+    if (nprefetch > 0) {
+        while ((staged = hpssix_extractor_stage_pop(&stage)) != NULL) {
+            double started = latencies[staged->index];
+
+            ret = hpssix_extractor_file_extract(&extraction, id, &watches[id],
+                                                &file_stats[id],
+                                                &staged->object,
+                                                staged->index, staged, NULL);
+            account(&staged->object, staged->index, ret, started);
+
+            hpssix_extractor_staged_free(&stage, staged);
+        }
+
+        hpssix_extractor_stage_consumer_done(&stage);
+
+        return (void *) 0;
+    }
+
+    if (hpssix_workdata_open(&wd, dbpath))
+        die("hpssix_workdata_open failed\n");
+
+    while (get_next_batch(&list.offset, &list.count)) {
+        if (hpssix_workdata_dispatch(&wd, &list))
+            die("hpssix_workdata_dispatch failed\n");
+
+        for (i = 0; i < list.count; i++) {
+            double started = now_sec();
+
+            ret = hpssix_extractor_file_extract(&extraction, id, &watches[id],
+                                                &file_stats[id],
+                                                &list.object_list[i],
+                                                list.offset + i, NULL, NULL);
+            account(&list.object_list[i], list.offset + i, ret, started);
+        }
+
+        hpssix_workdata_cleanup_object_list(list.object_list, list.count);
+        list.object_list = NULL;
+    }
+
+    hpssix_workdata_close(&wd);
+
+    return (void *) 0;
+}
+
+static int compare_double(const void *p1, const void *p2)
+{
+    double d1 = *(const double *) p1;
+    double d2 = *(const double *) p2;
+
+    return d1 < d2 ? -1 : d1 > d2;
+}
+
+static inline double percentile(double *sorted, uint64_t n, double p)
+{
+    uint64_t pos = (uint64_t) (p*(n - 1) + 0.5F);
+
+    return sorted[pos];
+}
+
+static inline double rusage_sec(struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec/1e6 +
+           ru->ru_stime.tv_sec + ru->ru_stime.tv_usec/1e6;
+}
+
+static void run(void)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    double started = .0F;
+    double elapsed = .0F;
+    double cpu = .0F;
+    uint64_t n_total = nthreads + nprefetch;
+    pthread_t *threads = NULL;
+    char buf[MAX_STUBS][32];
+    char *endpoints[MAX_STUBS];
+    struct rusage ru_before = { 0, };
+    struct rusage ru_after = { 0, };
+
+    for (i = 0; i < n_stubs; i++) {
+        stubs[i].delay_ms = profile->delay_ms;
+        stubs[i].jitter_ms = profile->jitter_ms;
+        stubs[i].bytes_per_sec = profile->bytes_per_sec;
+        stubs[i].fail_permille = profile->fail_permille;
+
+        if (tika_stub_start(&stubs[i]))
+            die("tika_stub_start failed\n");
+
+        sprintf(buf[i], "127.0.0.1:%d", stubs[i].port);
+        endpoints[i] = buf[i];
+    }
+
+    hpssix_extractor_global_init();
+
+    ret = hpssix_extractor_pool_init(&pool, endpoints, n_stubs);
+    if (ret)
+        die("hpssix_extractor_pool_init failed (%d)\n", ret);
+
+    hpssix_extractor_limiter_init(&limiter, nthreads, adaptive);
+
+    if (nprefetch > 0 &&
+        hpssix_extractor_stage_init(&stage, 256*(1<<20), nprefetch, nthreads))
+        die("hpssix_extractor_stage_init failed\n");
+
+    latencies = calloc(n_files, sizeof(*latencies));
+    threads = calloc(n_total, sizeof(*threads));
+    watches = calloc(n_total, sizeof(*watches));
+    file_stats = calloc(n_total, sizeof(*file_stats));
+    if (!latencies || !threads || !watches || !file_stats)
+        die("calloc failed\n");
+
+    getrusage(RUSAGE_SELF, &ru_before);
+    started = now_sec();
+
+    for (i = 0; i < n_total; i++)
+        if (pthread_create(&threads[i], NULL,
+                           i < nthreads ? worker_func : prefetch_func,
+                           (void *) i))
+            die("pthread_create failed\n");
+
+    for (i = 0; i < n_total; i++)
+        pthread_join(threads[i], NULL);
+
+    elapsed = now_sec() - started;
+    getrusage(RUSAGE_SELF, &ru_after);
+
+    /* the stubs run in the same process, not to be counted */
+    cpu = rusage_sec(&ru_after) - rusage_sec(&ru_before);
+
+    qsort(latencies, n_files, sizeof(*latencies), compare_double);
+
+    hpssix_extractor_pool_print_stats(&pool, stdout);
+    hpssix_extractor_limiter_print_stats(&limiter, stdout);
+    if (nprefetch > 0)
+        hpssix_extractor_stage_print_stats(&stage, stdout);
+
+    printf("## profile: %s (%d ms + %d ms jitter, %lu bytes/sec, "
+           "%d/1000 failures), %lu stubs\n",
+           profile->name, profile->delay_ms, profile->jitter_ms,
+           profile->bytes_per_sec, profile->fail_permille, n_stubs);
+    printf("## threads: %lu upload, %lu prefetch, upload mode %s, %s "
+           "limiter\n",
+           nthreads, nprefetch,
+           extraction.upload_mode == HPSSIX_EXTRACTOR_UPLOAD_MMAP ?
+           "mmap" : "pread",
+           adaptive ? "adaptive" : "fixed");
+    printf("## documents: %lu (%lu failed) in %.3lf seconds\n",
+           n_done, n_failed, elapsed);
+    printf("## docs/sec: %.2lf\n", n_done/elapsed);
+    printf("## bytes/sec: %.0lf (%.3lf MB/s)\n",
+           bytes_done/elapsed, bytes_done/elapsed/(1<<20));
+    printf("## latency: p50 %.3lf, p90 %.3lf, p99 %.3lf, max %.3lf "
+           "seconds\n",
+           percentile(latencies, n_files, .5F),
+           percentile(latencies, n_files, .9F),
+           percentile(latencies, n_files, .99F),
+           latencies[n_files - 1]);
+    printf("## cpu/doc: %.3lf ms (%.3lf seconds in total, stubs included)\n",
+           cpu*1000/n_done, cpu);
+
+    if (nprefetch > 0)
+        hpssix_extractor_stage_fini(&stage);
+    hpssix_extractor_limiter_fini(&limiter);
+    hpssix_extractor_pool_fini(&pool);
+    hpssix_extractor_global_cleanup();
+
+    for (i = 0; i < n_stubs; i++)
+        tika_stub_stop(&stubs[i]);
+
+    free(file_stats);
+    free(watches);
+    free(threads);
+    free(latencies);
+}
+
+static struct option long_opts[] = {
+    { "files", 1, 0, 'f' },
+    { "help", 0, 0, 'h' },
+    { "keep", 0, 0, 'k' },
+    { "median", 1, 0, 'm' },
+    { "nthreads", 1, 0, 'n' },
+    { "prefetch", 1, 0, 'p' },
+    { "profile", 1, 0, 'P' },
+    { "seed", 1, 0, 'S' },
+    { "sigma", 1, 0, 's' },
+    { "stubs", 1, 0, 't' },
+    { "upload", 1, 0, 'u' },
+    { "fixed", 0, 0, 'x' },
+    { 0, 0, 0, 0},
+};
+
+static const char *short_opts = "f:hkm:n:p:P:S:s:t:u:x";
+
+static const char *usage_str = "\n"
+"Usage: bench-extractor [options]\n"
+"\n"
+"Available options:\n"
+"-f, --files=<NUM>      number of files to generate (default: 2000).\n"
+"-h, --help             print the help message.\n"
+"-k, --keep             keep the generated files.\n"
+"-m, --median=<BYTES>   median file size (default: 32768).\n"
+"-n, --nthreads=<NUM>   number of upload threads (default: 8).\n"
+"-p, --prefetch=<NUM>   number of prefetch threads (default: 0).\n"
+"-P, --profile=<NAME>   tika stub profile, fast, typical (default) or\n"
+"                       slow.\n"
+"-S, --seed=<NUM>       random seed for the files (default: 1).\n"
+"-s, --sigma=<NUM>      spread of the log-normal file sizes (default: 1.5).\n"
+"-t, --stubs=<NUM>      number of tika stubs (default: 1).\n"
+"-u, --upload=<MODE>    pread (default) or mmap.\n"
+"-x, --fixed            do not adapt the requests in flight.\n"
+"\n";
+
+static void print_usage(int status)
+{
+    fputs(usage_str, stderr);
+    exit(status);
+}
+
+int main(int argc, char **argv)
+{
+    int i = 0;
+    int ch = 0;
+    int optidx = 0;
+
+    while ((ch = getopt_long(argc, argv,
+                             short_opts, long_opts, &optidx)) >= 0) {
+        switch (ch) {
+        case 'f':
+            n_files = strtoull(optarg, 0, 0);
+            break;
+        case 'k':
+            keep = 1;
+            break;
+        case 'm':
+            median_size = strtoull(optarg, 0, 0);
+            break;
+        case 'n':
+            nthreads = strtoull(optarg, 0, 0);
+            break;
+        case 'p':
+            nprefetch = strtoull(optarg, 0, 0);
+            break;
+        case 'P':
+            for (profile = NULL, i = 0; i < n_profiles; i++)
+                if (strcmp(optarg, profiles[i].name) == 0)
+                    profile = &profiles[i];
+            if (!profile)
+                print_usage(1);
+            break;
+        case 'S':
+            seed = strtoull(optarg, 0, 0);
+            break;
+        case 's':
+            size_sigma = atof(optarg);
+            break;
+        case 't':
+            n_stubs = strtoull(optarg, 0, 0);
+            break;
+        case 'u':
+            extraction.upload_mode = hpssix_extractor_parse_upload_mode(optarg);
+            if (extraction.upload_mode < 0)
+                print_usage(1);
+            break;
+        case 'x':
+            adaptive = 0;
+            break;
+        case 'h':
+        default:
+            print_usage(1);
+            break;
+        }
+    }
+
+    if (!n_files || !nthreads || !n_stubs || n_stubs > MAX_STUBS || !seed)
+        print_usage(1);
+
+    generate_workdata();
+
+    run();
+
+    if (!keep)
+        remove_scratch();
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# usage: mock-locality.sh <datadir> <task id> [volumes]
+#
+# writes a mock storage locality file (scanner.<task id>.locality.csv) for
+# the objects in the scanner output, so that the builder orders the
+# extraction without the hpss storage attributes. objects are spread over
+# [volumes] (default 8) volumes by their object id, at increasing offsets.
+#
+
+function die() {
+    echo "## ERROR: $1"
+    exit 1
+}
+
+if [ $# -lt 2 ]; then
+    die "Please check the usage."
+fi
+
+datadir="$1"
+ts="$2"
+volumes="${3:-8}"
+
+in_fattr="${datadir}/scanner.${ts}.fattr.csv"
+out_locality="${datadir}/scanner.${ts}.locality.csv"
+
+[ -f "$in_fattr" ] || die "cannot find $in_fattr"
+
+awk -F, -v volumes="$volumes" '
+{
+    oid = $1
+    vol = oid % volumes
+    printf("%s,\"00001:VOL%03d:%020d\"\n", oid, vol, offset[vol])
+    offset[vol] += $9
+}' "$in_fattr" > "$out_locality" || die "failed to write $out_locality"
+
+echo "## mock locality: $(wc -l < $out_locality) objects, $volumes volumes"
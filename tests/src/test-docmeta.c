@@ -0,0 +1,124 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * flattens the tika metadata into the typed attributes, feeding the json in
+ * pieces of every size to see that the parser does not depend on where the
+ * response is split.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hpssix-docmeta.h"
+#include "testlib.h"
+
+static const char *meta =
+"{\"X-Parsed-By\":[\"org.apache.tika.parser.DefaultParser\",\"x\"],\n"
+" \"meta:author\":\"Second\",\n"
+" \"dc:creator\":[\"Caf\\u00e9 \\\"First\\\"\",\"Other\"],\n"
+" \"Content-Type\":\"Application/PDF; version=1.4\",\n"
+" \"xmpTPg:NPages\":\"12\",\n"
+" \"embedded\":{\"Author\":\"nested\",\"language\":\"xx\"},\n"
+" \"Creation-Date\":\"2000-01-01T00:00:00Z\",\n"
+" \"dcterms:created\":\"2019-03-01T10:20:30Z\",\n"
+" \"Last-Modified\":\"2019-03-01T10:20:30.5+01:00\",\n"
+" \"language\":null,\n"
+" \"dc:language\":\"EN\"}\n";
+
+static void check_docmeta(hpssix_docmeta_t *docmeta, uint64_t piece)
+{
+    if (!docmeta->content_type ||
+        strcmp(docmeta->content_type, "application/pdf"))
+        die("[%lu] content type: %s\n", piece, docmeta->content_type);
+    if (!docmeta->author || strcmp(docmeta->author, "Caf\xc3\xa9 \"First\""))
+        die("[%lu] author: %s\n", piece, docmeta->author);
+    if (!docmeta->language || strcmp(docmeta->language, "en"))
+        die("[%lu] language: %s\n", piece, docmeta->language);
+    if (docmeta->created != 1551435630)
+        die("[%lu] created: %ld\n", piece, docmeta->created);
+    if (docmeta->modified != 1551435630 - 3600)
+        die("[%lu] modified: %ld\n", piece, docmeta->modified);
+    if (docmeta->pages != 12)
+        die("[%lu] pages: %ld\n", piece, docmeta->pages);
+}
+
+static void test_pieces(void)
+{
+    uint64_t piece = 0;
+    uint64_t pos = 0;
+    uint64_t len = strlen(meta);
+    hpssix_docmeta_t docmeta;
+    hpssix_docmeta_parser_t parser;
+
+    for (piece = 1; piece <= len; piece++) {
+        hpssix_docmeta_parser_init(&parser, &docmeta);
+
+        for (pos = 0; pos < len; pos += piece)
+            if (hpssix_docmeta_parser_feed(&parser, &meta[pos],
+                                           pos + piece > len ? len - pos
+                                                             : piece))
+                die("[%lu] parse error at %lu\n", piece, pos);
+
+        check_docmeta(&docmeta, piece);
+        hpssix_docmeta_free(&docmeta);
+    }
+}
+
+static void test_limits(void)
+{
+    char *json = NULL;
+    char *pos = NULL;
+    uint64_t i = 0;
+    hpssix_docmeta_t docmeta;
+
+    /* the long value is cut at a character boundary */
+    json = malloc(2*HPSSIX_DOCMETA_MAX_VALUE + 64);
+    if (!json)
+        die("malloc failed\n");
+
+    pos = json + sprintf(json, "{\"Author\":\"x");
+    for (i = 0; i < HPSSIX_DOCMETA_MAX_VALUE; i++)
+        pos += sprintf(pos, "\xc3\xa9");
+    sprintf(pos, "\",\"Page-Count\":7}");
+
+    if (hpssix_docmeta_parse(json, &docmeta))
+        die("hpssix_docmeta_parse failed\n");
+    if (strlen(docmeta.author) != HPSSIX_DOCMETA_MAX_VALUE - 1)
+        die("author cut at %lu\n", strlen(docmeta.author));
+    if (docmeta.pages != 7)
+        die("pages: %ld\n", docmeta.pages);
+
+    hpssix_docmeta_free(&docmeta);
+    free(json);
+
+    /* not an object, and nothing found */
+    if (hpssix_docmeta_parse("[\"Author\"]", &docmeta) == 0)
+        die("an array should not be parsed\n");
+    if (docmeta.author || docmeta.pages != HPSSIX_DOCMETA_NONE)
+        die("unexpected fields\n");
+
+    /* dates */
+    if (hpssix_docmeta_parse_date("1969-12-31") != -86400 ||
+        hpssix_docmeta_parse_date("2019-03-01T10:20Z") != 1551435600 ||
+        hpssix_docmeta_parse_date("2019-03-01T10:20:30-0130") !=
+            1551435630 + 5400 ||
+        hpssix_docmeta_parse_date("March 1, 2019") != HPSSIX_DOCMETA_NONE)
+        die("unexpected dates\n");
+}
+
+int main(int argc, char **argv)
+{
+    test_pieces();
+    test_limits();
+
+    printf("passed\n");
+
+    return 0;
+}
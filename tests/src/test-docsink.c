@@ -0,0 +1,118 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * flushes a document through the document sink, against the database in the
+ * configuration, and checks that the batch is copied as a whole, not written
+ * document by document, with the profile and the document attributes.
+ */
+#include <config.h>
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hpssix.h>
+
+#include "testlib.h"
+
+/* out of the range of the hpss object ids */
+#define TEST_OID    9000000000000000001UL
+
+static hpssix_config_t config;
+static hpssix_db_t db;
+
+static const char *cleanup_stmt =
+"DELETE FROM hpssix_object WHERE oid = 9000000000000000001;";
+
+static const char *object_stmt =
+"INSERT INTO hpssix_object (oid, valid, st_dev, st_mode, st_nlink, st_uid,\n"
+"                           st_gid, st_rdev, st_size, st_blksize,\n"
+"                           st_blocks, st_atime, st_mtime, st_ctime)\n"
+"     VALUES (9000000000000000001, false, 0, 33188, 1, 0, 0, 0, 11, 4096,\n"
+"             1, 0, 0, 0);";
+
+static void check_value(const char *sql, const char *expected)
+{
+    PGresult *res = hpssix_db_psql_query(&db, "%s", sql);
+
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1 ||
+        strcmp(PQgetvalue(res, 0, 0), expected))
+        die("expected %s from: %s\n", expected, sql);
+
+    PQclear(res);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    hpssix_db_docsink_t sink = { 0, };
+    hpssix_db_document_t doc = { 0, };
+
+    ret = hpssix_config_read_sysconf(&config);
+    if (ret)
+        die("hpssix_config_read_sysconf failed\n");
+
+    ret = hpssix_db_connect(&db, &config);
+    if (ret)
+        die("hpssix_db_connect failed\n");
+
+    hpssix_db_psql_exec(&db, cleanup_stmt);
+
+    ret = hpssix_db_psql_exec(&db, object_stmt);
+    if (ret)
+        die("failed to insert the test object\n");
+
+    ret = hpssix_db_docsink_init(&sink, &db, 0, 0);
+    if (ret)
+        die("hpssix_db_docsink_init failed (%d)\n", ret);
+
+    sink.profile = 2;
+
+    doc.oid = TEST_OID;
+    doc.meta = strdup("{\"Content-Type\": \"application/pdf\"}");
+    doc.text = strdup("hello docsink");
+    doc.size = 11;
+    doc.mtime = 1;
+    doc.hash = 1234;
+
+    doc.docmeta = malloc(sizeof(*doc.docmeta));
+    if (!doc.meta || !doc.text || !doc.docmeta)
+        die("failed to allocate the document\n");
+
+    hpssix_docmeta_init(doc.docmeta);
+    doc.docmeta->content_type = strdup("application/pdf");
+    doc.docmeta->pages = 3;
+
+    ret = hpssix_db_docsink_append(&sink, &doc);
+    if (ret)
+        die("hpssix_db_docsink_append failed (%d)\n", ret);
+
+    ret = hpssix_db_docsink_flush(&sink);
+    if (ret)
+        die("hpssix_db_docsink_flush failed (%d)\n", ret);
+
+    if (sink.n_fallbacks || sink.n_failed || sink.n_flushed != 1)
+        die("expected the batch copied (%lu fallbacks, %lu failed)\n",
+            sink.n_fallbacks, sink.n_failed);
+
+    check_value("SELECT profile FROM hpssix_attr_document "
+                "WHERE oid = 9000000000000000001", "2");
+    check_value("SELECT content_type || ',' || pages FROM hpssix_attr_docmeta "
+                "WHERE oid = 9000000000000000001", "application/pdf,3");
+    check_value("SELECT hash FROM hpssix_attr_fingerprint "
+                "WHERE oid = 9000000000000000001", "1234");
+
+    hpssix_db_docsink_fini(&sink);
+
+    hpssix_db_psql_exec(&db, cleanup_stmt);
+
+    hpssix_db_disconnect(&db);
+    hpssix_config_free(&config);
+
+    return 0;
+}
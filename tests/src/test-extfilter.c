@@ -9,7 +9,7 @@ int main(int argc, char **argv)
     uint64_t i = 0;
     hpssix_extfilter_t *filter = NULL;
 
-    filter = hpssix_extfilter_get();
+    filter = hpssix_extfilter_get(1);
     assert(filter);
 
     printf("%lu registered extensions:\n", filter->n_exts);
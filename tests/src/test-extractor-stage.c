@@ -0,0 +1,179 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * runs the extractor prefetch stage with a few producer and consumer threads.
+ * every file pushed should be popped once, the staging memory should stay in
+ * the bound, and the prefetched buffer should upload to a tika stub.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "hpssix-extractor.h"
+#include "tika-stub.h"
+#include "testlib.h"
+
+#define N_PRODUCERS     3
+#define N_CONSUMERS     4
+#define N_FILES         200     /* per producer */
+
+static hpssix_extractor_stage_t stage;
+
+static const uint64_t max_bytes = 64*1024;
+
+static volatile uint64_t n_popped;
+static volatile uint64_t sum_popped;
+
+static void *producer_func(void *arg)
+{
+    uint64_t id = (unsigned long) arg;
+    uint64_t i = 0;
+
+    for (i = 0; i < N_FILES; i++) {
+        hpssix_extractor_staged_t *staged = calloc(1, sizeof(*staged));
+        uint64_t size = 1024 + (i*7919) % (16*1024);
+
+        if (!staged)
+            die("calloc failed\n");
+
+        staged->index = id*N_FILES + i;
+        staged->object.path = strdup("/file");
+
+        if (hpssix_extractor_stage_reserve(&stage, size))
+            die("hpssix_extractor_stage_reserve failed\n");
+
+        staged->reserved = size;
+        staged->sb.st_size = size;
+        staged->buf = malloc(size);
+        if (!staged->buf)
+            die("malloc failed\n");
+
+        memset(staged->buf, 'x', size);
+
+        hpssix_extractor_stage_push(&stage, staged, .001F);
+    }
+
+    hpssix_extractor_stage_producer_done(&stage);
+
+    return (void *) 0;
+}
+
+static void *consumer_func(void *arg)
+{
+    hpssix_extractor_staged_t *staged = NULL;
+
+    while ((staged = hpssix_extractor_stage_pop(&stage)) != NULL) {
+        if (stage.bytes > max_bytes)
+            die("staging memory %lu over the bound\n", stage.bytes);
+
+        usleep(100);
+
+        __sync_fetch_and_add(&n_popped, 1);
+        __sync_fetch_and_add(&sum_popped, staged->index);
+
+        hpssix_extractor_staged_free(&stage, staged);
+    }
+
+    hpssix_extractor_stage_consumer_done(&stage);
+
+    return (void *) 0;
+}
+
+static void test_pipeline(void)
+{
+    uint64_t i = 0;
+    uint64_t n = N_PRODUCERS*N_FILES;
+    pthread_t threads[N_PRODUCERS + N_CONSUMERS];
+
+    if (hpssix_extractor_stage_init(&stage, max_bytes, N_PRODUCERS,
+                                    N_CONSUMERS))
+        die("hpssix_extractor_stage_init failed\n");
+
+    for (i = 0; i < N_PRODUCERS + N_CONSUMERS; i++)
+        if (pthread_create(&threads[i], NULL,
+                           i < N_PRODUCERS ? producer_func : consumer_func,
+                           (void *) (unsigned long) i))
+            die("pthread_create failed\n");
+
+    for (i = 0; i < N_PRODUCERS + N_CONSUMERS; i++)
+        pthread_join(threads[i], NULL);
+
+    hpssix_extractor_stage_print_stats(&stage, stdout);
+
+    if (n_popped != n || sum_popped != n*(n - 1)/2)
+        die("%lu files popped, expected %lu\n", n_popped, n);
+    if (stage.peak_bytes > max_bytes || stage.bytes != 0)
+        die("staging memory peak %lu, left %lu\n",
+            stage.peak_bytes, stage.bytes);
+
+    /* too large, and nobody left to release the memory */
+    if (hpssix_extractor_stage_reserve(&stage, max_bytes + 1) != E2BIG)
+        die("oversized reservation should fail with E2BIG\n");
+    if (hpssix_extractor_stage_reserve(&stage, 1) != EPIPE)
+        die("reservation without consumers should fail with EPIPE\n");
+
+    hpssix_extractor_stage_fini(&stage);
+}
+
+static void test_upload(void)
+{
+    int ret = 0;
+    char buf[] = "hello, prefetched world.\n";
+    struct tika_stub stub = { 0, };
+    hpssix_extractor_data_t data = { 0, };
+
+    if (tika_stub_start(&stub))
+        die("tika_stub_start failed\n");
+
+    hpssix_extractor_global_init();
+
+    data.fd = -1;
+    data.tika_host = "127.0.0.1";
+    data.tika_port = stub.port;
+    data.map = buf;
+    data.file_size = strlen(buf);
+    data.upload_mode = HPSSIX_EXTRACTOR_UPLOAD_BUFFER;
+    data.tmpfp = tmpfile();
+    sprintf(data.file, "/prefetched");
+
+    ret = hpssix_extractor_get_meta(&data);
+    if (ret || !data.meta)
+        die("hpssix_extractor_get_meta failed (%d)\n", ret);
+    if (data.bytes_uploaded != strlen(buf))
+        die("uploaded %lu bytes\n", data.bytes_uploaded);
+
+    /* flattened while the response arrived */
+    if (!data.docmeta.content_type ||
+        strcmp(data.docmeta.content_type, "text/plain"))
+        die("unexpected content type %s\n", data.docmeta.content_type);
+
+    /* the buffer is not ours to unmap */
+    hpssix_extractor_close(&data);
+
+    fclose(data.tmpfp);
+    free(data.meta);
+    hpssix_docmeta_free(&data.docmeta);
+
+    hpssix_extractor_global_cleanup();
+    tika_stub_stop(&stub);
+}
+
+int main(int argc, char **argv)
+{
+    test_pipeline();
+    test_upload();
+
+    printf("passed\n");
+
+    return 0;
+}
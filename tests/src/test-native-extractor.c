@@ -0,0 +1,130 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * extracts a few sample files with the native extractors and checks the
+ * synthesized metadata and the content.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hpssix-extractor.h"
+#include "testlib.h"
+
+struct native_sample {
+    const char *name;
+    const char *data;
+    size_t len;                 /* 0 for strlen(data) */
+    int expected;               /* return code */
+    const char *meta;           /* should appear in the metadata */
+    const char *content;        /* should appear in the content */
+};
+
+static struct native_sample samples[] = {
+    { "plain.txt", "hello\nworld\n", 0, 0,
+      "\"hpssix:lines\":\"2\"", "world" },
+    { "notes.md", "some intro\n## The \"Title\"\nbody\n", 0, 0,
+      "\"title\":\"The \\\"Title\\\"\"", "body" },
+    { "table.csv", "id,name,size\n1,a,10\n", 0, 0,
+      "\"hpssix:columns\":\"3\"", "1,a,10" },
+    { "data.json", "{\"alpha\": 1, \"beta\": {\"gamma\": 2}}", 0, 0,
+      "\"hpssix:keys\":\"alpha,beta\"", "gamma" },
+    { "latin1.txt", "caf\xe9\n", 0, 0,
+      "ISO-8859-1", "caf\xc3\xa9" },
+    { "binary.txt", "ab\0cd", 5, ENOTSUP, NULL, NULL },
+};
+
+static const int n_samples = sizeof(samples)/sizeof(samples[0]);
+
+static int run_sample(const char *dir, struct native_sample *sample,
+                      int mode)
+{
+    int ret = 0;
+    size_t len = sample->len ? sample->len : strlen(sample->data);
+    FILE *fp = NULL;
+    struct stat sb = { 0, };
+    hpssix_extractor_data_t data = { 0, };
+    const hpssix_extractor_native_t *native = NULL;
+
+    data.fd = -1;
+    sprintf(data.file, "%s/%s", dir, sample->name);
+
+    fp = fopen(data.file, "w");
+    if (!fp)
+        die("fopen failed\n");
+    if (fwrite(sample->data, 1, len, fp) != len)
+        die("fwrite failed\n");
+    fclose(fp);
+
+    stat(data.file, &sb);
+    data.file_size = sb.st_size;
+
+    native = hpssix_extractor_native_lookup(data.file);
+    if (!native)
+        die("no native extractor for %s\n", data.file);
+
+    ret = hpssix_extractor_open(&data, mode);
+    if (ret)
+        die("hpssix_extractor_open failed\n");
+
+    ret = hpssix_extractor_native_extract(native, &data, 0);
+    hpssix_extractor_close(&data);
+    unlink(data.file);
+
+    if (ret != sample->expected)
+        die("%s: returned %d (expected %d)\n", sample->name, ret,
+            sample->expected);
+
+    if (ret)
+        return 0;
+
+    printf("%s: %s\n", sample->name, data.meta);
+
+    if (!strstr(data.meta, sample->meta))
+        die("%s: %s not found in the metadata\n", sample->name, sample->meta);
+
+    if (!strstr(data.content, sample->content))
+        die("%s: unexpected content\n", sample->name);
+
+    free(data.meta);
+    free(data.content);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i = 0;
+    char dir[] = "/tmp/test-native.XXXXXX";
+
+    if (!mkdtemp(dir))
+        die("mkdtemp failed\n");
+
+    if (hpssix_extractor_native_lookup("/path/to/paper.pdf"))
+        die("pdf should go to tika\n");
+
+    if (!hpssix_extractor_native_lookup_mime("text/csv; charset=UTF-8"))
+        die("cannot find the csv extractor by mime\n");
+
+    for (i = 0; i < n_samples; i++) {
+        run_sample(dir, &samples[i], HPSSIX_EXTRACTOR_UPLOAD_MMAP);
+        run_sample(dir, &samples[i], HPSSIX_EXTRACTOR_UPLOAD_PREAD);
+    }
+
+    rmdir(dir);
+
+    printf("passed\n");
+
+    return 0;
+}
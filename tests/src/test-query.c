@@ -0,0 +1,357 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * checks the statements from the search query builder: the values are only
+ * in the parameters, and the same conditions build the same statement.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpssix-query.h"
+#include "hpssix-query-msg.h"
+#include "testlib.h"
+
+/* more than the parameters, and the statement text, can hold */
+#define MANY_TAGS   2000
+
+static hpssix_query_tag_t tags[2] = {
+    { .name = "user.hpssix.projid", .op = HPSSIX_OP_BETWEEN,
+      .val1 = 10, .val2 = 20.5 },
+    { .name = "user.hpssix.owner", .op = HPSSIX_OP_NONE },
+};
+
+static void set_query(hpssix_query_t *query, const char *str, int64_t uid)
+{
+    hpssix_query_init(query);
+
+    query->fattr[HPSSIX_QUERY_UID].op = HPSSIX_OP_EQ;
+    query->fattr[HPSSIX_QUERY_UID].val1 = uid;
+    query->name = str;
+    query->under = "/home/hs2";
+    query->keyword = str;
+    query->author = "hyogi*";
+    query->pages.op = HPSSIX_OP_GE;
+    query->pages.val1 = 10;
+    query->n_tags = 2;
+    query->tags = tags;
+    query->limit = 100;
+
+    tags[1].value = str;
+}
+
+static void check_param(hpssix_query_stmt_t *stmt, int n, const char *expected)
+{
+    if (n > stmt->n_params || strcmp(stmt->params[n - 1], expected))
+        die("expected $%d = %s\n", n, expected);
+}
+
+static int find_param(hpssix_query_stmt_t *stmt, const char *expected)
+{
+    int i = 0;
+
+    for (i = 0; i < stmt->n_params; i++)
+        if (!strcmp(stmt->params[i], expected))
+            return i + 1;
+
+    die("no parameter %s\n", expected);
+
+    return 0;
+}
+
+/* a query of @n tags, as the search service receives it */
+static char *tags_msg(uint32_t n, uint32_t *len)
+{
+    uint32_t i = 0;
+    char *buf = malloc(12*n);
+
+    if (!buf)
+        die("malloc failed\n");
+
+    for (i = 0; i < n; i++)
+        memcpy(&buf[12*i], "tag=0,1,0,t", 12);
+
+    *len = 12*n;
+
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    int i = 0;
+    int ret = 0;
+    char buf[64] = { 0, };
+    hpssix_query_t query = { 0, };
+    hpssix_query_stmt_t stmt1 = { 0, };
+    hpssix_query_stmt_t stmt2 = { 0, };
+    hpssix_query_plan_t plan = { 0, };
+    hpssix_query_msg_t msg = { 0, };
+    hpssix_query_msg_t decoded = { 0, };
+    char *msgbuf = NULL;
+    uint32_t msglen = 0;
+
+    set_query(&query, "it's 100%_", 1000);
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    printf("%s\n", stmt1.sql);
+    for (i = 0; i < stmt1.n_params; i++)
+        printf("$%d = %s\n", i + 1, stmt1.params[i]);
+
+    if (strstr(stmt1.sql, "it's") || strstr(stmt1.sql, "hyogi") ||
+        strstr(stmt1.sql, "1000") || strstr(stmt1.sql, "hs2"))
+        die("a value is in the statement\n");
+
+    /* the same configuration as the tsvectors of the documents */
+    if (!strstr(stmt1.sql, "PLAINTO_TSQUERY('simple', $"))
+        die("expected the keyword with the simple configuration\n");
+
+    find_param(&stmt1, "1000");
+    find_param(&stmt1, "it's 100%_");
+    find_param(&stmt1, "%it's 100\\%\\_%");
+    find_param(&stmt1, "hyogi");
+    find_param(&stmt1, "hyogi\xf4\x8f\xbf\xbf");
+    find_param(&stmt1, "/home/hs2/");
+    find_param(&stmt1, "/home/hs20");
+    check_param(&stmt1, stmt1.n_params, "100");
+
+    /* the author prefix is a range of the index, not a LIKE */
+    if (!strstr(stmt1.sql, "LOWER(d.author) ~>=~ LOWER($") ||
+        !strstr(stmt1.sql, "LOWER(d.author) ~<~ LOWER($"))
+        die("expected the author prefix as a range\n");
+
+    /* the short name is not looked up in the trigram index */
+    set_query(&query, "ab", 0);
+
+    ret = hpssix_query_build(&query, &stmt2);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (!strstr(stmt2.sql, "(f.name || '') LIKE"))
+        die("expected the short name not to use the index\n");
+
+    hpssix_query_stmt_free(&stmt2);
+
+    set_query(&query, "other-name", 0);
+
+    ret = hpssix_query_build(&query, &stmt2);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (strcmp(stmt1.sql, stmt2.sql) || stmt1.n_params != stmt2.n_params)
+        die("expected the same statement\n");
+
+    hpssix_query_stmt_free(&stmt2);
+    hpssix_query_stmt_free(&stmt1);
+
+    /* keyset pagination */
+    if (hpssix_query_key_parse("0.0607927,1234", &query.after) ||
+        strcmp(query.after.rank, "0.0607927") || query.after.oid != 1234)
+        die("failed to parse the token\n");
+
+    hpssix_query_key_token(&query.after, buf);
+    if (strcmp(buf, "0.0607927,1234"))
+        die("expected the same token (%s)\n", buf);
+
+    if (!hpssix_query_key_parse("12x", &query.after) ||
+        !hpssix_query_key_parse(",12", &query.after) ||
+        !hpssix_query_key_parse("rank,12", &query.after) ||
+        !hpssix_query_key_parse("", &query.after))
+        die("expected the tokens not to be parsed\n");
+
+    set_query(&query, "keyword", 0);
+    hpssix_query_key_parse("0.5,1234", &query.after);
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (!strstr(stmt1.sql, "ORDER BY t.rank DESC, f.oid"))
+        die("expected the results ordered by the rank and the oid\n");
+
+    find_param(&stmt1, "0.5");
+    find_param(&stmt1, "1234");
+    hpssix_query_stmt_free(&stmt1);
+
+    query.keyword = NULL;
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret != EINVAL)
+        die("expected EINVAL for the key of a keyword search (%d)\n", ret);
+
+    hpssix_query_key_parse("1234", &query.after);
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (!strstr(stmt1.sql, "f.oid > $") || !strstr(stmt1.sql, "ORDER BY f.oid"))
+        die("expected the results after the oid\n");
+
+    if (strstr(stmt1.sql, "WITH"))
+        die("expected no common table expressions\n");
+
+    hpssix_query_stmt_free(&stmt1);
+
+    /* driven by the rarest tag, and each tag on its own row */
+    set_query(&query, "it's 100%_", 1000);
+
+    plan.n_preds = 4;
+    plan.n_tags = 2;
+    plan.preds[0] = (hpssix_query_pred_t) { HPSSIX_QUERY_PRED_TAG, 1, 5 };
+    plan.preds[1] = (hpssix_query_pred_t) { HPSSIX_QUERY_PRED_KEYWORD, 0, 9 };
+    plan.preds[2] = (hpssix_query_pred_t) { HPSSIX_QUERY_PRED_OBJECT, 0, 10 };
+    plan.preds[3] = (hpssix_query_pred_t) { HPSSIX_QUERY_PRED_TAG, 0, -1 };
+    query.plan = &plan;
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (!strstr(stmt1.sql, "FROM hpssix_attr_val v JOIN hpssix_object o") ||
+        !strstr(stmt1.sql, "WHERE v.kid=") ||
+        !strstr(stmt1.sql, "v.sval LIKE") ||
+        !strstr(stmt1.sql, "EXISTS (SELECT 1 FROM hpssix_attr_val v0") ||
+        strstr(stmt1.sql, "v1."))
+        die("expected the search driven by the second tag\n");
+
+    hpssix_query_stmt_free(&stmt1);
+
+    /* the count by the keyword reads no rank */
+    query.countonly = 1;
+    query.limit = 0;
+    plan.preds[0].type = HPSSIX_QUERY_PRED_KEYWORD;
+    plan.preds[1].type = HPSSIX_QUERY_PRED_TAG;
+    plan.preds[1].tag = 1;
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (!strstr(stmt1.sql, "SELECT COUNT(f.path)\nFROM (SELECT oid") ||
+        strstr(stmt1.sql, "EXISTS (SELECT 1 FROM hpssix_attr_document"))
+        die("expected the count driven by the keyword\n");
+
+    hpssix_query_stmt_free(&stmt1);
+
+    /* a plan of another search */
+    query.keyword = NULL;
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret != EINVAL || stmt1.sql)
+        die("expected EINVAL for the plan of another search (%d)\n", ret);
+
+    /* a batch of names, each row tagged with its key */
+    hpssix_query_init(&query);
+    query.keys = HPSSIX_QUERY_KEYS_NAME;
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (!strstr(stmt1.sql, "SELECT f.oid, f.path, k.key") ||
+        !strstr(stmt1.sql, "JOIN hpssix_query_keys k ON k.key = f.name") ||
+        !strstr(stmt1.sql, "ORDER BY k.seq, f.oid"))
+        die("expected the results of each name\n");
+
+    hpssix_query_stmt_free(&stmt1);
+
+    query.keys = HPSSIX_QUERY_KEYS_PATH;
+    query.countonly = 1;
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    /* the keys with no files are counted as 0 */
+    if (!strstr(stmt1.sql, "FROM hpssix_query_keys k\nLEFT JOIN LATERAL") ||
+        !strstr(stmt1.sql, "f.path = k.key") ||
+        !strstr(stmt1.sql, "GROUP BY k.seq, k.key"))
+        die("expected the counts of each path\n");
+
+    hpssix_query_stmt_free(&stmt1);
+
+    /* too many parameters, and more tags than the statement can hold */
+    hpssix_query_init(&query);
+    query.tags = calloc(MANY_TAGS, sizeof(*query.tags));
+    query.n_tags = MANY_TAGS;
+
+    for (i = 0; i < MANY_TAGS; i++) {
+        sprintf(buf, "user.hpssix.tag%d", i);
+        query.tags[i].name = strdup(buf);
+        query.tags[i].op = HPSSIX_OP_EQ;
+    }
+
+    ret = hpssix_query_build(&query, &stmt1);
+    if (ret != EINVAL || stmt1.sql)
+        die("expected EINVAL (%d)\n", ret);
+
+    for (i = 0; i < MANY_TAGS; i++)
+        free((void *) query.tags[i].name);
+    free(query.tags);
+
+    /* the query to the search service builds the same statement */
+    memset((void *) &msg, 0, sizeof(msg));
+    set_query(&msg.query, "with,comma=100%", 1000);
+    hpssix_query_key_parse("0.5,1234", &msg.query.after);
+    msg.batch = 500;
+
+    ret = hpssix_query_build(&msg.query, &stmt1);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    ret = hpssix_query_msg_encode(&msg, &msgbuf, &msglen);
+    if (ret)
+        die("hpssix_query_msg_encode failed (%d)\n", ret);
+
+    ret = hpssix_query_msg_decode(&decoded, msgbuf, msglen);
+    if (ret)
+        die("hpssix_query_msg_decode failed (%d)\n", ret);
+
+    if (decoded.batch != 500 || decoded.query.n_tags != 2 ||
+        strcmp(decoded.query.tags[1].value, "with,comma=100%"))
+        die("expected the same query\n");
+
+    ret = hpssix_query_build(&decoded.query, &stmt2);
+    if (ret)
+        die("hpssix_query_build failed (%d)\n", ret);
+
+    if (strcmp(stmt1.sql, stmt2.sql) || stmt1.n_params != stmt2.n_params)
+        die("expected the same statement\n");
+
+    for (i = 0; i < stmt1.n_params; i++)
+        if (strcmp(stmt1.params[i], stmt2.params[i]))
+            die("expected the same parameters ($%d)\n", i + 1);
+
+    hpssix_query_stmt_free(&stmt2);
+    hpssix_query_stmt_free(&stmt1);
+    hpssix_query_msg_free(&decoded);
+
+    /* as many tags as hpssix-search takes, and one more */
+    msgbuf = tags_msg(HPSSIX_QUERY_MSG_MAX_TAGS, &msglen);
+    if (hpssix_query_msg_decode(&decoded, msgbuf, msglen))
+        die("expected the tags decoded\n");
+    hpssix_query_msg_free(&decoded);
+
+    msgbuf = tags_msg(HPSSIX_QUERY_MSG_MAX_TAGS + 1, &msglen);
+    if (hpssix_query_msg_decode(&decoded, msgbuf, msglen) != EINVAL)
+        die("expected EINVAL for too many tags\n");
+    hpssix_query_msg_free(&decoded);
+
+    /* a field with no value */
+    msgbuf = malloc(13);
+    memcpy(msgbuf, "name=x\0limit", 13);
+    if (hpssix_query_msg_decode(&decoded, msgbuf, 13) != EINVAL)
+        die("expected EINVAL for a broken query\n");
+    hpssix_query_msg_free(&decoded);
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * checks the result cache of the search service: the hits and the misses,
+ * the lru eviction in the size, and the invalidation by the generation.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hpssixd-search-cache.h"
+#include "testlib.h"
+
+static hpssixd_search_cache_t cache;
+
+static char answer[4096];
+
+static void put(uint64_t generation, const char *key, uint64_t len)
+{
+    int ret = hpssixd_search_cache_put(&cache, generation, key, strlen(key),
+                                       answer, len);
+    if (ret)
+        die("failed to put %s (%d)\n", key, ret);
+}
+
+static int get(const char *key)
+{
+    int ret = 0;
+    char *data = NULL;
+    uint64_t len = 0;
+
+    ret = hpssixd_search_cache_get(&cache, key, strlen(key), &data, &len);
+    if (ret == 0) {
+        if (len && memcmp(data, answer, len))
+            die("unexpected answer of %s\n", key);
+        free(data);
+    }
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    hpssixd_search_cache_stats_t stats = { 0, };
+
+    memset(answer, 'a', sizeof(answer));
+
+    /* four answers of 2KB, at most a quarter each */
+    ret = hpssixd_search_cache_init(&cache, 8400);
+    if (ret)
+        die("failed to initialize the cache (%d)\n", ret);
+
+    hpssixd_search_cache_set_generation(&cache, 1);
+
+    put(1, "q1", 2000);
+    put(1, "q2", 2000);
+    put(1, "q3", 2000);
+    put(1, "q4", 2000);
+
+    if (get("q1") || get("q2") || get("q3") || get("q4"))
+        die("expected the answers\n");
+
+    if (get("q5") != ENOENT)
+        die("expected a miss\n");
+
+    /* q1 is the least recently used, after reading q1 to q4 */
+    put(1, "q5", 2000);
+
+    if (get("q1") != ENOENT || get("q5"))
+        die("expected q1 evicted\n");
+
+    /* too large, and of the old generation */
+    if (hpssixd_search_cache_put(&cache, 1, "q6", 2, answer, 4000) != EFBIG)
+        die("expected EFBIG\n");
+
+    if (hpssixd_search_cache_put(&cache, 0, "q6", 2, answer, 10) != ESTALE)
+        die("expected ESTALE\n");
+
+    hpssixd_search_cache_get_stats(&cache, &stats);
+    if (stats.hits != 5 || stats.misses != 2 || stats.evictions != 1 ||
+        stats.n_entries != 4 || stats.size > stats.capacity)
+        die("unexpected stats (hits %lu, misses %lu, evictions %lu)\n",
+            stats.hits, stats.misses, stats.evictions);
+
+    /* the next task completed */
+    hpssixd_search_cache_set_generation(&cache, 2);
+
+    if (get("q5") != ENOENT)
+        die("expected q5 invalidated\n");
+
+    hpssixd_search_cache_get_stats(&cache, &stats);
+    if (stats.n_entries != 0 || stats.size != 0 || stats.invalidations != 4)
+        die("expected the cache emptied\n");
+
+    hpssixd_search_cache_free(&cache);
+
+    return 0;
+}
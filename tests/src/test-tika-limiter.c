@@ -0,0 +1,141 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * drives the extractor concurrency limiter with a simulated tika server. the
+ * server serves @capacity requests at the base latency, and gets slower
+ * linearly beyond that. with @fail_over set, requests fail when more than
+ * that many are in flight. the limiter should grow up to the cap on a fast
+ * server, and settle down on an overloaded one.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "hpssix-extractor.h"
+#include "testlib.h"
+
+struct sim_server {
+    uint32_t capacity;
+    uint32_t fail_over;         /* 0 never fails */
+    uint32_t base_ms;
+    volatile uint32_t inflight;
+};
+
+static hpssix_extractor_limiter_t limiter;
+static struct sim_server server;
+
+static uint64_t nthreads = 16;
+static double duration = 1.5F;
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static int do_request(double *latency)
+{
+    uint32_t inflight = 0;
+    double before = now_sec();
+    double ms = server.base_ms;
+
+    inflight = __sync_add_and_fetch(&server.inflight, 1);
+
+    if (inflight > server.capacity)
+        ms = ms*inflight/server.capacity;
+
+    usleep((useconds_t) (ms*1000));
+
+    __sync_fetch_and_sub(&server.inflight, 1);
+
+    *latency = now_sec() - before;
+
+    return server.fail_over && inflight > server.fail_over;
+}
+
+static void *worker_func(void *arg)
+{
+    int failed = 0;
+    double latency = .0F;
+    double deadline = now_sec() + duration;
+
+    while (now_sec() < deadline) {
+        hpssix_extractor_limiter_acquire(&limiter);
+        failed = do_request(&latency);
+        hpssix_extractor_limiter_release(&limiter, failed, latency, 4096);
+    }
+
+    return (void *) 0;
+}
+
+static uint32_t run(uint32_t capacity, uint32_t fail_over, int adaptive)
+{
+    uint64_t i = 0;
+    pthread_t threads[64];
+
+    memset((void *) &server, 0, sizeof(server));
+    server.capacity = capacity;
+    server.fail_over = fail_over;
+    server.base_ms = 10;
+
+    if (hpssix_extractor_limiter_init(&limiter, nthreads, adaptive))
+        die("hpssix_extractor_limiter_init failed\n");
+
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&threads[i], NULL, worker_func, NULL))
+            die("pthread_create failed\n");
+
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    printf("capacity %u, fail over %u:\n", capacity, fail_over);
+    hpssix_extractor_limiter_print_stats(&limiter, stdout);
+    hpssix_extractor_limiter_fini(&limiter);
+
+    return (uint32_t) limiter.limit;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t limit = 0;
+
+    /* fast server, should go up to the cap */
+    limit = run(64, 0, 1);
+    if (limit != nthreads)
+        die("limit %u did not reach the cap on a fast server\n", limit);
+
+    /* overloaded server, should settle around twice the capacity */
+    limit = run(4, 0, 1);
+    if (limit < 2 || limit > 12)
+        die("limit %u on an overloaded server\n", limit);
+
+    /* failing server, should back off below the failure point */
+    limit = run(4, 6, 1);
+    if (limiter.n_error_backoffs == 0)
+        die("no error backoff on a failing server\n");
+    if (limit > 8)
+        die("limit %u on a failing server\n", limit);
+
+    /* fixed, no matter what */
+    limit = run(4, 6, 0);
+    if (limit != nthreads || limiter.n_increases + limiter.n_error_backoffs)
+        die("fixed limiter changed the limit\n");
+
+    printf("passed\n");
+
+    return 0;
+}
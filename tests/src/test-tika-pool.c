@@ -0,0 +1,213 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * runs the extractor tika pool against three stub servers: a fast one, a slow
+ * one and a broken one (503). the broken server should be taken out of the
+ * rotation and put back after it recovers, and the fast server should get
+ * the most requests.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hpssix-extractor.h"
+#include "tika-stub.h"
+#include "testlib.h"
+
+enum { STUB_FAST = 0, STUB_SLOW, STUB_BROKEN, N_STUBS };
+
+static struct tika_stub stubs[N_STUBS];
+static hpssix_extractor_pool_t pool;
+
+static uint64_t nthreads = 4;
+static uint64_t requests_per_thread = 25;
+
+static char testfile[PATH_MAX];
+
+static inline double elapsed_sec(struct timeval *before)
+{
+    struct timeval now = { 0, };
+
+    gettimeofday(&now, NULL);
+
+    return timediff_sec(before, &now);
+}
+
+static int do_request(void)
+{
+    int ret = 0;
+    hpssix_extractor_data_t data = { 0, };
+    hpssix_extractor_endpoint_t *ep = NULL;
+    struct timeval before = { 0, };
+    struct stat sb = { 0, };
+
+    data.fd = -1;
+    strcpy(data.file, testfile);
+
+    if (stat(data.file, &sb))
+        die("stat failed\n");
+
+    data.file_size = sb.st_size;
+
+    ret = hpssix_extractor_open(&data, HPSSIX_EXTRACTOR_UPLOAD_PREAD);
+    if (ret)
+        die("hpssix_extractor_open failed\n");
+
+    data.tmpfp = tmpfile();
+    if (!data.tmpfp)
+        die("tmpfile failed\n");
+
+    ep = hpssix_extractor_pool_get(&pool);
+    if (!ep)
+        die("no endpoint available\n");
+
+    data.tika_host = ep->host;
+    data.tika_port = ep->port;
+
+    gettimeofday(&before, NULL);
+
+    ret = hpssix_extractor_get_meta(&data);
+    if (!ret)
+        ret = hpssix_extractor_get_content(&data);
+
+    hpssix_extractor_pool_put(&pool, ep, ret && ret != EINVAL,
+                              elapsed_sec(&before),
+                              data.bytes_uploaded);
+
+    fclose(data.tmpfp);
+    hpssix_extractor_close(&data);
+
+    if (!ret && (!data.meta || !strstr(data.meta, "stub")))
+        die("unexpected metadata: %s\n", data.meta);
+
+    free(data.meta);
+    free(data.content);
+
+    return ret;
+}
+
+static void *worker_func(void *arg)
+{
+    uint64_t i = 0;
+
+    for (i = 0; i < requests_per_thread; i++)
+        do_request();
+
+    return (void *) 0;
+}
+
+static void run_workers(void)
+{
+    uint64_t i = 0;
+    pthread_t threads[64];
+
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&threads[i], NULL, worker_func, NULL))
+            die("pthread_create failed\n");
+
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+}
+
+static void create_testfile(void)
+{
+    int fd = 0;
+    char buf[4096];
+
+    sprintf(testfile, "/tmp/test-tika-pool.XXXXXX");
+
+    fd = mkstemp(testfile);
+    if (fd < 0)
+        die("mkstemp failed\n");
+
+    memset(buf, 'a', sizeof(buf));
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+        die("write failed\n");
+
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int i = 0;
+    char buf[N_STUBS][64];
+    char *endpoints[N_STUBS];
+
+    if (argc == 2)
+        requests_per_thread = strtoull(argv[1], NULL, 0);
+
+    create_testfile();
+    hpssix_extractor_global_init();
+
+    stubs[STUB_SLOW].delay_ms = 100;
+    stubs[STUB_BROKEN].status = 503;
+
+    for (i = 0; i < N_STUBS; i++) {
+        ret = tika_stub_start(&stubs[i]);
+        if (ret)
+            die("tika_stub_start failed\n");
+
+        sprintf(buf[i], "127.0.0.1:%d", stubs[i].port);
+        endpoints[i] = buf[i];
+    }
+
+    ret = hpssix_extractor_pool_init(&pool, endpoints, N_STUBS);
+    if (ret)
+        die("hpssix_extractor_pool_init failed\n");
+
+    pool.min_samples = 4;
+    pool.probe_interval = 0.5F;
+    pool.probe_timeout = 1.0F;
+    pool.wait_timeout = 5.0F;
+
+    run_workers();
+    hpssix_extractor_pool_print_stats(&pool, stdout);
+
+    if (pool.endpoints[STUB_BROKEN].healthy)
+        die("broken endpoint is still in the rotation\n");
+
+    if (pool.endpoints[STUB_BROKEN].n_requests > 2*pool.max_failures)
+        die("too many requests to the broken endpoint\n");
+
+    if (stubs[STUB_FAST].n_requests <= stubs[STUB_SLOW].n_requests)
+        die("slow endpoint got more requests than the fast one\n");
+
+    /* recover the broken server, it should be back after the probe */
+    stubs[STUB_BROKEN].status = 200;
+    sleep(2);
+
+    run_workers();
+    hpssix_extractor_pool_print_stats(&pool, stdout);
+
+    if (stubs[STUB_BROKEN].n_probes == 0)
+        die("broken endpoint has never been probed\n");
+
+    if (!pool.endpoints[STUB_BROKEN].healthy)
+        die("recovered endpoint is not back in the rotation\n");
+
+    hpssix_extractor_pool_fini(&pool);
+
+    for (i = 0; i < N_STUBS; i++)
+        tika_stub_stop(&stubs[i]);
+
+    hpssix_extractor_global_cleanup();
+    unlink(testfile);
+
+    printf("passed\n");
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * checks the client side tsvector and tsquery literals, and the title lookup
+ * in the tika metadata.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpssix-tsv.h"
+#include "testlib.h"
+
+struct tsv_sample {
+    const char *title;
+    const char *text;
+    const char *expected;
+};
+
+static struct tsv_sample samples[] = {
+    { NULL, NULL, "" },
+    { "The Title", "the text, THE end.",
+      "'end':6 'text':4 'the':1A,3,5 'title':2A" },
+    { NULL, "x-ray scan", "'ray':3 'scan':4 'x':2 'x-ray':1" },
+    { NULL, "it's a \\path", "'a':3 'it':1 'path':4 's':2" },
+    { NULL, "caf\xc3\xa9 CAF\xc3\xa9", "'caf\xc3\xa9':1,2" },
+};
+
+static const int n_samples = sizeof(samples)/sizeof(samples[0]);
+
+struct title_sample {
+    const char *meta;
+    const char *expected;
+};
+
+static struct title_sample titles[] = {
+    { "{\"dc:title\":\"no\",\"title\" : \"A \\\"B\\\" caf\\u00e9\"}",
+      "A \"B\" caf\xc3\xa9" },
+    { "{\"title\":[\"one\",\"two\"],\"x\":1}", "[\"one\",\"two\"]" },
+    { "{\"Content-Type\":\"text/plain\"}", NULL },
+};
+
+static const int n_titles = sizeof(titles)/sizeof(titles[0]);
+
+int main(int argc, char **argv)
+{
+    int i = 0;
+    int ret = 0;
+    char *tsv = NULL;
+    char *query = NULL;
+
+    for (i = 0; i < n_samples; i++) {
+        struct tsv_sample *sample = &samples[i];
+
+        ret = hpssix_tsv_build(sample->title, sample->text, &tsv);
+        if (ret)
+            die("hpssix_tsv_build failed (%d)\n", ret);
+
+        printf("%s\n", tsv);
+
+        if (strcmp(tsv, sample->expected))
+            die("expected %s\n", sample->expected);
+
+        free(tsv);
+    }
+
+    for (i = 0; i < n_titles; i++) {
+        char *title = hpssix_tsv_meta_title(titles[i].meta);
+
+        printf("%s\n", title ? title : "(null)");
+
+        if ((title || titles[i].expected) &&
+            (!title || !titles[i].expected ||
+             strcmp(title, titles[i].expected)))
+            die("expected %s\n", titles[i].expected);
+
+        free(title);
+    }
+
+    ret = hpssix_tsv_query("Hello, O'Neil x-ray", &query);
+    if (ret)
+        die("hpssix_tsv_query failed (%d)\n", ret);
+
+    printf("%s\n", query);
+
+    if (strcmp(query, "'hello' & 'o' & 'neil' & 'x-ray' & 'x' & 'ray'"))
+        die("unexpected query\n");
+
+    free(query);
+
+    printf("passed\n");
+
+    return 0;
+}
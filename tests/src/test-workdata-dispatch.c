@@ -60,7 +60,8 @@ int main(int argc, char **argv)
 
     for (i = 0; i < list.count; i++) {
         hpssix_workdata_object_t *current = &list.object_list[i];
-        printf("oid: %lu, path: %s\n", current->object_id, current->path);
+        printf("oid: %lu, path: %s, locality: %s\n", current->object_id,
+               current->path, current->locality ? current->locality : "-");
     }
 
     hpssix_workdata_cleanup_object_list(list.object_list, list.count);
@@ -0,0 +1,256 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "tika-stub.h"
+
+static const char *stub_meta =
+"{\"Content-Type\":\"text/plain; charset=ISO-8859-1\",\"title\":\"stub\"}";
+
+static const char *stub_content = "hpssix tika stub content\n";
+
+static const char *stub_probe = "This is Tika Server (stub).\n";
+
+struct stub_conn {
+    struct tika_stub *stub;
+    int fd;
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n = 0;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n <= 0)
+            return -1;
+
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static const char *status_str(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 422: return "Unprocessable Entity";
+    case 503: return "Service Unavailable";
+    default: return "Error";
+    }
+}
+
+static void *stub_conn_func(void *arg)
+{
+    struct stub_conn *conn = (struct stub_conn *) arg;
+    struct tika_stub *stub = conn->stub;
+    int fd = conn->fd;
+    int status = stub->status;
+    char buf[8192] = { 0, };
+    char method[16] = { 0, };
+    char path[256] = { 0, };
+    char *pos = NULL;
+    char *header_end = NULL;
+    size_t len = 0;
+    size_t body = 0;
+    size_t content_length = 0;
+    const char *reply = NULL;
+    ssize_t n = 0;
+    uint64_t seq = 0;
+    uint64_t delay_us = 0;
+    unsigned int seed = (unsigned int) (uintptr_t) conn;
+
+    free(conn);
+
+    /* read the request header */
+    while (!header_end && len < sizeof(buf) - 1) {
+        n = read(fd, buf + len, sizeof(buf) - 1 - len);
+        if (n <= 0)
+            goto out;
+
+        len += n;
+        buf[len] = '\0';
+        header_end = strstr(buf, "\r\n\r\n");
+    }
+
+    if (!header_end)
+        goto out;
+
+    sscanf(buf, "%15s %255s", method, path);
+
+    for (pos = buf; pos && pos < header_end; pos = strstr(pos, "\r\n")) {
+        pos += 2;
+
+        if (strncasecmp(pos, "Content-Length:", 15) == 0)
+            content_length = strtoull(pos + 15, NULL, 0);
+        else if (strncasecmp(pos, "Expect: 100-continue", 20) == 0) {
+            const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+
+            if (write_all(fd, cont, strlen(cont)))
+                goto out;
+        }
+    }
+
+    /* discard the body */
+    body = len - (header_end + 4 - buf);
+
+    while (body < content_length) {
+        n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            goto out;
+
+        body += n;
+    }
+
+    delay_us = stub->delay_ms*1000;
+    if (stub->jitter_ms > 0)
+        delay_us += rand_r(&seed) % (stub->jitter_ms*1000);
+    if (stub->bytes_per_sec > 0)
+        delay_us += body*1000000/stub->bytes_per_sec;
+
+    if (delay_us > 0)
+        usleep(delay_us);
+
+    if (strcmp(method, "GET") == 0) {
+        __sync_fetch_and_add(&stub->n_probes, 1);
+        reply = stub_probe;
+    }
+    else {
+        seq = __sync_fetch_and_add(&stub->n_requests, 1);
+        __sync_fetch_and_add(&stub->bytes_received, body);
+        reply = strcmp(path, "/meta") == 0 ? stub_meta : stub_content;
+
+        /* spread the failures evenly over the requests */
+        if (stub->fail_permille > 0 && status == 200 &&
+            (seq*7919) % 1000 < (uint64_t) stub->fail_permille) {
+            __sync_fetch_and_add(&stub->n_failed, 1);
+            status = 422;
+        }
+    }
+
+    if (status != 200)
+        reply = "";
+
+    n = snprintf(buf, sizeof(buf),
+                 "HTTP/1.1 %d %s\r\n"
+                 "Content-Type: text/plain\r\n"
+                 "Content-Length: %lu\r\n"
+                 "Connection: close\r\n"
+                 "\r\n%s",
+                 status, status_str(status), strlen(reply), reply);
+
+    write_all(fd, buf, n);
+
+out:
+    close(fd);
+
+    return (void *) 0;
+}
+
+static void *stub_server_func(void *arg)
+{
+    int fd = 0;
+    struct tika_stub *stub = (struct tika_stub *) arg;
+    struct pollfd pfd = { 0, };
+    pthread_t thread;
+
+    pfd.fd = stub->listenfd;
+    pfd.events = POLLIN;
+
+    while (!stub->stop) {
+        struct stub_conn *conn = NULL;
+
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        fd = accept(stub->listenfd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        conn = malloc(sizeof(*conn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+
+        conn->stub = stub;
+        conn->fd = fd;
+
+        if (pthread_create(&thread, NULL, stub_conn_func, conn)) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    return (void *) 0;
+}
+
+int tika_stub_start(struct tika_stub *stub)
+{
+    int ret = 0;
+    int fd = -1;
+    int one = 1;
+    struct sockaddr_in addr = { 0, };
+    socklen_t addrlen = sizeof(addr);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return errno;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+        listen(fd, 64) ||
+        getsockname(fd, (struct sockaddr *) &addr, &addrlen)) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    if (stub->status == 0)
+        stub->status = 200;
+
+    stub->port = ntohs(addr.sin_port);
+    stub->listenfd = fd;
+    stub->stop = 0;
+
+    ret = pthread_create(&stub->thread, NULL, stub_server_func, stub);
+    if (ret)
+        close(fd);
+
+    return ret;
+}
+
+void tika_stub_stop(struct tika_stub *stub)
+{
+    stub->stop = 1;
+    pthread_join(stub->thread, NULL);
+    close(stub->listenfd);
+}
@@ -0,0 +1,54 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * a minimal http server standing in for the tika server. it answers
+ * PUT /meta with a fixed json, PUT /tika with a fixed text, and GET /tika
+ * for the health probes. the request body is read and discarded.
+ */
+#ifndef __HPSSIX_TIKA_STUB_H
+#define __HPSSIX_TIKA_STUB_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+struct tika_stub {
+    int port;                   /* assigned by tika_stub_start() */
+
+    /* behavior, can be changed while running */
+    volatile int status;        /* http status to answer, 200 by default */
+    volatile int delay_ms;      /* delay before answering each request */
+    volatile int jitter_ms;     /* plus a random delay up to this */
+    volatile uint64_t bytes_per_sec;    /* parsing speed, 0 for no cost */
+    volatile int fail_permille; /* PUT requests answered with 422 */
+
+    volatile uint64_t n_requests;   /* PUT requests served */
+    volatile uint64_t n_probes;     /* GET requests served */
+    volatile uint64_t n_failed;     /* PUT requests failed on purpose */
+    volatile uint64_t bytes_received;
+
+    int listenfd;
+    volatile int stop;
+    pthread_t thread;
+};
+
+/**
+ * @brief start the stub server on a random localhost port.
+ *
+ * @param stub
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int tika_stub_start(struct tika_stub *stub);
+
+/**
+ * @brief
+ *
+ * @param stub
+ */
+void tika_stub_stop(struct tika_stub *stub);
+
+#endif /* __HPSSIX_TIKA_STUB_H */
@@ -175,3 +175,98 @@ int hpssix_builder_process_deleted(hpssix_builder_t *self)
     return hpssix_db_copy(self->db, &copy);
 }
 
+
+/*
+ * storage locality of the objects (oid, key), exported by the scanner from
+ * the hpss storage attributes. objects are handed over to the extractor in
+ * the key order, so that files on the same volume are read one after
+ * another. the file is optional, and any file in the same format (e.g.,
+ * tests/src/mock-locality.sh) can stand in for it.
+ */
+static const char *builder_locality_init_stmt =
+"CREATE TEMPORARY TABLE __locality (oid BIGINT, locality TEXT);\n";
+
+static const char *builder_locality_copy_stmt =
+"COPY __locality (oid, locality) FROM STDIN WITH DELIMITER ',' CSV "
+"QUOTE '\"';\n";
+
+static const char *builder_locality_fini_stmt =
+"CREATE INDEX ON __locality (oid);\n"
+"ANALYZE __locality;\n";
+
+int hpssix_builder_process_locality(hpssix_builder_t *self)
+{
+    hpssix_db_copy_t copy = { 0, };
+    char scanner_output[PATH_MAX] = { 0, };
+
+    hpssix_builder_get_scanner_filename(self, scanner_output,
+                                        SCANNER_OUTPUT_LOCALITY);
+
+    /* without the locality, the parent directory is used instead */
+    if (access(scanner_output, R_OK))
+        return hpssix_db_psql_exec(self->db, builder_locality_init_stmt);
+
+    memset((void *) &copy, 0, sizeof(copy));
+
+    copy.stmt_init = builder_locality_init_stmt;
+    copy.stmt_copy = builder_locality_copy_stmt;
+    copy.stmt_fini = builder_locality_fini_stmt;
+    copy.input_csv = scanner_output;
+
+    return hpssix_db_copy(self->db, &copy);
+}
+
+/*
+ * the statistics of the planner, refreshed as the tables have just been
+ * rewritten in bulk.
+ */
+static const char *builder_analyze_stmt =
+"ANALYZE hpssix_object;\n"
+"ANALYZE hpssix_file;\n"
+"ANALYZE hpssix_attr_val;\n"
+"ANALYZE hpssix_attr_document;\n";
+
+/*
+ * the counters for the estimated searches (hpssix_object_count), from the
+ * objects as of this build.
+ */
+static const char *builder_count_stmt =
+"DELETE FROM hpssix_object_count;\n"
+"INSERT INTO hpssix_object_count (valid, st_uid, st_gid, st_type, n)\n"
+"  SELECT valid, st_uid, st_gid, st_mode & 61440, COUNT(*)\n"
+"    FROM hpssix_object GROUP BY 1, 2, 3, 4;\n"
+"DELETE FROM hpssix_attr_key_count;\n"
+"INSERT INTO hpssix_attr_key_count (kid, n)\n"
+"  SELECT kid, COUNT(*) FROM hpssix_attr_val GROUP BY kid;\n"
+"ANALYZE hpssix_object_count;\n"
+"ANALYZE hpssix_attr_key_count;\n";
+
+/*
+ * after the build has committed, not to keep its transaction (and the locks
+ * on the index) open over the whole tables. the counters are replaced in a
+ * transaction of their own, which bumps the generation again for the
+ * estimates cached in between.
+ */
+int hpssix_builder_process_counts(hpssix_builder_t *self)
+{
+    int ret = 0;
+
+    ret = hpssix_db_psql_exec(self->db, builder_analyze_stmt);
+    if (ret)
+        return ret;
+
+    ret = hpssix_db_begin_transaction(self->db);
+    if (ret)
+        return ret;
+
+    ret = hpssix_db_psql_exec(self->db, builder_count_stmt);
+    if (!ret)
+        ret = hpssix_db_bump_generation(self->db);
+
+    if (ret)
+        hpssix_db_rollback(self->db);
+    else
+        ret = hpssix_db_end_transaction(self->db);
+
+    return ret;
+}
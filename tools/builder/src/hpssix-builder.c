@@ -52,10 +52,24 @@ static int db_initialize(void)
     return ret;
 }
 
+/*
+ * the objects are ordered by the storage locality (or the parent directory if
+ * not known), which becomes the order of the extraction.
+ */
 const char *workdata_sql =
-"SELECT o.oid, o.st_mode, o.st_size, f.path\n"
-"  FROM (SELECT oid, st_mode, st_size FROM __object WHERE st_size > 0) o\n"
-"       NATURAL JOIN __file f;\n";
+"SELECT o.oid, o.st_mode, o.st_size, o.st_mtime, f.path,\n"
+"       fp.st_size, fp.st_mtime, fp.hash,\n"
+"       COALESCE(l.locality,\n"
+"                'dir:' || REGEXP_REPLACE(f.path, '/[^/]*$', '')) AS locality,\n"
+"       l.locality IS NOT NULL,\n"
+"       q.n_timeouts, q.st_mtime\n"
+"  FROM (SELECT oid, st_mode, st_size, st_mtime\n"
+"          FROM __object WHERE st_size > 0) o\n"
+"       NATURAL JOIN __file f\n"
+"       LEFT OUTER JOIN hpssix_attr_fingerprint fp ON o.oid = fp.oid\n"
+"       LEFT OUTER JOIN __locality l ON o.oid = l.oid\n"
+"       LEFT OUTER JOIN hpssix_attr_quarantine q ON o.oid = q.oid\n"
+" ORDER BY locality, o.oid;\n";
 
 static int hpssix_builder_create_workdata(hpssix_builder_t *self)
 {
@@ -84,18 +98,51 @@ static int hpssix_builder_create_workdata(hpssix_builder_t *self)
     rows = PQntuples(res);
 
     for (i = 0; i < rows; i++) {
-        uint64_t oid = strtoull(PQgetvalue(res, i, 0), NULL, 0);
+        hpssix_workdata_object_t object = { 0, };
         mode_t st_mode = atoi(PQgetvalue(res, i, 1));
-        size_t st_size = strtoull(PQgetvalue(res, i, 2), NULL, 0);
-        char *path = PQgetvalue(res, i, 3);
 
-        if (!builder_filter_meta_extract(self, path, st_mode, st_size))
+        object.object_id = strtoull(PQgetvalue(res, i, 0), NULL, 0);
+        object.size = strtoull(PQgetvalue(res, i, 2), NULL, 0);
+        object.mtime = strtoull(PQgetvalue(res, i, 3), NULL, 0);
+        object.path = PQgetvalue(res, i, 4);
+        object.locality = PQgetvalue(res, i, 8);
+
+        if (!builder_filter_meta_extract(self, object.path, st_mode,
+                                         object.size))
             continue;
 
-        ret = hpssix_workdata_append(&workdata, oid, path);
+        /* timed out too many times, and not modified since */
+        if (!PQgetisnull(res, i, 10) && self->config->extractor_quarantine &&
+            atoi(PQgetvalue(res, i, 10)) >=
+                (int) self->config->extractor_quarantine &&
+            object.mtime == strtoull(PQgetvalue(res, i, 11), NULL, 0)) {
+            self->n_quarantined++;
+            continue;
+        }
+
+        /*
+         * the content cannot have changed if the size and mtime are the
+         * same. if only the mtime differs, pass the previous hash over to the
+         * extractor so that it can compare the fingerprint.
+         */
+        if (!PQgetisnull(res, i, 5) &&
+            object.size == strtoull(PQgetvalue(res, i, 5), NULL, 0)) {
+            if (object.mtime == strtoull(PQgetvalue(res, i, 6), NULL, 0)) {
+                self->n_unchanged++;
+                continue;
+            }
+
+            if (!PQgetisnull(res, i, 7))
+                object.hash = strtoll(PQgetvalue(res, i, 7), NULL, 0);
+        }
+
+        ret = hpssix_workdata_append_object(&workdata, &object);
         if (ret)
             break;
 
+        if (PQgetvalue(res, i, 9)[0] == 't')
+            self->n_localities++;
+
         count++;
     }
 
@@ -118,6 +165,8 @@ out:
  * 2) insert/update filepath (hpssix_file)
  * 3) insert/update xattrs (hpssix_attr_key, hpssix_attr_val)
  * 4) mark deleted files (hpssix_object)
+ * 5) count the objects by the owner and the type (hpssix_object_count)
+ *    and the values of each xattr key (hpssix_attr_key_count)
  */
 static int do_builder(void)
 {
@@ -162,20 +211,40 @@ static int do_builder(void)
         goto out_finish;
     }
 
+    ret = hpssix_builder_process_locality(&builder);
+    if (ret) {
+        fprintf(stderr, "## failed to process the storage locality.\n");
+        goto out_finish;
+    }
+
     ret = hpssix_builder_create_workdata(&builder);
     if (ret) {
         fprintf(stderr, "## failed to create the workdata.\n");
         goto out_finish;
     }
 
+    /* the cached searches are of the index before this build */
+    ret = hpssix_db_bump_generation(&db);
+    if (ret) {
+        fprintf(stderr, "## failed to bump the index generation.\n");
+        goto out_finish;
+    }
+
     printf("## files indexed: %lu\n", builder.n_processed);
     printf("## regular files: %lu\n", builder.n_regular_files);
+    printf("## unchanged files: %lu\n", builder.n_unchanged);
+    printf("## storage localities: %lu\n", builder.n_localities);
+    printf("## quarantined files: %lu\n", builder.n_quarantined);
 
 out_finish:
     if (ret)
         hpssix_db_rollback(&db);
     else
-        hpssix_db_end_transaction(&db);
+        ret = hpssix_db_end_transaction(&db);
+
+    /* once committed, a failure only leaves the counters of the last build */
+    if (!ret && hpssix_builder_process_counts(&builder))
+        fprintf(stderr, "## failed to count the objects.\n");
 
 out:
     hpssix_db_disconnect(&db);
@@ -249,7 +318,7 @@ int main(int argc, char **argv)
         goto out;
     }
 
-    filter = hpssix_extfilter_get();
+    filter = hpssix_extfilter_get(config.extractor_native);
     if (!filter) {
         fprintf(stderr, "failed to load the extfilter: %s\n", strerror(errno));
         goto out;
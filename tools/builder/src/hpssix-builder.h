@@ -28,6 +28,9 @@ struct _hpssix_builder {
 
     uint64_t n_processed;
     uint64_t n_regular_files;
+    uint64_t n_unchanged;       /* skipped by the fingerprint */
+    uint64_t n_localities;      /* objects with the storage locality */
+    uint64_t n_quarantined;     /* skipped for the extraction timeouts */
 };
 
 typedef struct _hpssix_builder hpssix_builder_t;
@@ -40,12 +43,17 @@ int hpssix_builder_process_xattrs(hpssix_builder_t *self);
 
 int hpssix_builder_process_deleted(hpssix_builder_t *self);
 
+int hpssix_builder_process_locality(hpssix_builder_t *self);
+
+int hpssix_builder_process_counts(hpssix_builder_t *self);
+
 enum {
     SCANNER_OUTPUT_FATTR = 0,
     SCANNER_OUTPUT_PATH = 1,
     SCANNER_OUTPUT_XATTR = 2,
     SCANNER_OUTPUT_DELETED = 3,
-    N_SCANNER_OUTPUT_TYPE = 4,
+    SCANNER_OUTPUT_LOCALITY = 4,
+    N_SCANNER_OUTPUT_TYPE = 5,
 };
 
 static inline char *hpssix_builder_get_scanner_filename(hpssix_builder_t *self,
@@ -72,6 +80,11 @@ static inline char *hpssix_builder_get_scanner_filename(hpssix_builder_t *self,
                      self->datadir, self->task_id);
         break;
 
+    case SCANNER_OUTPUT_LOCALITY:
+        sprintf(buf, "%s/scanner.%lu.locality.csv",
+                     self->datadir, self->task_id);
+        break;
+
     default:
         return NULL;
     }
@@ -0,0 +1,458 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * the extraction of a single file: the stat (or the prefetched buffer), the
+ * fingerprint, the native extractors, and the tika requests under the limiter
+ * and the pool, within the deadline of the file.
+ */
+#include <config.h>
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include <hpssix.h>
+#include "hpssix-extractor.h"
+
+/* the file is read in this size, checking the cancellation in between */
+static const uint64_t prefetch_chunk = 1<<20;
+
+static inline double timediff(struct timeval *t1, struct timeval *t2)
+{
+    double usec = (t2->tv_sec - t1->tv_sec)*1e6 + 1.0F*(t2->tv_usec - t1->tv_usec);
+    return usec/1e6;
+}
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+double hpssix_extractor_file_deadline(hpssix_extractor_file_t *self,
+                                      double from, uint64_t size)
+{
+    if (!self->timeout)
+        return .0F;
+
+    return from + self->timeout + (self->minrate ? size/self->minrate : 0);
+}
+
+void hpssix_extractor_watch_begin(hpssix_extractor_file_t *self,
+                                  hpssix_extractor_watch_t *watch,
+                                  hpssix_workdata_object_t *object,
+                                  uint64_t index)
+{
+    watch->oid = object->object_id;
+    watch->mtime = object->mtime;
+    watch->index = index;
+    watch->cancel = 0;
+    __sync_synchronize();
+    watch->deadline = hpssix_extractor_file_deadline(self, now_sec(),
+                                                     object->size);
+}
+
+void hpssix_extractor_watch_end(hpssix_extractor_watch_t *watch)
+{
+    watch->deadline = .0F;
+    __sync_synchronize();
+}
+
+/*
+ * fnv-1a hash over the file size, and the first and last @fingerprint_bytes
+ * of the file. this is to catch the files that are only touched (e.g., by
+ * hpssix-tag), not to detect every modification.
+ */
+static uint64_t fingerprint_hash(hpssix_extractor_data_t *data,
+                                 uint64_t fingerprint_bytes)
+{
+    uint64_t hash = 14695981039346656037UL;
+    uint64_t i = 0;
+    uint64_t len = fingerprint_bytes;
+    uint64_t offset[2] = { 0, 0 };
+    unsigned char buf[4096];
+    int n = 0;
+
+    for (i = 0; i < sizeof(data->file_size); i++) {
+        hash ^= (data->file_size >> (i*8)) & 0xff;
+        hash *= 1099511628211UL;
+    }
+
+    if (len > data->file_size)
+        len = data->file_size;
+
+    offset[1] = data->file_size - len;
+
+    for (n = 0; n < 2; n++) {
+        uint64_t pos = offset[n];
+        uint64_t remaining = len;
+
+        while (remaining > 0) {
+            ssize_t nread = 0;
+            size_t count = remaining < sizeof(buf) ? remaining : sizeof(buf);
+
+            if (data->map) {
+                memcpy(buf, (char *) data->map + pos, count);
+                nread = count;
+            }
+            else
+                nread = pread(data->fd, buf, count, pos);
+            if (nread <= 0)
+                return 0;
+
+            for (i = 0; i < nread; i++) {
+                hash ^= buf[i];
+                hash *= 1099511628211UL;
+            }
+
+            pos += nread;
+            remaining -= nread;
+        }
+
+        if (len == data->file_size)     /* the whole file in the head */
+            break;
+    }
+
+    return hash ? hash : 1;
+}
+
+/*
+ * the prefetched @staged (NULL without the prefetch stage) has been read into
+ * the memory, unless it is passed through for the size.
+ */
+int hpssix_extractor_file_extract(hpssix_extractor_file_t *self, uint64_t id,
+                                  hpssix_extractor_watch_t *watch,
+                                  hpssix_extractor_file_stat_t *wstat,
+                                  hpssix_workdata_object_t *object,
+                                  uint64_t index,
+                                  hpssix_extractor_staged_t *staged,
+                                  hpssix_db_docsink_t *sink)
+{
+    int ret = 0;
+    struct stat sb = { 0, };
+    hpssix_extractor_data_t data = { 0, };
+    hpssix_db_document_t doc = { 0, };
+    hpssix_extractor_endpoint_t *ep = NULL;
+    const hpssix_extractor_native_t *native = NULL;
+    struct timeval before = { 0, };
+    struct timeval after = { 0, };
+    FILE *fp = NULL;
+
+    data.fd = -1;
+    data.cancel = &watch->cancel;
+
+    sprintf(data.file, "%s%s", self->prefix, object->path);
+
+    if (staged) {
+        if (staged->error)      /* reported by the prefetch */
+            return staged->error;
+
+        sb = staged->sb;
+    }
+    else {
+        ret = stat(data.file, &sb);
+        if (ret) {
+            printf("[%lu]EE: cannot stat %s (%s)\n",
+                   id, data.file, strerror(errno));
+            return errno;
+        }
+    }
+
+    data.file_size = sb.st_size;
+
+    /* the watchdog deadline started at the size from the builder */
+    if (watch->deadline > 0) {
+        data.deadline = hpssix_extractor_file_deadline(self, now_sec(),
+                                                       data.file_size);
+        watch->deadline = data.deadline;
+    }
+
+    if (staged && staged->buf) {
+        data.map = staged->buf;
+        data.upload_mode = HPSSIX_EXTRACTOR_UPLOAD_BUFFER;
+    }
+    else {
+        ret = hpssix_extractor_open(&data, self->upload_mode);
+        if (ret) {
+            printf("[%lu]EE: cannot open %s (%s)\n",
+                   id, data.file, strerror(ret));
+            return ret;
+        }
+    }
+
+    doc.oid = object->object_id;
+    doc.tag = index;
+    doc.size = sb.st_size;
+    doc.mtime = sb.st_mtime;
+
+    if (self->fingerprint_bytes > 0) {
+        doc.hash = fingerprint_hash(&data, self->fingerprint_bytes);
+
+        if (object->hash && object->size == doc.size &&
+            object->hash == doc.hash) {
+            if (self->verbose)
+                printf("[%lu] %s unchanged, skipping\n", id, data.file);
+
+            hpssix_extractor_close(&data);
+            wstat->n_unchanged++;
+
+            /* only update the fingerprint with the new mtime */
+            return sink ? hpssix_db_docsink_append(sink, &doc) : 0;
+        }
+    }
+
+    if (self->native)
+        native = hpssix_extractor_native_lookup(data.file);
+
+    if (native) {
+        ret = hpssix_extractor_native_extract(native, &data,
+                                              self->native_maxbytes);
+        if (ret == 0) {
+            hpssix_docmeta_parse(data.meta, &data.docmeta);
+            wstat->n_native++;
+            goto out;
+        }
+
+        if (self->verbose)
+            printf("[%lu] %s: native extraction failed (%s), trying tika\n",
+                   id, data.file, strerror(ret));
+    }
+
+    fp = tmpfile();
+    if (!fp) {
+        ret = errno;
+        printf("[%lu]EE: cannot make tmpfile (%s)\n", id, strerror(ret));
+        hpssix_extractor_close(&data);
+        return ret;
+    }
+
+    data.tmpfp = fp;
+
+    /*
+     * the waits for a request slot and an endpoint are not counted against
+     * the deadline, e.g., while all tika servers are out of the rotation.
+     * the deadline starts over for the requests.
+     */
+    hpssix_extractor_watch_end(watch);
+
+    hpssix_extractor_limiter_acquire(self->limiter);
+
+    ep = hpssix_extractor_pool_get(self->pool);
+
+    data.deadline = hpssix_extractor_file_deadline(self, now_sec(),
+                                                   data.file_size);
+    watch->deadline = data.deadline;
+
+    if (!ep) {
+        ret = EHOSTUNREACH;
+        printf("[%lu]EE: no tika server available\n", id);
+        hpssix_extractor_limiter_release(self->limiter, 1, .0F, 0);
+        goto out;
+    }
+
+    data.tika_host = ep->host;
+    data.tika_port = ep->port;
+
+    gettimeofday(&before, NULL);
+
+    ret = hpssix_extractor_get_meta(&data);
+    if (ret) {
+        if (self->verbose && ret != EINVAL)
+            printf("[%lu]EE: hpssix_extractor_get_meta failed (%d:%s)\n",
+                   id, ret, strerror(ret));
+        goto out_put;
+    }
+
+    ret = hpssix_extractor_get_content(&data);
+    if (ret && self->verbose)
+        printf("[%lu]EE: hpssix_extractor_get_content failed (%d:%s)\n",
+               id, ret, strerror(ret));
+
+out_put:
+    gettimeofday(&after, NULL);
+
+    /*
+     * EINVAL is about the document, not the server. a timeout is counted
+     * as a failure, for the server may be choking on the document.
+     */
+    hpssix_extractor_pool_put(self->pool, ep, ret && ret != EINVAL,
+                              timediff(&before, &after),
+                              data.bytes_uploaded);
+    hpssix_extractor_limiter_release(self->limiter, ret && ret != EINVAL,
+                                     timediff(&before, &after),
+                                     data.bytes_uploaded);
+
+    /* do not index a partial result, the file will be retried on resume */
+    if (ret && ret != EINVAL && data.meta) {
+        free(data.meta);
+        free(data.content);
+        data.meta = NULL;
+        data.content = NULL;
+        hpssix_docmeta_free(&data.docmeta);
+    }
+out:
+    if (data.tmpfp)
+        fclose(data.tmpfp);
+    hpssix_extractor_close(&data);
+
+    wstat->bytes_uploaded += data.bytes_uploaded;
+    wstat->upload_sec += data.upload_sec;
+
+    if (data.meta && !sink) {
+        free(data.meta);
+        free(data.content);
+        hpssix_docmeta_free(&data.docmeta);
+    }
+    else if (data.meta) {
+        if (self->verbose)
+            printf("[%lu] extracted from %lu, %s (meta: %s, content: ...)\n",
+                    id, object->object_id, data.file, data.meta);
+
+        /* index the data, the sink takes the ownership of the buffers */
+        doc.meta = data.meta;
+        doc.text = data.content;
+
+        doc.docmeta = malloc(sizeof(*doc.docmeta));
+        if (doc.docmeta)
+            *doc.docmeta = data.docmeta;
+        else
+            hpssix_docmeta_free(&data.docmeta);
+
+        ret = hpssix_db_docsink_append(sink, &doc);
+        if (ret)
+            fprintf(stderr, "hpssix_db_docsink_append failed (%d:%s)\n", ret,
+                    strerror(ret));
+    }
+
+    return ret;
+}
+
+/*
+ * read the whole file into @buf, in chunks to see the cancellation. a file
+ * which got shorter since the stat is taken as it is.
+ */
+static int prefetch_read(const char *file, void *buf, uint64_t *size,
+                         volatile int *cancel)
+{
+    int ret = 0;
+    int fd = -1;
+    uint64_t offset = 0;
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (offset < *size) {
+        uint64_t count = *size - offset;
+        ssize_t n = 0;
+
+        if (count > prefetch_chunk)
+            count = prefetch_chunk;
+
+        n = pread(fd, (char *) buf + offset, count, offset);
+        if (n < 0 || *cancel) {
+            ret = n < 0 ? errno : ETIMEDOUT;
+            break;
+        }
+        if (n == 0)
+            break;
+
+        offset += n;
+    }
+
+    close(fd);
+
+    *size = offset;
+
+    return ret;
+}
+
+void hpssix_extractor_file_prefetch(hpssix_extractor_file_t *self, uint64_t id,
+                                    hpssix_extractor_watch_t *watch,
+                                    hpssix_extractor_file_stat_t *wstat,
+                                    hpssix_extractor_staged_t *staged)
+{
+    int ret = 0;
+    uint64_t size = 0;
+    char file[PATH_MAX] = { 0, };
+    struct timeval before = { 0, };
+    struct timeval after = { 0, };
+
+    sprintf(file, "%s%s", self->prefix, staged->object.path);
+
+    hpssix_extractor_watch_begin(self, watch, &staged->object, staged->index);
+
+    ret = stat(file, &staged->sb);
+    if (ret) {
+        ret = errno;
+        printf("[%lu]EE: cannot stat %s (%s)\n", id, file, strerror(ret));
+        goto out;
+    }
+
+    /* the wait for the memory is not counted against the deadline */
+    hpssix_extractor_watch_end(watch);
+
+    size = staged->sb.st_size;
+
+    /* too large (or no one to upload it), the upload thread reads it */
+    if (hpssix_extractor_stage_reserve(self->stage, size))
+        goto out;
+
+    staged->reserved = size;
+    staged->buf = malloc(size ? size : 1);
+    if (!staged->buf)
+        goto out;
+
+    hpssix_extractor_watch_begin(self, watch, &staged->object, staged->index);
+    watch->deadline = hpssix_extractor_file_deadline(self, now_sec(), size);
+
+    gettimeofday(&before, NULL);
+
+    ret = prefetch_read(file, staged->buf, &size, &watch->cancel);
+    if (ret)
+        printf("[%lu]EE: cannot read %s (%s)\n", id, file, strerror(ret));
+
+    gettimeofday(&after, NULL);
+
+    staged->sb.st_size = size;
+
+    wstat->n_prefetched++;
+    wstat->bytes_read += size;
+    wstat->read_sec += timediff(&before, &after);
+
+out:
+    hpssix_extractor_watch_end(watch);
+
+    if (ret && watch->cancel)
+        ret = ETIMEDOUT;
+
+    staged->error = ret;
+
+    if (!staged->buf || ret) {
+        free(staged->buf);
+        staged->buf = NULL;
+        hpssix_extractor_stage_release(self->stage, staged->reserved);
+        staged->reserved = 0;
+    }
+
+    hpssix_extractor_stage_push(self->stage, staged,
+                                timediff(&before, &after));
+}
@@ -0,0 +1,227 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "hpssix-extractor.h"
+
+/* latencies are counted per this many bytes uploaded, on top of a request */
+static const double limiter_norm_bytes = 1048576.0F;
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+/* should be called with the lock held */
+static void set_limit(hpssix_extractor_limiter_t *limiter, double limit,
+                      const char *reason)
+{
+    double now = now_sec();
+
+    if (limit < limiter->min_limit)
+        limit = limiter->min_limit;
+    if (limit > limiter->max_limit)
+        limit = limiter->max_limit;
+
+    if (limiter->trace && reason &&
+        (uint32_t) limit != (uint32_t) limiter->limit)
+        fprintf(limiter->trace, "## [limiter] %.3lf: limit %u -> %u (%s)\n",
+                now - limiter->started_at, (uint32_t) limiter->limit,
+                (uint32_t) limit, reason);
+
+    limiter->limit_sum += (now - limiter->changed_at)*(uint32_t) limiter->limit;
+    limiter->changed_at = now;
+    limiter->limit = limit;
+
+    if ((uint32_t) limit > limiter->peak_limit)
+        limiter->peak_limit = (uint32_t) limit;
+    if ((uint32_t) limit < limiter->low_limit)
+        limiter->low_limit = (uint32_t) limit;
+}
+
+/* should be called with the lock held */
+static void close_window(hpssix_extractor_limiter_t *limiter)
+{
+    double latency = limiter->window_latency/limiter->window_samples;
+
+    if (limiter->window_errors > 0) {
+        set_limit(limiter, limiter->limit*limiter->error_decrease,
+                  "errors");
+        limiter->n_error_backoffs++;
+        limiter->draining = limiter->inflight;
+    }
+    else if (latency > limiter->tolerance*limiter->baseline) {
+        set_limit(limiter, limiter->limit*limiter->latency_decrease,
+                  "latency");
+        limiter->n_latency_backoffs++;
+    }
+    else if (limiter->window_peak >= (uint32_t) limiter->limit &&
+             (uint32_t) limiter->limit < limiter->max_limit) {
+        set_limit(limiter, (uint32_t) limiter->limit + 1, "saturated");
+        limiter->n_increases++;
+    }
+
+    /* let the baseline follow a server that got slower for good */
+    limiter->baseline *= 1.0F + limiter->baseline_drift;
+
+    limiter->window_samples = 0;
+    limiter->window_errors = 0;
+    limiter->window_peak = limiter->inflight;
+    limiter->window_latency = .0F;
+}
+
+int hpssix_extractor_limiter_init(hpssix_extractor_limiter_t *limiter,
+                                  uint32_t max_limit, int adaptive)
+{
+    if (!limiter || !max_limit)
+        return EINVAL;
+
+    memset((void *) limiter, 0, sizeof(*limiter));
+
+    limiter->adaptive = adaptive;
+    limiter->min_limit = 1;
+    limiter->max_limit = max_limit;
+    limiter->min_window = 8;
+    limiter->tolerance = 2.0F;
+    limiter->latency_decrease = 0.9F;
+    limiter->error_decrease = 0.5F;
+    limiter->baseline_drift = 0.002F;
+
+    /* start in the middle, and find the way up or down */
+    limiter->limit = adaptive ? (max_limit + 1)/2 : max_limit;
+    limiter->peak_limit = (uint32_t) limiter->limit;
+    limiter->low_limit = (uint32_t) limiter->limit;
+    limiter->started_at = limiter->changed_at = now_sec();
+
+    pthread_mutex_init(&limiter->lock, NULL);
+    pthread_cond_init(&limiter->cond, NULL);
+
+    return 0;
+}
+
+void hpssix_extractor_limiter_fini(hpssix_extractor_limiter_t *limiter)
+{
+    if (!limiter)
+        return;
+
+    pthread_cond_destroy(&limiter->cond);
+    pthread_mutex_destroy(&limiter->lock);
+}
+
+void hpssix_extractor_limiter_acquire(hpssix_extractor_limiter_t *limiter)
+{
+    double before = .0F;
+
+    pthread_mutex_lock(&limiter->lock);
+
+    if (limiter->inflight >= (uint32_t) limiter->limit) {
+        limiter->n_waits++;
+        before = now_sec();
+
+        while (limiter->inflight >= (uint32_t) limiter->limit)
+            pthread_cond_wait(&limiter->cond, &limiter->lock);
+
+        limiter->wait_sec += now_sec() - before;
+    }
+
+    limiter->inflight++;
+    if (limiter->inflight > limiter->window_peak)
+        limiter->window_peak = limiter->inflight;
+
+    pthread_mutex_unlock(&limiter->lock);
+}
+
+void hpssix_extractor_limiter_release(hpssix_extractor_limiter_t *limiter,
+                                      int failed, double latency,
+                                      uint64_t bytes)
+{
+    double normalized = latency/(1.0F + bytes/limiter_norm_bytes);
+    uint32_t window = 0;
+
+    pthread_mutex_lock(&limiter->lock);
+
+    limiter->inflight--;
+    limiter->n_requests++;
+
+    if (!limiter->adaptive)
+        goto out;
+
+    if (failed) {
+        limiter->n_errors++;
+        limiter->window_errors++;
+    }
+    else {
+        if (limiter->baseline == .0F || normalized < limiter->baseline)
+            limiter->baseline = normalized;
+
+        limiter->window_latency += normalized;
+    }
+
+    limiter->window_samples++;
+
+    if (limiter->draining > 0)
+        limiter->draining--;
+
+    window = (uint32_t) limiter->limit;
+    if (window < limiter->min_window)
+        window = limiter->min_window;
+
+    /*
+     * a failure backs off right away, not waiting for the window, but only
+     * once for the requests which were already in flight.
+     */
+    if (limiter->window_samples >= window ||
+        (failed && limiter->draining == 0))
+        close_window(limiter);
+
+out:
+    pthread_cond_broadcast(&limiter->cond);
+    pthread_mutex_unlock(&limiter->lock);
+}
+
+void hpssix_extractor_limiter_print_stats(hpssix_extractor_limiter_t *limiter,
+                                          FILE *fp)
+{
+    double elapsed = .0F;
+    double average = .0F;
+
+    pthread_mutex_lock(&limiter->lock);
+
+    set_limit(limiter, limiter->limit, NULL);   /* to close the average */
+
+    elapsed = limiter->changed_at - limiter->started_at;
+    average = elapsed > 0 ? limiter->limit_sum/elapsed : limiter->limit;
+
+    fprintf(fp, "## [limiter] %s, limit %u (min %u, max %u, avg %.2lf, "
+                "cap %u)\n",
+                limiter->adaptive ? "adaptive" : "fixed",
+                (uint32_t) limiter->limit, limiter->low_limit,
+                limiter->peak_limit, average, limiter->max_limit);
+    fprintf(fp, "## [limiter] %lu requests, %lu errors, %lu increases, "
+                "%lu latency backoffs, %lu error backoffs\n",
+                limiter->n_requests, limiter->n_errors, limiter->n_increases,
+                limiter->n_latency_backoffs, limiter->n_error_backoffs);
+    fprintf(fp, "## [limiter] %lu waits (%.3lf seconds), "
+                "baseline latency %.3lf seconds/request\n",
+                limiter->n_waits, limiter->wait_sec, limiter->baseline);
+
+    pthread_mutex_unlock(&limiter->lock);
+}
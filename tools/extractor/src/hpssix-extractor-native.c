@@ -0,0 +1,538 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "hpssix-extractor.h"
+
+static const uint64_t native_default_maxbytes = 4*(1<<20);
+
+/*
+ * metadata buffer
+ */
+struct native_meta {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static int meta_grow(struct native_meta *meta, size_t len)
+{
+    char *buf = NULL;
+    size_t size = meta->size ? meta->size : 512;
+
+    if (meta->len + len + 1 <= meta->size)
+        return 0;
+
+    while (size < meta->len + len + 1)
+        size *= 2;
+
+    buf = realloc(meta->buf, size);
+    if (!buf)
+        return ENOMEM;
+
+    meta->buf = buf;
+    meta->size = size;
+
+    return 0;
+}
+
+static int meta_append(struct native_meta *meta, const char *str, size_t len)
+{
+    if (meta_grow(meta, len))
+        return ENOMEM;
+
+    memcpy(meta->buf + meta->len, str, len);
+    meta->len += len;
+    meta->buf[meta->len] = '\0';
+
+    return 0;
+}
+
+/* append "key":"val", with @val (utf-8) escaped for json */
+static int meta_add(struct native_meta *meta, const char *key,
+                    const char *val, size_t vlen)
+{
+    int ret = 0;
+    size_t i = 0;
+    char esc[8] = { 0, };
+
+    ret = meta_append(meta, meta->len > 1 ? ",\"" : "\"", meta->len > 1 ? 2 : 1);
+    ret |= meta_append(meta, key, strlen(key));
+    ret |= meta_append(meta, "\":\"", 3);
+
+    for (i = 0; i < vlen && !ret; i++) {
+        unsigned char ch = val[i];
+
+        if (ch == '"' || ch == '\\') {
+            esc[0] = '\\';
+            esc[1] = ch;
+            ret = meta_append(meta, esc, 2);
+        }
+        else if (ch < 0x20) {
+            sprintf(esc, "\\u%04x", ch);
+            ret = meta_append(meta, esc, 6);
+        }
+        else
+            ret = meta_append(meta, (char *) &ch, 1);
+    }
+
+    ret |= meta_append(meta, "\"", 1);
+
+    return ret ? ENOMEM : 0;
+}
+
+static int meta_add_str(struct native_meta *meta, const char *key,
+                        const char *val)
+{
+    return meta_add(meta, key, val, strlen(val));
+}
+
+static int meta_add_num(struct native_meta *meta, const char *key,
+                        uint64_t val)
+{
+    char buf[32] = { 0, };
+
+    sprintf(buf, "%lu", val);
+
+    return meta_add(meta, key, buf, strlen(buf));
+}
+
+/*
+ * utf-8 handling
+ */
+
+/* returns the length of the valid utf-8 sequence at @s, 0 if invalid. */
+static size_t utf8_seqlen(const unsigned char *s, size_t len)
+{
+    size_t n = 0;
+    size_t i = 0;
+    uint32_t cp = 0;
+
+    if (s[0] < 0x80)
+        return 1;
+    else if ((s[0] & 0xe0) == 0xc0) {
+        n = 2;
+        cp = s[0] & 0x1f;
+    }
+    else if ((s[0] & 0xf0) == 0xe0) {
+        n = 3;
+        cp = s[0] & 0x0f;
+    }
+    else if ((s[0] & 0xf8) == 0xf0) {
+        n = 4;
+        cp = s[0] & 0x07;
+    }
+    else
+        return 0;
+
+    if (n > len)
+        return 0;
+
+    for (i = 1; i < n; i++) {
+        if ((s[i] & 0xc0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[i] & 0x3f);
+    }
+
+    /* overlong, surrogates and out of range */
+    if ((n == 2 && cp < 0x80) || (n == 3 && cp < 0x800) ||
+        (n == 4 && cp < 0x10000) || cp > 0x10ffff ||
+        (cp >= 0xd800 && cp <= 0xdfff))
+        return 0;
+
+    return n;
+}
+
+/*
+ * copy @len bytes of @in to a new nul-terminated utf-8 string. the bytes
+ * which are not valid utf-8 are taken as latin-1, which is what tika
+ * would detect for most of such files. @len is shortened not to cut a
+ * multibyte sequence at the end, and @*valid is cleared if the input was not
+ * utf-8. returns NULL with errno set to ENOTSUP if the input looks binary.
+ */
+static char *utf8_sanitize(const char *in, size_t len, int truncated,
+                           int *valid)
+{
+    size_t i = 0;
+    size_t n = 0;
+    char *out = NULL;
+    char *pos = NULL;
+    const unsigned char *s = (const unsigned char *) in;
+
+    out = malloc(2*len + 1);
+    if (!out)
+        return NULL;
+
+    *valid = 1;
+    pos = out;
+
+    while (i < len) {
+        if (s[i] == '\0') {
+            free(out);
+            errno = ENOTSUP;
+            return NULL;
+        }
+
+        n = utf8_seqlen(&s[i], len - i);
+        if (n > 0) {
+            memcpy(pos, &s[i], n);
+            pos += n;
+            i += n;
+            continue;
+        }
+
+        /* the cut of the truncation */
+        if (truncated && len - i < 4 && s[i] >= 0xc0)
+            break;
+
+        *valid = 0;
+        *pos++ = (char) (0xc0 | (s[i] >> 6));
+        *pos++ = (char) (0x80 | (s[i] & 0x3f));
+        i++;
+    }
+
+    *pos = '\0';
+
+    return out;
+}
+
+/*
+ * handlers
+ */
+
+/* the first line of @text, without the end of line */
+static size_t first_line(const char *text, const char **line)
+{
+    const char *end = NULL;
+
+    while (*text == '\n' || *text == '\r')
+        text++;
+
+    end = strchr(text, '\n');
+    if (!end)
+        end = text + strlen(text);
+
+    *line = text;
+
+    while (end > text && isspace((unsigned char) end[-1]))
+        end--;
+
+    return end - text;
+}
+
+static int native_meta_text(const char *text, struct native_meta *meta)
+{
+    uint64_t lines = 0;
+    const char *pos = text;
+
+    while ((pos = strchr(pos, '\n')) != NULL) {
+        lines++;
+        pos++;
+    }
+
+    return meta_add_num(meta, "hpssix:lines", lines);
+}
+
+/* title from the first atx heading (# title) */
+static int native_meta_markdown(const char *text, struct native_meta *meta)
+{
+    const char *pos = text;
+    const char *end = NULL;
+
+    while (pos && *pos) {
+        if (pos[0] == '#') {
+            while (*pos == '#')
+                pos++;
+            while (*pos == ' ' || *pos == '\t')
+                pos++;
+
+            end = strchr(pos, '\n');
+            if (!end)
+                end = pos + strlen(pos);
+            while (end > pos && isspace((unsigned char) end[-1]))
+                end--;
+
+            if (end > pos)
+                return meta_add(meta, "title", pos, end - pos);
+        }
+
+        pos = strchr(pos, '\n');
+        if (pos)
+            pos++;
+    }
+
+    return native_meta_text(text, meta);
+}
+
+/* header line and the number of columns */
+static int native_meta_table(const char *text, struct native_meta *meta,
+                             char delimiter)
+{
+    int ret = 0;
+    uint64_t columns = 1;
+    size_t i = 0;
+    size_t len = 0;
+    const char *line = NULL;
+    char delim[2] = { delimiter, '\0' };
+
+    len = first_line(text, &line);
+
+    for (i = 0; i < len; i++)
+        if (line[i] == delimiter)
+            columns++;
+
+    ret = meta_add(meta, "hpssix:header", line, len);
+    ret |= meta_add_num(meta, "hpssix:columns", len ? columns : 0);
+    ret |= meta_add_str(meta, "hpssix:delimiter", delim);
+    ret |= native_meta_text(text, meta);
+
+    return ret;
+}
+
+static int native_meta_csv(const char *text, struct native_meta *meta)
+{
+    return native_meta_table(text, meta, ',');
+}
+
+static int native_meta_tsv(const char *text, struct native_meta *meta)
+{
+    return native_meta_table(text, meta, '\t');
+}
+
+/* top level keys of a json object */
+static int native_meta_json(const char *text, struct native_meta *meta)
+{
+    int ret = 0;
+    int depth = 0;
+    int instr = 0;
+    uint64_t nkeys = 0;
+    const char *pos = text;
+    const char *key = NULL;
+    struct native_meta keys = { 0, };
+
+    while (isspace((unsigned char) *pos))
+        pos++;
+
+    if (*pos != '{')
+        return native_meta_text(text, meta);
+
+    for ( ; *pos && ret == 0; pos++) {
+        if (instr) {
+            if (*pos == '\\' && pos[1])
+                pos++;
+            else if (*pos == '"') {
+                instr = 0;
+
+                /* a key at the top level is followed by a colon */
+                if (depth == 1 && key) {
+                    const char *next = pos + 1;
+
+                    while (isspace((unsigned char) *next))
+                        next++;
+
+                    if (*next == ':' && nkeys++ < 32) {
+                        if (keys.len)
+                            ret = meta_append(&keys, ",", 1);
+                        ret |= meta_append(&keys, key, pos - key);
+                    }
+                }
+                key = NULL;
+            }
+            continue;
+        }
+
+        switch (*pos) {
+        case '"':
+            instr = 1;
+            key = pos + 1;
+            break;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!ret && keys.len)
+        ret = meta_add(meta, "hpssix:keys", keys.buf, keys.len);
+
+    free(keys.buf);
+
+    return ret ? ret : native_meta_text(text, meta);
+}
+
+static const char *text_exts[] = {
+    "txt", "text", "log", "rst", "src", "c", "h", "cc", "cpp", "cxx", "hpp",
+    "py", "f", "f90", "f95", "java", "sh", "pl", "r", "m", "jl", "go", "rs",
+    "cfg", "conf", "ini", "yaml", "yml", NULL
+};
+static const char *markdown_exts[] = { "md", "markdown", NULL };
+static const char *csv_exts[] = { "csv", NULL };
+static const char *tsv_exts[] = { "tsv", "tab", NULL };
+static const char *json_exts[] = { "json", NULL };
+
+static hpssix_extractor_native_t native_registry[] = {
+    { "hpssix-native-markdown", "text/markdown", markdown_exts,
+      native_meta_markdown },
+    { "hpssix-native-csv", "text/csv", csv_exts, native_meta_csv },
+    { "hpssix-native-tsv", "text/tab-separated-values", tsv_exts,
+      native_meta_tsv },
+    { "hpssix-native-json", "application/json", json_exts, native_meta_json },
+    { "hpssix-native-text", "text/plain", text_exts, native_meta_text },
+};
+
+static const int n_native_registry =
+                        sizeof(native_registry)/sizeof(native_registry[0]);
+
+const hpssix_extractor_native_t *hpssix_extractor_native_lookup(const char *path)
+{
+    int i = 0;
+    const char *ext = NULL;
+    const char **pos = NULL;
+    const char *filename = NULL;
+
+    if (!path)
+        return NULL;
+
+    filename = strrchr(path, '/');
+    filename = filename ? filename + 1 : path;
+
+    ext = strrchr(filename, '.');
+    if (!ext || ext[1] == '\0')
+        return NULL;
+
+    ext++;
+
+    for (i = 0; i < n_native_registry; i++)
+        for (pos = native_registry[i].exts; *pos; pos++)
+            if (strcasecmp(ext, *pos) == 0)
+                return &native_registry[i];
+
+    return NULL;
+}
+
+const hpssix_extractor_native_t *
+hpssix_extractor_native_lookup_mime(const char *mime)
+{
+    int i = 0;
+    size_t len = 0;
+
+    if (!mime)
+        return NULL;
+
+    /* ignore the parameters, e.g., "; charset=UTF-8" */
+    len = strcspn(mime, ";");
+
+    for (i = 0; i < n_native_registry; i++)
+        if (strlen(native_registry[i].mime) == len &&
+            strncasecmp(mime, native_registry[i].mime, len) == 0)
+            return &native_registry[i];
+
+    return NULL;
+}
+
+int hpssix_extractor_native_extract(const hpssix_extractor_native_t *native,
+                                    hpssix_extractor_data_t *data,
+                                    uint64_t maxbytes)
+{
+    int ret = 0;
+    int valid = 0;
+    int truncated = 0;
+    uint64_t len = data->file_size;
+    char *raw = NULL;
+    char *text = NULL;
+    const char *filename = NULL;
+    char ctype[128] = { 0, };
+    struct native_meta meta = { 0, };
+
+    if (!native || !data)
+        return EINVAL;
+
+    if (!maxbytes)
+        maxbytes = native_default_maxbytes;
+
+    if (len > maxbytes) {
+        len = maxbytes;
+        truncated = 1;
+    }
+
+    if (data->map)
+        raw = (char *) data->map;
+    else {
+        ssize_t n = 0;
+        uint64_t offset = 0;
+
+        raw = malloc(len + 1);
+        if (!raw)
+            return ENOMEM;
+
+        while (offset < len) {
+            n = pread(data->fd, raw + offset, len - offset, offset);
+            if (n <= 0) {
+                ret = n < 0 ? errno : EIO;
+                goto out;
+            }
+            offset += n;
+        }
+    }
+
+    text = utf8_sanitize(raw, len, truncated, &valid);
+    if (!text) {
+        ret = errno;    /* ENOTSUP for binaries, let tika handle it */
+        goto out;
+    }
+
+    filename = strrchr(data->file, '/');
+    filename = filename ? filename + 1 : data->file;
+
+    sprintf(ctype, "%s; charset=%s", native->mime,
+                   valid ? "UTF-8" : "ISO-8859-1");
+
+    ret = meta_append(&meta, "{", 1);
+    ret |= meta_add_str(&meta, "Content-Type", ctype);
+    ret |= meta_add_str(&meta, "Content-Encoding",
+                              valid ? "UTF-8" : "ISO-8859-1");
+    ret |= meta_add_num(&meta, "Content-Length", data->file_size);
+    ret |= meta_add_str(&meta, "resourceName", filename);
+    ret |= meta_add_str(&meta, "X-Parsed-By", native->name);
+    if (truncated)
+        ret |= meta_add_str(&meta, "hpssix:truncated", "true");
+    ret |= native->func(text, &meta);
+    ret |= meta_append(&meta, "}", 1);
+    if (ret) {
+        ret = ENOMEM;
+        free(meta.buf);
+        free(text);
+        goto out;
+    }
+
+    data->meta = meta.buf;
+    data->content = text;
+
+out:
+    if (raw != data->map)
+        free(raw);
+
+    return ret;
+}
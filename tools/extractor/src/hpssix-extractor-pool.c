@@ -0,0 +1,397 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <curl/curl.h>
+
+#include "hpssix-extractor.h"
+
+static const int pool_default_port = 9998;
+
+/* weight of the latest sample in the latency ewma */
+static const double pool_latency_alpha = 0.2;
+
+/*
+ * latencies are counted per this many bytes uploaded, on top of a request, so
+ * an endpoint is not taken out for being handed larger documents.
+ */
+static const double pool_norm_bytes = 1048576.0F;
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static int parse_endpoint(hpssix_extractor_endpoint_t *ep, const char *str)
+{
+    char *pos = NULL;
+
+    ep->host = strdup(str);
+    if (!ep->host)
+        return ENOMEM;
+
+    ep->port = pool_default_port;
+
+    pos = strrchr(ep->host, ':');
+    if (pos) {
+        *pos++ = '\0';
+        ep->port = atoi(pos);
+    }
+
+    if (ep->host[0] == '\0' || ep->port <= 0)
+        return EINVAL;
+
+    return 0;
+}
+
+static inline uint32_t count_healthy(hpssix_extractor_pool_t *pool)
+{
+    uint32_t i = 0;
+    uint32_t count = 0;
+
+    for (i = 0; i < pool->n_endpoints; i++)
+        if (pool->endpoints[i].healthy)
+            count++;
+
+    return count;
+}
+
+/* should be called with the lock held */
+static void take_out(hpssix_extractor_pool_t *pool,
+                     hpssix_extractor_endpoint_t *ep, const char *reason)
+{
+    if (ep->backoff == .0F)
+        ep->backoff = pool->probe_interval;
+
+    ep->healthy = 0;
+    ep->n_takeouts++;
+    ep->retry_at = now_sec() + ep->backoff;
+
+    fprintf(stderr, "## [tika %s:%d] taken out of the rotation (%s), "
+                    "probing in %.1lf seconds\n",
+                    ep->host, ep->port, reason, ep->backoff);
+
+    ep->backoff *= 2;
+    if (ep->backoff > pool->probe_max_interval)
+        ep->backoff = pool->probe_max_interval;
+}
+
+/* should be called with the lock held */
+static void put_back(hpssix_extractor_pool_t *pool,
+                     hpssix_extractor_endpoint_t *ep)
+{
+    ep->healthy = 1;
+    ep->consecutive_failures = 0;
+    ep->n_samples = 0;
+    ep->latency = .0F;
+}
+
+/*
+ * probe the endpoints which are due, with the lock held. the lock is
+ * released during the probe.
+ */
+static void probe_endpoints(hpssix_extractor_pool_t *pool)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    double now = now_sec();
+
+    for (i = 0; i < pool->n_endpoints; i++) {
+        hpssix_extractor_endpoint_t *ep = &pool->endpoints[i];
+
+        if (ep->healthy || ep->probing || now < ep->retry_at)
+            continue;
+
+        ep->probing = 1;
+        pthread_mutex_unlock(&pool->lock);
+
+        ret = hpssix_extractor_pool_probe(ep, pool->probe_timeout);
+
+        pthread_mutex_lock(&pool->lock);
+        ep->probing = 0;
+
+        if (ret == 0) {
+            put_back(pool, ep);
+            pthread_cond_broadcast(&pool->cond);
+        }
+        else {
+            ep->retry_at = now_sec() + ep->backoff;
+
+            ep->backoff *= 2;
+            if (ep->backoff > pool->probe_max_interval)
+                ep->backoff = pool->probe_max_interval;
+        }
+    }
+}
+
+static inline int is_better(hpssix_extractor_endpoint_t *ep,
+                            hpssix_extractor_endpoint_t *best)
+{
+    if (!best)
+        return 1;
+
+    if (ep->outstanding != best->outstanding)
+        return ep->outstanding < best->outstanding;
+
+    return ep->latency < best->latency;
+}
+
+int hpssix_extractor_pool_init(hpssix_extractor_pool_t *pool,
+                               char **endpoints, uint32_t n_endpoints)
+{
+    int ret = 0;
+    uint32_t i = 0;
+
+    if (!pool || !endpoints || !n_endpoints)
+        return EINVAL;
+
+    memset((void *) pool, 0, sizeof(*pool));
+
+    pool->max_failures = 3;
+    pool->min_samples = 8;
+    pool->slow_factor = 4.0F;
+    pool->probe_interval = 5.0F;
+    pool->probe_max_interval = 120.0F;
+    pool->probe_timeout = 5.0F;
+    pool->wait_timeout = 300.0F;
+
+    pool->endpoints = calloc(n_endpoints, sizeof(*pool->endpoints));
+    if (!pool->endpoints)
+        return ENOMEM;
+
+    pool->n_endpoints = n_endpoints;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < n_endpoints; i++) {
+        hpssix_extractor_endpoint_t *ep = &pool->endpoints[i];
+
+        ret = parse_endpoint(ep, endpoints[i]);
+        if (ret) {
+            hpssix_extractor_pool_fini(pool);
+            return ret;
+        }
+
+        ep->healthy = 1;
+    }
+
+    return 0;
+}
+
+void hpssix_extractor_pool_fini(hpssix_extractor_pool_t *pool)
+{
+    uint32_t i = 0;
+
+    if (!pool || !pool->endpoints)
+        return;
+
+    for (i = 0; i < pool->n_endpoints; i++)
+        free(pool->endpoints[i].host);
+
+    free(pool->endpoints);
+    pool->endpoints = NULL;
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+hpssix_extractor_endpoint_t *
+hpssix_extractor_pool_get(hpssix_extractor_pool_t *pool)
+{
+    uint32_t i = 0;
+    double deadline = now_sec() + pool->wait_timeout;
+    hpssix_extractor_endpoint_t *best = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        double now = 0;
+        double wakeup = 0;
+        struct timespec ts = { 0, };
+
+        probe_endpoints(pool);
+
+        for (i = 0; i < pool->n_endpoints; i++) {
+            hpssix_extractor_endpoint_t *ep = &pool->endpoints[i];
+
+            if (ep->healthy && is_better(ep, best))
+                best = ep;
+        }
+
+        if (best) {
+            best->outstanding++;
+            break;
+        }
+
+        now = now_sec();
+        if (now >= deadline)
+            break;
+
+        /* sleep until the earliest probe, or someone puts an endpoint back */
+        wakeup = deadline;
+        for (i = 0; i < pool->n_endpoints; i++) {
+            hpssix_extractor_endpoint_t *ep = &pool->endpoints[i];
+
+            if (!ep->probing && ep->retry_at < wakeup)
+                wakeup = ep->retry_at;
+        }
+        if (wakeup < now + 0.01F)
+            wakeup = now + 0.01F;
+
+        ts.tv_sec = (time_t) wakeup;
+        ts.tv_nsec = (long) ((wakeup - ts.tv_sec)*1e9);
+
+        pthread_cond_timedwait(&pool->cond, &pool->lock, &ts);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return best;
+}
+
+void hpssix_extractor_pool_put(hpssix_extractor_pool_t *pool,
+                               hpssix_extractor_endpoint_t *ep,
+                               int failed, double latency, uint64_t bytes)
+{
+    uint32_t i = 0;
+    double fastest = .0F;
+    double normalized = latency/(1.0F + bytes/pool_norm_bytes);
+
+    if (!pool || !ep)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+
+    ep->outstanding--;
+    ep->n_requests++;
+
+    if (failed) {
+        ep->n_failures++;
+        ep->consecutive_failures++;
+
+        if (ep->healthy && ep->consecutive_failures >= pool->max_failures)
+            take_out(pool, ep, "failures");
+
+        goto out;
+    }
+
+    ep->consecutive_failures = 0;
+    ep->n_samples++;
+
+    if (ep->latency == .0F)
+        ep->latency = normalized;
+    else
+        ep->latency = pool_latency_alpha*normalized
+                      + (1.0F - pool_latency_alpha)*ep->latency;
+
+    if (!ep->healthy || ep->n_samples < pool->min_samples)
+        goto out;
+
+    /* reset the backoff once the endpoint behaves for a while */
+    if (ep->n_samples == pool->min_samples)
+        ep->backoff = pool->probe_interval;
+
+    /* never take out the last endpoint for being slow */
+    if (count_healthy(pool) < 2)
+        goto out;
+
+    for (i = 0; i < pool->n_endpoints; i++) {
+        hpssix_extractor_endpoint_t *other = &pool->endpoints[i];
+
+        if (other == ep || !other->healthy ||
+            other->n_samples < pool->min_samples)
+            continue;
+
+        if (fastest == .0F || other->latency < fastest)
+            fastest = other->latency;
+    }
+
+    if (fastest > .0F && ep->latency > pool->slow_factor*fastest)
+        take_out(pool, ep, "slow");
+
+out:
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static
+size_t probe_write_callback(char *ptr, size_t size, size_t nmemb, void *priv)
+{
+    return size*nmemb;      /* discard */
+}
+
+int hpssix_extractor_pool_probe(hpssix_extractor_endpoint_t *ep,
+                                double timeout)
+{
+    int ret = 0;
+    CURL *curl = NULL;
+    CURLcode cc = 0;
+    long status = 0;
+    char url[1024] = { 0, };
+
+    curl = curl_easy_init();
+    if (!curl)
+        return ENOMEM;
+
+    sprintf(url, "http://%s:%d/tika", ep->host, ep->port);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, probe_write_callback);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long) (timeout*1000));
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    cc = curl_easy_perform(curl);
+    if (cc != CURLE_OK) {
+        ret = EIO;
+        goto out;
+    }
+
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (status != 200)
+        ret = EIO;
+
+out:
+    curl_easy_cleanup(curl);
+
+    return ret;
+}
+
+void hpssix_extractor_pool_print_stats(hpssix_extractor_pool_t *pool,
+                                       FILE *fp)
+{
+    uint32_t i = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (i = 0; i < pool->n_endpoints; i++) {
+        hpssix_extractor_endpoint_t *ep = &pool->endpoints[i];
+
+        fprintf(fp, "## [tika %s:%d] %lu requests, %lu failures, "
+                    "taken out %lu times, latency %.3lf seconds%s\n",
+                    ep->host, ep->port, ep->n_requests, ep->n_failures,
+                    ep->n_takeouts, ep->latency,
+                    ep->healthy ? "" : " (out of rotation)");
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
@@ -0,0 +1,233 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "hpssix-extractor.h"
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+int hpssix_extractor_stage_init(hpssix_extractor_stage_t *stage,
+                                uint64_t max_bytes, uint32_t n_producers,
+                                uint32_t n_consumers)
+{
+    if (!stage || !max_bytes || !n_producers || !n_consumers)
+        return EINVAL;
+
+    memset((void *) stage, 0, sizeof(*stage));
+
+    stage->max_bytes = max_bytes;
+    stage->n_producers = n_producers;
+    stage->n_consumers = n_consumers;
+
+    pthread_mutex_init(&stage->lock, NULL);
+    pthread_cond_init(&stage->cond, NULL);
+
+    return 0;
+}
+
+void hpssix_extractor_stage_fini(hpssix_extractor_stage_t *stage)
+{
+    hpssix_extractor_staged_t *staged = NULL;
+
+    if (!stage)
+        return;
+
+    while ((staged = stage->head) != NULL) {
+        stage->head = staged->next;
+        hpssix_extractor_staged_free(stage, staged);
+    }
+
+    pthread_cond_destroy(&stage->cond);
+    pthread_mutex_destroy(&stage->lock);
+}
+
+int hpssix_extractor_stage_reserve(hpssix_extractor_stage_t *stage,
+                                   uint64_t size)
+{
+    int ret = 0;
+    double before = .0F;
+
+    if (size > stage->max_bytes)
+        return E2BIG;
+
+    pthread_mutex_lock(&stage->lock);
+
+    if (stage->bytes + size > stage->max_bytes && stage->n_consumers > 0) {
+        stage->n_full_waits++;
+        before = now_sec();
+
+        while (stage->bytes + size > stage->max_bytes &&
+               stage->n_consumers > 0)
+            pthread_cond_wait(&stage->cond, &stage->lock);
+
+        stage->full_wait_sec += now_sec() - before;
+    }
+
+    if (stage->n_consumers == 0) {
+        ret = EPIPE;
+        goto out;
+    }
+
+    stage->bytes += size;
+    if (stage->bytes > stage->peak_bytes)
+        stage->peak_bytes = stage->bytes;
+
+out:
+    pthread_mutex_unlock(&stage->lock);
+
+    return ret;
+}
+
+void hpssix_extractor_stage_release(hpssix_extractor_stage_t *stage,
+                                    uint64_t size)
+{
+    if (!size)
+        return;
+
+    pthread_mutex_lock(&stage->lock);
+
+    stage->bytes -= size;
+
+    pthread_cond_broadcast(&stage->cond);
+    pthread_mutex_unlock(&stage->lock);
+}
+
+void hpssix_extractor_stage_push(hpssix_extractor_stage_t *stage,
+                                 hpssix_extractor_staged_t *staged,
+                                 double read_sec)
+{
+    staged->next = NULL;
+
+    pthread_mutex_lock(&stage->lock);
+
+    if (stage->tail)
+        stage->tail->next = staged;
+    else
+        stage->head = staged;
+    stage->tail = staged;
+
+    stage->n_queued++;
+    if (stage->n_queued > stage->peak_queued)
+        stage->peak_queued = stage->n_queued;
+
+    if (staged->buf) {
+        stage->n_staged++;
+        stage->bytes_staged += staged->sb.st_size;
+        stage->read_sec += read_sec;
+    }
+    else if (!staged->error)
+        stage->n_passthrough++;
+
+    pthread_cond_broadcast(&stage->cond);
+    pthread_mutex_unlock(&stage->lock);
+}
+
+hpssix_extractor_staged_t *
+hpssix_extractor_stage_pop(hpssix_extractor_stage_t *stage)
+{
+    double before = .0F;
+    hpssix_extractor_staged_t *staged = NULL;
+
+    pthread_mutex_lock(&stage->lock);
+
+    if (!stage->head && stage->n_producers > 0) {
+        stage->n_empty_waits++;
+        before = now_sec();
+
+        while (!stage->head && stage->n_producers > 0)
+            pthread_cond_wait(&stage->cond, &stage->lock);
+
+        stage->empty_wait_sec += now_sec() - before;
+    }
+
+    staged = stage->head;
+    if (staged) {
+        stage->head = staged->next;
+        if (!stage->head)
+            stage->tail = NULL;
+        stage->n_queued--;
+    }
+
+    pthread_mutex_unlock(&stage->lock);
+
+    return staged;
+}
+
+void hpssix_extractor_stage_producer_done(hpssix_extractor_stage_t *stage)
+{
+    pthread_mutex_lock(&stage->lock);
+
+    stage->n_producers--;
+
+    pthread_cond_broadcast(&stage->cond);
+    pthread_mutex_unlock(&stage->lock);
+}
+
+void hpssix_extractor_stage_consumer_done(hpssix_extractor_stage_t *stage)
+{
+    pthread_mutex_lock(&stage->lock);
+
+    stage->n_consumers--;
+
+    pthread_cond_broadcast(&stage->cond);
+    pthread_mutex_unlock(&stage->lock);
+}
+
+void hpssix_extractor_staged_free(hpssix_extractor_stage_t *stage,
+                                  hpssix_extractor_staged_t *staged)
+{
+    if (!staged)
+        return;
+
+    hpssix_extractor_stage_release(stage, staged->reserved);
+
+    free(staged->buf);
+    free(staged->object.path);
+    free(staged->object.locality);
+    free(staged);
+}
+
+void hpssix_extractor_stage_print_stats(hpssix_extractor_stage_t *stage,
+                                        FILE *fp)
+{
+    double mbps = .0F;
+
+    pthread_mutex_lock(&stage->lock);
+
+    if (stage->read_sec > 0)
+        mbps = stage->bytes_staged/stage->read_sec/(1<<20);
+
+    fprintf(fp, "## [prefetch] %lu files staged (%lu bytes, %.3lf MB/s per "
+                "thread), %lu passed through\n",
+                stage->n_staged, stage->bytes_staged, mbps,
+                stage->n_passthrough);
+    fprintf(fp, "## [prefetch] peak %lu bytes of %lu, %lu files queued\n",
+                stage->peak_bytes, stage->max_bytes, stage->peak_queued);
+    fprintf(fp, "## [prefetch] %lu waits for the memory (%.3lf seconds), "
+                "%lu waits for the prefetch (%.3lf seconds)\n",
+                stage->n_full_waits, stage->full_wait_sec,
+                stage->n_empty_waits, stage->empty_wait_sec);
+
+    pthread_mutex_unlock(&stage->lock);
+}
@@ -15,9 +15,11 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <curl/curl.h>
@@ -32,19 +34,167 @@
                 fprintf(stderr, "%s\n", curl_easy_strerror(c)); \
         } while (0)
 
+/*
+ * curl buffer size for uploading with HPSSIX_EXTRACTOR_UPLOAD_PREAD. each
+ * pread(2) fills the whole curl buffer, so the reads are issued at the
+ * offsets aligned to this size.
+ */
+static const long extractor_upload_bufsize = 512*(1<<10);
+
+static const char *upload_mode_str[] = { "mmap", "pread" };
+
+/* a request is aborted if nothing moves for this long (seconds) */
+static const long extractor_low_speed_time = 60;
+
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static inline int is_expired(hpssix_extractor_data_t *data)
+{
+    if (data->cancel && *data->cancel)
+        return 1;
+
+    return data->deadline > 0 && now_sec() > data->deadline;
+}
+
+int hpssix_extractor_parse_upload_mode(const char *str)
+{
+    int i = 0;
+
+    if (!str)
+        return -1;
+
+    for (i = 0; i < sizeof(upload_mode_str)/sizeof(char *); i++)
+        if (0 == strcmp(str, upload_mode_str[i]))
+            return i;
+
+    return -1;
+}
+
+int hpssix_extractor_open(hpssix_extractor_data_t *data, int mode)
+{
+    int fd = -1;
+    void *map = NULL;
+
+    if (!data)
+        return EINVAL;
+
+    fd = open(data->file, O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    /* we always read the whole file from the beginning to the end */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    data->fd = fd;
+    data->map = NULL;
+    data->offset = 0;
+    data->upload_mode = HPSSIX_EXTRACTOR_UPLOAD_PREAD;
+
+    if (mode != HPSSIX_EXTRACTOR_UPLOAD_MMAP || data->file_size == 0)
+        return 0;
+
+    map = mmap(NULL, data->file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)  /* not supported by the mount, use pread */
+        return 0;
+
+    madvise(map, data->file_size, MADV_SEQUENTIAL);
+
+    data->map = map;
+    data->upload_mode = HPSSIX_EXTRACTOR_UPLOAD_MMAP;
+
+    return 0;
+}
+
+void hpssix_extractor_close(hpssix_extractor_data_t *data)
+{
+    if (data) {
+        /* the prefetch stage owns the buffer */
+        if (data->map && data->upload_mode != HPSSIX_EXTRACTOR_UPLOAD_BUFFER)
+            munmap(data->map, data->file_size);
+        if (data->fd >= 0)
+            close(data->fd);
+
+        data->map = NULL;
+        data->fd = -1;
+    }
+}
+
+/* the response goes to the tmpfile, and to the metadata parser if any */
+struct tika_response {
+    FILE *tmpfp;
+    hpssix_docmeta_parser_t *parser;
+};
+
 static
 size_t write_callback(char *ptr, size_t size, size_t nmemb, void *priv)
 {
     int ret = 0;
-    FILE *tmpfp = (FILE *) priv;
+    struct tika_response *response = (struct tika_response *) priv;
 
-    ret = fwrite((void *) ptr, nmemb, 1, tmpfp);
+    ret = fwrite((void *) ptr, nmemb, 1, response->tmpfp);
     if (ret != 1)
         return 0;
 
+    /* a malformed json only stops the parser, not the request */
+    if (response->parser)
+        hpssix_docmeta_parser_feed(response->parser, ptr, nmemb);
+
     return nmemb;
 }
 
+/*
+ * reads the file directly into the curl upload buffer.
+ */
+static
+size_t read_callback(char *buffer, size_t size, size_t nitems, void *priv)
+{
+    ssize_t n = 0;
+    hpssix_extractor_data_t *data = (hpssix_extractor_data_t *) priv;
+
+    /* a hung read is interrupted by the watchdog with a signal (EINTR) */
+    n = pread(data->fd, buffer, size*nitems, data->offset);
+    if (n < 0 || is_expired(data))
+        return CURL_READFUNC_ABORT;
+
+    data->offset += n;
+
+    return n;
+}
+
+static int progress_callback(void *priv, curl_off_t dltotal, curl_off_t dlnow,
+                             curl_off_t ultotal, curl_off_t ulnow)
+{
+    hpssix_extractor_data_t *data = (hpssix_extractor_data_t *) priv;
+
+    return is_expired(data);
+}
+
+static void setup_deadline(CURL *curl, hpssix_extractor_data_t *data)
+{
+    double remaining = data->deadline - now_sec();
+
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, extractor_low_speed_time);
+
+    if (data->deadline > 0)
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                         (long) (remaining > 0.001F ? remaining*1000 : 1));
+
+    if (data->deadline > 0 || data->cancel) {
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void *) data);
+    }
+}
+
 static inline void reset_tmpfile(FILE *tmpfp)
 {
     if (tmpfp) {
@@ -64,122 +214,189 @@ void get_tika_url_content(hpssix_extractor_data_t *data, char *buf)
     sprintf(buf, "http://%s:%d/tika", data->tika_host, data->tika_port);
 }
 
-int hpssix_extractor_get_meta(hpssix_extractor_data_t *data)
+static struct curl_slist *setup_upload(CURL *curl,
+                                       hpssix_extractor_data_t *data,
+                                       struct curl_slist *list)
+{
+    if (data->upload_mode == HPSSIX_EXTRACTOR_UPLOAD_MMAP ||
+        data->upload_mode == HPSSIX_EXTRACTOR_UPLOAD_BUFFER) {
+        /*
+         * curl sends the request body straight from the mapped file (or the
+         * prefetched buffer). the default content type for the postfields
+         * should not be sent, tika detects the type itself.
+         */
+        list = curl_slist_append(list, "Content-Type:");
+
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data->map);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                               (curl_off_t) data->file_size);
+    }
+    else {
+        data->offset = 0;
+
+        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE,
+                               extractor_upload_bufsize);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, (void *) data);
+        curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE,
+                               (curl_off_t) data->file_size);
+    }
+
+    return list;
+}
+
+/*
+ * upload the file to @url, and returns the response body in @out (should be
+ * freed by the caller). the body is also fed to @parser as it arrives, if
+ * @parser is not NULL.
+ */
+static int tika_request(hpssix_extractor_data_t *data, const char *url,
+                        const char *accept, hpssix_docmeta_parser_t *parser,
+                        char **out)
 {
     int ret = 0;
+    struct tika_response response = { data->tmpfp, parser };
     struct curl_slist *list = NULL;
     CURL *curl = NULL;
     CURLcode cc = 0;
     char *buf = NULL;
     size_t datalen = 0;
-    char url[1024] = { 0, };
+    curl_off_t uploaded = 0;
+    long status = 0;
+    struct timeval before = { 0, };
+    struct timeval after = { 0, };
+
+    if (is_expired(data))
+        return ETIMEDOUT;
 
-    rewind(data->fp);
     reset_tmpfile(data->tmpfp);
-    get_tika_url_meta(data, url);
 
     curl = curl_easy_init();
-    list = curl_slist_append(list, "Accept: application/json");
+    if (!curl)
+        return ENOMEM;
+
+    setup_deadline(curl, data);
 
-    cc = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    cc = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) data->tmpfp);
-    cc = curl_easy_setopt(curl, CURLOPT_URL, url);
-    cc = curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+    list = curl_slist_append(list, accept);
+    list = setup_upload(curl, data, list);
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &response);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
     cc = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-    cc = curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-    cc = curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, data->file_size);
-    cc = curl_easy_setopt(curl, CURLOPT_READDATA, data->fp);
     if (cc != CURLE_OK) {
         fprintf(stderr, "## [E] curl processing failed (%s).\n",
                 curl_easy_strerror(cc));
-        return EIO;
+        ret = EIO;
+        goto out;
     }
 
+    gettimeofday(&before, NULL);
+
     cc = curl_easy_perform(curl);
     if (cc != CURLE_OK) {
+        if (cc == CURLE_OPERATION_TIMEDOUT || is_expired(data)) {
+            fprintf(stderr, "## [E] tika request timed out for %s.\n",
+                    data->file);
+            ret = ETIMEDOUT;
+            goto out;
+        }
+
         fprintf(stderr, "## [E] curl processing failed (%s).\n",
                 curl_easy_strerror(cc));
-        return EIO;
+        ret = EIO;
+        goto out;
     }
 
-    curl_slist_free_all(list);
-    curl_easy_cleanup(curl);
+    gettimeofday(&after, NULL);
+
+    /*
+     * 5xx means the server is in trouble, while 4xx (e.g., 422 for the
+     * unprocessable files) is specific to the document.
+     */
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (status >= 500) {
+        fprintf(stderr, "## [E] tika returned %ld for %s.\n",
+                status, data->file);
+        ret = EIO;
+        goto out;
+    }
+    else if (status >= 400) {
+        ret = EINVAL;
+        goto out;
+    }
+
+    if (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded))
+        data->bytes_uploaded += uploaded;
+    data->upload_sec += timediff_sec(&before, &after);
 
     datalen = ftell(data->tmpfp);
     rewind(data->tmpfp);
 
-    if (datalen > 0) {
-        buf = calloc(1, datalen+1);
-        if (!buf)
-            return ENOMEM;
-
-        ret = fread(buf, datalen, 1, data->tmpfp);
-        if (ret != 1)
-            return errno;
-
-        data->meta = buf;
-        ret = 0;
+    buf = calloc(1, datalen+1);
+    if (!buf) {
+        ret = ENOMEM;
+        goto out;
     }
-    else {
-        data->meta = NULL;
-        ret = EINVAL;
+
+    if (datalen > 0 && fread(buf, datalen, 1, data->tmpfp) != 1) {
+        ret = errno ? errno : EIO;
+        free(buf);
+        goto out;
     }
 
+    *out = buf;
+
+out:
+    curl_slist_free_all(list);
+    curl_easy_cleanup(curl);
+
     return ret;
 }
 
-
-int hpssix_extractor_get_content(hpssix_extractor_data_t *data)
+int hpssix_extractor_get_meta(hpssix_extractor_data_t *data)
 {
     int ret = 0;
-    struct curl_slist *list = NULL;
-    CURL *curl = NULL;
-    CURLcode cc;
     char *buf = NULL;
-    size_t datalen = 0;
     char url[1024] = { 0, };
+    hpssix_docmeta_parser_t parser;
 
-    rewind(data->fp);
-    reset_tmpfile(data->tmpfp);
-    get_tika_url_content(data, url);
+    get_tika_url_meta(data, url);
 
-    curl = curl_easy_init();
-    list = curl_slist_append(list, "Accept: text/plain");
+    hpssix_docmeta_parser_init(&parser, &data->docmeta);
 
-    cc = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    cc = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) data->tmpfp);
-    cc = curl_easy_setopt(curl, CURLOPT_URL, url);
-    cc = curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
-    cc = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-    cc = curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-    cc = curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, data->file_size);
-    cc = curl_easy_setopt(curl, CURLOPT_READDATA, data->fp);
-    if (cc != CURLE_OK) {
-        fprintf(stderr, "## [E] curl processing failed (%s).\n",
-                curl_easy_strerror(cc));
-        return EIO;
+    ret = tika_request(data, url, "Accept: application/json", &parser, &buf);
+    if (ret) {
+        hpssix_docmeta_free(&data->docmeta);
+        return ret;
     }
 
-    cc = curl_easy_perform(curl);
-    if (cc != CURLE_OK) {
-        fprintf(stderr, "## [E] curl processing failed (%s).\n",
-                curl_easy_strerror(cc));
-        return EIO;
+    if (buf[0] == '\0') {
+        free(buf);
+        data->meta = NULL;
+        hpssix_docmeta_free(&data->docmeta);
+        return EINVAL;
     }
 
-    curl_slist_free_all(list);
-    curl_easy_cleanup(curl);
+    data->meta = buf;
 
-    datalen = ftell(data->tmpfp);
-    rewind(data->tmpfp);
+    return 0;
+}
 
-    buf = calloc(1, datalen+1);
-    if (!buf)
-        return ENOMEM;
+int hpssix_extractor_get_content(hpssix_extractor_data_t *data)
+{
+    int ret = 0;
+    char *buf = NULL;
+    char url[1024] = { 0, };
 
-    ret = fread(buf, datalen, 1, data->tmpfp);
-    if (ret != 1)
-        return errno;
+    get_tika_url_content(data, url);
+
+    ret = tika_request(data, url, "Accept: text/plain", NULL, &buf);
+    if (ret)
+        return ret;
 
     data->content = buf;
 
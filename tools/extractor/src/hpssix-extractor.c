@@ -13,10 +13,12 @@
 #include <stdint.h>
 #include <string.h>
 #include <pthread.h>
+#include <signal.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <limits.h>
@@ -26,19 +28,86 @@
 #include <hpssix.h>
 #include "hpssix-extractor.h"
 
-static char *tika_host = "localhost";
-static int tika_port = 9998;
+static hpssix_extractor_pool_t tika_pool;
+static hpssix_extractor_limiter_t tika_limiter;
 
+/*
+ * with the prefetch stage, the files go through a pipeline of @nprefetch
+ * threads reading them (read), @nthreads threads sending them to tika
+ * (upload), and the document sink of each upload thread (index). the
+ * prefetch threads follow the upload threads in @threads.
+ */
 static uint64_t nthreads;
+static uint64_t nprefetch;
 static pthread_t *threads;
 static uint64_t total_objects;
 
+static hpssix_extractor_stage_t stage;
+
+/*
+ * the workdata is sorted by the storage locality. threads take batches of
+ * @dispatch_size objects in that order, so that the reads at any time are
+ * close to each other on the storage.
+ */
+static uint64_t dispatch_size = 128;
+static uint64_t dispatch_next;
+
+/* done-bitmap of the workdata, to resume an interrupted run */
+static hpssix_workdata_progress_t progress;
+
 static hpssix_config_t config;
 static char *dbpath;
 
 static uint64_t n_extracted;
+static uint64_t n_truncated;
+static uint64_t bytes_truncated;
+static uint64_t n_client_tsv;
+static uint64_t n_sink_fallbacks;
 static int verbose;
 
+/* how each file is extracted, set up from the configuration */
+static hpssix_extractor_file_t extraction = {
+    .upload_mode = HPSSIX_EXTRACTOR_UPLOAD_PREAD,
+    .pool = &tika_pool,
+    .limiter = &tika_limiter,
+    .stage = &stage,
+};
+
+/*
+ * each file should be done by timeout + size/minrate seconds, not counting
+ * the waits for a tika server. the tika requests give up by themselves at
+ * the deadline. if a thread is still stuck (e.g., in a hung read) after
+ * @watchdog_grace seconds, the watchdog cancels it and interrupts the read
+ * with a signal, and after @watchdog_abandon seconds, it leaves the thread
+ * behind not to wait for it anymore.
+ */
+static const double watchdog_grace = 5.0F;
+static const double watchdog_abandon = 60.0F;
+static const useconds_t watchdog_interval = 200000;
+
+static hpssix_extractor_watch_t *watches;
+
+/*
+ * with --rate, the files are started at most @rate_interval seconds apart
+ * over all threads, e.g., to trickle a re-extraction behind the nightly
+ * runs. @rate_next is when the next file can be started.
+ */
+static double rate_interval;
+static double rate_next;
+static pthread_mutex_t rate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct extractor_worker_stat {
+    hpssix_extractor_file_stat_t file;
+    uint64_t n_resumed;         /* done by the previous run */
+    uint64_t n_batches;
+    uint64_t n_switches;        /* moved to another volume or directory */
+    uint64_t n_timedout;
+    uint64_t bytes_flushed;     /* by the document sink */
+    double flush_sec;
+};
+
+static struct extractor_worker_stat *worker_stats;
+
 static struct timeval start, end;
 
 static inline double timediff(struct timeval *t1, struct timeval *t2)
@@ -47,6 +116,20 @@ static inline double timediff(struct timeval *t1, struct timeval *t2)
     return usec/1e6;
 }
 
+static inline double now_sec(void)
+{
+    struct timeval tv = { 0, };
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+/* only to interrupt the blocking syscalls, without SA_RESTART */
+static void watchdog_signal_handler(int signum)
+{
+}
+
 static int check_builder_output(void)
 {
     int ret = 0;
@@ -59,101 +142,206 @@ static int check_builder_output(void)
     return sb.st_size > 0 ? 0 : EINVAL;
 }
 
-static inline
-void get_work_allocation(uint64_t id, uint64_t *offset, uint64_t *count)
+/* take the next batch, returns 0 if nothing left */
+static inline int get_next_batch(uint64_t *offset, uint64_t *count)
 {
-    uint64_t per_each = total_objects / nthreads;
-    uint64_t _offset = 0;
-    uint64_t _count = 0;
-
-    _offset = per_each * id;
-    _count = per_each;
+    uint64_t _offset = __sync_fetch_and_add(&dispatch_next, dispatch_size);
 
-    if (id == nthreads - 1)
-        _count += total_objects % nthreads;
+    if (_offset >= total_objects)
+        return 0;
 
     *offset = _offset;
-    *count = _count;
+    *count = total_objects - _offset < dispatch_size ?
+             total_objects - _offset : dispatch_size;
+
+    return 1;
 }
 
-static
-int do_extract(hpssix_workdata_object_t *object, hpssix_db_t *db, uint64_t id)
+/*
+ * the storage unit of a locality key, without the offset in a storage key
+ * ("cos:volume:offset"). a "dir:<path>" key is compared as a whole.
+ */
+static size_t locality_unit_len(const char *locality)
+{
+    const char *pos = NULL;
+
+    if (strncmp(locality, "dir:", 4) == 0)
+        return strlen(locality);
+
+    pos = strrchr(locality, ':');
+
+    return pos ? (size_t) (pos - locality) : strlen(locality);
+}
+
+static void count_locality_switch(struct extractor_worker_stat *wstat,
+                                  char **last, const char *locality)
+{
+    size_t len = 0;
+
+    if (!locality)
+        return;
+
+    len = locality_unit_len(locality);
+
+    if (*last && locality_unit_len(*last) == len &&
+        strncmp(*last, locality, len) == 0)
+        return;
+
+    wstat->n_switches++;
+
+    free(*last);
+    *last = strdup(locality);
+}
+
+/* the documents are done only when they are written to the database */
+static void document_flushed(hpssix_db_document_t *doc, void *arg)
+{
+    hpssix_workdata_progress_mark(&progress, doc->tag);
+}
+
+static void rate_throttle(void)
+{
+    double now = .0F;
+    double wait = .0F;
+
+    if (!rate_interval)
+        return;
+
+    pthread_mutex_lock(&rate_lock);
+
+    now = now_sec();
+    if (rate_next < now)
+        rate_next = now;
+
+    wait = rate_next - now;
+    rate_next += rate_interval;
+
+    pthread_mutex_unlock(&rate_lock);
+
+    if (wait > 0)
+        usleep((useconds_t) (wait*1e6));
+}
+
+static void process_object(uint64_t id, hpssix_workdata_object_t *object,
+                           uint64_t index, hpssix_extractor_staged_t *staged,
+                           hpssix_db_docsink_t *sink, hpssix_db_t *db)
 {
     int ret = 0;
-    struct stat sb = { 0, };
-    hpssix_extractor_data_t data = { 0, };
-    FILE *fp = NULL;
+    struct extractor_worker_stat *wstat = &worker_stats[id];
+    hpssix_extractor_watch_t *watch = &watches[id];
 
-    sprintf(data.file, "%s%s", config.hpss_mountpoint, object->path);
+    rate_throttle();
 
-    ret = stat(data.file, &sb);
-    if (ret) {
-        printf("[%lu]EE: cannot stat %s (%s)\n", id, data.file, strerror(errno));
-        return errno;
-    }
+    hpssix_extractor_watch_begin(&extraction, watch, object, index);
 
-    data.file_size = sb.st_size;
-    /*
-     * need to resolve firewall/connection issue to use the full domain name.
-     */
-    /*data.tika_host = config.tika_host;*/
-    data.tika_host = tika_host;
-    data.tika_port = config.tika_port;
-
-    fp = fopen(data.file, "r");
-    if (!fp) {
-        printf("[%lu]EE: cannot fopen %s (%s)\n",
-               id, data.file, strerror(errno));
-        return errno;
+    ret = hpssix_extractor_file_extract(&extraction, id, watch, &wstat->file,
+                                        object, index, staged, sink);
+
+    hpssix_extractor_watch_end(watch);
+
+    /* e.g., EINTR from a read interrupted by the watchdog */
+    if (ret && watch->cancel)
+        ret = ETIMEDOUT;
+
+    if (ret == ETIMEDOUT) {
+        printf("[%lu]EE: %s timed out, quarantined\n", id, object->path);
+
+        wstat->n_timedout++;
+        hpssix_db_quarantine(db, object->object_id, object->mtime);
     }
 
-    data.fp = fp;
+    if (ret) {
+        /* nothing to extract from these, no need to retry */
+        if (ret == ENOENT || ret == EINVAL || ret == ETIMEDOUT) {
+            hpssix_workdata_progress_mark(&progress, index);
+            return;
+        }
 
-    fp = tmpfile();
-    if (!fp) {
-        printf("[%lu]EE: cannot make tmpfile (%s)\n",
-               id, data.file, strerror(errno));
-        return errno;
+        if (verbose)
+            fprintf(stderr, "[%lu]E: extraction failed (%d)\n", id, ret);
     }
+}
+
+/* a thread leaves the prefetch stage, only once even if abandoned */
+static void stage_leave(uint64_t id)
+{
+    if (nprefetch == 0 ||
+        !__sync_bool_compare_and_swap(&watches[id].released, 0, 1))
+        return;
+
+    if (id < nthreads)
+        hpssix_extractor_stage_consumer_done(&stage);
+    else
+        hpssix_extractor_stage_producer_done(&stage);
+}
 
-    data.tmpfp = fp;
+static void *prefetch_worker_func(void *arg)
+{
+    int ret = 0;
+    uint64_t id = (unsigned long) arg;
+    uint64_t i = 0;
+    hpssix_workdata_t wd = { 0, };
+    hpssix_workdata_worklist_t list = { 0, };
+    struct extractor_worker_stat *wstat = &worker_stats[id];
+    char *last_locality = NULL;
 
-    ret = hpssix_extractor_get_meta(&data);
-    if (ret && verbose) {
-        if (ret != EINVAL)
-            printf("[%lu]EE: hpssix_extractor_get_meta failed (%d:%s)\n",
-                   id, strerror(ret));
+    ret = hpssix_workdata_open(&wd, dbpath);
+    if (ret) {
+        fprintf(stderr, "[%lu]: hpssix_workdata_open failed\n", id);
         goto out;
     }
 
-    ret = hpssix_extractor_get_content(&data);
-    if (ret && verbose)
-        printf("[%lu]EE: hpssix_extractor_get_content failed (%d:%s)\n",
-               id, strerror(ret));
+    while (get_next_batch(&list.offset, &list.count)) {
+        if (verbose)
+            printf("[%lu] prefetch (%lu, %lu)\n", id, list.offset, list.count);
 
-out:
-    fclose(data.tmpfp);
-    fclose(data.fp);
+        ret = hpssix_workdata_dispatch(&wd, &list);
+        if (ret) {
+            fprintf(stderr, "[%lu]: hpssix_workdata_dispatch failed\n", id);
+            break;
+        }
 
-    if (data.meta) {
-        if (verbose)
-            printf("[%lu] extracted from %lu, %s (meta: %s, content: ...)\n",
-                    id, object->object_id, data.file, data.meta);
+        wstat->n_batches++;
 
-        /* index the data */
-        ret = hpssix_db_index_tsv(db, object->object_id,
-                                  data.meta, data.content);
-        if (ret)
-            fprintf(stderr, "hpssix_db_index_tsv failed (%d:%s)\n", ret,
-                    strerror(ret));
-        else
-            n_extracted++;
+        for (i = 0; i < list.count; i++) {
+            hpssix_workdata_object_t *current = &list.object_list[i];
+            hpssix_extractor_staged_t *staged = NULL;
+            uint64_t index = list.offset + i;
+
+            if (hpssix_workdata_progress_isdone(&progress, index)) {
+                wstat->n_resumed++;
+                continue;
+            }
+
+            staged = calloc(1, sizeof(*staged));
+            if (!staged) {
+                perror("[E] calloc");
+                continue;   /* retried on resume */
+            }
 
-        free(data.meta);
-        free(data.content);
+            count_locality_switch(wstat, &last_locality, current->locality);
+
+            /* the staged file takes the path and the locality over */
+            staged->object = *current;
+            staged->index = index;
+            current->path = NULL;
+            current->locality = NULL;
+
+            hpssix_extractor_file_prefetch(&extraction, id, &watches[id],
+                                           &wstat->file, staged);
+        }
+
+        hpssix_workdata_cleanup_object_list(list.object_list, list.count);
+        list.object_list = NULL;
     }
 
-    return ret;
+    hpssix_workdata_close(&wd);
+    free(last_locality);
+out:
+    stage_leave(id);
+    watches[id].finished = 1;
+
+    return (void *) 0;
 }
 
 static void *extractor_worker_func(void *arg)
@@ -164,67 +352,213 @@ static void *extractor_worker_func(void *arg)
     hpssix_workdata_t wd = { 0, };
     hpssix_workdata_worklist_t list = { 0, };
     hpssix_db_t db = { 0, };
+    hpssix_db_docsink_t sink = { 0, };
+    hpssix_extractor_staged_t *staged = NULL;
+    struct extractor_worker_stat *wstat = &worker_stats[id];
+    char *last_locality = NULL;
 
-    get_work_allocation(id, &list.offset, &list.count);
-
-    if (verbose)
-        printf("[%lu] work (%lu, %lu)\n", id, list.offset, list.count);
-
-    ret = hpssix_workdata_open(&wd, dbpath);
+    ret = hpssix_db_connect(&db, &config);
     if (ret) {
-        fprintf(stderr, "[%lu]: hpssix_workdata_open failed\n", id);
+        fprintf(stderr, "[%lu]: hpssix_workdata_db_connect failed\n", id);
         goto out;
     }
 
-    ret = hpssix_workdata_dispatch(&wd, &list);
-    hpssix_workdata_close(&wd);
+    ret = hpssix_db_docsink_init(&sink, &db, config.extractor_batchcount,
+                                 config.extractor_batchbytes);
     if (ret) {
-        fprintf(stderr, "[%lu]: hpssix_workdata_dispatch failed\n", id);
-        goto out;
+        fprintf(stderr, "[%lu]: hpssix_db_docsink_init failed\n", id);
+        goto out_disconnect;
     }
 
-    ret = hpssix_db_connect(&db, &config);
-    if (ret) {
-        fprintf(stderr, "[%lu]: hpssix_workdata_db_connect failed\n", id);
-        goto out;
+    sink.flushed = document_flushed;
+    sink.text_head = config.extractor_texthead;
+    sink.text_tail = config.extractor_texttail;
+    sink.keep_full = config.extractor_keepfull;
+    sink.client_tsv = config.extractor_clienttsv;
+    sink.profile = config.extractor_profile;
+
+    /* take the files from the prefetch threads */
+    while (nprefetch > 0 &&
+           (staged = hpssix_extractor_stage_pop(&stage)) != NULL) {
+        if (verbose)
+            printf("[%lu]: processing file %lu (%s)\n",
+                   id, staged->index, staged->object.path);
+
+        process_object(id, &staged->object, staged->index, staged, &sink, &db);
+        hpssix_extractor_staged_free(&stage, staged);
+    }
+
+    if (nprefetch > 0) {
+        stage_leave(id);
+        goto out_fini;
     }
 
-    for (i = 0; i < list.count; i++) {
-        hpssix_workdata_object_t *current = &list.object_list[i];
-        char *meta = NULL;
-        char *text = NULL;
+    ret = hpssix_workdata_open(&wd, dbpath);
+    if (ret) {
+        fprintf(stderr, "[%lu]: hpssix_workdata_open failed\n", id);
+        goto out_fini;
+    }
 
+    while (get_next_batch(&list.offset, &list.count)) {
         if (verbose)
-            printf("[%lu]: processing file %lu/%lu (%s)\n",
-                   id, i, list.count, current->path);
+            printf("[%lu] work (%lu, %lu)\n", id, list.offset, list.count);
 
-        ret = do_extract(current, &db, id);
+        ret = hpssix_workdata_dispatch(&wd, &list);
         if (ret) {
-            if (ret == ENOENT || ret == EINVAL)
+            fprintf(stderr, "[%lu]: hpssix_workdata_dispatch failed\n", id);
+            break;
+        }
+
+        wstat->n_batches++;
+
+        for (i = 0; i < list.count; i++) {
+            hpssix_workdata_object_t *current = &list.object_list[i];
+            uint64_t index = list.offset + i;
+
+            if (hpssix_workdata_progress_isdone(&progress, index)) {
+                wstat->n_resumed++;
                 continue;
+            }
 
             if (verbose)
-                fprintf(stderr, "[%lu]E: do_extract failed (%d)\n", id, ret);
+                printf("[%lu]: processing file %lu/%lu (%s)\n",
+                       id, i, list.count, current->path);
+
+            count_locality_switch(wstat, &last_locality, current->locality);
+
+            process_object(id, current, index, NULL, &sink, &db);
         }
+
+        hpssix_workdata_cleanup_object_list(list.object_list, list.count);
+        list.object_list = NULL;
     }
 
+    hpssix_workdata_close(&wd);
+    free(last_locality);
+
+out_fini:
+    ret = hpssix_db_docsink_fini(&sink);
+    if (ret)
+        fprintf(stderr, "[%lu]: failed to index %lu documents\n",
+                id, sink.n_failed);
+
+    __sync_fetch_and_add(&n_extracted, sink.n_flushed);
+    __sync_fetch_and_add(&n_truncated, sink.n_truncated);
+    __sync_fetch_and_add(&bytes_truncated, sink.bytes_truncated);
+    __sync_fetch_and_add(&n_client_tsv, sink.n_client_tsv);
+    __sync_fetch_and_add(&n_sink_fallbacks, sink.n_fallbacks);
+
+    wstat->bytes_flushed = sink.bytes_flushed;
+    wstat->flush_sec = sink.flush_sec;
+
 out_disconnect:
     hpssix_db_disconnect(&db);
-    hpssix_workdata_cleanup_object_list(list.object_list, list.count);
 out:
+    stage_leave(id);
+    watches[id].finished = 1;
+
     return (void *) 0;
 }
 
+/*
+ * watch the threads until they all finish, or are left behind. returns the
+ * number of the threads abandoned.
+ */
+static uint64_t watch_workers(void)
+{
+    int ret = 0;
+    uint64_t i = 0;
+    uint64_t n_done = 0;
+    uint64_t n_abandoned = 0;
+    uint64_t n_total = nthreads + nprefetch;
+    hpssix_db_t db = { 0, };
+    int connected = 0;
+
+    while (n_done < n_total) {
+        double now = .0F;
+
+        usleep(watchdog_interval);
+        now = now_sec();
+
+        for (n_done = 0, i = 0; i < n_total; i++) {
+            hpssix_extractor_watch_t *watch = &watches[i];
+            double deadline = watch->deadline;
+
+            if (watch->finished || watch->abandoned) {
+                n_done++;
+                continue;
+            }
+
+            if (deadline == .0F || now < deadline + watchdog_grace)
+                continue;
+
+            if (!watch->cancel) {
+                printf("## [watchdog] thread %lu stuck in object %lu, "
+                       "cancelling\n", i, watch->oid);
+
+                watch->cancel = 1;
+                pthread_kill(threads[i], SIGUSR1);
+            }
+            else if (now > deadline + watchdog_abandon) {
+                printf("## [watchdog] thread %lu stuck in object %lu, "
+                       "abandoned\n", i, watch->oid);
+
+                watch->abandoned = 1;
+                n_abandoned++;
+                worker_stats[i].n_timedout++;
+
+                if (!connected) {
+                    ret = hpssix_db_connect(&db, &config);
+                    connected = ret == 0;
+                }
+                if (connected)
+                    hpssix_db_quarantine(&db, watch->oid, watch->mtime);
+
+                hpssix_workdata_progress_mark(&progress, watch->index);
+
+                /* not to keep the other stage waiting */
+                stage_leave(i);
+            }
+            else
+                pthread_kill(threads[i], SIGUSR1);  /* once more */
+        }
+    }
+
+    if (connected)
+        hpssix_db_disconnect(&db);
+
+    return n_abandoned;
+}
+
+static int init_tika_pool(void)
+{
+    char buf[HOST_NAME_MAX+16] = { 0, };
+    char *endpoint = buf;
+
+    if (config.tika_n_endpoints > 0)
+        return hpssix_extractor_pool_init(&tika_pool, config.tika_endpoints,
+                                          config.tika_n_endpoints);
+
+    sprintf(buf, "%s:%d",
+            config.tika_host ? config.tika_host : "localhost",
+            config.tika_port ? config.tika_port : 9998);
+
+    return hpssix_extractor_pool_init(&tika_pool, &endpoint, 1);
+}
+
 static char *program;
 
 static struct option long_opts[] = {
     { "help", 0, 0, 'h' },
     { "nthreads", 1, 0, 'n' },
+    { "prefetch", 1, 0, 'p' },
+    { "rate", 1, 0, 'r' },
+    { "upload", 1, 0, 'u' },
     { "verbose", 0, 0, 'v' },
     { 0, 0, 0, 0},
 };
 
-static const char *short_opts = "hn:v";
+static const char *short_opts = "hn:p:r:u:v";
 
 static const char *usage_str = "\n"
 "Usage: extractor [options] <input dbfile>\n"
@@ -233,6 +567,16 @@ static const char *usage_str = "\n"
 "-h, --help             print the help message.\n"
 "-n, --nthreads=<NUM>   number of threads to be spawned. this will override\n"
 "                       the value in the configuration file.\n"
+"-p, --prefetch=<NUM>   number of threads reading the files ahead of the\n"
+"                       upload, 0 to disable. this will override the value\n"
+"                       in the configuration file.\n"
+"-r, --rate=<NUM>       extract at most NUM files per second (default: no\n"
+"                       limit), to run in the background.\n"
+"-u, --upload=<MODE>    how files are uploaded to tika, pread (default) or\n"
+"                       mmap. mmap falls back to pread if the mount does\n"
+"                       not support it. a file truncated or failing to be\n"
+"                       read during the upload kills the extractor with\n"
+"                       mmap (SIGBUS), while pread only fails the file.\n"
 "-v, --verbose          print noisy output.\n"
 "\n";
 
@@ -250,6 +594,27 @@ int main(int argc, char **argv)
     uint64_t i = 0;
     hpssix_workdata_t wd = { 0, };
     double elapsed = .0F;
+    char *upload_str = NULL;
+    uint64_t bytes_uploaded = 0;
+    uint64_t n_unchanged = 0;
+    uint64_t n_native = 0;
+    uint64_t n_resumed = 0;
+    uint64_t n_remaining = 0;
+    uint64_t n_batches = 0;
+    uint64_t n_switches = 0;
+    uint64_t n_timedout = 0;
+    uint64_t n_abandoned = 0;
+    uint64_t n_prefetched = 0;
+    uint64_t bytes_read = 0;
+    double read_sec = .0F;
+    uint64_t bytes_flushed = 0;
+    double flush_sec = .0F;
+    double upload_sec = .0F;
+    double wall = .0F;
+    uint32_t max_inflight = 0;
+    int prefetch_opt = -1;
+    uint64_t rate = 0;
+    struct sigaction sa = { 0, };
 
     program = hpssix_path_basename(argv[0]);
 
@@ -260,6 +625,18 @@ int main(int argc, char **argv)
             nthreads = strtoull(optarg, 0, 0);
             break;
 
+        case 'p':
+            prefetch_opt = atoi(optarg);
+            break;
+
+        case 'r':
+            rate = strtoull(optarg, 0, 0);
+            break;
+
+        case 'u':
+            upload_str = optarg;
+            break;
+
         case 'v':
             verbose = 1;
             break;
@@ -293,6 +670,34 @@ int main(int argc, char **argv)
     if (!nthreads)
         nthreads = config.extractor_nthreads;
 
+    if (!upload_str)
+        upload_str = config.extractor_upload;
+
+    extraction.prefix = config.hpss_mountpoint;
+    extraction.fingerprint_bytes = config.extractor_fingerprint << 10;
+    extraction.native = config.extractor_native;
+    extraction.native_maxbytes = config.extractor_nativecap;
+    extraction.verbose = verbose;
+
+    if (config.extractor_dispatch)
+        dispatch_size = config.extractor_dispatch;
+
+    extraction.timeout = config.extractor_timeout;
+    extraction.minrate = config.extractor_minrate;
+
+    nprefetch = prefetch_opt >= 0 ? prefetch_opt : config.extractor_prefetch;
+
+    if (rate)
+        rate_interval = 1.0F/rate;
+
+    if (upload_str) {
+        extraction.upload_mode = hpssix_extractor_parse_upload_mode(upload_str);
+        if (extraction.upload_mode < 0) {
+            fprintf(stderr, "unknown upload mode: %s\n", upload_str);
+            return EINVAL;
+        }
+    }
+
     ret = hpssix_workdata_open(&wd, dbpath);
     if (ret) {
         fprintf(stderr, "hpssix_workdata_open: %s\n", strerror(ret));
@@ -307,23 +712,77 @@ int main(int argc, char **argv)
 
     hpssix_workdata_close(&wd);
 
-    printf("Total work: %lu\n", total_objects);
+    printf("Total work: %lu (profile %u", total_objects,
+           config.extractor_profile);
+    if (rate)
+        printf(", %lu files/sec", rate);
+    printf(")\n");
     if (total_objects == 0) {
         printf("Nothing to extract.. terminating.\n");
         goto out_donothing;
     }
 
+    n_remaining = total_objects;
+
+    ret = hpssix_workdata_progress_open(&progress, dbpath, total_objects);
+    if (ret) {
+        fprintf(stderr, "hpssix_workdata_progress_open: %s\n", strerror(ret));
+        goto out_donothing;
+    }
+
+    if (hpssix_workdata_progress_count_done(&progress) > 0)
+        printf("Resuming: %lu done by the previous run\n",
+               hpssix_workdata_progress_count_done(&progress));
+
     hpssix_extractor_global_init();
- 
-    threads = calloc(nthreads, sizeof(*threads));
-    if (!threads) {
+
+    ret = init_tika_pool();
+    if (ret) {
+        fprintf(stderr, "invalid tika endpoints (%s)\n", strerror(ret));
+        goto out;
+    }
+
+    max_inflight = config.extractor_maxinflight;
+    if (!max_inflight || max_inflight > nthreads)
+        max_inflight = nthreads;
+
+    hpssix_extractor_limiter_init(&tika_limiter, max_inflight,
+                                  config.extractor_adaptive);
+    if (verbose)
+        tika_limiter.trace = stdout;
+
+    threads = calloc(nthreads + nprefetch, sizeof(*threads));
+    worker_stats = calloc(nthreads + nprefetch, sizeof(*worker_stats));
+    watches = calloc(nthreads + nprefetch, sizeof(*watches));
+    if (!threads || !worker_stats || !watches) {
         perror("## [E] calloc");
         ret = errno;
         goto out;
     }
 
-    for (i = 0; i < nthreads; i++) {
-        ret = pthread_create(&threads[i], 0, extractor_worker_func,
+    sa.sa_handler = watchdog_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (nprefetch > 0) {
+        ret = hpssix_extractor_stage_init(&stage,
+                                          config.extractor_stagebytes ?
+                                          config.extractor_stagebytes :
+                                          256*(1<<20), nprefetch, nthreads);
+        if (ret) {
+            fprintf(stderr, "hpssix_extractor_stage_init: %s\n",
+                    strerror(ret));
+            nprefetch = 0;
+            goto out;
+        }
+
+        printf("Prefetching with %lu threads\n", nprefetch);
+    }
+
+    for (i = 0; i < nthreads + nprefetch; i++) {
+        ret = pthread_create(&threads[i], 0,
+                             i < nthreads ? extractor_worker_func
+                                          : prefetch_worker_func,
                              (void *) (unsigned long) i);
         if (ret) {
             perror("pthread_create failed");
@@ -331,21 +790,122 @@ int main(int argc, char **argv)
         }
     }
 
-    for (i = 0; i < nthreads; i++) {
+    n_abandoned = watch_workers();
+
+    for (i = 0; i < nthreads + nprefetch; i++) {
+        if (watches[i].abandoned)
+            continue;
+
         ret = pthread_join(threads[i], NULL);
         if (ret)
             perror("pthread_join");
     }
 
+    for (i = 0; i < nthreads + nprefetch; i++) {
+        struct extractor_worker_stat *stat = &worker_stats[i];
+        double mbps = .0F;
+
+        if (i >= nthreads) {
+            if (stat->file.read_sec > 0)
+                mbps = stat->file.bytes_read/stat->file.read_sec/(1<<20);
+
+            printf("## [thread %lu] prefetched %lu bytes in %.3lf seconds "
+                   "(%.3lf MB/s)\n",
+                   i, stat->file.bytes_read, stat->file.read_sec, mbps);
+        }
+        else {
+            if (stat->file.upload_sec > 0)
+                mbps = stat->file.bytes_uploaded/stat->file.upload_sec/(1<<20);
+
+            printf("## [thread %lu] uploaded %lu bytes in %.3lf seconds "
+                   "(%.3lf MB/s)\n",
+                   i, stat->file.bytes_uploaded, stat->file.upload_sec, mbps);
+        }
+
+        bytes_uploaded += stat->file.bytes_uploaded;
+        upload_sec += stat->file.upload_sec;
+        n_unchanged += stat->file.n_unchanged;
+        n_native += stat->file.n_native;
+        n_resumed += stat->n_resumed;
+        n_batches += stat->n_batches;
+        n_switches += stat->n_switches;
+        n_timedout += stat->n_timedout;
+        n_prefetched += stat->file.n_prefetched;
+        bytes_read += stat->file.bytes_read;
+        read_sec += stat->file.read_sec;
+        bytes_flushed += stat->bytes_flushed;
+        flush_sec += stat->flush_sec;
+    }
+
+    n_remaining = total_objects - hpssix_workdata_progress_count_done(&progress);
+
+    hpssix_extractor_pool_print_stats(&tika_pool, stdout);
+    hpssix_extractor_limiter_print_stats(&tika_limiter, stdout);
+
+    /*
+     * the busy time of each stage summed over its threads, and the overall
+     * throughput of the stage over the run. the stage with the highest busy
+     * time per thread is the bottleneck.
+     */
+    wall = now_sec() - (start.tv_sec + start.tv_usec/1e6);
+
+    if (nprefetch > 0) {
+        hpssix_extractor_stage_print_stats(&stage, stdout);
+
+        printf("## [stage] read: %lu files, %lu bytes, %.3lf seconds busy "
+               "in %lu threads (%.3lf MB/s)\n",
+               n_prefetched, bytes_read, read_sec, nprefetch,
+               bytes_read/wall/(1<<20));
+    }
+    printf("## [stage] upload: %lu bytes, %.3lf seconds busy in %lu threads "
+           "(%.3lf MB/s)\n",
+           bytes_uploaded, upload_sec, nthreads,
+           bytes_uploaded/wall/(1<<20));
+    printf("## [stage] index: %lu documents, %lu bytes, %.3lf seconds busy "
+           "in %lu threads (%.3lf MB/s)\n",
+           n_extracted, bytes_flushed, flush_sec, nthreads,
+           bytes_flushed/wall/(1<<20));
+
+    /*
+     * the threads left behind may still touch the shared structures, and
+     * their pending documents are not flushed (nor marked done). only sync
+     * the progress, the exit cleans up the rest.
+     */
+    if (n_abandoned > 0) {
+        hpssix_workdata_progress_sync(&progress);
+        goto out_abandoned;
+    }
+
 out:
+    if (nprefetch > 0)
+        hpssix_extractor_stage_fini(&stage);
+    hpssix_workdata_progress_close(&progress);
+    hpssix_extractor_limiter_fini(&tika_limiter);
+    hpssix_extractor_pool_fini(&tika_pool);
     hpssix_extractor_global_cleanup();
+    free(watches);
+    free(worker_stats);
     free(threads);
 
+out_abandoned:
     gettimeofday(&end, NULL);
     elapsed = timediff(&start, &end);
 
 out_donothing:
     printf("## files extracted: %d\n", n_extracted);
+    printf("## unchanged files: %lu\n", n_unchanged);
+    printf("## native extracted: %lu\n", n_native);
+    printf("## documents truncated: %lu (%lu bytes)\n",
+           n_truncated, bytes_truncated);
+    printf("## tsvectors prepared: %lu\n", n_client_tsv);
+    printf("## batches written one by one: %lu\n", n_sink_fallbacks);
+    printf("## files resumed: %lu\n", n_resumed);
+    printf("## files remaining: %lu\n", n_remaining);
+    printf("## files timed out: %lu (%lu threads abandoned)\n",
+           n_timedout, n_abandoned);
+    printf("## batches dispatched: %lu (%lu locality switches)\n",
+           n_batches, n_switches);
+    printf("## bytes uploaded: %lu\n", bytes_uploaded);
     printf("## %.3lf seconds\n", elapsed);
 
     return ret;
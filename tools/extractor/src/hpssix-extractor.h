@@ -14,31 +14,91 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
 
 #include <hpssix.h>
 
+enum {
+    HPSSIX_EXTRACTOR_UPLOAD_MMAP = 0,   /* hand the mapped file to curl */
+    HPSSIX_EXTRACTOR_UPLOAD_PREAD,      /* pread directly into curl buffer */
+    HPSSIX_EXTRACTOR_UPLOAD_BUFFER,     /* read ahead by the prefetch stage */
+};
+
 struct _hpssix_extractor_data {
     char *tika_host;
     int tika_port;
 
     char file[PATH_MAX];
     uint64_t file_size;
-    FILE *fp;
+    int fd;
     FILE *tmpfp;
 
+    int upload_mode;            /* HPSSIX_EXTRACTOR_UPLOAD_XX */
+    void *map;                  /* with HPSSIX_EXTRACTOR_UPLOAD_MMAP/BUFFER */
+    uint64_t offset;            /* with HPSSIX_EXTRACTOR_UPLOAD_PREAD */
+
+    uint64_t bytes_uploaded;    /* accumulated over the requests */
+    double upload_sec;
+
+    /*
+     * requests are aborted (ETIMEDOUT) once @deadline (seconds since the
+     * epoch, 0 for none) has passed, or when *@cancel is set, e.g., by a
+     * watchdog thread.
+     */
+    double deadline;
+    volatile int *cancel;
+
     char *meta;
     char *content;
+    hpssix_docmeta_t docmeta;   /* flattened from @meta */
 };
 
 typedef struct _hpssix_extractor_data hpssix_extractor_data_t;
 
+/**
+ * @brief parse the upload mode string (e.g., "mmap" or "pread").
+ *
+ * @param str
+ *
+ * @return HPSSIX_EXTRACTOR_UPLOAD_XX, or -1 if @str is not recognized.
+ */
+int hpssix_extractor_parse_upload_mode(const char *str);
+
+/**
+ * @brief open @data->file for uploading. with HPSSIX_EXTRACTOR_UPLOAD_MMAP,
+ * the file is mapped into the memory. if the mount does not support mmap(2),
+ * e.g., some fuse mounts, this silently falls back to
+ * HPSSIX_EXTRACTOR_UPLOAD_PREAD, and @data->upload_mode is updated. an i/o
+ * error on a mapped page (e.g., a failed tape recall, or the file truncated)
+ * raises SIGBUS, which is not caught, thus HPSSIX_EXTRACTOR_UPLOAD_PREAD is
+ * the default.
+ *
+ * @param data
+ * @param mode HPSSIX_EXTRACTOR_UPLOAD_XX
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_extractor_open(hpssix_extractor_data_t *data, int mode);
+
 /**
  * @brief
  *
  * @param data
+ */
+void hpssix_extractor_close(hpssix_extractor_data_t *data);
+
+/**
+ * @brief get the metadata json in @data->meta. the typed attributes are
+ * flattened into @data->docmeta while the response is received, and should
+ * be released with hpssix_docmeta_free() by the caller.
  *
- * @return
+ * @param data
+ *
+ * @return 0 on success, EINVAL if tika cannot process the document,
+ * ETIMEDOUT if the deadline has passed or the request is cancelled, errno
+ * otherwise.
  */
 int hpssix_extractor_get_meta(hpssix_extractor_data_t *data);
 
@@ -47,10 +107,547 @@ int hpssix_extractor_get_meta(hpssix_extractor_data_t *data);
  *
  * @param data
  *
- * @return
+ * @return the same as hpssix_extractor_get_meta().
  */
 int hpssix_extractor_get_content(hpssix_extractor_data_t *data);
 
+/*
+ * prefetch stage, defined in hpssix-extractor-stage.c.
+ *
+ * the prefetch threads read the upcoming files into the memory ahead of the
+ * upload threads, so that the uploads do not wait on the hpss mount (e.g.,
+ * for a file being staged from tape). the files are handed over in a fifo,
+ * and the staging memory is bounded by @max_bytes. files larger than that are
+ * passed through, to be read by the upload thread itself.
+ */
+struct _hpssix_extractor_staged {
+    hpssix_workdata_object_t object;    /* owns the path and the locality */
+    uint64_t index;                     /* in the workdata */
+    int error;                          /* errno from the prefetch */
+    struct stat sb;
+    void *buf;                          /* the file, NULL if passed through */
+    uint64_t reserved;                  /* bytes of the staging memory */
+
+    struct _hpssix_extractor_staged *next;
+};
+
+typedef struct _hpssix_extractor_staged hpssix_extractor_staged_t;
+
+struct _hpssix_extractor_stage {
+    uint64_t max_bytes;
+    uint64_t bytes;             /* reserved by the staged files */
+    uint32_t n_producers;       /* prefetch threads still running */
+    uint32_t n_consumers;       /* upload threads still running */
+
+    hpssix_extractor_staged_t *head;
+    hpssix_extractor_staged_t *tail;
+    uint64_t n_queued;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* metrics */
+    uint64_t n_staged;
+    uint64_t n_passthrough;
+    uint64_t bytes_staged;
+    double read_sec;
+    uint64_t peak_bytes;
+    uint64_t peak_queued;
+    uint64_t n_full_waits;      /* prefetch waited for the memory */
+    double full_wait_sec;
+    uint64_t n_empty_waits;     /* upload waited for the prefetch */
+    double empty_wait_sec;
+};
+
+typedef struct _hpssix_extractor_stage hpssix_extractor_stage_t;
+
+/**
+ * @brief
+ *
+ * @param stage
+ * @param max_bytes the staging memory.
+ * @param n_producers number of the prefetch threads.
+ * @param n_consumers number of the upload threads.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_extractor_stage_init(hpssix_extractor_stage_t *stage,
+                                uint64_t max_bytes, uint32_t n_producers,
+                                uint32_t n_consumers);
+
+/**
+ * @brief release the stage, and the files left in the fifo.
+ *
+ * @param stage
+ */
+void hpssix_extractor_stage_fini(hpssix_extractor_stage_t *stage);
+
+/**
+ * @brief reserve @size bytes of the staging memory, waiting for the upload
+ * threads to release it if needed.
+ *
+ * @param stage
+ * @param size
+ *
+ * @return 0 on success, E2BIG if @size can never fit in the stage, EPIPE if
+ * no upload thread is left to release the memory.
+ */
+int hpssix_extractor_stage_reserve(hpssix_extractor_stage_t *stage,
+                                   uint64_t size);
+
+/**
+ * @brief release the memory reserved by hpssix_extractor_stage_reserve().
+ *
+ * @param stage
+ * @param size
+ */
+void hpssix_extractor_stage_release(hpssix_extractor_stage_t *stage,
+                                    uint64_t size);
+
+/**
+ * @brief hand a file over to the upload threads.
+ *
+ * @param stage
+ * @param staged
+ * @param read_sec time spent to read the file, for the metrics.
+ */
+void hpssix_extractor_stage_push(hpssix_extractor_stage_t *stage,
+                                 hpssix_extractor_staged_t *staged,
+                                 double read_sec);
+
+/**
+ * @brief take the next file, waiting for the prefetch threads if needed.
+ *
+ * @param stage
+ *
+ * @return the file which should be freed by hpssix_extractor_staged_free(),
+ * NULL if all prefetch threads are done.
+ */
+hpssix_extractor_staged_t *
+hpssix_extractor_stage_pop(hpssix_extractor_stage_t *stage);
+
+/**
+ * @brief a prefetch thread is done, or left behind.
+ *
+ * @param stage
+ */
+void hpssix_extractor_stage_producer_done(hpssix_extractor_stage_t *stage);
+
+/**
+ * @brief an upload thread is done, or left behind.
+ *
+ * @param stage
+ */
+void hpssix_extractor_stage_consumer_done(hpssix_extractor_stage_t *stage);
+
+/**
+ * @brief free a staged file, and release its staging memory.
+ *
+ * @param stage
+ * @param staged
+ */
+void hpssix_extractor_staged_free(hpssix_extractor_stage_t *stage,
+                                  hpssix_extractor_staged_t *staged);
+
+/**
+ * @brief
+ *
+ * @param stage
+ * @param fp
+ */
+void hpssix_extractor_stage_print_stats(hpssix_extractor_stage_t *stage,
+                                        FILE *fp);
+
+/*
+ * native extractors, defined in hpssix-extractor-native.c.
+ *
+ * plain text formats are extracted in the process instead of going through
+ * tika. the content is validated as utf-8 (invalid bytes are taken as
+ * latin-1) and capped in size, and the metadata is synthesized in the same
+ * json layout as tika produces.
+ */
+struct native_meta;
+
+struct _hpssix_extractor_native {
+    const char *name;           /* reported as X-Parsed-By */
+    const char *mime;
+    const char **exts;          /* NULL terminated, lower case */
+    int (*func)(const char *text, struct native_meta *meta); /* format meta */
+};
+
+typedef struct _hpssix_extractor_native hpssix_extractor_native_t;
+
+/**
+ * @brief find the native extractor for the file extension of @path.
+ *
+ * @param path
+ *
+ * @return the extractor, NULL if the file should go to tika.
+ */
+const hpssix_extractor_native_t *
+hpssix_extractor_native_lookup(const char *path);
+
+/**
+ * @brief find the native extractor for the mime type (e.g., text/csv).
+ *
+ * @param mime
+ *
+ * @return the extractor, NULL if not found.
+ */
+const hpssix_extractor_native_t *
+hpssix_extractor_native_lookup_mime(const char *mime);
+
+/**
+ * @brief extract @data->file (opened by hpssix_extractor_open()), and
+ * populate @data->meta and @data->content.
+ *
+ * @param native
+ * @param data
+ * @param maxbytes content is truncated at this size, 0 for the default (4MB).
+ *
+ * @return 0 on success, ENOTSUP if the file does not look like text (should
+ * go to tika), errno otherwise.
+ */
+int hpssix_extractor_native_extract(const hpssix_extractor_native_t *native,
+                                    hpssix_extractor_data_t *data,
+                                    uint64_t maxbytes);
+
+/*
+ * tika server pool, defined in hpssix-extractor-pool.c.
+ *
+ * requests go to the healthy endpoint with the least outstanding requests.
+ * an endpoint is taken out of the rotation after a few consecutive failures,
+ * or if its latency gets much higher than the fastest endpoint. endpoints out
+ * of the rotation are probed lazily (GET /tika) with a backoff, and put back
+ * once the probe succeeds.
+ */
+struct _hpssix_extractor_endpoint {
+    char *host;
+    int port;
+
+    int healthy;                /* in the rotation */
+    int probing;                /* a health probe is in progress */
+    uint64_t outstanding;       /* requests in flight */
+    uint64_t n_requests;
+    uint64_t n_failures;
+    uint64_t n_takeouts;        /* times taken out of the rotation */
+    uint32_t consecutive_failures;
+    uint32_t n_samples;         /* requests since put into the rotation */
+    double latency;             /* ewma of the normalized latency (seconds) */
+    double retry_at;            /* when to probe next, if not healthy */
+    double backoff;             /* current probe interval (seconds) */
+};
+
+typedef struct _hpssix_extractor_endpoint hpssix_extractor_endpoint_t;
+
+struct _hpssix_extractor_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    uint32_t n_endpoints;
+    hpssix_extractor_endpoint_t *endpoints;
+
+    /* tunables, set to the defaults by hpssix_extractor_pool_init() */
+    uint32_t max_failures;      /* consecutive failures to take out */
+    uint32_t min_samples;       /* requests before judging the latency */
+    double slow_factor;         /* take out if slower than this * fastest */
+    double probe_interval;      /* initial probe interval (seconds) */
+    double probe_max_interval;
+    double probe_timeout;
+    double wait_timeout;        /* max wait when no endpoint is healthy */
+};
+
+typedef struct _hpssix_extractor_pool hpssix_extractor_pool_t;
+
+/**
+ * @brief initialize the pool with @endpoints ("host" or "host:port").
+ *
+ * @param pool
+ * @param endpoints
+ * @param n_endpoints
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_extractor_pool_init(hpssix_extractor_pool_t *pool,
+                               char **endpoints, uint32_t n_endpoints);
+
+/**
+ * @brief
+ *
+ * @param pool
+ */
+void hpssix_extractor_pool_fini(hpssix_extractor_pool_t *pool);
+
+/**
+ * @brief pick an endpoint for the next request. this blocks up to
+ * @pool->wait_timeout seconds when no endpoint is in the rotation. the
+ * endpoint should be returned with hpssix_extractor_pool_put().
+ *
+ * @param pool
+ *
+ * @return the endpoint, NULL if no endpoint becomes healthy.
+ */
+hpssix_extractor_endpoint_t *
+hpssix_extractor_pool_get(hpssix_extractor_pool_t *pool);
+
+/**
+ * @brief return the endpoint with the request result.
+ *
+ * @param pool
+ * @param ep
+ * @param failed non-zero if the server failed (not the document)
+ * @param latency seconds taken for the request
+ * @param bytes uploaded for the request
+ */
+void hpssix_extractor_pool_put(hpssix_extractor_pool_t *pool,
+                               hpssix_extractor_endpoint_t *ep,
+                               int failed, double latency, uint64_t bytes);
+
+/**
+ * @brief check if the tika server responds.
+ *
+ * @param ep
+ * @param timeout seconds
+ *
+ * @return 0 if healthy, errno otherwise.
+ */
+int hpssix_extractor_pool_probe(hpssix_extractor_endpoint_t *ep,
+                                double timeout);
+
+/**
+ * @brief print per endpoint statistics in '## ' lines.
+ *
+ * @param pool
+ * @param fp
+ */
+void hpssix_extractor_pool_print_stats(hpssix_extractor_pool_t *pool,
+                                       FILE *fp);
+
+/*
+ * adaptive concurrency limiter, defined in hpssix-extractor-limiter.c.
+ *
+ * bounds the number of tika requests in flight. the limit is adjusted every
+ * window of completed requests (aimd): it grows by one when the window was
+ * saturated with healthy latencies, shrinks by @latency_decrease when the
+ * latency goes over @tolerance times the baseline, and by @error_decrease
+ * when a server failed. latencies are normalized by the uploaded size, so
+ * that a few large files do not look like an overloaded server.
+ */
+struct _hpssix_extractor_limiter {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    int adaptive;               /* 0 to fix the limit at @max_limit */
+    double limit;               /* current limit, (int) limit is enforced */
+    uint32_t inflight;
+
+    /* tunables, set to the defaults by hpssix_extractor_limiter_init() */
+    uint32_t min_limit;
+    uint32_t max_limit;         /* the hard cap */
+    uint32_t min_window;        /* min samples for a decision */
+    double tolerance;           /* latency/baseline to back off */
+    double latency_decrease;
+    double error_decrease;
+    double baseline_drift;      /* the baseline creeps up this much/window */
+    FILE *trace;                /* if set, each decision is logged */
+
+    /* the current window */
+    uint32_t window_samples;
+    uint32_t window_errors;
+    uint32_t window_peak;       /* max inflight seen */
+    double window_latency;      /* sum of the normalized latency */
+    uint32_t draining;          /* requests sent before the last backoff */
+
+    double baseline;            /* min normalized latency seen */
+    double changed_at;          /* for the time weighted average */
+    double started_at;
+
+    /* metrics */
+    uint64_t n_requests;
+    uint64_t n_errors;
+    uint64_t n_increases;
+    uint64_t n_latency_backoffs;
+    uint64_t n_error_backoffs;
+    uint64_t n_waits;           /* acquires blocked by the limit */
+    double wait_sec;
+    double limit_sum;           /* limit * seconds */
+    uint32_t peak_limit;
+    uint32_t low_limit;
+};
+
+typedef struct _hpssix_extractor_limiter hpssix_extractor_limiter_t;
+
+/**
+ * @brief initialize the limiter.
+ *
+ * @param limiter
+ * @param max_limit the hard cap of the requests in flight
+ * @param adaptive 0 to always allow @max_limit requests in flight
+ *
+ * @return 0 on success, errno otherwise.
+ */
+int hpssix_extractor_limiter_init(hpssix_extractor_limiter_t *limiter,
+                                  uint32_t max_limit, int adaptive);
+
+/**
+ * @brief
+ *
+ * @param limiter
+ */
+void hpssix_extractor_limiter_fini(hpssix_extractor_limiter_t *limiter);
+
+/**
+ * @brief block until a request can be sent under the current limit. each
+ * successful acquire should be followed by hpssix_extractor_limiter_release().
+ *
+ * @param limiter
+ */
+void hpssix_extractor_limiter_acquire(hpssix_extractor_limiter_t *limiter);
+
+/**
+ * @brief finish a request and feed its result to the limiter.
+ *
+ * @param limiter
+ * @param failed non-zero if the server failed (not the document)
+ * @param latency seconds taken for the request
+ * @param bytes uploaded for the request
+ */
+void hpssix_extractor_limiter_release(hpssix_extractor_limiter_t *limiter,
+                                      int failed, double latency,
+                                      uint64_t bytes);
+
+/**
+ * @brief print the limiter decisions in '## ' lines.
+ *
+ * @param limiter
+ * @param fp
+ */
+void hpssix_extractor_limiter_print_stats(hpssix_extractor_limiter_t *limiter,
+                                          FILE *fp);
+
+/*
+ * the extraction of a single file, from the stat to the document handed to
+ * the document sink, defined in hpssix-extractor-file.c. hpssix-extractor and
+ * the benchmark (tests/src/bench-extractor.c) run the files through it.
+ */
+struct _hpssix_extractor_file {
+    const char *prefix;         /* of the object paths, e.g., the hpss mount */
+    int upload_mode;            /* HPSSIX_EXTRACTOR_UPLOAD_XX */
+    uint64_t fingerprint_bytes; /* hashed from the head/tail, 0 to disable */
+    int native;                 /* extract plain text formats in process */
+    uint64_t native_maxbytes;
+    uint32_t timeout;           /* seconds per file, 0 for no deadline */
+    uint64_t minrate;           /* bytes/sec, to extend the timeout */
+    hpssix_extractor_pool_t *pool;
+    hpssix_extractor_limiter_t *limiter;
+    hpssix_extractor_stage_t *stage;    /* with the prefetch threads */
+    int verbose;
+};
+
+typedef struct _hpssix_extractor_file hpssix_extractor_file_t;
+
+/*
+ * a thread working on a file, watched by the watchdog of hpssix-extractor.
+ */
+struct _hpssix_extractor_watch {
+    volatile double deadline;   /* 0 when not working on a file */
+    volatile int cancel;
+    volatile int finished;
+    int abandoned;
+    uint64_t oid;
+    uint64_t mtime;
+    uint64_t index;
+    int released;               /* a prefetch thread left the stage */
+};
+
+typedef struct _hpssix_extractor_watch hpssix_extractor_watch_t;
+
+struct _hpssix_extractor_file_stat {
+    uint64_t bytes_uploaded;
+    double upload_sec;
+    uint64_t n_unchanged;
+    uint64_t n_native;
+    uint64_t n_prefetched;
+    uint64_t bytes_read;        /* by the prefetch */
+    double read_sec;
+};
+
+typedef struct _hpssix_extractor_file_stat hpssix_extractor_file_stat_t;
+
+/**
+ * @brief the deadline of a file of @size bytes started at @from.
+ *
+ * @param self
+ * @param from
+ * @param size
+ *
+ * @return the deadline in seconds since the epoch, 0 for no deadline.
+ */
+double hpssix_extractor_file_deadline(hpssix_extractor_file_t *self,
+                                      double from, uint64_t size);
+
+/**
+ * @brief start watching @watch on @object, with the deadline from the size
+ * in the workdata.
+ *
+ * @param self
+ * @param watch
+ * @param object
+ * @param index of @object in the workdata
+ */
+void hpssix_extractor_watch_begin(hpssix_extractor_file_t *self,
+                                  hpssix_extractor_watch_t *watch,
+                                  hpssix_workdata_object_t *object,
+                                  uint64_t index);
+
+/**
+ * @brief stop watching @watch, e.g., while waiting for a resource.
+ *
+ * @param watch
+ */
+void hpssix_extractor_watch_end(hpssix_extractor_watch_t *watch);
+
+/**
+ * @brief extract @object, and append the document to @sink. the waits for
+ * the limiter and the pool are not counted against the deadline of @watch.
+ *
+ * @param self
+ * @param id of the thread, for the messages
+ * @param watch of the thread, between hpssix_extractor_watch_begin() and
+ * hpssix_extractor_watch_end()
+ * @param wstat of the thread
+ * @param object
+ * @param index of @object in the workdata
+ * @param staged read by the prefetch, NULL to read the file
+ * @param sink NULL to drop the document, as the benchmark does
+ *
+ * @return 0 on success, errno otherwise. EINVAL for the documents tika
+ * refuses, and ETIMEDOUT for the deadline.
+ */
+int hpssix_extractor_file_extract(hpssix_extractor_file_t *self, uint64_t id,
+                                  hpssix_extractor_watch_t *watch,
+                                  hpssix_extractor_file_stat_t *wstat,
+                                  hpssix_workdata_object_t *object,
+                                  uint64_t index,
+                                  hpssix_extractor_staged_t *staged,
+                                  hpssix_db_docsink_t *sink);
+
+/**
+ * @brief read @staged->object ahead into the memory of @self->stage, and
+ * push it to the stage. a file over the stage memory is pushed without the
+ * buffer, to be read by the upload thread.
+ *
+ * @param self
+ * @param id of the thread, for the messages
+ * @param watch of the thread
+ * @param wstat of the thread
+ * @param staged
+ */
+void hpssix_extractor_file_prefetch(hpssix_extractor_file_t *self, uint64_t id,
+                                    hpssix_extractor_watch_t *watch,
+                                    hpssix_extractor_file_stat_t *wstat,
+                                    hpssix_extractor_staged_t *staged);
+
 /**
  * @brief
  *
@@ -41,13 +41,15 @@ static inline void print_history_record(uint64_t len)
 
         printf("## task at %s: took %4lu seconds, "
                "%4lu scanned, %4lu deleted, "
-               "%4lu indexed, %4lu extracted.\n",
+               "%4lu indexed, %4lu extracted%s.\n",
                timebuf,
                current->extractor_end - current->scanner_start,
                current->n_scanned,
                current->n_deleted,
                current->n_indexed,
-               current->n_extracted);
+               current->n_extracted,
+               current->status == HPSSIX_WORK_STATUS_INCOMPLETE ?
+               " (incomplete)" : "");
     }
 }
 
@@ -0,0 +1,298 @@
+/* Copyright (C) 2019 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ *
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ * ---------------------------------------------------------------------------
+ *
+ * re-extraction of the documents produced by an older extraction profile
+ * (extractor.profile), e.g., after upgrading tika. the documents are picked
+ * by the priority, the most recently used or modified first, and written to
+ * a workdata which the extractor can run through in the background with
+ * --rate.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "hpssix-admin.h"
+
+static uint64_t count = 10000;  /* default 10000 */
+static int64_t profile = -1;    /* -1 for extractor.profile */
+static int64_t rate = -1;       /* -1 for extractor.rate */
+static char *output;
+static int run;
+static int dryrun;
+
+static hpssix_config_t config;
+
+/*
+ * the search queries are not logged, so the access time stands in for how
+ * often a file is used. the chosen documents are then ordered by the parent
+ * directory, to keep the reads of the extractor close on the storage.
+ */
+static const char *reextract_sql =
+"SELECT oid, st_size, st_mtime, path FROM (\n"
+"    SELECT o.oid, o.st_size, o.st_mtime, f.path\n"
+"      FROM hpssix_attr_document d\n"
+"           JOIN hpssix_object o ON d.oid = o.oid\n"
+"           JOIN hpssix_file f ON d.oid = f.oid\n"
+"           LEFT OUTER JOIN hpssix_attr_quarantine q ON d.oid = q.oid\n"
+"     WHERE d.profile < %ld AND o.valid AND o.st_size > 0\n"
+"       AND (q.oid IS NULL OR %u = 0 OR q.n_timeouts < %u\n"
+"            OR q.st_mtime <> o.st_mtime)\n"
+"     ORDER BY GREATEST(o.st_atime, o.st_mtime) DESC, o.oid\n"
+"     LIMIT %lu\n"
+") AS chosen\n"
+"ORDER BY REGEXP_REPLACE(path, '/[^/]*$', ''), oid;\n";
+
+static const char *reextract_count_sql =
+"SELECT profile, COUNT(*) FROM hpssix_attr_document\n"
+" GROUP BY profile ORDER BY profile;\n";
+
+static void print_profiles(hpssix_db_t *db)
+{
+    int i = 0;
+    PGresult *res = NULL;
+
+    res = hpssix_db_psql_query(db, reextract_count_sql);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+        goto out;
+
+    for (i = 0; i < PQntuples(res); i++)
+        printf("## documents with profile %s: %s\n",
+               PQgetvalue(res, i, 0), PQgetvalue(res, i, 1));
+
+out:
+    PQclear(res);
+}
+
+static int write_workdata(hpssix_db_t *db, uint64_t *n_written)
+{
+    int ret = 0;
+    int i = 0;
+    int rows = 0;
+    PGresult *res = NULL;
+    hpssix_workdata_t workdata = { 0, };
+
+    res = hpssix_db_psql_query(db, reextract_sql, profile,
+                               config.extractor_quarantine,
+                               config.extractor_quarantine, count);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        ret = EIO;
+        goto out;
+    }
+
+    rows = PQntuples(res);
+    if (dryrun || rows == 0)
+        goto out;
+
+    ret = hpssix_workdata_create(&workdata, output);
+    if (ret)
+        goto out;
+
+    hpssix_workdata_begin_transaction(&workdata);
+
+    /* no previous hash, the fingerprint should not skip these */
+    for (i = 0; i < rows; i++) {
+        hpssix_workdata_object_t object = { 0, };
+
+        object.object_id = strtoull(PQgetvalue(res, i, 0), NULL, 0);
+        object.size = strtoull(PQgetvalue(res, i, 1), NULL, 0);
+        object.mtime = strtoull(PQgetvalue(res, i, 2), NULL, 0);
+        object.path = PQgetvalue(res, i, 3);
+
+        ret = hpssix_workdata_append_object(&workdata, &object);
+        if (ret)
+            break;
+    }
+
+    if (ret)
+        hpssix_workdata_rollback_transaction(&workdata);
+    else
+        hpssix_workdata_end_transaction(&workdata);
+
+    hpssix_workdata_close(&workdata);
+
+out:
+    *n_written = ret ? 0 : rows;
+    PQclear(res);
+
+    return ret;
+}
+
+static int run_extractor(void)
+{
+    char ratebuf[32] = { 0, };
+
+    sprintf(ratebuf, "%ld", rate);
+
+    printf("## running the extractor (%ld files/sec)\n", rate);
+    fflush(stdout);
+
+    execl(LIBEXECDIR "/hpssix-extractor", "hpssix-extractor",
+          "--rate", ratebuf, output, (char *) NULL);
+
+    perror("execl");
+
+    return errno;
+}
+
+static int do_reextract(void)
+{
+    int ret = 0;
+    uint64_t n_written = 0;
+    hpssix_db_t db = { 0, };
+    char pathbuf[PATH_MAX] = { 0, };
+
+    ret = hpssix_config_read_sysconf(&config);
+    if (ret) {
+        fprintf(stderr, "failed to read the configuration.\n");
+        goto out;
+    }
+
+    if (profile < 0)
+        profile = config.extractor_profile;
+    if (rate < 0)
+        rate = config.extractor_rate;
+
+    if (!output) {
+        ret = hpssix_get_datadir_today(pathbuf, PATH_MAX);
+        if (ret) {
+            fprintf(stderr, "failed to create the data directory.\n");
+            goto out;
+        }
+
+        sprintf(&pathbuf[strlen(pathbuf)], "/reextract.%lu.db",
+                (uint64_t) time(NULL));
+        output = pathbuf;
+    }
+
+    ret = hpssix_db_connect(&db, &config);
+    if (ret) {
+        fprintf(stderr, "failed to connect to the database.\n");
+        goto out;
+    }
+
+    print_profiles(&db);
+
+    ret = write_workdata(&db, &n_written);
+
+    hpssix_db_disconnect(&db);
+
+    if (ret) {
+        fprintf(stderr, "failed to write the workdata (%s).\n",
+                strerror(ret));
+        goto out;
+    }
+
+    if (dryrun || n_written == 0) {
+        printf("## nothing written (profile %ld).\n", profile);
+        goto out;
+    }
+
+    printf("## %lu documents older than profile %ld: %s\n",
+           n_written, profile, output);
+
+    if (run)
+        ret = run_extractor();
+
+out:
+    return ret;
+}
+
+#define HPSSIX_ADMIN_CMD_REEXTRACT_USAGE \
+    "reextract [options]..\n" \
+    "\n" \
+    "Available options:\n" \
+    "-c, --count=<N>      pick up to <N> documents (default 10000)\n" \
+    "-d, --dry-run        only count the documents by profile\n" \
+    "-h, --help           print this help message\n" \
+    "-o, --output=<FILE>  write the workdata to <FILE>\n" \
+    "-p, --profile=<N>    documents older than <N> (extractor.profile)\n" \
+    "-r, --rate=<N>       with --run, at most <N> files/sec (default\n" \
+    "                     extractor.rate, 0 for no limit)\n" \
+    "-x, --run            run the extractor on the workdata\n" \
+    "\n"
+
+static void reextract_usage(void)
+{
+    printf("%s %s", hpssix_admin_program_name,
+                    HPSSIX_ADMIN_CMD_REEXTRACT_USAGE);
+}
+
+static const char *short_opts = "c:dho:p:r:x";
+
+static struct option const long_opts[] = {
+    { "count", 1, 0, 'c' },
+    { "dry-run", 0, 0, 'd' },
+    { "help", 0, 0, 'h' },
+    { "output", 1, 0, 'o' },
+    { "profile", 1, 0, 'p' },
+    { "rate", 1, 0, 'r' },
+    { "run", 0, 0, 'x' },
+    { 0, 0, 0, 0},
+};
+
+static int reextract_cmd_main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int optidx = 0;
+
+    while ((ch = getopt_long(argc, argv,
+                             short_opts, long_opts, &optidx)) >= 0) {
+        switch (ch) {
+        case 'c':
+            count = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'd':
+            dryrun = 1;
+            break;
+
+        case 'o':
+            output = optarg;
+            break;
+
+        case 'p':
+            profile = strtol(optarg, NULL, 0);
+            break;
+
+        case 'r':
+            rate = strtol(optarg, NULL, 0);
+            break;
+
+        case 'x':
+            run = 1;
+            break;
+
+        case 'h':
+        default:
+            reextract_usage();
+            goto out;
+        }
+    }
+
+    if (argc - optind != 0 || !count) {
+        reextract_usage();
+        goto out;
+    }
+
+    ret = do_reextract();
+out:
+    return ret;
+}
+
+hpssix_admin_cmd_t hpssix_admin_cmd_reextract = {
+    .name = "reextract",
+    .usage_str = HPSSIX_ADMIN_CMD_REEXTRACT_USAGE,
+    .func = reextract_cmd_main,
+};
+
@@ -18,6 +18,7 @@
 
 static hpssix_admin_cmd_t *cmds[] = {
     &hpssix_admin_cmd_history,
+    &hpssix_admin_cmd_reextract,
 };
 
 /*
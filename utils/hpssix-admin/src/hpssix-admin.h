@@ -28,5 +28,6 @@ struct _hpssix_admin_cmd {
 typedef struct _hpssix_admin_cmd hpssix_admin_cmd_t;
 
 extern hpssix_admin_cmd_t hpssix_admin_cmd_history;
+extern hpssix_admin_cmd_t hpssix_admin_cmd_reextract;
 
 #endif /* __HPSSIX_ADMIN_H */
@@ -72,8 +72,11 @@ static inline char *get_sql(const char *path)
         return NULL;
     }
 
-    sprintf(sqlbuf, "select meta, text from hpssix_attr_document "
-                    "where oid=(select oid from hpssix_file where "
+    /* truncated documents have the full text aside */
+    sprintf(sqlbuf, "select d.meta, coalesce(f.text, d.text) "
+                    "from hpssix_attr_document d "
+                    "left join hpssix_attr_document_full f on f.oid=d.oid "
+                    "where d.oid=(select oid from hpssix_file where "
                     "path=%s limit 1)", escaped_path);
 
     return sqlbuf;
@@ -15,24 +15,18 @@
 #include <getopt.h>
 #include <errno.h>
 #include <limits.h>
-#include <hpssix.h>
+#include <sys/stat.h>
 #include <sys/time.h>
-
-#include "hpssix-search.h"
+#include <unistd.h>
+#include <hpssix.h>
+#include <hpssix-query.h>
+#include <hpssix-query-msg.h>
 
 static hpssix_db_t db;
 static hpssix_config_t config;
 
-enum {
-    HPSSIX_SEARCH_PATH  = 1,
-    HPSSIX_SEARCH_FATTR = 2,
-    HPSSIX_SEARCH_TAG   = 4,
-    HPSSIX_SEARCH_TSV   = 8,
-};
-
-static int search_mode = HPSSIX_SEARCH_FATTR;
-
 static int countonly;
+static int estimate;
 static int removed;
 static int showino;
 static int directory_only;
@@ -40,38 +34,51 @@ static int file_only;
 
 static char *keyword;
 static uint64_t limit;
+static int stream;
+static char *after;
+static hpssix_query_key_t last_key;
+static uint64_t batch;          /* 0 for HPSSIX_QUERY_DEFAULT_BATCH */
 static int verbose;
+static int direct;              /* not through the search service */
+static int explain;
+static int keys;                /* HPSSIX_QUERY_KEYS_NAME or _PATH */
+static char *keys_file;         /* "-" for stdin */
+static int service_stats;
 static int print_meta;
 static int print_text;
 
-static char *cond_str[N_COND_ARG];
-
-const char *opstr[] = { "=", ">", ">=", "<", "<=", "<>" };
+static char *cond_str[N_HPSSIX_QUERY_FATTR];
 
-#define MAX_TAG_CONDS   128
+#define MAX_TAG_CONDS   HPSSIX_QUERY_MSG_MAX_TAGS
 
 static uint32_t n_tag_conds;
-static hpssix_search_tag_cond_t tag_conds[MAX_TAG_CONDS];
+static hpssix_query_tag_t tag_conds[MAX_TAG_CONDS];
 
 static char datetimebuf[512];
 
 static char *name;
 static char *path;
+static char *under;
+
+static char *content_type;
+static char *author;
+static char *language;
+static char *docmeta_str[3];    /* created, modified and pages */
 
-static char *sql_fattr;
-static char *sql_tags;
-static char *sql_tsv;
-static char sqlbuf[1<<20];
+static hpssix_query_t query;
+static hpssix_query_stmt_t stmt;
+static hpssix_query_plan_t plan;
+static double plan_sec;
 
-static inline void print_sql(char *sql)
+static inline void print_sql(hpssix_query_stmt_t *stmt)
 {
     int i = 0;
     char ch = 0;
 
     printf("## SQL:");
 
-    for (i = 0; i < strlen(sql); i++) {
-        ch = sql[i];
+    for (i = 0; i < strlen(stmt->sql); i++) {
+        ch = stmt->sql[i];
 
         if (ch == '\n')
             printf("\n## ");
@@ -79,7 +86,12 @@ static inline void print_sql(char *sql)
             fputc(ch, stdout);
     }
 
-    printf("\n\n");
+    printf("\n");
+
+    for (i = 0; i < stmt->n_params; i++)
+        printf("## $%d = %s\n", i + 1, stmt->params[i]);
+
+    printf("\n");
 }
 
 struct timeval tv_start;
@@ -92,31 +104,477 @@ static inline double timegap_sec(struct timeval *t1, struct timeval *t2)
     return usec/1e6;
 }
 
-static inline void print_result(FILE *out, PGresult *res)
+static inline void print_row(FILE *out, const char *oid, const char *path)
+{
+    if (showino)
+        fprintf(out, "%10lu: %s%s\n", strtoull(oid, NULL, 0),
+                     config.hpss_mountpoint, path);
+    else
+        fprintf(out, "%s%s\n", config.hpss_mountpoint, path);
+}
+
+/* the key of a batch, which is the last column */
+static inline void print_key(FILE *out, PGresult *res, int row)
+{
+    const char *key = PQgetvalue(res, row, PQnfields(res) - 1);
+
+    if (keys == HPSSIX_QUERY_KEYS_PATH)
+        fprintf(out, "%s%s\t", config.hpss_mountpoint, key);
+    else
+        fprintf(out, "%s\t", key);
+}
+
+static inline void print_rows(FILE *out, PGresult *res)
 {
     int i = 0;
     int rows = PQntuples(res);
 
+    for (i = 0; i < rows; i++) {
+        if (keys)
+            print_key(out, res, i);
+
+        print_row(out, PQgetvalue(res, i, 0), PQgetvalue(res, i, 1));
+    }
+}
+
+static inline void print_counts(FILE *out, PGresult *res)
+{
+    int i = 0;
+    int rows = PQntuples(res);
+
+    for (i = 0; i < rows; i++) {
+        if (keys)
+            print_key(out, res, i);
+
+        fprintf(out, "%s\n", PQgetvalue(res, i, 0));
+    }
+}
+
+/*
+ * the keys are loaded into the session once, and all of them are searched by
+ * a single statement, joined against them.
+ */
+static int load_keys(void)
+{
+    int ret = 0;
+    FILE *fp = stdin;
+    uint64_t n_keys = 0;
+
+    if (strcmp(keys_file, "-")) {
+        fp = fopen(keys_file, "r");
+        if (!fp)
+            return errno;
+    }
+
+    gettimeofday(&tv_start, NULL);
+
+    ret = hpssix_query_keys_load(&db, fp,
+                                 keys == HPSSIX_QUERY_KEYS_PATH ?
+                                 config.hpss_mountpoint : NULL, &n_keys);
+
+    gettimeofday(&tv_end, NULL);
+
+    if (fp != stdin)
+        fclose(fp);
+
+    if (!ret && verbose)
+        printf("## %lu keys loaded in %.6lf seconds.\n\n",
+               n_keys, timegap_sec(&tv_start, &tv_end));
+
+    return ret;
+}
+
+/*
+ * the counters are exact for the index, while a planner estimate is only
+ * bounded from above by the counters, if they have been built.
+ */
+static inline void print_estimate_rows(FILE *out,
+                                       hpssix_query_estimate_t *est)
+{
+    if (est->source == HPSSIX_QUERY_ESTIMATE_COUNTER)
+        fprintf(out, "%lu (exact, counted at the last build)\n", est->rows);
+    else if (est->bound != UINT64_MAX)
+        fprintf(out, "~%lu (estimated by the planner, at most %lu)\n",
+                     est->rows, est->bound);
+    else
+        fprintf(out, "~%lu (estimated by the planner)\n", est->rows);
+}
+
+static int print_estimate(FILE *out)
+{
+    int ret = 0;
+    hpssix_query_estimate_t est = { 0, };
+
+    gettimeofday(&tv_start, NULL);
+
+    ret = hpssix_query_estimate(&db, &query, &est);
+    if (ret)
+        return ret;
+
+    gettimeofday(&tv_end, NULL);
+
+    print_estimate_rows(out, &est);
+
     if (verbose)
-        print_sql(sqlbuf);
+        fprintf(out, "\n## estimated in %.6lf seconds.\n",
+                     timegap_sec(&tv_start, &tv_end));
+
+    return 0;
+}
+
+/*
+ * the statement is built again, driven by the most selective predicate. if
+ * the statistics cannot be read, the statement from hpssix_object is kept.
+ */
+static int plan_query(void)
+{
+    int ret = 0;
+
+    gettimeofday(&tv_start, NULL);
+
+    ret = hpssix_query_plan(&db, &query, &plan);
+    if (ret) {
+        if (verbose || explain)
+            printf("## failed to plan the search (%s).\n", strerror(ret));
+        return 0;
+    }
+
+    gettimeofday(&tv_end, NULL);
+
+    plan_sec = timegap_sec(&tv_start, &tv_end);
+
+    query.plan = &plan;
+
+    hpssix_query_stmt_free(&stmt);
+
+    return hpssix_query_build(&query, &stmt);
+}
+
+static void print_plan(FILE *out)
+{
+    uint32_t i = 0;
+    hpssix_query_pred_t *pred = NULL;
+
+    if (!query.plan)
+        return;
+
+    fprintf(out, "## plan, in %.6lf seconds:\n", plan_sec);
+
+    for (i = 0; i < plan.n_preds; i++) {
+        pred = &plan.preds[i];
+
+        fprintf(out, "##   %u. ", i + 1);
+
+        if (pred->type == HPSSIX_QUERY_PRED_OBJECT)
+            fprintf(out, "stat attributes");
+        else if (pred->type == HPSSIX_QUERY_PRED_TAG)
+            fprintf(out, "tag %s", query.tags[pred->tag].name);
+        else
+            fprintf(out, "keyword");
+
+        if (pred->rows < 0)
+            fprintf(out, ", rows unknown");
+        else
+            fprintf(out, ", ~%ld rows", pred->rows);
+
+        fprintf(out, "%s\n", i == 0 ? " (driving)" : "");
+    }
+
+    fprintf(out, "\n");
+}
+
+/* the statement is executed, but the results are not printed */
+static int print_explain(FILE *out)
+{
+    int ret = 0;
+    int i = 0;
+    PGresult *res = NULL;
+
+    print_plan(out);
+    print_sql(&stmt);
+
+    gettimeofday(&tv_start, NULL);
+
+    ret = hpssix_query_explain(&db, &stmt, &res);
+    if (ret)
+        return ret;
+
+    gettimeofday(&tv_end, NULL);
+
+    for (i = 0; i < PQntuples(res); i++)
+        fprintf(out, "## %s\n", PQgetvalue(res, i, 0));
+
+    fprintf(out, "\n## explained in %.6lf seconds.\n",
+                 timegap_sec(&tv_start, &tv_end));
+
+    PQclear(res);
+
+    return 0;
+}
+
+/* a full page has the token of the next one */
+static inline void print_summary(FILE *out, uint64_t rows)
+{
+    char token[HPSSIX_QUERY_MAX_TOKEN] = { 0, };
+
+    fprintf(out, "\n## %lu records found in %.6lf seconds.\n",
+                 rows, timegap_sec(&tv_start, &tv_end));
+
+    if (limit && rows == limit && last_key.valid) {
+        hpssix_query_key_token(&last_key, token);
+        fprintf(out, "## next page: --after=%s\n", token);
+    }
+}
+
+static inline void print_result(FILE *out, PGresult *res)
+{
+    uint64_t rows = PQntuples(res);
+
+    if (verbose) {
+        print_plan(out);
+        print_sql(&stmt);
+    }
 
     if (countonly)
-        fprintf(out, "%s\n", PQgetvalue(res, 0, 0));
+        print_counts(out, res);
+    else {
+        print_rows(out, res);
+        hpssix_query_key_get(&query, res, rows - 1, &last_key);
+    }
+
+    if (verbose)
+        print_summary(out, rows);
+}
+
+/*
+ * the rows are printed as each batch arrives, so that the output starts
+ * right away, and no more than a batch is kept in memory.
+ */
+static int stream_result(FILE *out)
+{
+    int ret = 0;
+    uint64_t rows = 0;
+    PGresult *res = NULL;
+    hpssix_query_cursor_t cursor = { 0, };
+
+    if (verbose) {
+        print_plan(out);
+        print_sql(&stmt);
+    }
+
+    gettimeofday(&tv_start, NULL);
+
+    ret = hpssix_query_open(&db, &stmt, batch, &cursor);
+    if (ret)
+        return ret;
+
+    while ((ret = hpssix_query_fetch(&cursor, &res)) == 0 && res) {
+        if (PQntuples(res) > 0)
+            hpssix_query_key_get(&query, res, PQntuples(res) - 1, &last_key);
+
+        rows += PQntuples(res);
+        print_rows(out, res);
+        PQclear(res);
+
+        fflush(out);
+    }
+
+    if (hpssix_query_close(&cursor) && !ret)
+        ret = EIO;
+
+    gettimeofday(&tv_end, NULL);
+
+    if (verbose)
+        print_summary(out, rows);
+
+    return ret;
+}
+
+/*
+ * a row from the search service, the columns of which are terminated by '\0'.
+ */
+static void print_remote_row(FILE *out, char *buf, uint32_t len)
+{
+    int n = 0;
+    char *cols[3] = { 0, };
+    char *pos = buf;
+    char token[HPSSIX_QUERY_MAX_TOKEN] = { 0, };
+    hpssix_query_estimate_t est = { 0, };
+
+    for (n = 0; n < 3 && pos < &buf[len]; n++) {
+        cols[n] = pos;
+        pos += strlen(pos) + 1;
+    }
+
+    if (estimate && countonly) {
+        if (n < 2)
+            return;
+
+        est.source = atoi(cols[0]);
+        est.rows = strtoull(cols[1], NULL, 10);
+        est.bound = n == 3 ? strtoull(cols[2], NULL, 10) : UINT64_MAX;
+        print_estimate_rows(out, &est);
+    }
+    else if (countonly) {
+        if (n > 0)
+            fprintf(out, "%s\n", cols[0]);
+    }
+    else if (n >= 2) {
+        print_row(out, cols[0], cols[1]);
+
+        if (n == 3)
+            snprintf(token, sizeof(token), "%s,%s", cols[2], cols[0]);
+        else
+            snprintf(token, sizeof(token), "%s", cols[0]);
+
+        hpssix_query_key_parse(token, &last_key);
+    }
+}
+
+/*
+ * search through the service of hpssixd, of which the database session is
+ * ready. the rows come as they are read, like -S. ECONNREFUSED if the service
+ * does not answer, to search directly.
+ */
+static int remote_search(FILE *out, int fd)
+{
+    int ret = 0;
+    int type = 0;
+    int rfd = -1;
+    int answered = 0;
+    int cached = 0;
+    uint64_t rows = 0;
+    char *buf = NULL;
+    uint32_t size = 0;
+    uint32_t len = 0;
+    char *qbuf = NULL;
+    uint32_t qlen = 0;
+    FILE *in = NULL;
+    FILE *sock = NULL;
+    hpssix_query_msg_t msg = { 0, };
+
+    msg.query = query;
+    msg.estimate = estimate && countonly;
+    msg.batch = batch;
+
+    ret = hpssix_query_msg_encode(&msg, &qbuf, &qlen);
+    if (ret) {
+        close(fd);
+        return ret;
+    }
+
+    rfd = dup(fd);
+    sock = fdopen(fd, "w");
+    in = rfd < 0 ? NULL : fdopen(rfd, "r");
+    if (!sock || !in) {
+        ret = ECONNREFUSED;
+        goto out;
+    }
+
+    if (verbose && !msg.estimate)
+        print_sql(&stmt);
+
+    gettimeofday(&tv_start, NULL);
+
+    if (hpssix_query_msg_send(sock, HPSSIX_QUERY_MSG_QUERY, qbuf, qlen) ||
+        fflush(sock)) {
+        ret = ECONNREFUSED;
+        goto out;
+    }
+
+    while ((ret = hpssix_query_msg_recv(in, &type, &buf, &size, &len)) == 0) {
+        answered = 1;
+
+        if (type == HPSSIX_QUERY_MSG_END) {
+            ret = atoi(buf);
+
+            /* the rows from the result cache of the service */
+            if (strlen(buf) + 1 < len)
+                cached = !strcmp(&buf[strlen(buf) + 1], "cached");
+            break;
+        }
+        else if (type != HPSSIX_QUERY_MSG_ROW) {
+            ret = EIO;
+            break;
+        }
+
+        print_remote_row(out, buf, len);
+        rows++;
+    }
+
+    if (ret && !answered)
+        ret = ECONNREFUSED;
+
+    gettimeofday(&tv_end, NULL);
+
+    if (verbose && !ret) {
+        if (msg.estimate)
+            fprintf(out, "\n## estimated in %.6lf seconds.\n",
+                         timegap_sec(&tv_start, &tv_end));
+        else
+            print_summary(out, rows);
+
+        fprintf(out, "## served by hpssixd (%s%s).\n", config.search_socket,
+                     cached ? ", cached" : "");
+    }
+
+out:
+    free(buf);
+    free(qbuf);
+
+    if (in)
+        fclose(in);
+    else if (rfd >= 0)
+        close(rfd);
+
+    if (sock)
+        fclose(sock);
     else
-        for (i = 0; i < rows; i++) {
-            if (showino) {
-                fprintf(out, "%10lu: %s%s\n", 
-                             strtoull(PQgetvalue(res, i, 0), NULL, 0),
-                             config.hpss_mountpoint, PQgetvalue(res, i ,1));
-            }
-            else
-                fprintf(out, "%s%s\n",
-                             config.hpss_mountpoint, PQgetvalue(res, i ,1));
+        close(fd);
+
+    return ret;
+}
+
+static int print_service_stats(FILE *out)
+{
+    int ret = 0;
+    int fd = -1;
+    int type = 0;
+    char *buf = NULL;
+    uint32_t size = 0;
+    uint32_t len = 0;
+    FILE *sock = NULL;
+
+    fd = hpssix_query_msg_connect(config.search_socket);
+    if (fd < 0)
+        return ECONNREFUSED;
+
+    sock = fdopen(fd, "r+");
+    if (!sock) {
+        close(fd);
+        return errno;
+    }
+
+    if (hpssix_query_msg_send(sock, HPSSIX_QUERY_MSG_STATS, NULL, 0) ||
+        fflush(sock)) {
+        ret = EIO;
+        goto out;
+    }
+
+    while ((ret = hpssix_query_msg_recv(sock, &type, &buf, &size, &len)) == 0) {
+        if (type == HPSSIX_QUERY_MSG_END) {
+            ret = atoi(buf);
+            break;
         }
 
-    if (verbose)
-        fprintf(out, "\n## %lu records found in %.6lf seconds.\n",
-                     rows, timegap_sec(&tv_start, &tv_end));
+        fprintf(out, "%s: %s\n", buf, &buf[strlen(buf) + 1]);
+    }
+
+out:
+    free(buf);
+    fclose(sock);
+
+    return ret;
 }
 
 static inline uint64_t parse_datetime_str(char *str)
@@ -313,13 +771,21 @@ static void add_tag_cond(char *str)
     char *val = NULL;
     char *val1 = NULL;
     char *val2 = NULL;
-    hpssix_search_tag_cond_t *cond = &tag_conds[n_tag_conds++];
+    char *tag_name = NULL;
+    hpssix_query_tag_t *cond = NULL;
 
     if (!name) {
         perror("cannot allocate memory");
         exit(ENOMEM);
     }
 
+    if (n_tag_conds == MAX_TAG_CONDS) {
+        fprintf(stderr, "too many tags (max %d).\n", MAX_TAG_CONDS);
+        exit(EINVAL);
+    }
+
+    cond = &tag_conds[n_tag_conds++];
+
     val = strchr(name, ':');
     if (!val) {
         fprintf(stderr, "cannot parse the expr: %s\n", str);
@@ -328,12 +794,16 @@ static void add_tag_cond(char *str)
 
     val[0] = '\0';
 
-    sprintf(cond->tag_name, "user.hpssix.%s", name);
+    if (asprintf(&tag_name, "user.hpssix.%s", name) < 0) {
+        perror("cannot allocate memory");
+        exit(ENOMEM);
+    }
 
-    cond->tag_val = &val[1];
-    cond->op = -1;
+    cond->name = tag_name;
+    cond->value = &val[1];
+    cond->op = HPSSIX_OP_NONE;
 
-    if (parse_op(cond->tag_val, &op, &val1, &val2) > 0) {
+    if (parse_op(&val[1], &op, &val1, &val2) > 0) {
         fprintf(stderr, "cannot parse the expr: %s\n", str);
         exit(EINVAL);
     }
@@ -347,12 +817,10 @@ static void add_tag_cond(char *str)
     }
 }
 
-static inline
-int parse_fattr_condition(hpssix_search_fattr_cond_t *cond, int attr)
+static inline int parse_condition(hpssix_query_cond_t *cond, char *str)
 {
     int ret = 0;
     int op = 0;
-    char *str = cond_str[attr];
     char *val1 = NULL;
     char *val2 = NULL;
 
@@ -363,167 +831,97 @@ int parse_fattr_condition(hpssix_search_fattr_cond_t *cond, int attr)
     if (op < 0)
         return EINVAL;
 
-    cond->attr = attr;
     cond->op = op;
-    cond->val1 = strtoull(val1, NULL, 0);
+    cond->val1 = strtoll(val1, NULL, 0);
 
     if (val2)
-        cond->val2 = strtoull(val2, NULL, 0);
+        cond->val2 = strtoll(val2, NULL, 0);
 
     return 0;
 }
 
-static hpssix_search_fattr_cond_t cond_dir_mode = {
-    .attr = COND_ARG_MODE,
-    .op = HPSSIX_OP_BITAND,
-    .val1 = S_IFDIR,
-};
-
-static hpssix_search_fattr_cond_t cond_file_mode = {
-    .attr = COND_ARG_MODE,
-    .op = HPSSIX_OP_BITAND,
-    .val1 = S_IFREG,
-};
-
-static inline void fattr_get_sql(void)
+static void fattr_set_query(void)
 {
-    int ret = 0;
     int i = 0;
-    hpssix_search_fattr_t fattr = { 0, };
-    hpssix_search_fattr_cond_t cond = { 0, };
-
-    hpssix_search_fattr_init(&fattr);
 
-    fattr.path = path;
-    fattr.name = name;
+    for (i = 0; i < N_HPSSIX_QUERY_FATTR; i++) {
+        if (!cond_str[i])
+            continue;
 
-    for (i = 0; i < N_COND_ARG; i++) {
-        if (cond_str[i]) {
-            ret = parse_fattr_condition(&cond, i);
-            if (ret) {
-                fprintf(stderr, "failed to process the condition.\n");
-                exit(EINVAL);
-            }
-
-            ret = hpssix_search_fattr_add_cond(&fattr, &cond);
-            if (ret) {
-                fprintf(stderr, "failed to process the condition.\n");
-                exit(EINVAL);
-            }
+        if (parse_condition(&query.fattr[i], cond_str[i])) {
+            fprintf(stderr, "failed to process the condition.\n");
+            exit(EINVAL);
         }
     }
 
     if (directory_only + file_only > 0) {
-        if (cond_str[COND_ARG_MODE]) {
+        if (cond_str[HPSSIX_QUERY_MODE]) {
             fprintf(stderr, "-D and -F options cannot be used with -m.\n");
             exit(EINVAL);
         }
 
-        if (directory_only)
-            hpssix_search_fattr_add_cond(&fattr, &cond_dir_mode);
-        else if (file_only)
-            hpssix_search_fattr_add_cond(&fattr, &cond_file_mode);
+        query.fattr[HPSSIX_QUERY_MODE].op = HPSSIX_OP_BITAND;
+        query.fattr[HPSSIX_QUERY_MODE].val1 = directory_only ? S_IFDIR
+                                                             : S_IFREG;
     }
 
-    fattr.output = stdout;
-    fattr.verbose = verbose;
-    fattr.countonly = countonly;
-    fattr.removed = removed;
-
-    sql_fattr = hpssix_search_fattr_get_sql(&fattr);
+    query.removed = removed;
+    query.countonly = countonly;
 }
 
-static void tag_get_sql(void)
+static void docmeta_set_query(void)
 {
-    hpssix_search_tag_t tag = { 0, };
-
-    tag.count = n_tag_conds;
-    tag.conds = tag_conds;
-
-    sql_tags = hpssix_search_tag_get_sql(&tag);
-}
+    int i = 0;
+    hpssix_query_cond_t *conds[3] = {
+        &query.created, &query.modified, &query.pages,
+    };
 
-static void tsv_get_sql(void)
-{
-    hpssix_search_tsv_t tsv = { 0, };
+    query.content_type = content_type;
+    query.author = author;
+    query.language = language;
 
-    tsv.keyword = keyword;
-    tsv.limit = limit ? limit : 0;
-    tsv.output = stdout;
-    tsv.verbose = verbose;
-    tsv.meta = print_meta;
-    tsv.text = print_text;
+    for (i = 0; i < 3; i++) {
+        if (!docmeta_str[i])
+            continue;
 
-    sql_tsv = hpssix_search_tsv_get_sql(&tsv);
+        if (parse_condition(conds[i], docmeta_str[i])) {
+            fprintf(stderr, "failed to process the condition: %s\n",
+                    docmeta_str[i]);
+            exit(EINVAL);
+        }
+    }
 }
 
-static char *remove_single_quote(char *str)
+/*
+ * the paths are stored without the mount point, and with no trailing slash.
+ * @dir is accepted either way.
+ */
+static char *normalize_under(const char *dir)
 {
-    char *rpos = NULL;
-    char *newstr = NULL;
-
-    if (!str)
-        return NULL;
-
-    if (str[0] != '\'')
-        return NULL;
-
-    rpos = strrchr(str, '\'');
-    if (!rpos)
-        return NULL;
-    *rpos = '\0';
+    char *normalized = NULL;
+    size_t len = 0;
+    const char *mnt = config.hpss_mountpoint;
 
-    newstr = strdup(&str[1]);
-    PQfreemem(str);
-
-    return newstr;
-}
-
-static int get_file_predicate(char *out)
-{
-    int ret = 0;
-    char *name_escaped = NULL;
-    char *path_escaped = NULL;
+    if (mnt && strlen(mnt) > 1) {
+        len = strlen(mnt);
+        while (len > 1 && mnt[len - 1] == '/')
+            len--;
 
-    if (!name && !path)
-        return 0;
-
-    if (name) {
-        name_escaped = PQescapeLiteral(db.dbconn, name, strlen(name));
-        if (!name_escaped)
-            return -errno;
-
-        name_escaped = remove_single_quote(name_escaped);
+        if (strncmp(dir, mnt, len) == 0 && (!dir[len] || dir[len] == '/'))
+            dir = &dir[len];
     }
 
-    if (path) {
-        path_escaped = PQescapeLiteral(db.dbconn, path, strlen(path));
-        if (!path_escaped) {
-            ret = -errno;
-            goto out_free;
-        }
-
-        path_escaped = remove_single_quote(path_escaped);
-    }
+    normalized = malloc(strlen(dir) + 2);
+    if (!normalized)
+        return NULL;
 
-    if (name_escaped && path_escaped)
-        ret = sprintf(out, "WHERE "
-                      "f.name LIKE '%%%%%s%%%%' AND f.path LIKE '%%%%%s%%%%' ",
-                      name_escaped, path_escaped);
-    else if (name_escaped)
-        ret = sprintf(out, "WHERE f.name LIKE '%%%%%s%%%%' ", name_escaped);
-    else if (path_escaped)
-        ret = sprintf(out, "WHERE f.path LIKE '%%%%%s%%%%' ", path_escaped);
-    else
-        ret = -EINVAL;
+    sprintf(normalized, "%s%s", dir[0] == '/' ? "" : "/", dir);
 
-out_free:
-    if (path_escaped)
-        free(path_escaped);
-    if (name_escaped)
-        free(name_escaped);
+    len = strlen(normalized);
+    while (len > 1 && normalized[len - 1] == '/')
+        normalized[--len] = '\0';
 
-    return ret;
+    return normalized;
 }
 
 /*
@@ -531,6 +929,21 @@ out_free:
  */
 static char *program;
 
+/* long options only */
+enum {
+    OPT_AUTHOR = 256,
+    OPT_CONTENT_TYPE,
+    OPT_LANGUAGE,
+    OPT_CREATED,
+    OPT_MODIFIED,
+    OPT_PAGES,
+    OPT_DIRECT,
+    OPT_SERVICE_STATS,
+    OPT_EXPLAIN,
+    OPT_NAMES_FROM,
+    OPT_PATHS_FROM,
+};
+
 static struct option const long_opts[] = {
     { "count-only", 0, 0, 'c' },
     { "date", 1, 0, 'd' },
@@ -555,20 +968,40 @@ static struct option const long_opts[] = {
     { "directory-only", 0, 0, 'D' },
     { "file-only", 0, 0, 'F' },
     { "removed", 0, 0, 'r' },
+    { "under", 1, 0, 'U' },
+    { "stream", 0, 0, 'S' },
+    { "batch", 1, 0, 'b' },
+    { "after", 1, 0, 'a' },
+    { "estimate", 0, 0, 'e' },
+    { "author", 1, 0, OPT_AUTHOR },
+    { "content-type", 1, 0, OPT_CONTENT_TYPE },
+    { "language", 1, 0, OPT_LANGUAGE },
+    { "created", 1, 0, OPT_CREATED },
+    { "modified", 1, 0, OPT_MODIFIED },
+    { "pages", 1, 0, OPT_PAGES },
+    { "direct", 0, 0, OPT_DIRECT },
+    { "service-stats", 0, 0, OPT_SERVICE_STATS },
+    { "explain", 0, 0, OPT_EXPLAIN },
+    { "names-from", 1, 0, OPT_NAMES_FROM },
+    { "paths-from", 1, 0, OPT_PATHS_FROM },
     { 0, 0, 0, 0 },
 };
 
-static const char *short_opts = "A:M:C:DFIT:Vcd:hk:l:n:i:m:u:g:p:rs:tv";
+static const char *short_opts = "A:M:C:DFIST:U:Va:b:cd:ehk:l:n:i:m:u:g:p:rs:tv";
 
 static const char *usage_str =
 "\n"
 "Usage: %s [options] ...\n"
 "\n"
 "  -c, --count-only        Only print the number of resulting files.\n"
+"  -e, --estimate          With -c, estimate the number instead of counting\n"
+"                          (exact for -u, -g, -D and -F only).\n"
 "  -d, --date=<datetime>   Look up based on <datetime> (YYYYMMDD-HH:mm:ss).\n"
 "  -h, --help              Print this help message.\n"
 "  -k, --keyword=<keyword> Look for document files having <keyword>.\n"
 "  -l, --limit=<count>     Retrieve first <count> result.\n"
+"  -a, --after=<token>     Retrieve the results after <token>, which is\n"
+"                          printed with -v at the end of a full page.\n"
 "  -V, --meta              Print document metadata.\n"
 "  -t, --text              Print document fulltext.\n"
 "  -v, --verbose           Show details about the result files.\n"
@@ -579,6 +1012,7 @@ static const char *usage_str =
 "  -s, --size=<SIZE>       Look up based on size.\n"
 "  -n, --name=<keyword>    Look up files with filename containing <keyword>.\n"
 "  -p, --path=<keyword>    Look up files with pathname containing <keyword>.\n"
+"  -U, --under=<dir>       Look up files under the directory <dir>.\n"
 "  -r, --removed           Look up from removed files.\n"
 "  -A, --atime=<TIME>      Look up based on atime (access time).\n"
 "  -M, --mtime=<TIME>      Look up based on mtime (modification time).\n"
@@ -587,6 +1021,35 @@ static const char *usage_str =
 "  -I, --showino           Print inode number in result.\n"
 "  -D, --directory-only    Search only directories.\n"
 "  -F, --file-only         Search only regular files.\n"
+"  -S, --stream            Print the results as they are read, for the huge\n"
+"                          results.\n"
+"  -b, --batch=<count>     Read <count> results at a time (implies -S).\n"
+"      --direct            Search the database directly, not through the\n"
+"                          search service of hpssixd, which is used when\n"
+"                          running.\n"
+"      --service-stats     Print the statistics of the search service, e.g.,\n"
+"                          the hits of the result cache.\n"
+"      --explain           Print the plan of the search, with the estimated\n"
+"                          rows of each predicate, and the plan and the\n"
+"                          timing of the database (implies --direct).\n"
+"      --names-from=<file> Look up the file names in <file>, one per line\n"
+"                          ('-' for stdin), in a single search. each result\n"
+"                          is prefixed by its name and a tab (implies\n"
+"                          --direct).\n"
+"      --paths-from=<file> Look up the paths in <file>, as --names-from.\n"
+"\n"
+"  Document attributes, from the extracted metadata:\n"
+"      --author=<name>     Look up documents by <name> (<prefix>* to match\n"
+"                          the prefix), ignoring the case.\n"
+"      --content-type=<type>\n"
+"                          Look up documents of <type>, e.g.,\n"
+"                          application/pdf or image/*.\n"
+"      --language=<lang>   Look up documents in <lang>, e.g., en.\n"
+"      --created=<datetime>\n"
+"                          Look up documents created at <datetime>.\n"
+"      --modified=<datetime>\n"
+"                          Look up documents modified at <datetime>.\n"
+"      --pages=<count>     Look up documents by the number of pages.\n"
 "\n";
 
 static void usage(int status)
@@ -600,9 +1063,7 @@ int main(int argc, char **argv)
     int ret = 0;
     int ch = 0;
     int optidx = 0;
-    int i = 0;
-    int count = 0;
-    char *pos = NULL;
+    int fd = -1;
     PGresult *res = NULL;
 
     program = hpssix_path_basename(argv[0]);
@@ -614,11 +1075,11 @@ int main(int argc, char **argv)
                              short_opts, long_opts, &optidx)) >= 0) {
         switch (ch) {
         case 'A':
-            cond_str[COND_ARG_ATIME] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_ATIME] = strdup(optarg);
             break;
 
         case 'C':
-            cond_str[COND_ARG_CTIME] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_CTIME] = strdup(optarg);
             break;
 
         case 'D':
@@ -630,7 +1091,7 @@ int main(int argc, char **argv)
             break;
 
         case 'M':
-            cond_str[COND_ARG_MTIME] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_MTIME] = strdup(optarg);
             break;
 
         case 'T':
@@ -641,12 +1102,29 @@ int main(int argc, char **argv)
             showino = 1;
             break;
 
+        case 'S':
+            stream = 1;
+            break;
+
+        case 'a':
+            after = strdup(optarg);
+            break;
+
+        case 'b':
+            batch = strtoull(optarg, NULL, 0);
+            stream = 1;
+            break;
+
         case 'c':
             countonly = 1;
             break;
 
+        case 'e':
+            estimate = 1;
+            break;
+
         case 'd':
-            cond_str[COND_ARG_MTIME] = parse_datetime(optarg);
+            cond_str[HPSSIX_QUERY_MTIME] = parse_datetime(optarg);
             break;
 
         case 'k':
@@ -674,23 +1152,23 @@ int main(int argc, char **argv)
             break;
 
         case 'i':
-            cond_str[COND_ARG_INODE] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_INODE] = strdup(optarg);
             break;
 
         case 'm':
-            cond_str[COND_ARG_MODE] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_MODE] = strdup(optarg);
             break;
 
         case 'u':
-            cond_str[COND_ARG_UID] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_UID] = strdup(optarg);
             break;
 
         case 'g':
-            cond_str[COND_ARG_GID] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_GID] = strdup(optarg);
             break;
 
         case 's':
-            cond_str[COND_ARG_SIZE] = strdup(optarg);
+            cond_str[HPSSIX_QUERY_SIZE] = strdup(optarg);
             break;
 
         case 'n':
@@ -701,42 +1179,61 @@ int main(int argc, char **argv)
             path = strdup(optarg);
             break;
 
-        case 'h':
-        default:
-            usage(0);
+        case 'U':
+            under = strdup(optarg);
             break;
-        }
-    }
 
-    pos = sqlbuf;
+        case OPT_AUTHOR:
+            author = strdup(optarg);
+            break;
+
+        case OPT_CONTENT_TYPE:
+            content_type = strdup(optarg);
+            break;
 
-    if (name || path)
-        search_mode |= HPSSIX_SEARCH_PATH;
+        case OPT_LANGUAGE:
+            language = strdup(optarg);
+            break;
 
-    for (i = 0; i < N_COND_ARG; i++)
-        if (cond_str[i])
-            count++;
+        case OPT_CREATED:
+            docmeta_str[0] = strdup(parse_datetime(optarg));
+            break;
 
-    /* fattr query should be included always for searching valid files only */
-    fattr_get_sql();
-    pos += sprintf(pos, "\n%s", sql_fattr);
+        case OPT_MODIFIED:
+            docmeta_str[1] = strdup(parse_datetime(optarg));
+            break;
 
-    if (n_tag_conds) {
-        search_mode |= HPSSIX_SEARCH_TAG;
-        tag_get_sql();
+        case OPT_PAGES:
+            docmeta_str[2] = strdup(optarg);
+            break;
 
-        pos += sprintf(pos, ",\n%s", sql_tags);
-    }
+        case OPT_DIRECT:
+            direct = 1;
+            break;
 
-    if (keyword) {
-        search_mode |= HPSSIX_SEARCH_TSV;
-        tsv_get_sql();
+        case OPT_SERVICE_STATS:
+            service_stats = 1;
+            break;
 
-        pos += sprintf(pos, ",\n%s", sql_tsv);
-    }
+        case OPT_EXPLAIN:
+            explain = 1;
+            direct = 1;
+            break;
 
-    if (!search_mode)
-        usage(0);
+        case OPT_NAMES_FROM:
+        case OPT_PATHS_FROM:
+            keys = ch == OPT_NAMES_FROM ? HPSSIX_QUERY_KEYS_NAME
+                                        : HPSSIX_QUERY_KEYS_PATH;
+            keys_file = strdup(optarg);
+            direct = 1;
+            break;
+
+        case 'h':
+        default:
+            usage(0);
+            break;
+        }
+    }
 
     if (directory_only && file_only) {
         fprintf(stderr, "you cannot specify -D and -F together.\n");
@@ -750,59 +1247,128 @@ int main(int argc, char **argv)
         goto out;
     }
 
-    ret = hpssix_db_connect(&db, &config);
-    if (ret) {
-        fprintf(stderr, "failed to connect to the database.\n");
+    if (service_stats) {
+        ret = print_service_stats(stdout);
+        if (ret == ENOENT)
+            fprintf(stderr, "the result cache is not enabled.\n");
+        else if (ret)
+            fprintf(stderr, "failed to read the statistics (%s).\n",
+                    strerror(ret));
         goto out;
     }
 
-    if (countonly)
-        pos += sprintf(pos, "\nSELECT COUNT(f.path) FROM fattr_oids ");
-    else
-        pos += sprintf(pos, "\nSELECT f.oid, f.path FROM fattr_oids ");
+    hpssix_query_init(&query);
 
-    if (search_mode & HPSSIX_SEARCH_TAG)
-        pos += sprintf(pos, "NATURAL JOIN tag_oids ");
+    fattr_set_query();
+    docmeta_set_query();
 
-    if (search_mode & HPSSIX_SEARCH_TSV)
-        pos += sprintf(pos, "NATURAL JOIN tsv_oids t ");
+    query.n_tags = n_tag_conds;
+    query.tags = tag_conds;
+    query.keyword = keyword;
+    query.name = name;
+    query.path = path;
+    query.limit = limit;
+    query.keys = keys;
 
-    pos += sprintf(pos, "NATURAL JOIN hpssix_file f ");
+    if (after && hpssix_query_key_parse(after, &query.after)) {
+        fprintf(stderr, "cannot parse the token: %s\n", after);
+        ret = EINVAL;
+        goto out;
+    }
 
-    ret = get_file_predicate(pos);
-    if (ret < 0) {
-        fprintf(stderr, "failed to generate a SQL.\n");
+    if (under) {
+        query.under = normalize_under(under);
+        if (!query.under) {
+            ret = ENOMEM;
+            goto out;
+        }
+    }
+
+    ret = hpssix_query_build(&query, &stmt);
+    if (ret) {
+        fprintf(stderr, "failed to generate a SQL (%s).\n", strerror(ret));
         goto out;
     }
-    else
-        pos += ret;
 
-    if (search_mode & HPSSIX_SEARCH_TSV) {
-        pos += sprintf(pos, "\nORDER BY "
-                            "TS_RANK_CD(t.tsv, PLAINTO_TSQUERY('%s')) DESC ",
-                            keyword);
+    if (!direct && config.search_socket) {
+        fd = hpssix_query_msg_connect(config.search_socket);
+        if (fd >= 0) {
+            ret = remote_search(stdout, fd);
+            if (ret != ECONNREFUSED) {
+                if (ret)
+                    fprintf(stderr, "failed to search (%s).\n",
+                            strerror(ret));
+                goto out_free;
+            }
+        }
+    }
+
+    ret = hpssix_db_connect(&db, &config);
+    if (ret) {
+        fprintf(stderr, "failed to connect to the database.\n");
+        goto out_free;
+    }
+
+    if (keys) {
+        ret = load_keys();
+        if (ret) {
+            fprintf(stderr, "failed to load the keys (%s).\n",
+                    strerror(ret));
+            goto out_disconnect;
+        }
+    }
+
+    if (!(estimate && countonly)) {
+        ret = plan_query();
+        if (ret) {
+            fprintf(stderr, "failed to generate a SQL (%s).\n",
+                    strerror(ret));
+            goto out_disconnect;
+        }
+    }
+
+    if (explain) {
+        ret = print_explain(stdout);
+        if (ret)
+            fprintf(stderr, "failed to explain the search (%s).\n",
+                    strerror(ret));
+        goto out_disconnect;
+    }
+
+    if (estimate && countonly) {
+        ret = print_estimate(stdout);
+        if (ret)
+            fprintf(stderr, "failed to estimate the results (%s).\n",
+                    strerror(ret));
+        goto out_disconnect;
     }
 
-    if (limit)
-        pos += sprintf(pos, " LIMIT %lu;", limit);
+    if (stream && !countonly) {
+        ret = stream_result(stdout);
+        if (ret)
+            fprintf(stderr, "failed to read the results (%s).\n",
+                    strerror(ret));
+        goto out_disconnect;
+    }
 
     gettimeofday(&tv_start, NULL);
 
-    res = hpssix_db_psql_query(&db, sqlbuf);
+    res = hpssix_query_exec(&db, &stmt);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "No data received!\n");
-        goto out;
+        ret = EIO;
+        goto out_disconnect;
     }
 
     gettimeofday(&tv_end, NULL);
 
     print_result(stdout, res);
 
-    PQclear(res);
-
 out_disconnect:
+    PQclear(res);
     hpssix_db_disconnect(&db);
+out_free:
+    hpssix_query_stmt_free(&stmt);
 out:
     return ret;
 }
-